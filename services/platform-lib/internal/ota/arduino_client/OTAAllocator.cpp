@@ -0,0 +1,28 @@
+#include "OTAAllocator.h"
+
+#if defined(ESP32)
+#include <esp_heap_caps.h>
+#endif
+
+static void* defaultAllocate(size_t size, OTAMemoryKind kind) {
+#if defined(ESP32)
+    // Keeps internal RAM for WiFi and TLS on boards with PSRAM, and PSRAM's
+    // slower access away from the buffers every chunk passes through
+    uint32_t caps = (kind == OTA_MEMORY_BULK) ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL;
+    void* buffer = heap_caps_malloc(size, caps | MALLOC_CAP_8BIT);
+    if (buffer != nullptr) {
+        return buffer;
+    }
+#endif
+    return malloc(size);
+}
+
+static void defaultRelease(void* ptr) {
+    // heap_caps_malloc() memory of any kind goes back with free()
+    free(ptr);
+}
+
+const OTAAllocator& otaDefaultAllocator() {
+    static const OTAAllocator allocator = { defaultAllocate, defaultRelease };
+    return allocator;
+}
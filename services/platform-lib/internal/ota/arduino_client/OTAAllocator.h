@@ -0,0 +1,46 @@
+#ifndef OTA_ALLOCATOR_H
+#define OTA_ALLOCATOR_H
+
+#include <Arduino.h>
+
+/**
+ * @brief What a buffer is used for, so an allocator can pick the memory for it
+ */
+enum OTAMemoryKind {
+    OTA_MEMORY_BULK,     // Large buffers only the CPU touches: the buffered image, the inflate dictionary
+    OTA_MEMORY_INTERNAL  // Buffers read from the network or written to flash on every chunk
+};
+
+/**
+ * @brief Allocation function type
+ * @param size Bytes to allocate
+ * @param kind What the buffer is used for
+ * @return Pointer to the buffer, or nullptr if there isn't enough memory
+ */
+typedef void* (*OTAAllocateFunction)(size_t size, OTAMemoryKind kind);
+
+/**
+ * @brief Release function type; like free(), must accept nullptr
+ * @param ptr Buffer returned by the matching allocation function
+ */
+typedef void (*OTAReleaseFunction)(void* ptr);
+
+/**
+ * @brief Where the OTA client and its helpers get their buffers from
+ * 
+ * The default strategy suits boards with and without PSRAM: on ESP32, bulk
+ * buffers go to PSRAM when there is any, and internal buffers to internal
+ * RAM, each falling back to whatever memory is left. Elsewhere both use
+ * malloc().
+ */
+struct OTAAllocator {
+    OTAAllocateFunction allocate;
+    OTAReleaseFunction release;
+};
+
+/**
+ * @brief Get the built-in allocation strategy
+ */
+const OTAAllocator& otaDefaultAllocator();
+
+#endif // OTA_ALLOCATOR_H
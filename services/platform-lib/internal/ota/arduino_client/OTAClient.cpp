@@ -2,17 +2,135 @@
 #include <ArduinoJson.h>
 #include <base64.h>
 
+#if defined(ESP32)
+#include <Preferences.h>
+#include <esp_attr.h>
+#include <esp_ota_ops.h>
+#include <esp_rom_crc.h>
+#if OTA_ENABLE_LOCAL_CACHE
+#include <mdns.h>
+#endif
+#include <sys/time.h>
+#endif
+#include <new>
+
+#if defined(ESP32)
+#define OTA_SLEEP_STATE_MAGIC 0x4f545350 // "OTSP"
+
+// Poll schedule in low-power mode; RTC_NOINIT memory keeps it across deep sleep
+struct OTASleepState {
+    uint32_t magic;
+    uint32_t checksum;             // Of everything after it
+    int64_t pollDue;               // System time of the next check in microseconds, which deep sleep keeps
+    uint32_t pollWait;
+    uint32_t pollRandom;
+    uint8_t pollFailures;
+    char etag[OTA_SLEEP_ETAG_SIZE];
+};
+
+static RTC_NOINIT_ATTR OTASleepState otaSleepState;
+
+static uint32_t sleepStateChecksum() {
+    return esp_rom_crc32_le(0, (const uint8_t*)&otaSleepState.pollDue,
+                            sizeof(otaSleepState) - offsetof(OTASleepState, pollDue));
+}
+
+static int64_t sleepClockMicros() {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+#endif
+
+// Stream reader for ArduinoJson that counts how much of the body the parser consumed
+struct CountingReader {
+    Stream& stream;
+    size_t count;
+    
+    explicit CountingReader(Stream& source) : stream(source), count(0) {}
+    
+    // Like ArduinoJson's own Stream reader, waits up to the stream timeout for a byte
+    // that hasn't arrived yet instead of taking it for the end of the body
+    int read() {
+        char c;
+        return (readBytes(&c, 1) == 1) ? (unsigned char)c : -1;
+    }
+    
+    size_t readBytes(char* buffer, size_t length) {
+        size_t read = stream.readBytes(buffer, length);
+        count += read;
+        return read;
+    }
+};
+
 OTAClient::OTAClient(const char* serverURL, const char* deviceID, const char* publicKey)
-    : _serverURL(serverURL), _deviceID(deviceID), _publicKey(publicKey),
-      _verifySignature(true), _lastError(OTA_ERROR_NONE),
-      _progressCallback(nullptr), _statusCallback(nullptr) {
+    : _serverURL(serverURL), _deviceID(deviceID), _publicKey(publicKey), _signingKeyLoaded(false),
+      _verifySignature(true), _streamingUpdate(true), _parallelDownloads(1), _resumableDownloads(true),
+      _downloadRetries(OTA_DEFAULT_DOWNLOAD_RETRIES), _chunkSize(OTA_DEFAULT_CHUNK_SIZE), _chunkBuffer(nullptr),
+      _allocator(otaDefaultAllocator()), _lastCheckpoint(0), _progressBytes(0), _progressPercent(OTA_DEFAULT_PROGRESS_PERCENT), _lastProgress(0),
+      _reportPercent(OTA_DEFAULT_REPORT_PERCENT), _reportInterval(OTA_DEFAULT_REPORT_INTERVAL_MS), _lastProgressReport(0),
+      _downloadStarted(0),
+      _deltaUpdates(true), _deltaActive(false), _compressedDownloads(true), _inflateActive(false),
+      _sectorReuse(true), _sectorActive(false), _chunkVerification(true), _chunkDigests(nullptr),
+      _chunkStage(nullptr), _chunkStageStart(0), _chunkStageLen(0), _chunkRejected(false),
+      _pipelinedWrites(false), _connectionReuse(true), _localCachePath(OTA_LOCAL_CACHE_PATH), _pollDelay(0), _updateNotice(false),
+      _pollInterval(OTA_DEFAULT_POLL_INTERVAL_MS), _pollJitter(OTA_DEFAULT_POLL_JITTER_MS),
+      _pollMaxBackoff(OTA_DEFAULT_POLL_MAX_BACKOFF_MS), _lastPoll(0), _pollWait(0), _pollRandom(0),
+      _pollFailures(0), _pollScheduled(false), _sliceTime(0), _sliceInterval(OTA_DEFAULT_SLICE_INTERVAL_MS),
+      _validationTimeout(0), _validationPending(false),
+#if defined(ESP32)
+      _validationTimer(nullptr),
+#endif
+      _statsReporting(false), _updateStarted(0), _hashMicros(0), _flashMicros(0),
+      _taskCheckFirst(false), _taskState(OTA_TASK_IDLE),
+#if defined(ESP32)
+      _taskHandle(nullptr), _taskEvents(nullptr), _taskLock(portMUX_INITIALIZER_UNLOCKED), _taskProgress(0),
+      _taskProgressTotal(0), _taskProgressPending(false),
+#endif
+      _lastError(OTA_ERROR_NONE), _progressCallback(nullptr), _statusCallback(nullptr), _yieldCallback(nullptr),
+      _lastYield(0) {
+    memset(&_stats, 0, sizeof(_stats));
+    mbedtls_pk_init(&_signingKey);
+    
+    // FNV-1a of the device ID; xorshift needs a non-zero state
+    _pollRandom = 2166136261UL;
+    for (size_t i = 0; i < _deviceID.length(); i++) {
+        _pollRandom = (_pollRandom ^ (uint8_t)_deviceID[i]) * 16777619UL;
+    }
+    if (_pollRandom == 0) {
+        _pollRandom = 1;
+    }
+    
+    // Response headers the update check looks at; kept across requests by HTTPClient
+    static const char* headerKeys[] = { "ETag", "Retry-After" };
+    _httpClient.collectHeaders(headerKeys, sizeof(headerKeys) / sizeof(headerKeys[0]));
 }
 
 OTAClient::~OTAClient() {
     _httpClient.end();
+    mbedtls_pk_free(&_signingKey);
+#if defined(ESP32)
+    if (_taskEvents) {
+        vQueueDelete(_taskEvents);
+    }
+    if (_validationTimer) {
+        esp_timer_stop(_validationTimer);
+        esp_timer_delete(_validationTimer);
+    }
+#endif
 }
 
 bool OTAClient::begin() {
+    // Parsed once instead of on every verification
+    if (!_signingKeyLoaded && _publicKey.length() > 0) {
+        bool loaded = loadSigningKey((const uint8_t*)_publicKey.c_str(), _publicKey.length() + 1);
+        _publicKey = String();
+        if (!loaded && _verifySignature) {
+            setError(OTA_ERROR_VERIFICATION, "Invalid public key");
+            return false;
+        }
+    }
+    
     // Configure WiFi client for HTTPS
     if (_caCert.length() > 0) {
         _wifiClient.setCACert(_caCert.c_str());
@@ -21,6 +139,23 @@ bool OTAClient::begin() {
         _wifiClient.setInsecure();
     }
     
+    // Needed to request a delta patch from the running release
+    if (_currentRelease.length() == 0) {
+        loadCurrentRelease();
+    }
+#if OTA_ENABLE_BUNDLES
+    loadComponentsRelease();
+#endif
+    
+    // Reports that couldn't be sent before the last restart go out with the next check
+    _statusQueue.load(OTA_PREFS_NAMESPACE);
+    
+    // First boot of an update on trial, or the outcome of the last one
+    loadValidationState();
+    
+    // After deep sleep, carry on with the schedule from before it
+    loadSleepState();
+    
     return true;
 }
 
@@ -30,17 +165,60 @@ bool OTAClient::checkForUpdate(FirmwareUpdate* update) {
         return false;
     }
     
+    // This check answers any pending notice
+    _updateNotice = false;
+    
+    // Reports left over from before a reboot share the connection with the check
+    flushStatusReports();
+    
     // Build URL for checking updates
-    String url = _serverURL + "/api/v1/ota/updates/" + _deviceID;
+    String url;
+    url.reserve(_serverURL.length() + _deviceID.length() + _currentRelease.length() + 64);
+    url = _serverURL;
+    url += "/api/v1/ota/updates/";
+    url += _deviceID;
+    const char* separator = "?";
+#if OTA_ENABLE_DELTA
+    if (_deltaUpdates && _currentRelease.length() > 0) {
+        url += separator;
+        url += "current_release=";
+        url += _currentRelease;
+        separator = "&";
+    }
+#endif
+    if (supportsCompression()) {
+        url += separator;
+        url += "compression=" OTA_COMPRESSION_ZLIB;
+        separator = "&";
+    }
+    if (supportsSectorReuse() || supportsChunkVerification()) {
+        url += separator;
+        url += "sector_size=";
+        url += String(OTA_FLASH_SECTOR_SIZE);
+    }
+    
+    // An unchanged "no update" answer comes back as an empty 304
+    int httpCode = sendRequest("GET", url, nullptr, 0, 0, _updateETag.length() > 0 ? _updateETag.c_str() : nullptr);
     
-    _httpClient.begin(_wifiClient, url);
-    _httpClient.addHeader("Content-Type", "application/json");
+    // The server says when to check again (in seconds) so it can spread out a fleet's polls
+    if (httpCode > 0) {
+        String retryAfter = _httpClient.header("Retry-After");
+        _pollDelay = strtoul(retryAfter.c_str(), nullptr, 10) * 1000UL;
+    } else {
+        _pollDelay = 0;
+    }
     
-    int httpCode = _httpClient.GET();
+    // Only a "no update" answer is worth revalidating; an offered update is acted on
+    if (httpCode == HTTP_CODE_NOT_FOUND) {
+        _updateETag = _httpClient.header("ETag");
+    } else if (httpCode != HTTP_CODE_NOT_MODIFIED) {
+        _updateETag = "";
+    }
     
     if (httpCode != HTTP_CODE_OK) {
-        _httpClient.end();
-        if (httpCode == HTTP_CODE_NOT_FOUND) {
+        // Nothing more to do this cycle, so don't hold the connection open
+        disconnect();
+        if (httpCode == HTTP_CODE_NOT_FOUND || httpCode == HTTP_CODE_NOT_MODIFIED) {
             setError(OTA_ERROR_NO_UPDATE, "No update available");
         } else {
             setError(OTA_ERROR_NETWORK, "HTTP error: " + String(httpCode));
@@ -48,26 +226,70 @@ bool OTAClient::checkForUpdate(FirmwareUpdate* update) {
         return false;
     }
     
-    String payload = _httpClient.getString();
-    _httpClient.end();
-    
-    // Parse JSON response
-    DynamicJsonDocument doc(2048);
-    DeserializationError error = deserializeJson(doc, payload);
+    // Parse straight from the connection into the reusable document
+    _jsonDoc.clear();
+    DeserializationError error;
+    if (_httpClient.getSize() > 0) {
+        CountingReader reader(_httpClient.getStream());
+        error = deserializeJson(_jsonDoc, reader);
+        endRequest(reader.count);
+    } else {
+        // Chunked responses have to be decoded by HTTPClient first
+        String payload = _httpClient.getString();
+        _httpClient.end();
+        error = deserializeJson(_jsonDoc, payload);
+    }
     
+    if (error == DeserializationError::NoMemory) {
+        setError(OTA_ERROR_INVALID_RESPONSE, "Update response larger than OTA_JSON_DOC_SIZE (" +
+                 String(OTA_JSON_DOC_SIZE) + " bytes)");
+        return false;
+    }
     if (error) {
         setError(OTA_ERROR_INVALID_RESPONSE, "JSON parse error: " + String(error.c_str()));
         return false;
     }
     
-    // Extract update information
-    update->releaseID = doc["release_id"].as<String>();
-    update->version = doc["version"].as<String>();
-    update->binaryURL = doc["binary_url"].as<String>();
-    update->binaryHash = doc["binary_hash"].as<String>();
-    update->binarySize = doc["binary_size"].as<int64_t>();
-    update->signature = doc["signature"].as<String>();
-    update->releaseNotes = doc["release_notes"].as<String>();
+    // Assigning from const char* reuses the buffers of an update struct that is checked again
+    update->releaseID = _jsonDoc["release_id"] | "";
+    update->version = _jsonDoc["version"] | "";
+    update->binaryURL = _jsonDoc["binary_url"] | "";
+    update->binaryHash = _jsonDoc["binary_hash"] | "";
+    update->binarySize = _jsonDoc["binary_size"] | (int64_t)0;
+    update->signature = _jsonDoc["signature"] | "";
+    update->releaseNotes = _jsonDoc["release_notes"] | "";
+    update->deltaURL = _jsonDoc["delta_url"] | "";
+    update->deltaSize = _jsonDoc["delta_size"] | (int64_t)0;
+    update->deltaBaseReleaseID = _jsonDoc["delta_base_release_id"] | "";
+    update->compression = _jsonDoc["compression"] | "";
+    update->compressedURL = _jsonDoc["compressed_url"] | "";
+    update->compressedSize = _jsonDoc["compressed_size"] | (int64_t)0;
+    update->sectorManifestURL = _jsonDoc["sector_manifest_url"] | "";
+    update->sectorManifestSize = _jsonDoc["sector_manifest_size"] | (int64_t)0;
+    
+    // A bundle's components are all needed, so one this client can't install rejects the update
+    JsonArrayConst components = _jsonDoc["components"].as<JsonArrayConst>();
+    bool componentsValid = OTA_ENABLE_BUNDLES ? components.size() <= OTA_MAX_COMPONENTS : components.size() == 0;
+    update->componentCount = 0;
+    for (JsonObjectConst entry : components) {
+        if (!componentsValid) {
+            break;
+        }
+        FirmwareComponent& component = update->components[update->componentCount++];
+        component.name = entry["name"] | "";
+        component.type = entry["type"] | "";
+        component.partition = entry["partition"] | "";
+        component.url = entry["url"] | "";
+        component.hash = entry["hash"] | "";
+        component.size = entry["size"] | (int64_t)0;
+        component.signature = entry["signature"] | "";
+        
+        bool filesystem = component.type == OTA_COMPONENT_FILESYSTEM;
+        bool data = component.type == OTA_COMPONENT_DATA && component.partition.length() > 0;
+        componentsValid = (filesystem || data) && component.url.length() > 0 && component.hash.length() > 0 &&
+                          component.size > 0;
+    }
+    _jsonDoc.clear();
     
     // Validate required fields
     if (update->releaseID.length() == 0 || update->binaryURL.length() == 0 || 
@@ -76,72 +298,149 @@ bool OTAClient::checkForUpdate(FirmwareUpdate* update) {
         return false;
     }
     
+    if (!componentsValid) {
+        setError(OTA_ERROR_INVALID_RESPONSE, "Unsupported components in update response");
+        return false;
+    }
+    
     _lastError = OTA_ERROR_NONE;
     return true;
 }
 
 bool OTAClient::performUpdate(const FirmwareUpdate& update) {
+    beginStats();
+    
+    if (_streamingUpdate) {
+        bool streamed = performStreamingUpdate(update);
+        finishStats();
+        disconnect();
+        return streamed;
+    }
+    
     uint8_t* firmwareData = nullptr;
     bool success = false;
     
     // Report downloading status
     reportStatus(update.releaseID, OTA_STATUS_DOWNLOADING, 0);
-    if (_statusCallback) {
-        _statusCallback(OTA_STATUS_DOWNLOADING, 0);
-    }
+    notifyStatus(OTA_STATUS_DOWNLOADING, 0);
     
-    // Download firmware
-    size_t downloadedSize = downloadFirmware(update.binaryURL, &firmwareData, update.binarySize);
+    // Download firmware, from the local cache if there is one and it serves the right image
+    size_t downloadedSize = 0;
+    if (_localCache.length() > 0) {
+        size_t before = _stats.bytesDownloaded;
+        downloadedSize = downloadFirmware(localCacheURL(update.binaryURL, update.binaryHash), &firmwareData,
+                                          update.binarySize);
+        _verifier.finish();
+        if (downloadedSize > 0 && !_verifier.matchesHash(update.binaryHash)) {
+            _allocator.release(firmwareData);
+            firmwareData = nullptr;
+            downloadedSize = 0;
+        }
+        _stats.bytesFromCache += _stats.bytesDownloaded - before;
+    }
+    if (downloadedSize == 0) {
+        downloadedSize = downloadFirmware(update.binaryURL, &firmwareData, update.binarySize);
+    }
     if (downloadedSize == 0 || firmwareData == nullptr) {
         reportStatus(update.releaseID, OTA_STATUS_FAILED, 0, _lastErrorMessage.c_str());
         goto cleanup;
     }
     
-    // Verify hash
-    if (!verifyHash(firmwareData, downloadedSize, update.binaryHash)) {
-        setError(OTA_ERROR_VERIFICATION, "Hash verification failed");
-        reportStatus(update.releaseID, OTA_STATUS_FAILED, 0, "Hash verification failed");
+    // Verify hash and signature using the digest computed during download
+    if (!verifyImage(update)) {
+        reportStatus(update.releaseID, OTA_STATUS_FAILED, 0, _lastErrorMessage.c_str());
         goto cleanup;
     }
     
-    // Verify signature if enabled
-    if (_verifySignature && update.signature.length() > 0) {
-        if (!verifySignature(firmwareData, downloadedSize, update.signature)) {
-            setError(OTA_ERROR_VERIFICATION, "Signature verification failed");
-            reportStatus(update.releaseID, OTA_STATUS_FAILED, 0, "Signature verification failed");
-            goto cleanup;
-        }
-    }
-    
     // Report installing status
     reportStatus(update.releaseID, OTA_STATUS_INSTALLING, 50);
-    if (_statusCallback) {
-        _statusCallback(OTA_STATUS_INSTALLING, 50);
+    notifyStatus(OTA_STATUS_INSTALLING, 50);
+    
+#if OTA_ENABLE_BUNDLES
+    // Components go in once the image has checked out, before it replaces the running application
+    if (!installComponents(update)) {
+        reportStatus(update.releaseID, OTA_STATUS_FAILED, 50, _lastErrorMessage.c_str());
+        goto cleanup;
     }
+#endif
     
     // Install firmware
     if (!installFirmware(firmwareData, downloadedSize)) {
+        noteComponentsKept();
         reportStatus(update.releaseID, OTA_STATUS_FAILED, 50, _lastErrorMessage.c_str());
         goto cleanup;
     }
     
+    saveInstalledRelease(update.releaseID);
+    
     // Report completed status
-    reportStatus(update.releaseID, OTA_STATUS_COMPLETED, 100);
-    if (_statusCallback) {
-        _statusCallback(OTA_STATUS_COMPLETED, 100);
-    }
+    reportInstalled(update.releaseID);
+    notifyStatus(OTA_STATUS_COMPLETED, 100);
     
     success = true;
     _lastError = OTA_ERROR_NONE;
     
 cleanup:
-    if (firmwareData) {
-        free(firmwareData);
-    }
+    _allocator.release(firmwareData);
+    finishStats();
+    disconnect();
     
     return success;
 }
 
+bool OTAClient::performStreamingUpdate(const FirmwareUpdate& update) {
+    // Report downloading status
+    reportStatus(update.releaseID, OTA_STATUS_DOWNLOADING, 0);
+    notifyStatus(OTA_STATUS_DOWNLOADING, 0);
+    
+    // Download firmware straight into the update partition, from the local cache if there is one
+    bool streamed = false;
+    if (_localCache.length() > 0) {
+        size_t before = _stats.bytesDownloaded;
+        streamed = streamFirmware(viaLocalCache(update));
+        _stats.bytesFromCache += _stats.bytesDownloaded - before;
+        
+        // A paused download goes on from the cache next time
+        if (!streamed && _lastError == OTA_ERROR_PAUSED) {
+            return false;
+        }
+        
+        // The cache isn't trusted, so an image that doesn't match is fetched again from the server.
+        // A dropped cache download is resumed from there instead.
+        _verifier.finish();
+        if (streamed && !_verifier.matchesHash(update.binaryHash)) {
+            _flashWriter.abort();
+            clearResumeState();
+            streamed = false;
+        }
+    }
+    
+    if (!streamed && !streamFirmware(update)) {
+        // An interrupted download stays "downloading" so it can be resumed later
+        if (!isResumePending()) {
+            reportStatus(update.releaseID, OTA_STATUS_FAILED, 0, _lastErrorMessage.c_str());
+        }
+        return false;
+    }
+    
+    // Report installing status
+    reportStatus(update.releaseID, OTA_STATUS_INSTALLING, 50);
+    notifyStatus(OTA_STATUS_INSTALLING, 50);
+    
+    // Verify and commit the image
+    if (!finalizeStreamedFirmware(update)) {
+        reportStatus(update.releaseID, OTA_STATUS_FAILED, 50, _lastErrorMessage.c_str());
+        return false;
+    }
+    
+    // Report completed status
+    reportInstalled(update.releaseID);
+    notifyStatus(OTA_STATUS_COMPLETED, 100);
+    
+    _lastError = OTA_ERROR_NONE;
+    return true;
+}
+
 bool OTAClient::checkAndUpdate() {
     FirmwareUpdate update;
     
@@ -152,188 +451,2656 @@ bool OTAClient::checkAndUpdate() {
     return performUpdate(update);
 }
 
+bool OTAClient::startUpdate(const FirmwareUpdate& update) {
+    if (isUpdateRunning()) {
+        return false;
+    }
+    
+    _taskUpdate = update;
+    return startTask(false);
+}
+
+bool OTAClient::startCheckAndUpdate() {
+    if (isUpdateRunning()) {
+        return false;
+    }
+    
+    return startTask(true);
+}
+
+int OTAClient::poll() {
+    // Read the state first: everything the task reported before finishing is then already queued
+    int state = _taskState;
+    
+#if defined(ESP32)
+    if (_taskEvents) {
+        TaskEvent event;
+        while (xQueueReceive(_taskEvents, &event, 0) == pdTRUE) {
+            if (_statusCallback) {
+                _statusCallback(event.status, event.progress);
+            }
+        }
+    }
+    
+    portENTER_CRITICAL(&_taskLock);
+    bool progressPending = _taskProgressPending;
+    size_t current = _taskProgress;
+    size_t total = _taskProgressTotal;
+    _taskProgressPending = false;
+    portEXIT_CRITICAL(&_taskLock);
+    
+    if (progressPending && _progressCallback) {
+        _progressCallback(current, total);
+    }
+#endif
+    
+    // A finished update is reported once
+    if (state == OTA_TASK_SUCCEEDED || state == OTA_TASK_FAILED) {
+        _taskState = OTA_TASK_IDLE;
+    }
+    
+    return state;
+}
+
+bool OTAClient::isUpdateRunning() const {
+    return _taskState == OTA_TASK_RUNNING;
+}
+
+bool OTAClient::startTask(bool checkFirst) {
+    _taskCheckFirst = checkFirst;
+    
+#if defined(ESP32)
+    if (_taskEvents == nullptr) {
+        _taskEvents = xQueueCreate(OTA_TASK_EVENT_QUEUE_SIZE, sizeof(TaskEvent));
+        if (_taskEvents == nullptr) {
+            setError(OTA_ERROR_INSTALLATION, "Failed to create update task");
+            return false;
+        }
+    }
+    xQueueReset(_taskEvents);
+    _taskProgressPending = false;
+    
+    _taskState = OTA_TASK_RUNNING;
+    if (xTaskCreatePinnedToCore(updateTask, "ota_update", OTA_TASK_STACK_SIZE, this, OTA_TASK_PRIORITY,
+                                &_taskHandle, OTA_TASK_CORE) != pdPASS) {
+        _taskHandle = nullptr;
+        _taskState = OTA_TASK_IDLE;
+        setError(OTA_ERROR_INSTALLATION, "Failed to create update task");
+        return false;
+    }
+#else
+    // No scheduler to hand the work to; run it here
+    bool success = checkFirst ? checkAndUpdate() : performUpdate(_taskUpdate);
+    _taskState = success ? OTA_TASK_SUCCEEDED : OTA_TASK_FAILED;
+#endif
+    
+    return true;
+}
+
+void OTAClient::updateTask(void* context) {
+#if defined(ESP32)
+    OTAClient* client = static_cast<OTAClient*>(context);
+    
+    bool success = client->_taskCheckFirst ? client->checkAndUpdate() : client->performUpdate(client->_taskUpdate);
+    
+    client->_taskHandle = nullptr;
+    client->_taskState = success ? OTA_TASK_SUCCEEDED : OTA_TASK_FAILED;
+    vTaskDelete(nullptr);
+#endif
+}
+
+void OTAClient::notifyStatus(const char* status, int progress) {
+#if defined(ESP32)
+    if (_taskHandle != nullptr && xTaskGetCurrentTaskHandle() == _taskHandle) {
+        // Status strings are literals, so the pointer stays valid until poll()
+        TaskEvent event = { status, progress };
+        xQueueSend(_taskEvents, &event, 0);
+        return;
+    }
+#endif
+    
+    if (_statusCallback) {
+        _statusCallback(status, progress);
+    }
+}
+
 void OTAClient::setProgressCallback(ProgressCallback callback) {
     _progressCallback = callback;
 }
 
+void OTAClient::setProgressGranularity(size_t bytes, uint8_t percent) {
+    _progressBytes = bytes;
+    _progressPercent = min(percent, (uint8_t)100);
+}
+
+void OTAClient::setProgressReporting(uint8_t percent, unsigned long minInterval) {
+    _reportPercent = min(percent, (uint8_t)100);
+    _reportInterval = minInterval;
+}
+
 void OTAClient::setStatusCallback(StatusCallback callback) {
     _statusCallback = callback;
 }
 
-int OTAClient::getLastError() const {
-    return _lastError;
+void OTAClient::setYieldCallback(YieldCallback callback) {
+    _yieldCallback = callback;
 }
 
-const char* OTAClient::getLastErrorMessage() const {
-    return _lastErrorMessage.c_str();
+void OTAClient::setDownloadRateLimit(uint32_t bytesPerSecond, size_t burst) {
+    _throttle.setRate(bytesPerSecond, burst);
 }
 
-void OTAClient::setCACertificate(const char* caCert) {
-    _caCert = String(caCert);
+unsigned long OTAClient::getPollDelay() const {
+    return _pollDelay;
 }
 
-void OTAClient::setVerifySignature(bool enable) {
-    _verifySignature = enable;
+void OTAClient::setPollPolicy(unsigned long interval, unsigned long jitter, unsigned long maxBackoff) {
+    _pollInterval = interval;
+    _pollJitter = jitter;
+    _pollMaxBackoff = max(maxBackoff, interval);
 }
 
-bool OTAClient::reportStatus(const String& releaseID, const char* status, int progress, const char* errorMessage) {
-    String url = _serverURL + "/api/v1/ota/updates/status";
-    
-    _httpClient.begin(_wifiClient, url);
-    _httpClient.addHeader("Content-Type", "application/json");
-    
-    // Build JSON payload
-    DynamicJsonDocument doc(512);
-    doc["device_id"] = _deviceID;
-    doc["release_id"] = releaseID;
-    doc["status"] = status;
-    doc["progress"] = progress;
-    if (errorMessage) {
-        doc["error_message"] = errorMessage;
+void OTAClient::setLowPowerMode(unsigned long sliceTime, unsigned long sliceInterval) {
+    _sliceTime = sliceTime;
+    _sliceInterval = sliceInterval;
+}
+
+void OTAClient::setValidationTimeout(unsigned long timeout) {
+    _validationTimeout = timeout;
+}
+
+bool OTAClient::isValidationPending() const {
+    return _validationPending;
+}
+
+bool OTAClient::markValid() {
+    if (!_validationPending) {
+        return true;
     }
     
-    String payload;
-    serializeJson(doc, payload);
+#if defined(ESP32)
+    if (_validationTimer) {
+        esp_timer_stop(_validationTimer);
+    }
+    if (esp_ota_mark_app_valid_cancel_rollback() != ESP_OK) {
+        setError(OTA_ERROR_INSTALLATION, "Failed to mark firmware valid");
+        return false;
+    }
+#endif
     
-    int httpCode = _httpClient.POST(payload);
-    _httpClient.end();
+    _validationPending = false;
     
-    return (httpCode == HTTP_CODE_OK);
+    // Sent now if the network is up, otherwise with the next check
+    _statusQueue.add(_validationRelease.c_str(), OTA_STATUS_COMPLETED, 100, nullptr);
+    flushStatusReports();
+    clearValidationState();
+    return true;
 }
 
-size_t OTAClient::downloadFirmware(const String& url, uint8_t** buffer, size_t expectedSize) {
-    _httpClient.begin(_wifiClient, url);
-    
-    int httpCode = _httpClient.GET();
+bool OTAClient::rollback(const char* reason) {
+    if (!_validationPending) {
+        setError(OTA_ERROR_INSTALLATION, "No update to roll back");
+        return false;
+    }
     
-    if (httpCode != HTTP_CODE_OK) {
-        _httpClient.end();
-        setError(OTA_ERROR_DOWNLOAD, "Download failed: HTTP " + String(httpCode));
-        return 0;
+#if defined(ESP32)
+    // Only the application goes back; components stay at this release
+    String message = reason;
+#if OTA_ENABLE_BUNDLES
+    if (_componentsRelease == _validationRelease) {
+        message += OTA_COMPONENTS_KEPT_NOTE;
     }
+#endif
     
-    int contentLength = _httpClient.getSize();
-    if (contentLength <= 0) {
-        _httpClient.end();
-        setError(OTA_ERROR_DOWNLOAD, "Invalid content length");
-        return 0;
+    // Reported by the previous firmware if it can't be sent before the reboot
+    _statusQueue.add(_validationRelease.c_str(), OTA_STATUS_FAILED, 100, message.c_str());
+    flushStatusReports();
+    clearValidationState();
+    
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+#endif
+    
+    // Only gets here if there is no valid firmware to go back to
+    setError(OTA_ERROR_INSTALLATION, "Rollback failed");
+    return false;
+}
+
+bool OTAClient::loop() {
+    if (isUpdateRunning()) {
+        return false;
     }
     
-    // Allocate buffer
-    *buffer = (uint8_t*)malloc(contentLength);
-    if (*buffer == nullptr) {
-        _httpClient.end();
-        setError(OTA_ERROR_DOWNLOAD, "Memory allocation failed");
-        return 0;
+    if (!_pollScheduled) {
+        _pollScheduled = true;
+        schedulePoll(pollJitter());
+    }
+    if (getNextPollDelay() > 0) {
+        return false;
     }
     
-    // Download data
-    WiFiClient* stream = _httpClient.getStreamPtr();
-    size_t totalRead = 0;
-    size_t bytesRead = 0;
-    uint8_t buff[128];
+    bool installed = checkAndUpdate();
     
-    while (_httpClient.connected() && (contentLength > 0 || contentLength == -1)) {
-        size_t available = stream->available();
-        
-        if (available) {
-            bytesRead = stream->readBytes(buff, min(available, sizeof(buff)));
-            memcpy(*buffer + totalRead, buff, bytesRead);
-            totalRead += bytesRead;
-            
-            if (_progressCallback) {
-                _progressCallback(totalRead, contentLength);
-            }
-            
-            if (contentLength > 0) {
-                contentLength -= bytesRead;
-            }
+    unsigned long wait = _pollInterval;
+    if (_lastError == OTA_ERROR_NETWORK) {
+        // Back off while the server or the network is struggling
+        if (_pollFailures < 32) {
+            _pollFailures++;
         }
-        
-        delay(1);
+        for (uint8_t i = 0; i < _pollFailures && wait < _pollMaxBackoff; i++) {
+            wait = (wait > _pollMaxBackoff / 2) ? _pollMaxBackoff : wait * 2;
+        }
+    } else {
+        _pollFailures = 0;
     }
     
-    _httpClient.end();
-    
-    if (totalRead != expectedSize) {
-        setError(OTA_ERROR_DOWNLOAD, "Downloaded size mismatch");
-        free(*buffer);
-        *buffer = nullptr;
+    // A paused download is continued after the device has slept; the server already
+    // spreads its Retry-After delays across the fleet
+    if (_lastError == OTA_ERROR_PAUSED) {
+        schedulePoll(_sliceInterval);
+    } else {
+        schedulePoll(_pollDelay > 0 ? _pollDelay : wait + pollJitter());
+    }
+    return installed;
+}
+
+unsigned long OTAClient::getNextPollDelay() const {
+    if (!_pollScheduled) {
         return 0;
     }
     
-    return totalRead;
+    unsigned long elapsed = millis() - _lastPoll;
+    return (elapsed < _pollWait) ? _pollWait - elapsed : 0;
 }
 
-bool OTAClient::verifyHash(const uint8_t* data, size_t size, const String& expectedHash) {
-    uint8_t hash[32];
-    computeSHA256(data, size, hash);
+void OTAClient::yieldDownload(bool waiting) {
+    // A background update leaves the sketch's loop() running, so it needs no turns
+    bool foreground = true;
+#if defined(ESP32)
+    foreground = (_taskHandle == nullptr || xTaskGetCurrentTaskHandle() != _taskHandle);
+#endif
     
-    // Convert hash to hex string
-    char hashStr[65];
-    for (int i = 0; i < 32; i++) {
-        sprintf(hashStr + (i * 2), "%02x", hash[i]);
+    unsigned long now = millis();
+    if (_yieldCallback && foreground && (waiting || now - _lastYield >= OTA_YIELD_INTERVAL_MS)) {
+        _lastYield = now;
+        _yieldCallback();
     }
-    hashStr[64] = '\0';
     
-    return (expectedHash.equalsIgnoreCase(hashStr));
+    if (waiting) {
+        delay(1);
+    }
 }
 
-bool OTAClient::verifySignature(const uint8_t* data, size_t size, const String& signature) {
-    // Decode base64 signature
-    uint8_t sigBytes[512];
-    size_t sigLen = base64Decode(signature, sigBytes, sizeof(sigBytes));
-    
-    if (sigLen == 0) {
-        return false;
+void OTAClient::schedulePoll(unsigned long wait) {
+    _lastPoll = millis();
+    _pollWait = wait;
+    saveSleepState();
+}
+
+unsigned long OTAClient::pollJitter() {
+    if (_pollJitter == 0) {
+        return 0;
     }
     
-    // Compute hash of data
-    uint8_t hash[32];
-    computeSHA256(data, size, hash);
+    // xorshift32: cheap, and the same sequence for a device on every boot
+    _pollRandom ^= _pollRandom << 13;
+    _pollRandom ^= _pollRandom >> 17;
+    _pollRandom ^= _pollRandom << 5;
+    return _pollRandom % _pollJitter;
+}
+
+void OTAClient::saveSleepState() {
+#if defined(ESP32)
+    if (_sliceTime == 0) {
+        return;
+    }
     
-    // Verify signature using mbedtls
-    mbedtls_pk_context pk;
-    mbedtls_pk_init(&pk);
+    otaSleepState.pollDue = sleepClockMicros() + (int64_t)getNextPollDelay() * 1000;
+    otaSleepState.pollWait = _pollWait;
+    otaSleepState.pollRandom = _pollRandom;
+    otaSleepState.pollFailures = _pollFailures;
     
-    int ret = mbedtls_pk_parse_public_key(&pk, (const unsigned char*)_publicKey.c_str(), 
-                                          _publicKey.length() + 1);
-    if (ret != 0) {
-        mbedtls_pk_free(&pk);
-        return false;
+    // A longer ETag isn't kept; the next check after waking then gets a full answer
+    memset(otaSleepState.etag, 0, sizeof(otaSleepState.etag));
+    if (_updateETag.length() < sizeof(otaSleepState.etag)) {
+        memcpy(otaSleepState.etag, _updateETag.c_str(), _updateETag.length());
     }
     
-    ret = mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, hash, sizeof(hash), sigBytes, sigLen);
+    otaSleepState.checksum = sleepStateChecksum();
+    otaSleepState.magic = OTA_SLEEP_STATE_MAGIC;
+#endif
+}
+
+void OTAClient::loadSleepState() {
+#if defined(ESP32)
+    // RTC memory holds garbage after power-on
+    if (_sliceTime == 0 || otaSleepState.magic != OTA_SLEEP_STATE_MAGIC ||
+        otaSleepState.checksum != sleepStateChecksum()) {
+        return;
+    }
     
-    mbedtls_pk_free(&pk);
+    // A clock that was set back while asleep wakes into a full wait rather than a long one
+    int64_t remaining = (otaSleepState.pollDue - sleepClockMicros()) / 1000;
+    remaining = constrain(remaining, (int64_t)0, (int64_t)otaSleepState.pollWait);
     
-    return (ret == 0);
+    _pollRandom = otaSleepState.pollRandom;
+    _pollFailures = otaSleepState.pollFailures;
+    otaSleepState.etag[sizeof(otaSleepState.etag) - 1] = '\0';
+    _updateETag = otaSleepState.etag;
+    _pollScheduled = true;
+    schedulePoll((unsigned long)remaining);
+#endif
 }
 
-bool OTAClient::installFirmware(const uint8_t* data, size_t size) {
-    if (!Update.begin(size)) {
-        setError(OTA_ERROR_INSTALLATION, "Update begin failed: " + String(Update.errorString()));
-        return false;
+String OTAClient::getUpdateNoticeTopic() const {
+    return String(OTA_NOTICE_TOPIC_PREFIX) + _deviceID + OTA_NOTICE_TOPIC_SUFFIX;
+}
+
+void OTAClient::handleUpdateNotice(const char* topic, const uint8_t* payload, unsigned int length) {
+    // The broker deletes a retained notice by sending an empty one
+    if (topic == nullptr || payload == nullptr || length == 0 || getUpdateNoticeTopic() != topic) {
+        return;
     }
     
-    size_t written = Update.write(data, size);
-    if (written != size) {
-        Update.abort();
-        setError(OTA_ERROR_INSTALLATION, "Update write failed: " + String(Update.errorString()));
-        return false;
+    // Small enough for the stack; the shared document may be in use by an update task
+    StaticJsonDocument<256> notice;
+    if (deserializeJson(notice, (const char*)payload, length)) {
+        return;
     }
     
-    if (!Update.end()) {
-        setError(OTA_ERROR_INSTALLATION, "Update end failed: " + String(Update.errorString()));
-        return false;
+    // A notice for the release we're running is left over from the last update
+    const char* releaseID = notice["release_id"] | "";
+    if (strlen(releaseID) > 0 && _currentRelease == releaseID) {
+        return;
     }
     
-    if (!Update.isFinished()) {
-        setError(OTA_ERROR_INSTALLATION, "Update not finished");
-        return false;
-    }
+    _updateNotice = true;
     
-    return true;
+    // Every device of a deployment gets its notice at once, so its check is spread out too
+    if (_pollScheduled) {
+        unsigned long wait = pollJitter();
+        if (getNextPollDelay() > wait) {
+            schedulePoll(wait);
+        }
+    }
+}
+
+bool OTAClient::hasUpdateNotice() const {
+    return _updateNotice;
+}
+
+int OTAClient::getLastError() const {
+    return _lastError;
+}
+
+const char* OTAClient::getLastErrorMessage() const {
+    return _lastErrorMessage.c_str();
+}
+
+const OTAStats& OTAClient::getStats() const {
+    return _stats;
+}
+
+void OTAClient::setStatsReporting(bool enable) {
+    _statsReporting = enable;
+}
+
+void OTAClient::setCACertificate(const char* caCert) {
+    _caCert = String(caCert);
+}
+
+void OTAClient::setVerifySignature(bool enable) {
+    _verifySignature = enable;
+}
+
+void OTAClient::setStreamingUpdate(bool enable) {
+    _streamingUpdate = enable;
+}
+
+void OTAClient::setParallelDownloads(uint8_t connections) {
+    _parallelDownloads = constrain(connections, (uint8_t)1, (uint8_t)OTA_MAX_PARALLEL_DOWNLOADS);
+}
+
+void OTAClient::setResumableDownloads(bool enable) {
+    _resumableDownloads = enable;
+    if (!enable) {
+        clearResumeState();
+    }
+}
+
+void OTAClient::setDownloadRetries(uint8_t retries) {
+    _downloadRetries = retries;
+}
+
+void OTAClient::setChunkSize(size_t size) {
+    _chunkSize = constrain(size, (size_t)OTA_MIN_CHUNK_SIZE, (size_t)OTA_MAX_CHUNK_SIZE);
+}
+
+void OTAClient::setAllocator(const OTAAllocator& allocator) {
+    _allocator = allocator;
+    _flashWriter.setAllocator(allocator);
+#if OTA_ENABLE_COMPRESSION
+    _inflater.setAllocator(allocator);
+#endif
+    _pipeline.setAllocator(allocator);
+}
+
+void OTAClient::setPipelinedWrites(bool enable) {
+    _pipelinedWrites = enable;
+}
+
+void OTAClient::setDeltaUpdates(bool enable) {
+    _deltaUpdates = enable;
+}
+
+void OTAClient::setCompressedDownloads(bool enable) {
+    _compressedDownloads = enable;
+}
+
+void OTAClient::setSectorReuse(bool enable) {
+    _sectorReuse = enable;
+}
+
+void OTAClient::setChunkVerification(bool enable) {
+    _chunkVerification = enable;
+}
+
+void OTAClient::setCurrentRelease(const char* releaseID) {
+    _currentRelease = String(releaseID);
+}
+
+const char* OTAClient::getCurrentRelease() const {
+    return _currentRelease.c_str();
+}
+
+#if OTA_ENABLE_BUNDLES
+const char* OTAClient::getComponentsRelease() const {
+    return _componentsRelease.c_str();
+}
+#endif
+
+void OTAClient::setConnectionReuse(bool enable) {
+    _connectionReuse = enable;
+    if (!enable) {
+        disconnect();
+    }
+}
+
+void OTAClient::setLocalCache(const char* baseURL) {
+#if OTA_ENABLE_LOCAL_CACHE
+    _localCache = (baseURL != nullptr) ? String(baseURL) : String();
+    while (_localCache.length() > 0 && _localCache[_localCache.length() - 1] == '/') {
+        _localCache = _localCache.substring(0, _localCache.length() - 1);
+    }
+    _localCachePath = OTA_LOCAL_CACHE_PATH;
+#else
+    (void)baseURL;
+#endif
+}
+
+bool OTAClient::discoverLocalCache(unsigned long timeoutMs) {
+#if defined(ESP32) && OTA_ENABLE_LOCAL_CACHE
+    mdns_result_t* results = nullptr;
+    if (mdns_query_ptr(OTA_LOCAL_CACHE_SERVICE, OTA_LOCAL_CACHE_PROTO, timeoutMs, 4, &results) != ESP_OK) {
+        return false;
+    }
+    
+    bool found = false;
+    for (mdns_result_t* result = results; result != nullptr && !found; result = result->next) {
+        for (mdns_ip_addr_t* address = result->addr; address != nullptr; address = address->next) {
+            if (address->addr.type != ESP_IPADDR_TYPE_V4) {
+                continue;
+            }
+            String baseURL = "http://" + IPAddress(address->addr.u_addr.ip4.addr).toString() + ":" +
+                             String(result->port);
+            setLocalCache(baseURL.c_str());
+            found = true;
+            break;
+        }
+        
+        // The cache may serve its fetch route elsewhere
+        for (size_t i = 0; found && i < result->txt_count; i++) {
+            if (strcmp(result->txt[i].key, "path") == 0 && result->txt[i].value != nullptr &&
+                result->txt[i].value[0] == '/') {
+                _localCachePath = result->txt[i].value;
+            }
+        }
+    }
+    
+    mdns_query_results_free(results);
+    return found;
+#else
+    (void)timeoutMs;
+    return false;
+#endif
+}
+
+const char* OTAClient::getLocalCache() const {
+    return _localCache.c_str();
+}
+
+void OTAClient::setTLSSessionResumption(bool enable) {
+    _wifiClient.setSessionResumption(enable);
+    if (!enable) {
+        _wifiClient.clearSession();
+    }
+}
+
+void OTAClient::disconnect() {
+    _httpClient.end();
+    _wifiClient.stop();
+    _plainClient.stop();
+    _connectedOrigin = "";
+}
+
+// Range header value for bytes start to end (exclusive), or from start on if end is 0
+static String rangeHeader(size_t start, size_t end) {
+    String range = "bytes=" + String((unsigned long)start) + "-";
+    if (end > 0) {
+        range += String((unsigned long)(end - 1));
+    }
+    return range;
+}
+
+int OTAClient::sendRequest(const char* method, const String& url, const char* payload, size_t rangeStart,
+                           size_t rangeEnd, const char* ifNoneMatch) {
+    int httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+    
+    for (uint8_t attempt = 0; attempt < 2; attempt++) {
+        bool reused = beginRequest(url);
+        if (payload != nullptr) {
+            _httpClient.addHeader("Content-Type", "application/json");
+        }
+        if (rangeStart > 0 || rangeEnd > 0) {
+            _httpClient.addHeader("Range", rangeHeader(rangeStart, rangeEnd));
+        }
+        if (ifNoneMatch != nullptr) {
+            _httpClient.addHeader("If-None-Match", ifNoneMatch);
+        }
+        
+        httpCode = _httpClient.sendRequest(method, (uint8_t*)payload, payload ? strlen(payload) : 0);
+        
+        // The server may have closed a kept-alive connection while it was idle
+        if (httpCode >= 0 || !reused) {
+            break;
+        }
+        disconnect();
+    }
+    
+    return httpCode;
+}
+
+bool OTAClient::beginRequest(const String& url) {
+    // Only one connection is kept; a request to another host replaces it
+    String origin = urlOrigin(url);
+    if (!_connectionReuse || origin != _connectedOrigin) {
+        _wifiClient.stop();
+        _plainClient.stop();
+    }
+    
+    // Only the local cache is reached over plain HTTP; what it serves is checked like any other download
+    bool plain = isLocalCacheURL(url) && url.startsWith("http://");
+    WiFiClient& client = plain ? _plainClient : static_cast<WiFiClient&>(_wifiClient);
+    
+    bool reused = client.connected();
+    _connectedOrigin = origin;
+    
+    _httpClient.setReuse(_connectionReuse);
+    _httpClient.begin(client, url);
+    
+    return reused;
+}
+
+void OTAClient::endRequest(size_t consumed) {
+    int remaining = _httpClient.getSize();
+    if (!_connectionReuse || remaining < 0 || (size_t)remaining < consumed) {
+        // Without a length (or with chunked encoding) the end of the body can't be found
+        disconnect();
+        return;
+    }
+    
+    // Read the rest of the response so the next request starts clean
+    remaining -= consumed;
+    uint8_t scratch[64];
+    WiFiClient& stream = _httpClient.getStream();
+    unsigned long lastData = millis();
+    while (remaining > 0 && _httpClient.connected() && millis() - lastData < OTA_STREAM_TIMEOUT_MS) {
+        int read = stream.read(scratch, min((size_t)remaining, sizeof(scratch)));
+        if (read > 0) {
+            remaining -= read;
+            lastData = millis();
+        } else {
+            delay(1);
+        }
+    }
+    
+    _httpClient.end();
+    if (remaining > 0) {
+        disconnect();
+    }
+}
+
+String OTAClient::urlOrigin(const String& url) {
+    int hostStart = url.indexOf("://");
+    hostStart = (hostStart < 0) ? 0 : hostStart + 3;
+    
+    int hostEnd = url.indexOf('/', hostStart);
+    return (hostEnd < 0) ? url : url.substring(0, hostEnd);
+}
+
+// Percent-encode everything but unreserved characters, for a URL carried in a query parameter
+static String urlEncode(const String& value) {
+    static const char hexDigits[] = "0123456789ABCDEF";
+    String encoded;
+    encoded.reserve(value.length() + value.length() / 2);
+    
+    for (size_t i = 0; i < value.length(); i++) {
+        char c = value[i];
+        if (isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += c;
+        } else {
+            encoded += '%';
+            encoded += hexDigits[(uint8_t)c >> 4];
+            encoded += hexDigits[(uint8_t)c & 0x0F];
+        }
+    }
+    
+    return encoded;
+}
+
+bool OTAClient::isLocalCacheURL(const String& url) const {
+    return _localCache.length() > 0 && url.startsWith(_localCache + "/");
+}
+
+String OTAClient::localCacheURL(const String& url, const String& hash) const {
+    String cached = _localCache + _localCachePath + "?src=" + urlEncode(url);
+    if (hash.length() > 0) {
+        cached += "&sha256=" + hash;
+    }
+    return cached;
+}
+
+FirmwareUpdate OTAClient::viaLocalCache(const FirmwareUpdate& update) const {
+    // Only the image's hash is known up front; the rest are checked by what they produce
+    FirmwareUpdate cached = update;
+    cached.binaryURL = localCacheURL(update.binaryURL, update.binaryHash);
+    if (update.deltaURL.length() > 0) {
+        cached.deltaURL = localCacheURL(update.deltaURL, "");
+    }
+    if (update.compressedURL.length() > 0) {
+        cached.compressedURL = localCacheURL(update.compressedURL, "");
+    }
+    if (update.sectorManifestURL.length() > 0) {
+        cached.sectorManifestURL = localCacheURL(update.sectorManifestURL, "");
+    }
+    return cached;
+}
+
+void OTAClient::reportStatus(const String& releaseID, const char* status, int progress, const char* errorMessage) {
+    bool final = (strcmp(status, OTA_STATUS_COMPLETED) == 0 || strcmp(status, OTA_STATUS_FAILED) == 0);
+    
+    // The final report can carry the statistics of the whole update
+    const OTAStats* stats = nullptr;
+    if (final && _statsReporting) {
+        finishStats();
+        stats = &_stats;
+    }
+    _statusQueue.add(releaseID.c_str(), status, progress, errorMessage, 0, 0, 0, stats);
+    
+    // Intermediate states wait for the final one instead of costing a request each
+    if (final) {
+        flushStatusReports();
+    }
+}
+
+bool OTAClient::flushStatusReports() {
+    if (_statusQueue.count() == 0) {
+        return true;
+    }
+    
+    bool sent = sendStatusReports();
+    if (sent) {
+        _statusQueue.clear();
+    }
+    
+    // Whatever is left is kept in NVS for the next boot, e.g. after the post-install restart
+    _statusQueue.save(OTA_PREFS_NAMESPACE);
+    
+    return sent;
+}
+
+// Fill a JSON object (or document) with one status report; strings are stored by pointer
+template <typename T>
+static void writeStatusReport(T& target, const char* deviceID, const OTAStatusReport& report) {
+    target["device_id"] = deviceID;
+    target["release_id"] = (const char*)report.releaseID;
+    target["status"] = (const char*)report.status;
+    target["progress"] = report.progress;
+    if (report.bytesTotal > 0) {
+        target["bytes_downloaded"] = report.bytesDownloaded;
+        target["bytes_total"] = report.bytesTotal;
+        target["throughput_bps"] = report.throughput;
+    }
+    if (report.errorMessage[0] != '\0') {
+        target["error_message"] = (const char*)report.errorMessage;
+    }
+    if (report.hasStats) {
+        JsonObject stats = target.createNestedObject("stats");
+        stats["dns_ms"] = report.stats.dnsMs;
+        stats["tls_ms"] = report.stats.tlsMs;
+        stats["first_byte_ms"] = report.stats.firstByteMs;
+        stats["download_ms"] = report.stats.downloadMs;
+        stats["hash_ms"] = report.stats.hashMs;
+        stats["verify_ms"] = report.stats.verifyMs;
+        stats["flash_write_ms"] = report.stats.flashWriteMs;
+        stats["finalize_ms"] = report.stats.finalizeMs;
+        stats["total_ms"] = report.stats.totalMs;
+        stats["bytes_downloaded"] = report.stats.bytesDownloaded;
+        stats["throughput_bps"] = report.stats.throughput;
+        stats["min_free_heap"] = report.stats.minFreeHeap;
+        stats["retries"] = report.stats.retries;
+    }
+}
+
+bool OTAClient::sendStatusReports() {
+    String url;
+    url.reserve(_serverURL.length() + 40);
+    url = _serverURL;
+    url += "/api/v1/ota/updates/status";
+    
+    // Everything queued goes out in one request
+    _jsonDoc.clear();
+    JsonArray reports = _jsonDoc.createNestedArray("reports");
+    for (size_t i = 0; i < _statusQueue.count(); i++) {
+        JsonObject report = reports.createNestedObject();
+        writeStatusReport(report, _deviceID.c_str(), _statusQueue.get(i));
+    }
+    
+    int httpCode = postJson(url + "/batch");
+    if (httpCode != HTTP_CODE_NOT_FOUND && httpCode != HTTPC_ERROR_TOO_LESS_RAM) {
+        return (httpCode == HTTP_CODE_OK);
+    }
+    
+    // Servers without the batch endpoint, or a batch too big to build, take one report per request
+    for (size_t i = 0; i < _statusQueue.count(); i++) {
+        _jsonDoc.clear();
+        writeStatusReport(_jsonDoc, _deviceID.c_str(), _statusQueue.get(i));
+        if (postJson(url) != HTTP_CODE_OK) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+int OTAClient::postJson(const String& url) {
+    char payload[OTA_STATUS_PAYLOAD_SIZE];
+    if (measureJson(_jsonDoc) >= sizeof(payload)) {
+        // Truncated JSON would only be rejected by the server
+        _jsonDoc.clear();
+        return HTTPC_ERROR_TOO_LESS_RAM;
+    }
+    serializeJson(_jsonDoc, payload, sizeof(payload));
+    _jsonDoc.clear();
+    
+    int httpCode = sendRequest("POST", url, payload);
+    endRequest();
+    
+    return httpCode;
+}
+
+size_t OTAClient::downloadFirmware(const String& url, uint8_t** buffer, size_t expectedSize) {
+    // Range connections are HTTPS only; the local cache is near enough to do without them
+    if (_parallelDownloads > 1 && expectedSize >= 2 * OTA_MIN_PARALLEL_RANGE && !isLocalCacheURL(url)) {
+        *buffer = (uint8_t*)_allocator.allocate(expectedSize, OTA_MEMORY_BULK);
+        if (*buffer == nullptr) {
+            setError(OTA_ERROR_DOWNLOAD, "Memory allocation failed");
+            return 0;
+        }
+        
+        bool unsupported = false;
+        if (downloadRanges(url, *buffer, expectedSize, &unsupported)) {
+            return expectedSize;
+        }
+        _allocator.release(*buffer);
+        *buffer = nullptr;
+        if (!unsupported) {
+            return 0;
+        }
+    }
+    
+    unsigned long started = millis();
+    int httpCode = sendRequest("GET", url);
+    _stats.firstByteMs = millis() - started;
+    
+    if (httpCode != HTTP_CODE_OK) {
+        endRequest();
+        setError(OTA_ERROR_DOWNLOAD, "Download failed: HTTP " + String(httpCode));
+        return 0;
+    }
+    
+    int contentLength = _httpClient.getSize();
+    if (contentLength <= 0) {
+        disconnect();
+        setError(OTA_ERROR_DOWNLOAD, "Invalid content length");
+        return 0;
+    }
+    
+    // Allocate buffer
+    *buffer = (uint8_t*)_allocator.allocate(contentLength, OTA_MEMORY_BULK);
+    if (*buffer == nullptr) {
+        disconnect();
+        setError(OTA_ERROR_DOWNLOAD, "Memory allocation failed");
+        return 0;
+    }
+    
+    // Download straight into the image buffer, hashing it as it arrives
+    _verifier.begin();
+    _lastProgress = 0;
+    WiFiClient* stream = _httpClient.getStreamPtr();
+    size_t totalSize = contentLength;
+    size_t totalRead = 0;
+    unsigned long lastData = millis();
+    
+    while (totalRead < totalSize && (_httpClient.connected() || stream->available())) {
+        size_t available = stream->available();
+        size_t allowed = _throttle.allowance(available);
+        
+        if (allowed) {
+            size_t toRead = min(min(allowed, _chunkSize), totalSize - totalRead);
+            size_t bytesRead = stream->readBytes(*buffer + totalRead, toRead);
+            hashImage(*buffer + totalRead, bytesRead);
+            totalRead += bytesRead;
+            _stats.bytesDownloaded += bytesRead;
+            _throttle.consume(bytesRead);
+            lastData = millis();
+            
+            reportProgress(totalRead, totalSize);
+            yieldDownload(false);
+        } else if (available == 0 && millis() - lastData > OTA_STREAM_TIMEOUT_MS) {
+            break;
+        } else {
+            // Only sleep when there is nothing to read, or the rate limit says to wait
+            yieldDownload(true);
+        }
+    }
+    
+    // Don't let a half-read response be reused for the next request
+    if (totalRead == totalSize) {
+        _httpClient.end();
+    } else {
+        disconnect();
+    }
+    _stats.downloadMs += millis() - started;
+    sampleFreeHeap();
+    
+    if (totalRead != expectedSize) {
+        setError(OTA_ERROR_DOWNLOAD, "Downloaded size mismatch");
+        _allocator.release(*buffer);
+        *buffer = nullptr;
+        return 0;
+    }
+    
+    return totalRead;
+}
+
+// Progress of one range of a parallel download
+struct OTARange {
+    size_t position;
+    size_t end;
+    uint8_t attempts;        // Requests since data last arrived
+    bool open;               // Its response is being read
+    unsigned long lastData;
+    unsigned long retryAt;
+};
+
+static void closeRange(HTTPClient& http, OTATLSClient& client) {
+    http.end();
+    client.stop();
+}
+
+bool OTAClient::downloadRanges(const String& url, uint8_t* buffer, size_t size, bool* unsupported) {
+    uint8_t count = (uint8_t)min((size_t)_parallelDownloads, size / OTA_MIN_PARALLEL_RANGE);
+    
+    // The first range uses the client's own connection; the others are opened for this download
+    RangeConnection* extra = new (std::nothrow) RangeConnection[count - 1];
+    if (extra == nullptr) {
+        *unsupported = true;
+        return false;
+    }
+    for (uint8_t i = 0; i < count - 1; i++) {
+        if (_caCert.length() > 0) {
+            extra[i].client.setCACert(_caCert.c_str());
+        } else {
+            extra[i].client.setInsecure();
+        }
+        extra[i].http.setReuse(true);
+    }
+    
+    OTARange ranges[OTA_MAX_PARALLEL_DOWNLOADS];
+    for (uint8_t i = 0; i < count; i++) {
+        ranges[i].position = size * i / count;
+        ranges[i].end = size * (i + 1) / count;
+        ranges[i].attempts = 0;
+        ranges[i].open = false;
+        ranges[i].lastData = 0;
+        ranges[i].retryAt = 0;
+    }
+    
+    unsigned long started = millis();
+    size_t received = 0;
+    bool failed = false;
+    _lastProgress = 0;
+    
+    // Every connection is read in turn, so each keeps its own TCP window busy
+    while (received < size && !failed) {
+        bool idle = true;
+        
+        for (uint8_t i = 0; i < count && !failed; i++) {
+            OTARange& range = ranges[i];
+            HTTPClient& http = (i == 0) ? _httpClient : extra[i - 1].http;
+            OTATLSClient& client = (i == 0) ? _wifiClient : extra[i - 1].client;
+            if (range.position == range.end) {
+                continue;
+            }
+            
+            // Request what is left of the range, waiting between attempts that bring nothing
+            if (!range.open) {
+                if ((long)(millis() - range.retryAt) < 0) {
+                    continue;
+                }
+                if (range.attempts > _downloadRetries) {
+                    setError(OTA_ERROR_NETWORK, "Download interrupted at " + String((unsigned long)received) + " bytes");
+                    failed = true;
+                    break;
+                }
+                // Every request after a range's first picks up where it stopped
+                if (range.attempts > 0 || range.lastData != 0) {
+                    _stats.retries++;
+                }
+                range.attempts++;
+                range.retryAt = millis() + OTA_RETRY_DELAY_MS * range.attempts;
+                
+                unsigned long requested = millis();
+                int httpCode = requestRange((i == 0) ? nullptr : &extra[i - 1], url, range.position, range.end);
+                if (httpCode > 0 && _stats.firstByteMs == 0) {
+                    _stats.firstByteMs = millis() - requested;
+                }
+                
+                if (httpCode == HTTP_CODE_OK) {
+                    // The whole image is coming instead of the range
+                    closeRange(http, client);
+                    *unsupported = true;
+                    failed = true;
+                    break;
+                }
+                if (httpCode != HTTP_CODE_PARTIAL_CONTENT || http.getSize() != (int)(range.end - range.position)) {
+                    closeRange(http, client);
+                    // Connection-level failures and server errors are worth retrying
+                    if (httpCode < 0 || httpCode >= 500) {
+                        continue;
+                    }
+                    setError(OTA_ERROR_DOWNLOAD, "Download failed: HTTP " + String(httpCode));
+                    failed = true;
+                    break;
+                }
+                range.open = true;
+                range.lastData = millis();
+            }
+            
+            // One rate limit covers all connections
+            WiFiClient* stream = http.getStreamPtr();
+            size_t available = stream->available();
+            size_t allowed = _throttle.allowance(available);
+            if (allowed) {
+                size_t toRead = min(min(allowed, _chunkSize), range.end - range.position);
+                size_t bytesRead = stream->readBytes(buffer + range.position, toRead);
+                range.position += bytesRead;
+                range.attempts = 0;
+                range.lastData = millis();
+                received += bytesRead;
+                _stats.bytesDownloaded += bytesRead;
+                _throttle.consume(bytesRead);
+                idle = false;
+                
+                // A finished range leaves its connection open; the client's own one is reused for reports
+                if (range.position == range.end) {
+                    http.end();
+                    range.open = false;
+                }
+                reportProgress(received, size);
+            } else if (available == 0 && (!http.connected() || millis() - range.lastData > OTA_STREAM_TIMEOUT_MS)) {
+                // Dropped or stalled: requested again from where it stopped
+                closeRange(http, client);
+                range.open = false;
+            }
+        }
+        
+        // Only sleep when no connection had anything to read
+        if (!failed) {
+            yieldDownload(idle);
+        }
+    }
+    
+    // The extra connections' TLS buffers count towards the lowest free heap
+    sampleFreeHeap();
+    for (uint8_t i = 0; i < count; i++) {
+        if (i > 0) {
+            closeRange(extra[i - 1].http, extra[i - 1].client);
+        } else if (ranges[0].open) {
+            disconnect();
+        }
+    }
+    delete[] extra;
+    _stats.downloadMs += millis() - started;
+    
+    if (failed) {
+        return false;
+    }
+    
+    // Ranges arrive out of order, so the image is hashed once it is complete
+    _verifier.begin();
+    hashImage(buffer, size);
+    return true;
+}
+
+int OTAClient::requestRange(RangeConnection* connection, const String& url, size_t start, size_t end) {
+    if (connection == nullptr) {
+        return sendRequest("GET", url, nullptr, start, end);
+    }
+    
+    connection->http.begin(connection->client, url);
+    connection->http.addHeader("Range", rangeHeader(start, end));
+    return connection->http.sendRequest("GET");
+}
+
+bool OTAClient::streamFirmware(const FirmwareUpdate& update) {
+    if (update.binarySize <= 0) {
+        setError(OTA_ERROR_DOWNLOAD, "Invalid firmware size");
+        return false;
+    }
+    
+#if OTA_ENABLE_DELTA
+    // Prefer the smallest payload; any problem with it falls back to the raw image
+    if (canApplyDelta(update) && streamEncodedFirmware(update, update.deltaURL, update.deltaSize, true)) {
+        return true;
+    }
+#endif
+    
+    // Neither of these can resume after a reboot, so finish a saved raw download instead
+    bool resumePending = loadResumeOffset(update) > 0;
+    bool streamed = false;
+    
+#if OTA_ENABLE_SECTOR_MANIFESTS
+    // One manifest tells which sectors can be reused and what downloaded ones must hash to
+    bool reuse = canReuseSectors(update) && !resumePending;
+    uint8_t* unchanged = nullptr;
+    if ((reuse || canCheckChunks(update)) && loadSectorManifest(update, reuse ? &unchanged : nullptr) &&
+        unchanged != nullptr) {
+        streamed = streamSectorFirmware(update, unchanged);
+        _allocator.release(unchanged);
+    }
+#endif
+    
+#if OTA_ENABLE_COMPRESSION
+    if (!streamed && canDecompress(update) && update.compressedURL.length() > 0 && update.compressedSize > 0 &&
+        !resumePending) {
+        streamed = streamEncodedFirmware(update, update.compressedURL, update.compressedSize, false);
+    }
+#else
+    (void)resumePending;
+#endif
+    
+    if (!streamed) {
+        streamed = streamFullFirmware(update);
+    }
+    
+    _allocator.release(_chunkDigests);
+    _chunkDigests = nullptr;
+    return streamed;
+}
+
+#if OTA_ENABLE_DELTA || OTA_ENABLE_COMPRESSION
+bool OTAClient::streamEncodedFirmware(const FirmwareUpdate& update, const String& url, size_t payloadSize, bool delta) {
+    size_t expectedSize = update.binarySize;
+    bool inflate = canDecompress(update);
+    
+#if OTA_ENABLE_COMPRESSION
+    if (inflate && !_inflater.begin(writeInflatedOutput, this)) {
+        setError(OTA_ERROR_DOWNLOAD, "Decompression unavailable: " + String(_inflater.errorString()));
+        return false;
+    }
+#endif
+    
+    // This overwrites the partition, so saved raw-image progress is void
+    clearResumeState();
+    
+    if (!_flashWriter.begin(expectedSize)) {
+#if OTA_ENABLE_COMPRESSION
+        _inflater.end();
+#endif
+        setError(OTA_ERROR_INSTALLATION, "Update begin failed: " + String(_flashWriter.errorString()));
+        return false;
+    }
+    
+    _verifier.begin();
+#if OTA_ENABLE_DELTA
+    if (delta) {
+        _deltaDecoder.begin(expectedSize, readRunningImage, writeDeltaOutput, this);
+    }
+#endif
+    _deltaActive = delta;
+    _inflateActive = inflate;
+    
+    size_t offset = 0;
+    bool received = downloadPayload(update, url, payloadSize, &offset, payloadSize, false);
+    bool complete = true;
+#if OTA_ENABLE_COMPRESSION
+    complete = complete && (!inflate || _inflater.isComplete());
+#endif
+#if OTA_ENABLE_DELTA
+    complete = complete && (!delta || _deltaDecoder.isComplete());
+#endif
+    
+    _deltaActive = false;
+    _inflateActive = false;
+#if OTA_ENABLE_COMPRESSION
+    _inflater.end();
+#endif
+    
+    if (!received) {
+        _flashWriter.abort();
+        return false;
+    }
+    
+    if (!complete || _flashWriter.bytesWritten() != expectedSize) {
+        _flashWriter.abort();
+        setError(OTA_ERROR_DOWNLOAD, "Decoded image incomplete");
+        return false;
+    }
+    
+    // Catch a patch applied to a different base before the image is used
+    _verifier.finish();
+    if (!_verifier.matchesHash(update.binaryHash)) {
+        _flashWriter.abort();
+        setError(OTA_ERROR_VERIFICATION, "Decoded image hash mismatch");
+        return false;
+    }
+    
+    return true;
+}
+#endif
+
+#if OTA_ENABLE_SECTOR_MANIFESTS
+bool OTAClient::streamSectorFirmware(const FirmwareUpdate& update, uint8_t* unchanged) {
+    size_t imageSize = update.binarySize;
+    size_t sectors = (imageSize + OTA_FLASH_SECTOR_SIZE - 1) / OTA_FLASH_SECTOR_SIZE;
+    
+    // An unchanged run between two changed ones splits a download in two, so a short one
+    // is downloaded with its neighbours instead
+    size_t downloadBytes = 0;
+    for (size_t sector = 0; sector < sectors; ) {
+        bool reuse = (unchanged[sector / 8] >> (sector % 8)) & 1;
+        size_t last = sector + 1;
+        while (last < sectors && (bool)((unchanged[last / 8] >> (last % 8)) & 1) == reuse) {
+            last++;
+        }
+        
+        size_t start = sector * OTA_FLASH_SECTOR_SIZE;
+        size_t end = min(last * OTA_FLASH_SECTOR_SIZE, imageSize);
+        if (reuse && start > 0 && end < imageSize && end - start < OTA_MIN_REUSED_RUN) {
+            for (size_t i = sector; i < last; i++) {
+                unchanged[i / 8] &= ~(1 << (i % 8));
+            }
+            reuse = false;
+        }
+        if (!reuse) {
+            downloadBytes += end - start;
+        }
+        sector = last;
+    }
+    
+    // Only worth it if it beats the next best download
+    size_t alternative = imageSize;
+    if (canDecompress(update) && update.compressedURL.length() > 0 && update.compressedSize > 0) {
+        alternative = min(alternative, (size_t)update.compressedSize);
+    }
+    if (downloadBytes >= alternative) {
+        setError(OTA_ERROR_DOWNLOAD, "Sector manifest saves nothing");
+        return false;
+    }
+    
+    // This overwrites the partition, so saved raw-image progress is void
+    clearResumeState();
+    
+    if (!_flashWriter.begin(imageSize)) {
+        setError(OTA_ERROR_INSTALLATION, "Update begin failed: " + String(_flashWriter.errorString()));
+        return false;
+    }
+    
+    _verifier.begin();
+    
+    // Runs of sectors alternate between the running partition and Range requests
+    bool written = true;
+    for (size_t sector = 0; written && sector < sectors; ) {
+        bool reuse = (unchanged[sector / 8] >> (sector % 8)) & 1;
+        size_t last = sector + 1;
+        while (last < sectors && (bool)((unchanged[last / 8] >> (last % 8)) & 1) == reuse) {
+            last++;
+        }
+        
+        size_t start = sector * OTA_FLASH_SECTOR_SIZE;
+        size_t end = min(last * OTA_FLASH_SECTOR_SIZE, imageSize);
+        if (reuse) {
+            written = copyRunningImage(start, end);
+            _stats.bytesReused += end - start;
+            reportProgress(end, imageSize);
+        } else {
+            size_t offset = start;
+            _sectorActive = true;
+            written = downloadPayload(update, update.binaryURL, imageSize, &offset, end, false);
+            _sectorActive = false;
+        }
+        sector = last;
+    }
+    
+    if (!written) {
+        _flashWriter.abort();
+        return false;
+    }
+    
+    // A wrong manifest entry or a misread sector shows up here, and the full image is downloaded instead
+    _verifier.finish();
+    if (!_verifier.matchesHash(update.binaryHash)) {
+        _flashWriter.abort();
+        setError(OTA_ERROR_VERIFICATION, "Rebuilt image hash mismatch");
+        return false;
+    }
+    
+    return true;
+}
+
+static uint32_t readUInt32LE(const uint8_t* data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+bool OTAClient::loadSectorManifest(const FirmwareUpdate& update, uint8_t** unchanged) {
+    size_t sectors = (update.binarySize + OTA_FLASH_SECTOR_SIZE - 1) / OTA_FLASH_SECTOR_SIZE;
+    
+    // The manifest must describe this image at this device's sector size; the signature is what follows the hashes
+    size_t hashesEnd = OTA_SECTOR_MANIFEST_HEADER_SIZE + sectors * OTA_SHA256_SIZE;
+    size_t manifestSize = update.sectorManifestSize;
+    if (manifestSize < hashesEnd || manifestSize - hashesEnd > OTA_SECTOR_MANIFEST_MAX_SIGNATURE) {
+        setError(OTA_ERROR_DOWNLOAD, "Invalid sector manifest");
+        return false;
+    }
+    size_t signatureLen = manifestSize - hashesEnd;
+    
+    int httpCode = sendRequest("GET", update.sectorManifestURL, nullptr, 0, 0);
+    if (httpCode != HTTP_CODE_OK) {
+        endRequest();
+        setError(OTA_ERROR_DOWNLOAD, "Sector manifest download failed: HTTP " + String(httpCode));
+        return false;
+    }
+    
+    int contentLength = _httpClient.getSize();
+    WiFiClient& stream = _httpClient.getStream();
+    uint8_t header[OTA_SECTOR_MANIFEST_HEADER_SIZE];
+    size_t consumed = (contentLength < 0 || (size_t)contentLength == manifestSize) ?
+        stream.readBytes(header, sizeof(header)) : 0;
+    if (consumed != sizeof(header) || memcmp(header, OTA_SECTOR_MANIFEST_MAGIC, 4) != 0 ||
+        header[4] != OTA_SECTOR_MANIFEST_VERSION || readUInt32LE(header + 8) != OTA_FLASH_SECTOR_SIZE ||
+        readUInt32LE(header + 12) != (uint32_t)update.binarySize) {
+        endRequest(consumed);
+        setError(OTA_ERROR_DOWNLOAD, "Invalid sector manifest");
+        return false;
+    }
+    
+    // One bit per sector: 32 bytes cover a megabyte of image
+    size_t mapSize = (sectors + 7) / 8;
+    uint8_t* map = (unchanged != nullptr) ? (uint8_t*)_allocator.allocate(mapSize, OTA_MEMORY_INTERNAL) : nullptr;
+    uint8_t* digests = canCheckChunks(update) ?
+        (uint8_t*)_allocator.allocate(sectors * OTA_CHUNK_DIGEST_SIZE, OTA_MEMORY_BULK) : nullptr;
+    uint8_t* buffer = (uint8_t*)_allocator.allocate(max(_chunkSize, (size_t)OTA_SECTOR_MANIFEST_MAX_SIGNATURE),
+                                                    OTA_MEMORY_INTERNAL);
+    if ((unchanged != nullptr && map == nullptr) || (canCheckChunks(update) && digests == nullptr) ||
+        buffer == nullptr) {
+        _allocator.release(map);
+        _allocator.release(digests);
+        _allocator.release(buffer);
+        endRequest(consumed);
+        setError(OTA_ERROR_DOWNLOAD, "Memory allocation failed");
+        return false;
+    }
+    if (map != nullptr) {
+        memset(map, 0, mapSize);
+    }
+    
+    // Hash each sector of the running partition as its expected hash arrives
+    OTAVerifier manifestHash;
+    OTAVerifier sectorHash;
+    manifestHash.begin();
+    manifestHash.update(header, sizeof(header));
+    bool complete = true;
+    uint32_t hashStart = micros();
+    for (size_t sector = 0; sector < sectors; sector++) {
+        uint8_t expected[OTA_SHA256_SIZE];
+        size_t read = stream.readBytes(expected, sizeof(expected));
+        consumed += read;
+        if (read != sizeof(expected)) {
+            complete = false;
+            break;
+        }
+        manifestHash.update(expected, sizeof(expected));
+        if (digests != nullptr) {
+            memcpy(digests + sector * OTA_CHUNK_DIGEST_SIZE, expected, OTA_CHUNK_DIGEST_SIZE);
+        }
+        if (map == nullptr) {
+            continue;
+        }
+        
+        // Past the end of the running partition nothing can be reused
+        size_t start = sector * OTA_FLASH_SECTOR_SIZE;
+        size_t length = min((size_t)OTA_FLASH_SECTOR_SIZE, (size_t)update.binarySize - start);
+        bool readable = true;
+        sectorHash.begin();
+        for (size_t pos = 0; readable && pos < length; pos += _chunkSize) {
+            size_t len = min(_chunkSize, length - pos);
+            readable = readRunningImage(this, start + pos, buffer, len);
+            sectorHash.update(buffer, len);
+        }
+        if (readable && memcmp(sectorHash.finish(), expected, OTA_SHA256_SIZE) == 0) {
+            map[sector / 8] |= 1 << (sector % 8);
+        }
+    }
+    _hashMicros += micros() - hashStart;
+    
+    size_t signatureRead = complete ? stream.readBytes(buffer, signatureLen) : 0;
+    consumed += signatureRead;
+    _stats.bytesDownloaded += consumed;
+    endRequest(consumed);
+    
+    // The hashes are only trusted once the release key has signed them
+    bool signatureValid = true;
+    if (complete && signatureRead == signatureLen && _verifySignature) {
+        unsigned long started = millis();
+        signatureValid = signatureLen > 0 && verifySignature(manifestHash.finish(), buffer, signatureLen);
+        _stats.verifyMs += millis() - started;
+    }
+    _allocator.release(buffer);
+    
+    if (!complete || signatureRead != signatureLen || !signatureValid) {
+        _allocator.release(map);
+        _allocator.release(digests);
+        if (!signatureValid) {
+            setError(OTA_ERROR_VERIFICATION, "Sector manifest signature verification failed");
+        } else {
+            setError(OTA_ERROR_DOWNLOAD, "Sector manifest incomplete");
+        }
+        return false;
+    }
+    
+    if (unchanged != nullptr) {
+        *unchanged = map;
+    }
+    _chunkDigests = digests;
+    return true;
+}
+
+bool OTAClient::copyRunningImage(size_t start, size_t end) {
+    // Read straight into the flash writer's sector buffer
+    for (size_t offset = start; offset < end; ) {
+        size_t space;
+        uint8_t* dest = _flashWriter.getBuffer(&space);
+        if (dest == nullptr) {
+            setError(OTA_ERROR_INSTALLATION, "Update write failed: " + String(_flashWriter.errorString()));
+            return false;
+        }
+        
+        size_t len = min(space, end - offset);
+        if (!readRunningImage(this, offset, dest, len)) {
+            setError(OTA_ERROR_INSTALLATION, "Failed to read running image");
+            return false;
+        }
+        hashImage(dest, len);
+        
+        uint32_t writeStart = micros();
+        bool committed = _flashWriter.commitBuffer(len);
+        _flashMicros += micros() - writeStart;
+        if (!committed) {
+            setError(OTA_ERROR_INSTALLATION, "Update write failed: " + String(_flashWriter.errorString()));
+            return false;
+        }
+        offset += len;
+    }
+    
+    return true;
+}
+#endif
+
+bool OTAClient::streamFullFirmware(const FirmwareUpdate& update) {
+    size_t expectedSize = update.binarySize;
+    
+    // Continue an interrupted download of the same image if one was saved
+    size_t resumeOffset = loadResumeOffset(update);
+    if (resumeOffset > 0 && !_flashWriter.begin(expectedSize, resumeOffset)) {
+        clearResumeState();
+        resumeOffset = 0;
+    }
+    
+    if (resumeOffset == 0 && !_flashWriter.begin(expectedSize)) {
+        setError(OTA_ERROR_INSTALLATION, "Update begin failed: " + String(_flashWriter.errorString()));
+        return false;
+    }
+    
+    _verifier.begin();
+    _lastCheckpoint = resumeOffset;
+    
+    // The hash state is not persisted; rebuild it from the data already in flash
+    if (resumeOffset > 0 && !rehashWrittenImage(resumeOffset)) {
+        _flashWriter.abort();
+        clearResumeState();
+        setError(OTA_ERROR_INSTALLATION, "Failed to read back partial image");
+        return false;
+    }
+    
+    size_t offset = resumeOffset;
+    if (!downloadPayload(update, update.binaryURL, expectedSize, &offset, expectedSize, true)) {
+        if (_lastError == OTA_ERROR_NETWORK || _lastError == OTA_ERROR_PAUSED) {
+            // Keep the resume state so a later attempt continues from here
+            saveResumeState(update, _flashWriter.bytesCommitted());
+        } else {
+            // Unrecoverable: the partial image cannot be trusted any more
+            clearResumeState();
+        }
+        _flashWriter.abort();
+        return false;
+    }
+    
+    return true;
+}
+
+bool OTAClient::downloadPayload(const FirmwareUpdate& update, const String& url, size_t payloadSize, size_t* offset,
+                                size_t end, bool resumable) {
+    if (payloadSize == 0 || end > payloadSize) {
+        setError(OTA_ERROR_DOWNLOAD, "Invalid download size");
+        return false;
+    }
+    
+    // Raw images checked against the sector manifest are received a sector
+    // at a time into a staging buffer and written once the sector matches
+    bool checked = _chunkDigests != nullptr && !_inflateActive && !_deltaActive &&
+                   *offset % OTA_FLASH_SECTOR_SIZE == 0;
+    if (checked) {
+        _chunkStage = (uint8_t*)_allocator.allocate(OTA_FLASH_SECTOR_SIZE, OTA_MEMORY_INTERNAL);
+        if (_chunkStage == nullptr) {
+            setError(OTA_ERROR_DOWNLOAD, "Memory allocation failed");
+            return false;
+        }
+        _chunkStageStart = *offset;
+        _chunkStageLen = 0;
+    }
+    
+    // With pipelining, chunks are received into the pipeline's ring and
+    // written on the other core; it falls back to inline writes if the ring
+    // can't be allocated
+    bool pipelined = !checked && _pipelinedWrites && _pipeline.begin(_chunkSize, consumePipelined, this);
+    
+    // Raw images are read straight into the flash writer's sector buffer;
+    // anything decoded first, or a writer without one, needs a read buffer
+    size_t space;
+    if (!pipelined && !checked && (_inflateActive || _deltaActive || _flashWriter.getBuffer(&space) == nullptr)) {
+        _chunkBuffer = (uint8_t*)_allocator.allocate(_chunkSize, OTA_MEMORY_INTERNAL);
+        if (_chunkBuffer == nullptr) {
+            setError(OTA_ERROR_DOWNLOAD, "Memory allocation failed");
+            return false;
+        }
+    }
+    
+    // Progress reports need the connection between requests, so the payload is fetched in report-sized ranges
+    size_t reportStep = 0;
+    if (_reportPercent > 0 && _reportPercent < 100 && _connectionReuse) {
+        reportStep = max(payloadSize / 100 * _reportPercent, (size_t)OTA_MIN_REPORT_STEP);
+    }
+    
+    // Receive the payload, resuming with a Range request after each dropout
+    uint8_t attempts = 0;
+    bool failed = false;
+    bool paused = false;
+    size_t startOffset = *offset;
+    _lastProgress = 0;
+    _downloadStarted = millis();
+    _lastProgressReport = _downloadStarted;
+    
+    while (*offset < end && attempts <= _downloadRetries) {
+        if (attempts > 0) {
+            _stats.retries++;
+            delay(OTA_RETRY_DELAY_MS * attempts);
+        }
+        
+        // Ranges end on fixed step boundaries, so a resumed download keeps the same ones.
+        // Each range runs to the first boundary past what the link is expected to deliver
+        // before the next report is due, so rate-limited reports don't cost a round trip per step.
+        size_t rangeEnd = end;
+        if (reportStep > 0 && reportStep < end - *offset) {
+            unsigned long now = millis();
+            unsigned long elapsed = now - _downloadStarted;
+            unsigned long wait = _reportInterval - min(now - _lastProgressReport, _reportInterval);
+            size_t expected = (elapsed > 0) ? (size_t)((uint64_t)(*offset - startOffset) * wait / elapsed) : 0;
+            rangeEnd = min((*offset + expected) / reportStep * reportStep + reportStep, end);
+        }
+        
+        size_t before = *offset;
+        _chunkRejected = false;
+        if (!receivePayload(update, url, payloadSize, offset, rangeEnd, resumable)) {
+            failed = true;
+            break;
+        }
+        
+        // Only attempts that make no progress count against the retry budget
+        if (*offset > before) {
+            attempts = 0;
+            if (reportStep > 0 && *offset < payloadSize) {
+                reportDownloadProgress(update, *offset, payloadSize, *offset - startOffset);
+            }
+        }
+        
+        // In low-power mode the rest waits for the next wake
+        if (*offset < end && isSliceOver(resumable)) {
+            paused = true;
+            break;
+        }
+        
+        // A completed range goes straight on to the next one; anything else was a dropout
+        if (*offset == rangeEnd) {
+            continue;
+        }
+        attempts++;
+    }
+    
+    _allocator.release(_chunkBuffer);
+    _chunkBuffer = nullptr;
+    _allocator.release(_chunkStage);
+    _chunkStage = nullptr;
+    
+    // Everything received must be in flash before the result is checked
+    if (pipelined && !_pipeline.end() && !failed) {
+        failed = true;
+    }
+    _stats.downloadMs += millis() - _downloadStarted;
+    
+    if (failed) {
+        return false;
+    }
+    
+    if (paused) {
+        setError(OTA_ERROR_PAUSED, "Download paused at " + String((unsigned long)*offset) + " bytes");
+        return false;
+    }
+    
+    // A sector that kept failing its check is reported as such rather than as a dropout
+    if (*offset != end) {
+        if (!_chunkRejected) {
+            setError(OTA_ERROR_NETWORK, "Download interrupted at " + String((unsigned long)*offset) + " bytes");
+        }
+        return false;
+    }
+    
+    return true;
+}
+
+bool OTAClient::receivePayload(const FirmwareUpdate& update, const String& url, size_t payloadSize, size_t* offset,
+                               size_t end, bool resumable) {
+    bool ranged = (*offset > 0 || end < payloadSize);
+    unsigned long requested = millis();
+    int httpCode = sendRequest("GET", url, nullptr, *offset, (end < payloadSize) ? end : 0);
+    
+    // Time to first byte is that of the first request of the update that gets an answer
+    if (httpCode > 0 && _stats.bytesDownloaded == 0) {
+        _stats.firstByteMs = millis() - requested;
+    }
+    
+    // A server that ignores Range resends the whole payload from the start; a sector
+    // update can't use that, since the bytes past this run come from flash
+    size_t skip = 0;
+    if (httpCode == HTTP_CODE_OK && !_sectorActive) {
+        skip = *offset;
+        end = payloadSize;
+    } else if (httpCode != HTTP_CODE_PARTIAL_CONTENT || !ranged) {
+        endRequest();
+        setError(OTA_ERROR_DOWNLOAD, "Download failed: HTTP " + String(httpCode));
+        // Connection-level failures and server errors are worth retrying
+        return (httpCode < 0 || httpCode >= 500);
+    }
+    
+    // A chunked response reports -1; otherwise it must match what is left
+    int contentLength = _httpClient.getSize();
+    if (contentLength > 0 && (size_t)contentLength != end - *offset + skip) {
+        disconnect();
+        setError(OTA_ERROR_DOWNLOAD, "Downloaded size mismatch");
+        return false;
+    }
+    
+    // Stream data to the decoder or flash
+    WiFiClient* stream = _httpClient.getStreamPtr();
+    unsigned long lastData = millis();
+    
+    while (*offset < end && (_httpClient.connected() || stream->available()) && !isSliceOver(resumable)) {
+        size_t available = stream->available();
+        
+        if (!available) {
+            if (millis() - lastData > OTA_STREAM_TIMEOUT_MS) {
+                // Stalled connection: drop it and resume with a new request
+                break;
+            }
+            // Only sleep when there is nothing to read
+            yieldDownload(true);
+            continue;
+        }
+        
+        // Over the rate limit the data waits in the socket, and the TCP window slows the server down
+        available = _throttle.allowance(available);
+        if (available == 0) {
+            yieldDownload(true);
+            continue;
+        }
+        
+        // Read raw image data directly into the flash sector buffer
+        size_t space = _chunkSize;
+        uint8_t* dest = _chunkBuffer;
+        bool staged = (_chunkStage != nullptr);
+        bool direct = (dest == nullptr && !staged && !_pipeline.isRunning());
+        if (staged) {
+            // Checked sectors are collected whole before they are written
+            size_t sectorLen = min((size_t)OTA_FLASH_SECTOR_SIZE, payloadSize - _chunkStageStart);
+            dest = _chunkStage + _chunkStageLen;
+            space = min(sectorLen - _chunkStageLen, _chunkSize);
+        } else if (_pipeline.isRunning()) {
+            dest = _pipeline.acquire();
+            if (dest == nullptr) {
+                disconnect();
+                // A failed write has already been reported by the writer task
+                if (!_pipeline.failed()) {
+                    setError(OTA_ERROR_INSTALLATION, "Flash writer stalled");
+                }
+                return false;
+            }
+        } else if (direct) {
+            dest = _flashWriter.getBuffer(&space);
+            if (dest == nullptr) {
+                disconnect();
+                setError(OTA_ERROR_INSTALLATION, "Update write failed: " + String(_flashWriter.errorString()));
+                return false;
+            }
+            space = min(space, _chunkSize);
+        }
+        
+        // Bytes we already have, when the server ignored Range, are read and dropped
+        size_t toRead = min(min(available, space), (skip > 0) ? skip : end - *offset);
+        size_t bytesRead = stream->readBytes(dest, toRead);
+        lastData = millis();
+        _stats.bytesDownloaded += bytesRead;
+        _throttle.consume(bytesRead);
+        
+        if (skip > 0) {
+            skip -= bytesRead;
+            continue;
+        }
+        
+        if (bytesRead == 0) {
+            continue;
+        }
+        
+        bool consumed;
+        if (staged) {
+            consumed = commitChunk(bytesRead, payloadSize);
+        } else if (_pipeline.isRunning()) {
+            consumed = _pipeline.submit(bytesRead);
+        } else if (direct) {
+            hashImage(dest, bytesRead);
+            uint32_t writeStart = micros();
+            consumed = _flashWriter.commitBuffer(bytesRead);
+            _flashMicros += micros() - writeStart;
+            if (!consumed) {
+                setError(OTA_ERROR_INSTALLATION, "Update write failed: " + String(_flashWriter.errorString()));
+            }
+        } else {
+            consumed = consumePayload(dest, bytesRead);
+        }
+        
+        if (!consumed) {
+            disconnect();
+            // Only the sector that failed its check is fetched again
+            if (_chunkRejected) {
+                *offset = _chunkStageStart;
+                return true;
+            }
+            return false;
+        }
+        
+        *offset += bytesRead;
+        reportProgress(*offset, payloadSize);
+        sampleFreeHeap();
+        yieldDownload(false);
+        
+        // Periodically persist how much of the image is safely in flash
+        if (resumable && _flashWriter.bytesCommitted() >= _lastCheckpoint + OTA_RESUME_CHECKPOINT_INTERVAL) {
+            saveResumeState(update, _flashWriter.bytesCommitted());
+        }
+    }
+    
+    // Don't let a half-read response be reused for the next request
+    if (*offset == end) {
+        _httpClient.end();
+    } else {
+        disconnect();
+    }
+    
+    return true;
+}
+
+bool OTAClient::commitChunk(size_t size, size_t imageSize) {
+    _chunkStageLen += size;
+    size_t sectorLen = min((size_t)OTA_FLASH_SECTOR_SIZE, imageSize - _chunkStageStart);
+    if (_chunkStageLen < sectorLen) {
+        return true;
+    }
+    
+    size_t sector = _chunkStageStart / OTA_FLASH_SECTOR_SIZE;
+    OTAVerifier sectorHash;
+    uint32_t start = micros();
+    sectorHash.begin();
+    sectorHash.update(_chunkStage, sectorLen);
+    bool matches = memcmp(sectorHash.finish(), _chunkDigests + sector * OTA_CHUNK_DIGEST_SIZE, OTA_CHUNK_DIGEST_SIZE) == 0;
+    _hashMicros += micros() - start;
+    _chunkStageLen = 0;
+    
+    if (!matches) {
+        _chunkRejected = true;
+        _stats.chunksRejected++;
+        setError(OTA_ERROR_VERIFICATION, "Sector " + String((unsigned long)sector) + " failed verification");
+        return false;
+    }
+    
+    _chunkStageStart += sectorLen;
+    return writeImage(_chunkStage, sectorLen);
+}
+
+void OTAClient::reportDownloadProgress(const FirmwareUpdate& update, size_t received, size_t total,
+                                       size_t sessionBytes) {
+    unsigned long now = millis();
+    if (now - _lastProgressReport < _reportInterval) {
+        return;
+    }
+    _lastProgressReport = now;
+    
+    // Throughput covers this session only, so a resumed download isn't counted as instant
+    unsigned long elapsed = now - _downloadStarted;
+    uint32_t throughput = (elapsed > 0) ? (uint32_t)((uint64_t)sessionBytes * 1000 / elapsed) : 0;
+    
+    // Downloading spans 0-50% of the overall progress; installing starts at 50
+    int progress = (int)((uint64_t)received * 50 / total);
+    _statusQueue.add(update.releaseID.c_str(), OTA_STATUS_DOWNLOADING, progress, nullptr, received, total, throughput);
+    flushStatusReports();
+}
+
+void OTAClient::beginStats() {
+    memset(&_stats, 0, sizeof(_stats));
+    _hashMicros = 0;
+    _flashMicros = 0;
+    _updateStarted = millis();
+    _wifiClient.resetTimings();
+    sampleFreeHeap();
+}
+
+void OTAClient::finishStats() {
+    _stats.dnsMs = _wifiClient.lookupTime();
+    _stats.tlsMs = _wifiClient.handshakeTime();
+    _stats.hashMs = _hashMicros / 1000;
+    _stats.flashWriteMs = _flashMicros / 1000;
+    _stats.sectorsSkipped = _streamingUpdate ? _flashWriter.sectorsSkipped() : 0;
+    _stats.totalMs = millis() - _updateStarted;
+    _stats.throughput = (_stats.downloadMs > 0) ?
+        (uint32_t)((uint64_t)_stats.bytesDownloaded * 1000 / _stats.downloadMs) : 0;
+    sampleFreeHeap();
+}
+
+void OTAClient::sampleFreeHeap() {
+#if defined(ESP32)
+    uint32_t freeHeap = ESP.getFreeHeap();
+    if (_stats.minFreeHeap == 0 || freeHeap < _stats.minFreeHeap) {
+        _stats.minFreeHeap = freeHeap;
+    }
+#endif
+}
+
+void OTAClient::reportProgress(size_t current, size_t total) {
+    if (!_progressCallback) {
+        return;
+    }
+    
+    // Whichever of the byte and percentage steps is smaller applies
+    size_t step = _progressBytes;
+    if (_progressPercent > 0) {
+        size_t percentStep = total / 100 * _progressPercent;
+        step = (step > 0) ? min(step, percentStep) : percentStep;
+    }
+    
+    if (current >= total || current < _lastProgress || current - _lastProgress >= step) {
+        _lastProgress = current;
+        
+#if defined(ESP32)
+        if (_taskHandle != nullptr && xTaskGetCurrentTaskHandle() == _taskHandle) {
+            // Only the latest progress matters; poll() picks it up
+            portENTER_CRITICAL(&_taskLock);
+            _taskProgress = current;
+            _taskProgressTotal = total;
+            _taskProgressPending = true;
+            portEXIT_CRITICAL(&_taskLock);
+            return;
+        }
+#endif
+        
+        _progressCallback(current, total);
+    }
+}
+
+bool OTAClient::consumePayload(const uint8_t* data, size_t size) {
+#if OTA_ENABLE_COMPRESSION
+    if (!_inflateActive) {
+        return decodePayload(data, size);
+    }
+    
+    // The decompressor calls decodePayload() with its output
+    if (!_inflater.write(data, size)) {
+        // Errors further down the pipeline have already been reported
+        if (!_inflater.outputFailed()) {
+            setError(OTA_ERROR_DOWNLOAD, "Decompression failed: " + String(_inflater.errorString()));
+        }
+        return false;
+    }
+    
+    return true;
+#else
+    return decodePayload(data, size);
+#endif
+}
+
+bool OTAClient::decodePayload(const uint8_t* data, size_t size) {
+#if OTA_ENABLE_DELTA
+    if (!_deltaActive) {
+        return writeImage(data, size);
+    }
+    
+    // The decoder calls writeImage() with the rebuilt image
+    if (!_deltaDecoder.write(data, size)) {
+        if (!_deltaDecoder.outputFailed()) {
+            setError(OTA_ERROR_DOWNLOAD, "Delta patch failed: " + String(_deltaDecoder.errorString()));
+        }
+        return false;
+    }
+    
+    return true;
+#else
+    return writeImage(data, size);
+#endif
+}
+
+void OTAClient::hashImage(const uint8_t* data, size_t size) {
+    uint32_t start = micros();
+    _verifier.update(data, size);
+    _hashMicros += micros() - start;
+}
+
+bool OTAClient::writeImage(const uint8_t* data, size_t size) {
+    hashImage(data, size);
+    
+    uint32_t start = micros();
+    size_t written = _flashWriter.write(data, size);
+    _flashMicros += micros() - start;
+    if (written != size) {
+        setError(OTA_ERROR_INSTALLATION, "Update write failed: " + String(_flashWriter.errorString()));
+        return false;
+    }
+    
+    return true;
+}
+
+bool OTAClient::writeDeltaOutput(void* context, const uint8_t* data, size_t size) {
+    return static_cast<OTAClient*>(context)->writeImage(data, size);
+}
+
+bool OTAClient::writeInflatedOutput(void* context, const uint8_t* data, size_t size) {
+    return static_cast<OTAClient*>(context)->decodePayload(data, size);
+}
+
+bool OTAClient::consumePipelined(void* context, const uint8_t* data, size_t size) {
+    return static_cast<OTAClient*>(context)->consumePayload(data, size);
+}
+
+bool OTAClient::readRunningImage(void* context, size_t offset, uint8_t* data, size_t size) {
+#if defined(ESP32)
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    return running && esp_partition_read(running, offset, data, size) == ESP_OK;
+#else
+    return false;
+#endif
+}
+
+bool OTAClient::canApplyDelta(const FirmwareUpdate& update) const {
+#if defined(ESP32) && OTA_ENABLE_DELTA
+    return _deltaUpdates && update.deltaURL.length() > 0 && update.deltaSize > 0 &&
+           update.deltaBaseReleaseID.length() > 0 && update.deltaBaseReleaseID == _currentRelease &&
+           (update.compression.length() == 0 || canDecompress(update));
+#else
+    return false;
+#endif
+}
+
+bool OTAClient::canDecompress(const FirmwareUpdate& update) const {
+    return supportsCompression() && update.compression == OTA_COMPRESSION_ZLIB;
+}
+
+bool OTAClient::canReuseSectors(const FirmwareUpdate& update) const {
+    return supportsSectorReuse() && update.sectorManifestURL.length() > 0 && update.sectorManifestSize > 0;
+}
+
+bool OTAClient::supportsSectorReuse() const {
+#if defined(ESP32) && OTA_ENABLE_SECTOR_MANIFESTS
+    // Sectors are copied straight into the flash writer, which buffered updates don't use
+    return _sectorReuse && _streamingUpdate;
+#else
+    return false;
+#endif
+}
+
+bool OTAClient::canCheckChunks(const FirmwareUpdate& update) const {
+    return supportsChunkVerification() && update.sectorManifestURL.length() > 0 && update.sectorManifestSize > 0;
+}
+
+bool OTAClient::supportsChunkVerification() const {
+    // Sectors are checked before they are written, which pipelined writes hand to the other core
+    return OTA_ENABLE_SECTOR_MANIFESTS && _chunkVerification && _streamingUpdate && !_pipelinedWrites;
+}
+
+bool OTAClient::supportsCompression() const {
+#if defined(ESP32) && OTA_ENABLE_COMPRESSION
+    return _compressedDownloads;
+#else
+    return false;
+#endif
+}
+
+bool OTAClient::rehashWrittenImage(size_t length) {
+    uint8_t* buff = (uint8_t*)_allocator.allocate(_chunkSize, OTA_MEMORY_INTERNAL);
+    if (buff == nullptr) {
+        return false;
+    }
+    
+    bool success = true;
+    for (size_t pos = 0; pos < length; ) {
+        size_t len = min(_chunkSize, length - pos);
+        if (!_flashWriter.readBack(pos, buff, len)) {
+            success = false;
+            break;
+        }
+        hashImage(buff, len);
+        pos += len;
+    }
+    
+    _allocator.release(buff);
+    return success;
+}
+
+size_t OTAClient::loadResumeOffset(const FirmwareUpdate& update) {
+#if defined(ESP32)
+    if (!_resumableDownloads || !_flashWriter.supportsResume()) {
+        return 0;
+    }
+    
+    Preferences prefs;
+    if (!prefs.begin(OTA_PREFS_NAMESPACE, true)) {
+        return 0;
+    }
+    
+    // Only resume the exact same image
+    size_t offset = 0;
+    if (prefs.getString("release", "") == update.releaseID &&
+        prefs.getString("hash", "") == update.binaryHash &&
+        prefs.getUInt("size", 0) == (uint32_t)update.binarySize) {
+        offset = prefs.getUInt("offset", 0);
+    }
+    prefs.end();
+    
+    return (offset < (size_t)update.binarySize) ? offset : 0;
+#else
+    return 0;
+#endif
+}
+
+void OTAClient::saveResumeState(const FirmwareUpdate& update, size_t offset) {
+    _lastCheckpoint = offset;
+    
+#if defined(ESP32)
+    if (!_resumableDownloads || !_flashWriter.supportsResume() || offset == 0) {
+        return;
+    }
+    
+    Preferences prefs;
+    if (!prefs.begin(OTA_PREFS_NAMESPACE, false)) {
+        return;
+    }
+    
+    prefs.putString("release", update.releaseID);
+    prefs.putString("hash", update.binaryHash);
+    prefs.putUInt("size", (uint32_t)update.binarySize);
+    prefs.putUInt("offset", (uint32_t)offset);
+    prefs.end();
+#endif
+}
+
+bool OTAClient::isResumePending() const {
+    return (_lastError == OTA_ERROR_NETWORK || _lastError == OTA_ERROR_PAUSED) && _resumableDownloads &&
+           _flashWriter.supportsResume();
+}
+
+bool OTAClient::isSliceOver(bool resumable) const {
+    return resumable && _sliceTime > 0 && _resumableDownloads && _flashWriter.supportsResume() &&
+           _flashWriter.bytesCommitted() > _lastCheckpoint && millis() - _updateStarted >= _sliceTime;
+}
+
+void OTAClient::clearResumeState() {
+    _lastCheckpoint = 0;
+    
+#if defined(ESP32)
+    Preferences prefs;
+    if (prefs.begin(OTA_PREFS_NAMESPACE, false)) {
+        prefs.remove("release");
+        prefs.remove("hash");
+        prefs.remove("size");
+        prefs.remove("offset");
+        prefs.end();
+    }
+#endif
+}
+
+void OTAClient::loadCurrentRelease() {
+#if defined(ESP32)
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (!running) {
+        return;
+    }
+    
+    Preferences prefs;
+    if (!prefs.begin(OTA_PREFS_NAMESPACE, true)) {
+        return;
+    }
+    
+    // After a rollback the running partition no longer holds the recorded release
+    if (prefs.getString("installed_part", "") == running->label) {
+        _currentRelease = prefs.getString("installed", "");
+    }
+    prefs.end();
+#endif
+}
+
+#if defined(ESP32)
+static void validationTimerExpired(void*) {
+    // Never marked valid: the bootloader boots the previous firmware, which reports the failure
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+#endif
+
+void OTAClient::reportInstalled(const String& releaseID) {
+    if (_validationTimeout == 0) {
+        reportStatus(releaseID, OTA_STATUS_COMPLETED, 100);
+        return;
+    }
+    
+#if defined(ESP32)
+    Preferences prefs;
+    if (prefs.begin(OTA_PREFS_NAMESPACE, false)) {
+        prefs.putString("verify_release", releaseID);
+        prefs.end();
+    }
+#endif
+    
+    // The new firmware reports completed once it passes validation. Installing at 100% isn't
+    // offered again, so the server doesn't send the update while it is on trial.
+    reportStatus(releaseID, OTA_STATUS_INSTALLING, 100);
+    flushStatusReports();
+}
+
+void OTAClient::loadValidationState() {
+#if defined(ESP32)
+    if (_validationPending) {
+        return;
+    }
+    
+    Preferences prefs;
+    if (!prefs.begin(OTA_PREFS_NAMESPACE, true)) {
+        return;
+    }
+    String releaseID = prefs.getString("verify_release", "");
+    String partition = prefs.getString("installed_part", "");
+    String components = prefs.getString("components", "");
+    prefs.end();
+    
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (releaseID.length() == 0 || !running) {
+        return;
+    }
+    
+    if (partition == running->label) {
+        esp_ota_img_states_t state;
+        if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+            _validationPending = true;
+            _validationRelease = releaseID;
+            
+            if (_validationTimeout > 0 && !_validationTimer) {
+                esp_timer_create_args_t args = {};
+                args.callback = validationTimerExpired;
+                args.name = "ota_rollback";
+                esp_timer_create(&args, &_validationTimer);
+            }
+            if (_validationTimer) {
+                esp_timer_start_once(_validationTimer, (uint64_t)_validationTimeout * 1000);
+            }
+            return;
+        }
+        
+        // Already valid: the bootloader doesn't roll back, or the core marked it before setup()
+        _statusQueue.add(releaseID.c_str(), OTA_STATUS_COMPLETED, 100, nullptr);
+    } else {
+        // Installed, but the device hasn't restarted into it yet
+        const esp_partition_t* boot = esp_ota_get_boot_partition();
+        if (boot && partition == boot->label) {
+            return;
+        }
+        
+        // Crashed, reset or timed out before it was marked valid. The bootloader only switches the
+        // application back, so components the update wrote stay at its release.
+        const char* message = OTA_ROLLBACK_MESSAGE;
+        if (components == releaseID) {
+            message = OTA_ROLLBACK_MESSAGE OTA_COMPONENTS_KEPT_NOTE;
+        }
+        _statusQueue.add(releaseID.c_str(), OTA_STATUS_FAILED, 100, message);
+    }
+    
+    // Sent with the next check, once the network is up
+    _statusQueue.save(OTA_PREFS_NAMESPACE);
+    clearValidationState();
+#endif
+}
+
+void OTAClient::clearValidationState() {
+#if defined(ESP32)
+    Preferences prefs;
+    if (prefs.begin(OTA_PREFS_NAMESPACE, false)) {
+        prefs.remove("verify_release");
+        prefs.end();
+    }
+#endif
+}
+
+void OTAClient::saveInstalledRelease(const String& releaseID) {
+#if defined(ESP32)
+    const esp_partition_t* boot = esp_ota_get_boot_partition();
+    if (!boot) {
+        return;
+    }
+    
+    Preferences prefs;
+    if (!prefs.begin(OTA_PREFS_NAMESPACE, false)) {
+        return;
+    }
+    
+    prefs.putString("installed", releaseID);
+    prefs.putString("installed_part", boot->label);
+    prefs.end();
+#endif
+}
+
+#if OTA_ENABLE_BUNDLES
+void OTAClient::loadComponentsRelease() {
+#if defined(ESP32)
+    Preferences prefs;
+    if (prefs.begin(OTA_PREFS_NAMESPACE, true)) {
+        _componentsRelease = prefs.getString("components", "");
+        prefs.end();
+    }
+#endif
+}
+
+void OTAClient::saveComponentsRelease(const String& releaseID) {
+    _componentsRelease = releaseID;
+    
+#if defined(ESP32)
+    Preferences prefs;
+    if (!prefs.begin(OTA_PREFS_NAMESPACE, false)) {
+        return;
+    }
+    if (releaseID.length() > 0) {
+        prefs.putString("components", releaseID);
+    } else {
+        prefs.remove("components");
+    }
+    prefs.end();
+#endif
+}
+#endif
+
+bool OTAClient::finalizeStreamedFirmware(const FirmwareUpdate& update) {
+    // The image is complete; a partial download can no longer be resumed
+    clearResumeState();
+    
+    // Verify before the image is allowed to become bootable
+    if (!verifyImage(update)) {
+        _flashWriter.abort();
+        return false;
+    }
+    
+#if OTA_ENABLE_BUNDLES && defined(ESP32)
+    // Components go in while the verified image waits to be selected for boot
+    if (!installComponents(update)) {
+        _flashWriter.abort();
+        return false;
+    }
+#endif
+    
+    unsigned long started = millis();
+    bool finalized = _flashWriter.end();
+    _stats.finalizeMs = millis() - started;
+    if (!finalized) {
+        setError(OTA_ERROR_INSTALLATION, "Update end failed: " + String(_flashWriter.errorString()));
+        noteComponentsKept();
+        return false;
+    }
+    
+#if OTA_ENABLE_BUNDLES && !defined(ESP32)
+    // The core's one Update session is needed for the data partitions too, so here they follow the image
+    if (!installComponents(update)) {
+        return false;
+    }
+#endif
+    
+    saveInstalledRelease(update.releaseID);
+    
+    return true;
+}
+
+void OTAClient::noteComponentsKept() {
+#if OTA_ENABLE_BUNDLES
+    if (_stats.componentsInstalled > 0) {
+        _lastErrorMessage += OTA_COMPONENTS_KEPT_NOTE;
+    }
+#endif
+}
+
+bool OTAClient::verifyImage(const FirmwareUpdate& update) {
+    return verifyDigest(update.binaryHash, update.signature);
+}
+
+bool OTAClient::verifyDigest(const String& expectedHash, const String& signature) {
+    // Single digest shared by the hash comparison and the signature check
+    const uint8_t* hash = _verifier.finish();
+    
+    // Verify hash
+    if (!_verifier.matchesHash(expectedHash)) {
+        setError(OTA_ERROR_VERIFICATION, "Hash verification failed");
+        return false;
+    }
+    
+    // Verify signature if enabled
+    if (_verifySignature && signature.length() > 0) {
+        unsigned long started = millis();
+        bool verified = verifySignature(hash, signature);
+        _stats.verifyMs += millis() - started;
+        if (!verified) {
+            setError(OTA_ERROR_VERIFICATION, "Signature verification failed");
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+#if OTA_ENABLE_BUNDLES
+bool OTAClient::installComponents(const FirmwareUpdate& update) {
+    for (uint8_t i = 0; i < update.componentCount; i++) {
+        const FirmwareComponent& component = update.components[i];
+        
+        // Left alone if an earlier attempt, or an earlier release, already wrote it
+        if (isComponentInstalled(component)) {
+            _stats.componentsSkipped++;
+            continue;
+        }
+        
+        bool written = false;
+        if (!installComponent(component, &written)) {
+            String error = "Component " + component.name + ": " + _lastErrorMessage;
+            if (written) {
+                error += ", partition left incomplete";
+            } else if (_stats.componentsInstalled > 0) {
+                error += OTA_COMPONENTS_KEPT_NOTE;
+            }
+            setError(_lastError, error);
+            return false;
+        }
+        
+        _stats.componentsInstalled++;
+    }
+    
+    // Kept through a rollback, so the previous firmware can tell its data partitions were changed
+    if (_stats.componentsInstalled > 0) {
+        saveComponentsRelease(update.releaseID);
+    }
+    
+    return true;
+}
+
+bool OTAClient::installComponent(const FirmwareComponent& component, bool* written) {
+    // Data partitions are written in place, so nothing reaches one before its image checks out.
+    // A streaming update keeps its heap small, so it only stages small images such as configuration.
+    uint8_t* image = nullptr;
+    if (!_streamingUpdate || component.size <= OTA_MAX_STAGED_COMPONENT) {
+        image = (uint8_t*)_allocator.allocate((size_t)component.size, OTA_MEMORY_BULK);
+    }
+    bool verified = false;
+    if (image != nullptr) {
+        // The local cache is trusted no more than any host on the LAN, so only a staged image comes from it
+        if (_localCache.length() > 0) {
+            size_t before = _stats.bytesDownloaded;
+            if (fetchComponent(localCacheURL(component.url, component.hash), component, image, nullptr)) {
+                _verifier.finish();
+                verified = _verifier.matchesHash(component.hash);
+            }
+            _stats.bytesFromCache += _stats.bytesDownloaded - before;
+        }
+        if (!verified) {
+            verified = fetchComponent(component.url, component, image, nullptr);
+        }
+    } else {
+        // Too large to stage: checked in a download that writes nothing, then downloaded again below
+        verified = fetchComponent(component.url, component, nullptr, nullptr);
+    }
+    verified = verified && verifyDigest(component.hash, component.signature);
+    if (!verified) {
+        _allocator.release(image);
+        return false;
+    }
+    
+    // A second writer, as the application image's session is kept open until the components are in
+    OTAFlashWriter writer;
+    writer.setAllocator(_allocator);
+    const char* label = (component.partition.length() > 0) ? component.partition.c_str() : nullptr;
+    if (!writer.beginData(component.size, label)) {
+        _allocator.release(image);
+        setError(OTA_ERROR_INSTALLATION, "Partition unavailable: " + String(writer.errorString()));
+        return false;
+    }
+    *written = true;
+    
+    // The partitions no longer hold any one release's components until the bundle is in
+    if (_componentsRelease.length() > 0) {
+        saveComponentsRelease(String());
+    }
+    
+    bool stored;
+    if (image != nullptr) {
+        uint32_t start = micros();
+        stored = writer.write(image, component.size) == (size_t)component.size;
+        _flashMicros += micros() - start;
+        if (!stored) {
+            setError(OTA_ERROR_INSTALLATION, "Partition write failed: " + String(writer.errorString()));
+        }
+        _allocator.release(image);
+    } else {
+        // The second download is checked too: the connection can drop, or the bytes differ from the first
+        stored = fetchComponent(component.url, component, nullptr, &writer) &&
+                 verifyDigest(component.hash, component.signature);
+    }
+    if (!stored) {
+        writer.abort();
+        return false;
+    }
+    
+    if (!writer.end()) {
+        setError(OTA_ERROR_INSTALLATION, "Partition write failed: " + String(writer.errorString()));
+        return false;
+    }
+    
+    return true;
+}
+
+bool OTAClient::fetchComponent(const String& url, const FirmwareComponent& component, uint8_t* image,
+                               OTAFlashWriter* writer) {
+    // Without a staging buffer each chunk is read into a scratch buffer, hashed and then dropped or written
+    uint8_t* chunk = nullptr;
+    if (image == nullptr) {
+        chunk = (uint8_t*)_allocator.allocate(_chunkSize, OTA_MEMORY_INTERNAL);
+        if (chunk == nullptr) {
+            setError(OTA_ERROR_DOWNLOAD, "Memory allocation failed");
+            return false;
+        }
+    }
+    
+    unsigned long started = millis();
+    size_t size = (size_t)component.size;
+    size_t received = 0;
+    bool stored = true;
+    bool failed = false;
+    uint8_t attempts = 0;
+    _verifier.begin();
+    _lastProgress = 0;
+    
+    while (received < size && attempts <= _downloadRetries) {
+        if (attempts > 0) {
+            _stats.retries++;
+            delay(OTA_RETRY_DELAY_MS * attempts);
+        }
+        
+        // A dropped download goes on where it stopped, so every byte is hashed and written once
+        int httpCode = sendRequest("GET", url, nullptr, received);
+        int expected = (received > 0) ? HTTP_CODE_PARTIAL_CONTENT : HTTP_CODE_OK;
+        if (httpCode != expected) {
+            endRequest();
+            setError(OTA_ERROR_DOWNLOAD, "Download failed: HTTP " + String(httpCode));
+            // Connection-level failures and server errors are worth retrying
+            if (httpCode >= 0 && httpCode < 500) {
+                failed = true;
+                break;
+            }
+            attempts++;
+            continue;
+        }
+        if (_httpClient.getSize() != (int)(size - received)) {
+            disconnect();
+            setError(OTA_ERROR_DOWNLOAD, "Downloaded size mismatch");
+            failed = true;
+            break;
+        }
+        
+        WiFiClient* stream = _httpClient.getStreamPtr();
+        size_t before = received;
+        unsigned long lastData = millis();
+        
+        while (stored && received < size && (_httpClient.connected() || stream->available())) {
+            size_t available = stream->available();
+            size_t allowed = _throttle.allowance(available);
+            
+            if (allowed) {
+                uint8_t* dest = (image != nullptr) ? image + received : chunk;
+                size_t bytesRead = stream->readBytes(dest, min(min(allowed, _chunkSize), size - received));
+                hashImage(dest, bytesRead);
+                if (writer != nullptr) {
+                    uint32_t start = micros();
+                    stored = writer->write(dest, bytesRead) == bytesRead;
+                    _flashMicros += micros() - start;
+                }
+                received += bytesRead;
+                _stats.bytesDownloaded += bytesRead;
+                _throttle.consume(bytesRead);
+                lastData = millis();
+                
+                reportProgress(received, size);
+                yieldDownload(false);
+            } else if (available == 0 && millis() - lastData > OTA_STREAM_TIMEOUT_MS) {
+                break;
+            } else {
+                yieldDownload(true);
+            }
+        }
+        
+        // Don't let a half-read response be reused for the next request
+        if (received == size) {
+            endRequest(size - before);
+        } else {
+            disconnect();
+        }
+        
+        if (!stored) {
+            setError(OTA_ERROR_INSTALLATION, "Partition write failed: " + String(writer->errorString()));
+            failed = true;
+            break;
+        }
+        
+        // Only attempts that make no progress count against the retry budget
+        if (received > before) {
+            attempts = 0;
+        }
+        if (received < size) {
+            setError(OTA_ERROR_NETWORK, "Download interrupted at " + String((unsigned long)received) + " bytes");
+            attempts++;
+        }
+    }
+    
+    _stats.downloadMs += millis() - started;
+    sampleFreeHeap();
+    _allocator.release(chunk);
+    
+    return !failed && received == size;
+}
+
+bool OTAClient::isComponentInstalled(const FirmwareComponent& component) {
+#if defined(ESP32)
+    const char* label = (component.partition.length() > 0) ? component.partition.c_str() : nullptr;
+    const esp_partition_t* partition = OTAFlashWriter::findDataPartition(label);
+    if (partition == nullptr || (uint64_t)component.size > partition->size) {
+        return false;
+    }
+    
+    uint8_t* buffer = (uint8_t*)_allocator.allocate(OTA_FLASH_SECTOR_SIZE, OTA_MEMORY_INTERNAL);
+    if (buffer == nullptr) {
+        return false;
+    }
+    
+    // Reading and hashing the partition is far quicker than downloading and rewriting it
+    uint32_t started = micros();
+    bool read = true;
+    _verifier.begin();
+    for (size_t offset = 0; read && offset < (size_t)component.size; offset += OTA_FLASH_SECTOR_SIZE) {
+        size_t length = min((size_t)OTA_FLASH_SECTOR_SIZE, (size_t)component.size - offset);
+        read = esp_partition_read(partition, offset, buffer, length) == ESP_OK;
+        if (read) {
+            _verifier.update(buffer, length);
+        }
+    }
+    _verifier.finish();
+    _hashMicros += micros() - started;
+    _allocator.release(buffer);
+    
+    return read && _verifier.matchesHash(component.hash);
+#else
+    return false;
+#endif
+}
+#endif
+
+bool OTAClient::verifySignature(const uint8_t* hash, const String& signature) {
+    if (!_signingKeyLoaded) {
+        return false;
+    }
+    
+    // Decode base64 signature
+    uint8_t sigBytes[512];
+    size_t sigLen = base64Decode(signature, sigBytes, sizeof(sigBytes));
+    
+    return verifySignature(hash, sigBytes, sigLen);
+}
+
+bool OTAClient::verifySignature(const uint8_t* hash, const uint8_t* signature, size_t length) {
+    if (!_signingKeyLoaded || length == 0) {
+        return false;
+    }
+    
+    int ret;
+    if (mbedtls_pk_can_do(&_signingKey, MBEDTLS_PK_RSA)) {
+        // The OTA service signs with RSA-PSS and the longest salt that fits
+        mbedtls_pk_rsassa_pss_options options;
+        options.mgf1_hash_id = MBEDTLS_MD_SHA256;
+        options.expected_salt_len = MBEDTLS_RSA_SALT_LEN_ANY;
+        ret = mbedtls_pk_verify_ext(MBEDTLS_PK_RSASSA_PSS, &options, &_signingKey, MBEDTLS_MD_SHA256, hash,
+                                    OTA_SHA256_SIZE, signature, length);
+    } else {
+        // ECDSA signatures are ASN.1 DER encoded
+        ret = mbedtls_pk_verify(&_signingKey, MBEDTLS_MD_SHA256, hash, OTA_SHA256_SIZE, signature, length);
+    }
+    
+    return (ret == 0);
+}
+
+bool OTAClient::setPublicKey(const uint8_t* key, size_t length) {
+    _publicKey = String();
+    return loadSigningKey(key, length);
+}
+
+bool OTAClient::loadSigningKey(const uint8_t* key, size_t length) {
+    mbedtls_pk_free(&_signingKey);
+    mbedtls_pk_init(&_signingKey);
+    _signingKeyLoaded = false;
+    
+    if (mbedtls_pk_parse_public_key(&_signingKey, key, length) != 0) {
+        return false;
+    }
+    if (!mbedtls_pk_can_do(&_signingKey, MBEDTLS_PK_RSA) && !mbedtls_pk_can_do(&_signingKey, MBEDTLS_PK_ECDSA)) {
+        mbedtls_pk_free(&_signingKey);
+        mbedtls_pk_init(&_signingKey);
+        return false;
+    }
+    
+    _signingKeyLoaded = true;
+    return true;
+}
+
+bool OTAClient::installFirmware(const uint8_t* data, size_t size) {
+    if (!Update.begin(size)) {
+        setError(OTA_ERROR_INSTALLATION, "Update begin failed: " + String(Update.errorString()));
+        return false;
+    }
+    
+    uint32_t writeStart = micros();
+    size_t written = Update.write(const_cast<uint8_t*>(data), size);
+    _flashMicros += micros() - writeStart;
+    if (written != size) {
+        Update.abort();
+        setError(OTA_ERROR_INSTALLATION, "Update write failed: " + String(Update.errorString()));
+        return false;
+    }
+    
+    unsigned long started = millis();
+    bool finalized = Update.end();
+    _stats.finalizeMs = millis() - started;
+    if (!finalized) {
+        setError(OTA_ERROR_INSTALLATION, "Update end failed: " + String(Update.errorString()));
+        return false;
+    }
+    
+    if (!Update.isFinished()) {
+        setError(OTA_ERROR_INSTALLATION, "Update not finished");
+        return false;
+    }
+    
+    return true;
 }
 
 void OTAClient::setError(int errorCode, const String& errorMessage) {
@@ -341,15 +3108,6 @@ void OTAClient::setError(int errorCode, const String& errorMessage) {
     _lastErrorMessage = errorMessage;
 }
 
-void OTAClient::computeSHA256(const uint8_t* data, size_t size, uint8_t* output) {
-    mbedtls_sha256_context ctx;
-    mbedtls_sha256_init(&ctx);
-    mbedtls_sha256_starts(&ctx, 0); // 0 = SHA-256 (not SHA-224)
-    mbedtls_sha256_update(&ctx, data, size);
-    mbedtls_sha256_finish(&ctx, output);
-    mbedtls_sha256_free(&ctx);
-}
-
 size_t OTAClient::hexToBytes(const String& hex, uint8_t* bytes, size_t maxLen) {
     size_t len = hex.length() / 2;
     if (len > maxLen) {
@@ -357,7 +3115,7 @@ size_t OTAClient::hexToBytes(const String& hex, uint8_t* bytes, size_t maxLen) {
     }
     
     for (size_t i = 0; i < len; i++) {
-        sscanf(hex.substring(i * 2, i * 2 + 2).c_str(), "%02x", &bytes[i]);
+        sscanf(hex.substring(i * 2, i * 2 + 2).c_str(), "%2hhx", &bytes[i]);
     }
     
     return len;
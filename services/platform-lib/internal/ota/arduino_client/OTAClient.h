@@ -5,8 +5,24 @@
 #include <WiFiClientSecure.h>
 #include <HTTPClient.h>
 #include <Update.h>
-#include <mbedtls/sha256.h>
 #include <mbedtls/pk.h>
+#include <ArduinoJson.h>
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <esp_timer.h>
+#endif
+#include "OTAAllocator.h"
+#include "OTAVerifier.h"
+#include "OTAFlashWriter.h"
+#include "OTADeltaDecoder.h"
+#include "OTAInflater.h"
+#include "OTATLSClient.h"
+#include "OTAPipeline.h"
+#include "OTAStatusQueue.h"
+#include "OTAStats.h"
+#include "OTAThrottle.h"
 
 // Update status constants
 #define OTA_STATUS_PENDING "pending"
@@ -23,6 +39,180 @@
 #define OTA_ERROR_VERIFICATION 4
 #define OTA_ERROR_INSTALLATION 5
 #define OTA_ERROR_INVALID_RESPONSE 6
+#define OTA_ERROR_PAUSED 7
+
+// Optional features. Build with -DOTA_ENABLE_<feature>=0 to leave one out of the binary; its
+// setters stay so sketches build either way, and the client no longer asks the server for it.
+#ifndef OTA_ENABLE_DELTA
+#define OTA_ENABLE_DELTA 1              // Delta patches (setDeltaUpdates())
+#endif
+#ifndef OTA_ENABLE_COMPRESSION
+#define OTA_ENABLE_COMPRESSION 1        // zlib-compressed payloads (setCompressedDownloads())
+#endif
+#ifndef OTA_ENABLE_SECTOR_MANIFESTS
+#define OTA_ENABLE_SECTOR_MANIFESTS 1   // Sector reuse and checks (setSectorReuse(), setChunkVerification())
+#endif
+#ifndef OTA_ENABLE_LOCAL_CACHE
+#define OTA_ENABLE_LOCAL_CACHE 1        // LAN cache and its mDNS discovery (setLocalCache())
+#endif
+#ifndef OTA_ENABLE_BUNDLES
+#define OTA_ENABLE_BUNDLES 1            // Filesystem and data components; bundles are rejected without it
+#endif
+
+// Download read size; raw images are read straight into the flash sector buffer
+#ifndef OTA_DEFAULT_CHUNK_SIZE
+#define OTA_DEFAULT_CHUNK_SIZE OTA_FLASH_SECTOR_SIZE
+#endif
+#define OTA_MIN_CHUNK_SIZE 256
+#define OTA_MAX_CHUNK_SIZE (4 * OTA_FLASH_SECTOR_SIZE)
+
+// Default progress callback granularity
+#define OTA_DEFAULT_PROGRESS_PERCENT 1
+
+// Default server progress reporting during downloads
+#define OTA_DEFAULT_REPORT_PERCENT 10
+#define OTA_DEFAULT_REPORT_INTERVAL_MS 5000
+// A ranged request per report step only pays off above this size
+#define OTA_MIN_REPORT_STEP (32 * 1024)
+
+// Resumable download configuration
+#define OTA_DEFAULT_DOWNLOAD_RETRIES 3
+#define OTA_RETRY_DELAY_MS 2000
+#define OTA_STREAM_TIMEOUT_MS 10000
+#define OTA_RESUME_CHECKPOINT_INTERVAL (64 * 1024)
+
+// Parallel buffered downloads: most connections at once, and the smallest range worth its own connection
+#ifndef OTA_MAX_PARALLEL_DOWNLOADS
+#define OTA_MAX_PARALLEL_DOWNLOADS 4
+#endif
+#define OTA_MIN_PARALLEL_RANGE (64 * 1024)
+
+// Download rate limit (see setDownloadRateLimit()): default burst, and how often a download that never
+// waits still calls the yield callback
+#ifndef OTA_DEFAULT_RATE_BURST
+#define OTA_DEFAULT_RATE_BURST (4 * OTA_FLASH_SECTOR_SIZE)
+#endif
+#ifndef OTA_YIELD_INTERVAL_MS
+#define OTA_YIELD_INTERVAL_MS 10
+#endif
+
+// Sector manifests: signed per-sector hashes of a release image, so unchanged sectors are copied from the
+// running partition and downloaded ones are checked before they are written
+#define OTA_SECTOR_MANIFEST_MAGIC "ATSM"
+#define OTA_SECTOR_MANIFEST_VERSION 2
+#define OTA_SECTOR_MANIFEST_HEADER_SIZE 16
+#define OTA_SECTOR_MANIFEST_MAX_SIGNATURE 512
+// Bytes of each sector hash kept for checking downloaded sectors; the full image hash is still checked at the end
+#ifndef OTA_CHUNK_DIGEST_SIZE
+#define OTA_CHUNK_DIGEST_SIZE 8
+#endif
+// Shorter unchanged runs are downloaded anyway: a Range request per run costs a round trip
+#ifndef OTA_MIN_REUSED_RUN
+#define OTA_MIN_REUSED_RUN (2 * OTA_FLASH_SECTOR_SIZE)
+#endif
+
+// Local cache (see setLocalCache()): its fetch route, and the DNS-SD service discoverLocalCache() looks for
+#define OTA_LOCAL_CACHE_PATH "/ota-cache/v1/fetch"
+#define OTA_LOCAL_CACHE_SERVICE "_athena-ota"
+#define OTA_LOCAL_CACHE_PROTO "_tcp"
+#ifndef OTA_LOCAL_CACHE_DISCOVERY_MS
+#define OTA_LOCAL_CACHE_DISCOVERY_MS 2000
+#endif
+
+// Background update task (ESP32); core 0 leaves loop() on core 1 untouched
+#ifndef OTA_TASK_STACK_SIZE
+#define OTA_TASK_STACK_SIZE 8192
+#endif
+#ifndef OTA_TASK_PRIORITY
+#define OTA_TASK_PRIORITY 1
+#endif
+#ifndef OTA_TASK_CORE
+#define OTA_TASK_CORE 0
+#endif
+#define OTA_TASK_EVENT_QUEUE_SIZE 8
+
+// Background update states returned by poll()
+#define OTA_TASK_IDLE 0
+#define OTA_TASK_RUNNING 1
+#define OTA_TASK_SUCCEEDED 2
+#define OTA_TASK_FAILED 3
+
+// Component images a release bundle can carry besides the application (see FirmwareComponent)
+#ifndef OTA_MAX_COMPONENTS
+#define OTA_MAX_COMPONENTS 4
+#endif
+#define OTA_COMPONENT_FILESYSTEM "filesystem"
+#define OTA_COMPONENT_DATA "data"
+
+// Largest component a streaming update stages in memory to check it before its partition is written;
+// a buffered update stages any that fits
+#ifndef OTA_MAX_STAGED_COMPONENT
+#define OTA_MAX_STAGED_COMPONENT 8192
+#endif
+
+// Added to the error of an update that failed after its components were written
+#define OTA_COMPONENTS_KEPT_NOTE "; data partitions keep the new components"
+
+// Room one bundle component takes in the update response document: its URL, hash and an RSA signature
+#ifndef OTA_JSON_COMPONENT_SIZE
+#define OTA_JSON_COMPONENT_SIZE 1024
+#endif
+
+// JSON document for update check responses and status reports, reused for every request;
+// sized for a response that carries OTA_MAX_COMPONENTS components
+#ifndef OTA_JSON_DOC_SIZE
+#if OTA_ENABLE_BUNDLES
+#define OTA_JSON_DOC_SIZE (2048 + OTA_MAX_COMPONENTS * OTA_JSON_COMPONENT_SIZE)
+#else
+#define OTA_JSON_DOC_SIZE 2048
+#endif
+#endif
+
+// Largest serialized status report request (a batch of OTA_STATUS_QUEUE_SIZE reports); built on the stack
+#ifndef OTA_STATUS_PAYLOAD_SIZE
+#define OTA_STATUS_PAYLOAD_SIZE 1024
+#endif
+
+// Topic the server publishes update notices on: OTA_NOTICE_TOPIC_PREFIX + device ID + OTA_NOTICE_TOPIC_SUFFIX
+#define OTA_NOTICE_TOPIC_PREFIX "ota/"
+#define OTA_NOTICE_TOPIC_SUFFIX "/update"
+
+// Poll scheduler defaults (see setPollPolicy())
+#ifndef OTA_DEFAULT_POLL_INTERVAL_MS
+#define OTA_DEFAULT_POLL_INTERVAL_MS (60UL * 60 * 1000)
+#endif
+#ifndef OTA_DEFAULT_POLL_JITTER_MS
+#define OTA_DEFAULT_POLL_JITTER_MS (10UL * 60 * 1000)
+#endif
+#ifndef OTA_DEFAULT_POLL_MAX_BACKOFF_MS
+#define OTA_DEFAULT_POLL_MAX_BACKOFF_MS (12UL * 60 * 60 * 1000)
+#endif
+
+// Low-power mode (see setLowPowerMode()): wait before the next slice of a paused download, and the
+// longest update check ETag kept in RTC memory across deep sleep
+#ifndef OTA_DEFAULT_SLICE_INTERVAL_MS
+#define OTA_DEFAULT_SLICE_INTERVAL_MS (60UL * 1000)
+#endif
+#define OTA_SLEEP_ETAG_SIZE 64
+
+// Rollback message reported for an update the device didn't keep (see setValidationTimeout())
+#define OTA_ROLLBACK_MESSAGE "Rolled back to the previous firmware"
+
+// NVS namespace for download progress and the installed release
+#define OTA_PREFS_NAMESPACE "athena_ota"
+
+/**
+ * @brief An image shipped with a release besides the application, for one of the data partitions
+ */
+struct FirmwareComponent {
+    String name;
+    String type;               // OTA_COMPONENT_FILESYSTEM or OTA_COMPONENT_DATA
+    String partition;          // Label of the target partition (empty: the filesystem partition)
+    String url;
+    String hash;
+    int64_t size;
+    String signature;
+};
 
 /**
  * @brief Structure to hold firmware update information
@@ -35,6 +225,16 @@ struct FirmwareUpdate {
     int64_t binarySize;
     String signature;
     String releaseNotes;
+    String deltaURL;           // Patch from the running release (empty if none offered)
+    int64_t deltaSize;
+    String deltaBaseReleaseID; // Release the patch applies to
+    String compression;        // Encoding of compressedURL and deltaURL (empty if raw)
+    String compressedURL;      // Compressed copy of the image (empty if none offered)
+    int64_t compressedSize;
+    String sectorManifestURL;  // Signed per-sector hashes of the raw image (empty if none offered)
+    int64_t sectorManifestSize;
+    FirmwareComponent components[OTA_MAX_COMPONENTS]; // Installed once the application image is verified
+    uint8_t componentCount;
 };
 
 /**
@@ -51,6 +251,11 @@ typedef void (*ProgressCallback)(size_t current, size_t total);
  */
 typedef void (*StatusCallback)(const char* status, int progress);
 
+/**
+ * @brief Callback function type for giving the sketch a turn during downloads
+ */
+typedef void (*YieldCallback)();
+
 /**
  * @brief OTA Client for Arduino devices
  * 
@@ -65,7 +270,8 @@ public:
      * 
      * @param serverURL Base URL of the OTA service (e.g., "https://athena.example.com")
      * @param deviceID Unique device identifier
-     * @param publicKey PEM-encoded public key for signature verification
+     * @param publicKey PEM-encoded RSA or ECDSA P-256 public key for signature
+     *        verification; parsed by begin(), or nullptr to use setPublicKey()
      */
     OTAClient(const char* serverURL, const char* deviceID, const char* publicKey);
     
@@ -77,8 +283,12 @@ public:
     /**
      * @brief Initialize the OTA client
      * 
+     * Parses the public key given to the constructor once, so verifying an
+     * update doesn't parse it again, and frees the PEM text.
+     * 
      * @return true if initialization successful
-     * @return false if initialization failed
+     * @return false if initialization failed, e.g. the public key is invalid
+     *         while signature verification is enabled
      */
     bool begin();
     
@@ -108,6 +318,47 @@ public:
      */
     bool checkAndUpdate();
     
+    /**
+     * @brief Start downloading and installing an update in the background
+     * 
+     * On ESP32 performUpdate() runs in a FreeRTOS task pinned to
+     * OTA_TASK_CORE, so the caller's loop keeps running. Call poll() from
+     * loop() to deliver progress and status callbacks on the calling task and
+     * to find out when the update has finished. No other OTAClient method may
+     * be called until poll() reports the task as finished. On other targets
+     * the update runs to completion before this returns.
+     * 
+     * @param update Firmware update information (copied)
+     * @return true if the update was started
+     * @return false if an update is already running or the task could not be created
+     */
+    bool startUpdate(const FirmwareUpdate& update);
+    
+    /**
+     * @brief Check for an update and install it in the background
+     * 
+     * Like startUpdate(), but runs checkAndUpdate(). If no update is
+     * available the task finishes as failed with OTA_ERROR_NO_UPDATE.
+     * 
+     * @return true if the task was started
+     * @return false if an update is already running or the task could not be created
+     */
+    bool startCheckAndUpdate();
+    
+    /**
+     * @brief Deliver pending callbacks and get the state of the background update
+     * 
+     * @return int OTA_TASK_IDLE, OTA_TASK_RUNNING, OTA_TASK_SUCCEEDED or
+     *         OTA_TASK_FAILED (see getLastError() for the reason); a finished
+     *         state is returned once, then poll() goes back to OTA_TASK_IDLE
+     */
+    int poll();
+    
+    /**
+     * @brief Check whether a background update is in progress
+     */
+    bool isUpdateRunning() const;
+    
     /**
      * @brief Set progress callback for download/installation progress
      * 
@@ -115,6 +366,33 @@ public:
      */
     void setProgressCallback(ProgressCallback callback);
     
+    /**
+     * @brief Set how often the progress callback fires during a download
+     * 
+     * The callback is called once the download has advanced by the given
+     * number of bytes or percentage of the total, whichever comes first, and
+     * always when it completes. Set both to 0 to be called for every chunk.
+     * 
+     * @param bytes Minimum bytes between callbacks (0 to ignore)
+     * @param percent Minimum percentage between callbacks (0 to ignore, default 1)
+     */
+    void setProgressGranularity(size_t bytes, uint8_t percent);
+    
+    /**
+     * @brief Set how often download progress is reported to the server
+     * 
+     * During streaming downloads a "downloading" report with the bytes
+     * received and the current throughput is sent every `percent` of the
+     * payload, but never more often than `minInterval`, so the server can
+     * estimate each device's remaining time. Reports are sent on the
+     * download's kept-alive connection between ranged requests, so they are
+     * skipped when connection reuse is disabled.
+     * 
+     * @param percent Payload percentage between reports (0 to disable, default 10)
+     * @param minInterval Minimum time between reports in milliseconds (default 5000)
+     */
+    void setProgressReporting(uint8_t percent, unsigned long minInterval);
+    
     /**
      * @brief Set status callback for status changes
      * 
@@ -122,6 +400,34 @@ public:
      */
     void setStatusCallback(StatusCallback callback);
     
+    /**
+     * @brief Set a function downloads call to let the sketch run its own network I/O
+     * 
+     * Called whenever a download waits for data or for the rate limit, and
+     * at least every OTA_YIELD_INTERVAL_MS while it reads, so a foreground
+     * update can keep an MQTT connection alive with mqtt.loop(). It must
+     * return quickly and must not use the OTA client. Not called by a
+     * background update, which leaves the sketch's loop() running anyway.
+     * 
+     * @param callback Function to call, or nullptr for none
+     */
+    void setYieldCallback(YieldCallback callback);
+    
+    /**
+     * @brief Limit how fast downloads read from the network
+     * 
+     * Downloads take their bytes from a token bucket that fills at
+     * bytesPerSecond up to burst bytes, shared by all connections of a
+     * parallel download. When it is empty the client stops reading; the
+     * server then slows down as the TCP window closes, which leaves the rest
+     * of the link to the application's own traffic. Status reports and
+     * update checks are not limited.
+     * 
+     * @param bytesPerSecond Sustained download rate, or 0 for no limit (default)
+     * @param burst Bytes that may be read at once after a pause (default OTA_DEFAULT_RATE_BURST)
+     */
+    void setDownloadRateLimit(uint32_t bytesPerSecond, size_t burst = OTA_DEFAULT_RATE_BURST);
+    
     /**
      * @brief Get the last error code
      * 
@@ -136,6 +442,197 @@ public:
      */
     const char* getLastErrorMessage() const;
     
+    /**
+     * @brief Get timings and counters of the last performUpdate()
+     * 
+     * Valid once performUpdate() has returned, or poll() has reported a
+     * background update as finished. A connection left open by
+     * checkForUpdate() is reused by the download, so its lookup and
+     * handshake are not included.
+     * 
+     * @return const OTAStats& Statistics of the last update
+     */
+    const OTAStats& getStats() const;
+    
+    /**
+     * @brief Include the update statistics in the final status report
+     * 
+     * The completed or failed report then carries getStats() in a "stats"
+     * object, so the server can build fleet-wide histograms of update
+     * timings. Disabled by default.
+     * 
+     * @param enable true to send statistics, false to send the status only
+     */
+    void setStatsReporting(bool enable);
+    
+    /**
+     * @brief Get the delay before the next update check suggested by the server
+     * 
+     * Updated by every checkForUpdate() from the response's Retry-After header.
+     * The server spreads these out across devices, so prefer it over a fixed
+     * interval when it is set.
+     * 
+     * @return unsigned long Delay in milliseconds, or 0 if the server gave none
+     */
+    unsigned long getPollDelay() const;
+    
+    /**
+     * @brief Set the schedule loop() checks for updates on
+     * 
+     * Each check is followed by the interval plus a random share of jitter.
+     * The random sequence is seeded from the device ID, so it is the same for
+     * a device on every boot but differs between devices, and a fleet that
+     * powers up together doesn't check in the same second: the first check
+     * after boot also waits a random share of jitter. Checks that fail with
+     * OTA_ERROR_NETWORK double the wait each time, up to maxBackoff. A
+     * Retry-After delay from the server replaces the computed wait.
+     * 
+     * @param interval Time between checks in milliseconds (default OTA_DEFAULT_POLL_INTERVAL_MS)
+     * @param jitter Largest random delay added to each wait (default OTA_DEFAULT_POLL_JITTER_MS)
+     * @param maxBackoff Longest wait after repeated network errors (default OTA_DEFAULT_POLL_MAX_BACKOFF_MS)
+     */
+    void setPollPolicy(unsigned long interval, unsigned long jitter, unsigned long maxBackoff);
+    
+    /**
+     * @brief Check for and install updates on the poll schedule; call from the sketch's loop()
+     * 
+     * Returns straight away until a check is due, then runs
+     * checkAndUpdate() and schedules the next check. An update notice
+     * received with handleUpdateNotice() brings the check forward to within
+     * the jitter window, since the server notifies a whole deployment at once.
+     * Does nothing while a background update is running.
+     * 
+     * @return true if an update was installed; restart to run it
+     * @return false otherwise (see getLastError() after a check)
+     */
+    bool loop();
+    
+    /**
+     * @brief Get the time until loop() runs the next check
+     * 
+     * In low-power mode this is how long the device can deep sleep before
+     * it has to wake and call loop() again.
+     * 
+     * @return unsigned long Milliseconds, 0 if a check is due or none has been scheduled yet
+     */
+    unsigned long getNextPollDelay() const;
+    
+    /**
+     * @brief Enable or disable low-power mode for devices that deep sleep between checks
+     * 
+     * When enabled (ESP32), loop()'s schedule, backoff and jitter sequence
+     * and the update check's ETag are kept in RTC memory, and begin()
+     * restores them after deep sleep, so a wake before the next check is
+     * due costs no request, and a check that finds no new update is
+     * answered with an empty 304 over a resumed TLS session. Each
+     * performUpdate() then downloads a raw image for at most sliceTime,
+     * saves how far it got and returns false with OTA_ERROR_PAUSED; loop()
+     * continues the download sliceInterval later, after the device has
+     * slept. Every slice writes at least one flash sector, so a window too
+     * short for the connection still makes progress. Call before begin().
+     * 
+     * @param sliceTime Longest download per performUpdate() in milliseconds, or 0 to disable
+     * @param sliceInterval Wait before the next slice (default OTA_DEFAULT_SLICE_INTERVAL_MS)
+     */
+    void setLowPowerMode(unsigned long sliceTime, unsigned long sliceInterval = OTA_DEFAULT_SLICE_INTERVAL_MS);
+    
+    /**
+     * @brief Require new firmware to validate itself before it is kept
+     * 
+     * When enabled (ESP32), an installed update is reported as installing
+     * instead of completed, and the new firmware boots on trial: begin()
+     * starts a timer, and unless the sketch calls markValid() within
+     * timeout, e.g. after its own health checks, the device rolls back to
+     * the previous firmware and reboots. The bootloader rolls back as well
+     * if the new firmware crashes or resets before it is marked valid.
+     * Either way the outcome, completed or failed, goes to the server with
+     * the next status report. Needs a bootloader built with
+     * CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE, and the sketch has to define
+     * verifyRollbackLater() to return true, or the Arduino core marks the
+     * new firmware valid before setup(). A device that deep sleeps must mark
+     * the firmware valid first, as the wake counts as a reset.
+     * 
+     * @param timeout Milliseconds the new firmware has to call markValid(),
+     *        or 0 to keep updates without validation (default)
+     */
+    void setValidationTimeout(unsigned long timeout);
+    
+    /**
+     * @brief Check whether the running firmware still has to be validated
+     * 
+     * @return true if this is the first boot of an update that is on trial
+     *         (see setValidationTimeout())
+     */
+    bool isValidationPending() const;
+    
+    /**
+     * @brief Keep the running firmware and cancel the rollback
+     * 
+     * Reports the update as completed. Does nothing if no validation is pending.
+     * 
+     * @return true if the running firmware is valid
+     * @return false if it couldn't be marked valid
+     */
+    bool markValid();
+    
+    /**
+     * @brief Give up on the running firmware and boot the previous one
+     * 
+     * Reports the update as failed with the reason and reboots, so it only
+     * returns on failure. Components the update wrote to data partitions
+     * stay as they are, and the report says so.
+     * 
+     * @param reason Error message for the status report
+     * @return false if no validation is pending or there is no firmware to roll back to
+     */
+    bool rollback(const char* reason);
+    
+    /**
+     * @brief Get the MQTT topic the server pushes this device's update notices to
+     * 
+     * Subscribe to it with any MQTT client and pass received messages to
+     * handleUpdateNotice(). Notices are retained, so one sent while the device
+     * was offline arrives when it subscribes.
+     * 
+     * @return String Topic name (ota/<device ID>/update)
+     */
+    String getUpdateNoticeTopic() const;
+    
+    /**
+     * @brief Handle a message received on the update notice topic
+     * 
+     * Matches the PubSubClient callback signature, so it can be called straight
+     * from the sketch's MQTT callback. Messages for other topics, empty
+     * (cleared) notices and notices for the running release are ignored.
+     * 
+     * @param topic Topic the message arrived on
+     * @param payload Message payload
+     * @param length Payload length
+     */
+    void handleUpdateNotice(const char* topic, const uint8_t* payload, unsigned int length);
+    
+    /**
+     * @brief Check whether an update notice arrived since the last checkForUpdate()
+     * 
+     * With notices, the sketch only needs to check over HTTP when this is set,
+     * plus an occasional fallback poll in case a notice was missed.
+     * 
+     * @return true if the server has announced an update for this device
+     */
+    bool hasUpdateNotice() const;
+    
+    /**
+     * @brief Send status reports that are still queued
+     * 
+     * Reports are queued and sent in one request when an update finishes.
+     * Ones that could not be delivered are kept in NVS and retried by the
+     * next checkForUpdate(), or by calling this. Don't call it while a
+     * background update is running.
+     * 
+     * @return true if nothing is left to send
+     */
+    bool flushStatusReports();
+    
     /**
      * @brief Set CA certificate for HTTPS verification
      * 
@@ -149,93 +646,1058 @@ public:
      * @param enable true to enable, false to disable (not recommended)
      */
     void setVerifySignature(bool enable);
-
-private:
-    String _serverURL;
-    String _deviceID;
-    String _publicKey;
-    String _caCert;
-    bool _verifySignature;
     
-    int _lastError;
-    String _lastErrorMessage;
+    /**
+     * @brief Set the signature verification key from DER or PEM bytes
+     * 
+     * Replaces the key given to the constructor. The key is parsed right
+     * away, so a DER key can be kept in flash and no PEM copy is held in RAM.
+     * RSA keys verify RSA-PSS signatures and EC keys ECDSA signatures over
+     * the image's SHA-256 hash, matching the OTA service's signer.
+     * 
+     * @param key DER-encoded SubjectPublicKeyInfo, or PEM text including its terminator
+     * @param length Key length in bytes
+     * @return true if the key was parsed
+     * @return false if it isn't an RSA or EC public key
+     */
+    bool setPublicKey(const uint8_t* key, size_t length);
     
-    ProgressCallback _progressCallback;
-    StatusCallback _statusCallback;
+    /**
+     * @brief Enable or disable streaming installation
+     * 
+     * In streaming mode each downloaded chunk is written straight to flash
+     * while the SHA-256 hash is computed incrementally, so peak RAM usage is
+     * a fixed buffer regardless of image size. The image is only marked
+     * bootable once hash and signature verification pass. When disabled the
+     * whole image is buffered in heap and verified before flashing.
+     * 
+     * @param enable true to stream (default), false to buffer the full image
+     */
+    void setStreamingUpdate(bool enable);
     
-    WiFiClientSecure _wifiClient;
-    HTTPClient _httpClient;
+    /**
+     * @brief Set how many connections a buffered download uses at once
+     * 
+     * With more than one, a buffered update (setStreamingUpdate(false))
+     * splits the image into that many byte ranges, requests each on its own
+     * connection and reads them in turn straight into the image buffer, which
+     * is allocated in PSRAM when the board has it. The image is hashed and
+     * verified once every range is complete. On links with a high
+     * bandwidth-delay product, where the TCP receive window rather than the
+     * link limits one connection, throughput grows with the number of
+     * connections. Each extra TLS connection needs its own session buffers
+     * while the download runs. A dropped range is requested again from where
+     * it stopped; a server that ignores Range is downloaded from over one
+     * connection. Images under two OTA_MIN_PARALLEL_RANGE ranges always use one.
+     * 
+     * @param connections 1 (default) to OTA_MAX_PARALLEL_DOWNLOADS
+     */
+    void setParallelDownloads(uint8_t connections);
     
     /**
-     * @brief Report update status to the server
+     * @brief Enable or disable resuming interrupted downloads across reboots
      * 
-     * @param releaseID Release ID
-     * @param status Status string
-     * @param progress Progress percentage
-     * @param errorMessage Error message (if any)
-     * @return true if report successful
-     * @return false if report failed
+     * When enabled (default), the streaming download periodically saves the
+     * release ID and the number of bytes safely written to flash in NVS. The
+     * next performUpdate() for the same release re-hashes the partial image
+     * from flash and continues with an HTTP Range request instead of starting
+     * from byte zero. Supported on ESP32 only.
+     * 
+     * @param enable true to persist download progress, false to always restart
      */
-    bool reportStatus(const String& releaseID, const char* status, int progress, const char* errorMessage = nullptr);
+    void setResumableDownloads(bool enable);
     
     /**
-     * @brief Download firmware binary from URL
+     * @brief Set how often a dropped download is resumed within one update
      * 
-     * @param url Download URL
-     * @param buffer Buffer to store downloaded data
-     * @param expectedSize Expected size of download
-     * @return size_t Actual bytes downloaded (0 on error)
+     * After a dropout the client reconnects and requests the remaining bytes
+     * with an HTTP Range header. Reconnects that make progress do not count
+     * against this limit.
+     * 
+     * @param retries Number of consecutive reconnects without progress
      */
-    size_t downloadFirmware(const String& url, uint8_t** buffer, size_t expectedSize);
+    void setDownloadRetries(uint8_t retries);
     
     /**
-     * @brief Verify firmware hash
+     * @brief Set the largest number of bytes read from the network at once
      * 
-     * @param data Firmware data
-     * @param size Data size
-     * @param expectedHash Expected SHA-256 hash (hex string)
-     * @return true if hash matches
-     * @return false if hash doesn't match
+     * Larger chunks mean fewer read calls per image. Raw images are read
+     * straight into the flash writer's sector buffer, so they are limited to
+     * the free part of the current sector; compressed and delta payloads are
+     * read into a buffer of this size allocated for the download.
+     * 
+     * @param size Chunk size in bytes (OTA_MIN_CHUNK_SIZE to OTA_MAX_CHUNK_SIZE,
+     *        default OTA_DEFAULT_CHUNK_SIZE)
      */
-    bool verifyHash(const uint8_t* data, size_t size, const String& expectedHash);
+    void setChunkSize(size_t size);
     
     /**
-     * @brief Verify firmware signature
+     * @brief Set where the client's buffers are allocated
      * 
-     * @param data Firmware data
-     * @param size Data size
-     * @param signature Base64-encoded signature
-     * @return true if signature is valid
-     * @return false if signature is invalid
+     * Used for the buffered image, chunk and flash sector buffers, the
+     * pipeline ring and the decompressor. Each allocation says whether it is
+     * a bulk buffer only the CPU touches or one the network or flash reads
+     * and writes on every chunk. The default, otaDefaultAllocator(), puts
+     * bulk buffers in PSRAM on boards that have it and the others in internal
+     * RAM. Set it before begin(); memory allocated by WiFi, TLS and
+     * HTTPClient is not covered.
+     * 
+     * @param allocator Allocation strategy; its functions must stay valid
      */
-    bool verifySignature(const uint8_t* data, size_t size, const String& signature);
+    void setAllocator(const OTAAllocator& allocator);
     
     /**
-     * @brief Install firmware update
+     * @brief Enable or disable pipelined flash writes
      * 
-     * @param data Firmware data
-     * @param size Data size
-     * @return true if installation successful
-     * @return false if installation failed
+     * When enabled (ESP32, streaming mode), downloaded chunks are handed to a
+     * writer task on the other core through a ring of OTA_PIPELINE_DEPTH
+     * buffers of setChunkSize() bytes. Hashing, decoding and flash writes
+     * then overlap with receiving the next chunks. If the ring can't be
+     * allocated the download runs unpipelined. Disabled by default.
+     * 
+     * @param enable true to pipeline writes, false to write on the receiving task
      */
-    bool installFirmware(const uint8_t* data, size_t size);
+    void setPipelinedWrites(bool enable);
     
     /**
-     * @brief Set error state
+     * @brief Enable or disable delta updates
      * 
-     * @param errorCode Error code
-     * @param errorMessage Error message
+     * When enabled (default) and the running release is known, the client
+     * asks the server for a patch from that release. The patch is streamed and
+     * applied on the fly: unchanged ranges are copied from the running
+     * partition and only the changed bytes are downloaded. If the patch cannot
+     * be applied, or the rebuilt image fails its hash check, the full image is
+     * downloaded instead. Only used in streaming mode on ESP32.
+     * 
+     * @param enable true to request delta updates, false to always download full images
      */
-    void setError(int errorCode, const String& errorMessage);
+    void setDeltaUpdates(bool enable);
     
     /**
-     * @brief Compute SHA-256 hash of data
+     * @brief Enable or disable compressed downloads
      * 
-     * @param data Input data
-     * @param size Data size
-     * @param output Output buffer (must be 32 bytes)
+     * When enabled (default), the client tells the server it can decode zlib
+     * and downloads the compressed image or patch if one is offered. Data is
+     * decompressed as it arrives and the hash is checked over the decompressed
+     * image. This needs about 43 KB of heap during the download; if that is
+     * not available, the raw image is downloaded instead. Only used in
+     * streaming mode on ESP32.
+     * 
+     * @param enable true to request compressed payloads, false to always download raw data
+     */
+    void setCompressedDownloads(bool enable);
+    
+    /**
+     * @brief Enable or disable reusing unchanged sectors of the running firmware
+     * 
+     * When enabled (default), the client tells the server its flash sector
+     * size, and for updates without a delta patch the server offers a manifest
+     * of the image's per-sector hashes. Sectors whose hash matches the same
+     * sector of the running partition are copied from flash, and only the
+     * others are downloaded with Range requests. This is used when it needs
+     * fewer bytes than the compressed or full image. Only used in streaming
+     * mode on ESP32.
+     * 
+     * @param enable true to request sector manifests, false to always download whole images
+     */
+    void setSectorReuse(bool enable);
+    
+    /**
+     * @brief Enable or disable checking each downloaded sector of the raw image
+     * 
+     * When enabled (default), the client asks for the sector manifest of
+     * updates it downloads as a raw image and checks its signature. Each
+     * sector is then collected in a buffer and hashed before it is written;
+     * one that doesn't match is fetched again with a Range request, within
+     * the setDownloadRetries() budget, instead of failing the whole image at
+     * the final hash check. This costs a sector of heap, OTA_CHUNK_DIGEST_SIZE
+     * bytes per sector of the image and a second hash pass. Only used in
+     * streaming mode without pipelined writes.
+     * 
+     * @param enable true to check sectors as they arrive, false to check only the whole image
+     */
+    void setChunkVerification(bool enable);
+    
+    /**
+     * @brief Download firmware through a cache on the local network
+     * 
+     * The update check still goes to the server, but the image, patch,
+     * compressed copy and sector manifest it offers are requested from the
+     * cache, which fetches each of them from the server once for the whole
+     * site. The cache is plain HTTP and isn't trusted: everything it serves
+     * is checked against the release's signed hash, as downloads from the
+     * server are. If the cache can't be reached, fails part way or serves an
+     * image that doesn't match, the update is downloaded from the server.
+     * 
+     * @param baseURL Cache address such as "http://192.168.1.20:8080", or nullptr to stop using one
+     */
+    void setLocalCache(const char* baseURL);
+    
+    /**
+     * @brief Look for a local cache advertised over mDNS and use it if one answers
+     * 
+     * Queries for the OTA_LOCAL_CACHE_SERVICE service, such as the one the
+     * OTA service's LAN cache advertises, and passes the first IPv4 answer
+     * to setLocalCache(). The sketch must start the mDNS responder with
+     * MDNS.begin() first. ESP32 only; elsewhere no cache is found.
+     * 
+     * @param timeoutMs How long to wait for answers
+     * @return true if a cache was found
+     */
+    bool discoverLocalCache(unsigned long timeoutMs = OTA_LOCAL_CACHE_DISCOVERY_MS);
+    
+    /**
+     * @brief Get the local cache downloads go through
+     * 
+     * @return const char* Cache address, or an empty string if none is used
+     */
+    const char* getLocalCache() const;
+    
+    /**
+     * @brief Set the release ID of the running firmware
+     * 
+     * The client records the release it installs and restores it in begin()
+     * when the device boots that image, so this is only needed for firmware
+     * that was flashed by other means.
+     * 
+     * @param releaseID Release ID of the running firmware
+     */
+    void setCurrentRelease(const char* releaseID);
+    
+    /**
+     * @brief Get the release ID of the running firmware
+     * 
+     * @return const char* Release ID, or an empty string if unknown
+     */
+    const char* getCurrentRelease() const;
+    
+#if OTA_ENABLE_BUNDLES
+    /**
+     * @brief Get the release whose components are in the data partitions
+     * 
+     * Set by an update that writes bundle components, and kept when that
+     * update is rolled back, since only the application partition goes
+     * back. Compare it with getCurrentRelease() to tell whether the data
+     * partitions go with the running firmware. ESP32 only.
+     * 
+     * @return const char* Release ID, or an empty string if no update has
+     *         written components or the last one stopped part way
+     */
+    const char* getComponentsRelease() const;
+#endif
+    
+    /**
+     * @brief Enable or disable keeping the server connection open between requests
+     * 
+     * When enabled (default), the update check, status reports and downloads
+     * share one kept-alive HTTPS connection, so a full update costs a single
+     * TLS handshake instead of one per request. The connection is closed when
+     * the next request goes to a different host, when a response is not read
+     * to the end, after performUpdate(), and when no update is available. A
+     * kept-alive connection the server has since closed is reopened once.
+     * 
+     * @param enable true to reuse connections, false to connect for every request
+     */
+    void setConnectionReuse(bool enable);
+    
+    /**
+     * @brief Enable or disable TLS session resumption
+     * 
+     * When enabled (default, ESP32 only), the TLS session negotiated with the
+     * server is kept in RTC memory and offered on the next connection, so
+     * periodic checks and status reports after a reboot or deep sleep use an
+     * abbreviated handshake without certificate exchange or key agreement. If
+     * the server no longer accepts the session, a full handshake is done.
+     * 
+     * @param enable true to resume sessions, false to always do a full handshake
+     */
+    void setTLSSessionResumption(bool enable);
+    
+    /**
+     * @brief Close the kept-alive server connection and free its TLS buffers
      */
-    void computeSHA256(const uint8_t* data, size_t size, uint8_t* output);
+    void disconnect();
+
+private:
+    String _serverURL;
+    String _deviceID;
+    String _publicKey;           // PEM from the constructor, until begin() parses it
+    mbedtls_pk_context _signingKey;
+    bool _signingKeyLoaded;
+    String _caCert;
+    bool _verifySignature;
+    bool _streamingUpdate;
+    uint8_t _parallelDownloads;
+    bool _resumableDownloads;
+    uint8_t _downloadRetries;
+    size_t _chunkSize;
+    uint8_t* _chunkBuffer;
+    OTAAllocator _allocator;
+    StaticJsonDocument<OTA_JSON_DOC_SIZE> _jsonDoc;
+    OTAStatusQueue _statusQueue;
+    size_t _lastCheckpoint;
+    size_t _progressBytes;
+    uint8_t _progressPercent;
+    size_t _lastProgress;
+    uint8_t _reportPercent;
+    unsigned long _reportInterval;
+    unsigned long _lastProgressReport;
+    unsigned long _downloadStarted;
+    bool _deltaUpdates;
+    bool _deltaActive;
+    bool _compressedDownloads;
+    bool _inflateActive;
+    bool _sectorReuse;
+    bool _sectorActive;
+    bool _chunkVerification;
+    uint8_t* _chunkDigests;         // Truncated hash of each image sector, while checked downloads may run
+    uint8_t* _chunkStage;           // The sector being received, until it is checked
+    size_t _chunkStageStart;        // Image offset of the staged sector
+    size_t _chunkStageLen;
+    bool _chunkRejected;            // The last request ended on a sector that failed its check
+    bool _pipelinedWrites;
+    bool _connectionReuse;
+    String _localCache;             // Base URL of the local cache, if downloads go through one
+    String _localCachePath;         // Its fetch route
+    String _currentRelease;
+#if OTA_ENABLE_BUNDLES
+    String _componentsRelease;
+#endif
+    String _connectedOrigin;
+    String _updateETag;
+    unsigned long _pollDelay;
+    volatile bool _updateNotice;
+    unsigned long _pollInterval;
+    unsigned long _pollJitter;
+    unsigned long _pollMaxBackoff;
+    unsigned long _lastPoll;        // When the next check was scheduled
+    unsigned long _pollWait;        // Milliseconds from _lastPoll to the next check
+    uint32_t _pollRandom;           // Jitter sequence, seeded from the device ID
+    uint8_t _pollFailures;          // Checks in a row that failed with OTA_ERROR_NETWORK
+    bool _pollScheduled;
+    unsigned long _sliceTime;       // Low-power mode: longest download per performUpdate(), 0 when off
+    unsigned long _sliceInterval;
+    unsigned long _validationTimeout; // 0 when updates are kept without validation
+    bool _validationPending;
+    String _validationRelease;      // Update on trial
+#if defined(ESP32)
+    esp_timer_handle_t _validationTimer;
+#endif
+    
+    // Statistics of the current or last update
+    OTAStats _stats;
+    bool _statsReporting;
+    unsigned long _updateStarted;
+    uint32_t _hashMicros;
+    uint32_t _flashMicros;
+    
+    // Background update task
+    struct TaskEvent {
+        const char* status;
+        int progress;
+    };
+    FirmwareUpdate _taskUpdate;
+    bool _taskCheckFirst;
+    volatile int _taskState;
+#if defined(ESP32)
+    TaskHandle_t _taskHandle;
+    QueueHandle_t _taskEvents;
+    portMUX_TYPE _taskLock;
+    size_t _taskProgress;
+    size_t _taskProgressTotal;
+    bool _taskProgressPending;
+#endif
+    
+    int _lastError;
+    String _lastErrorMessage;
+    
+    ProgressCallback _progressCallback;
+    StatusCallback _statusCallback;
+    YieldCallback _yieldCallback;
+    unsigned long _lastYield;
+    OTAThrottle _throttle;
+    
+    OTATLSClient _wifiClient;
+    WiFiClient _plainClient;        // For plain HTTP, which only the local cache uses
+    HTTPClient _httpClient;
+    OTAVerifier _verifier;
+    OTAFlashWriter _flashWriter;
+#if OTA_ENABLE_DELTA
+    OTADeltaDecoder _deltaDecoder;
+#endif
+#if OTA_ENABLE_COMPRESSION
+    OTAInflater _inflater;
+#endif
+    OTAPipeline _pipeline;
+    
+    /**
+     * @brief Create the background update task
+     * 
+     * @param checkFirst true to run checkAndUpdate(), false to install _taskUpdate
+     * @return true if the task was started
+     */
+    bool startTask(bool checkFirst);
+    
+    /**
+     * @brief Background update task entry point; context is the OTAClient
+     */
+    static void updateTask(void* context);
+    
+    /**
+     * @brief Call the status callback, or queue it for poll() while running in the background
+     */
+    void notifyStatus(const char* status, int progress);
+    
+    /**
+     * @brief Start a request and send it, reconnecting once if a reused connection failed
+     * 
+     * @param method HTTP method
+     * @param url Request URL
+     * @param payload JSON request body (nullptr for none)
+     * @param rangeStart Offset for a Range request (0 for the whole resource)
+     * @param rangeEnd Offset the range stops before (0 for the rest of the resource)
+     * @param ifNoneMatch ETag for a conditional request (nullptr for none)
+     * @return int HTTP status code, or a negative HTTPClient error
+     */
+    int sendRequest(const char* method, const String& url, const char* payload = nullptr, size_t rangeStart = 0,
+                    size_t rangeEnd = 0, const char* ifNoneMatch = nullptr);
+    
+    /**
+     * @brief Point the HTTP client at a URL, keeping the open connection if it is to the same host
+     * 
+     * @param url Request URL
+     * @return true if an already open connection will be used
+     */
+    bool beginRequest(const String& url);
+    
+    /**
+     * @brief Finish a request whose response may still hold unread body bytes
+     * 
+     * Short responses are read to the end so the connection stays usable.
+     * 
+     * @param consumed Body bytes the caller has already read from the stream
+     */
+    void endRequest(size_t consumed = 0);
+    
+    /**
+     * @brief Get the scheme, host and port part of a URL
+     */
+    static String urlOrigin(const String& url);
+    
+    /**
+     * @brief Check whether a URL points at the local cache
+     */
+    bool isLocalCacheURL(const String& url) const;
+    
+    /**
+     * @brief Get the local cache URL of a download from the server
+     * 
+     * @param url Download URL as offered by the server
+     * @param hash Hex SHA-256 of the download, so the cache can check it (empty if unknown)
+     */
+    String localCacheURL(const String& url, const String& hash) const;
+    
+    /**
+     * @brief Get a copy of an update whose downloads go through the local cache
+     */
+    FirmwareUpdate viaLocalCache(const FirmwareUpdate& update) const;
+    
+    /**
+     * @brief Queue an update status report for the server
+     * 
+     * Reports replace earlier ones for the same release. Final states
+     * (completed, failed) are sent right away together with anything else
+     * queued; intermediate ones wait for them.
+     * 
+     * @param releaseID Release ID
+     * @param status Status string
+     * @param progress Progress percentage
+     * @param errorMessage Error message (if any)
+     */
+    void reportStatus(const String& releaseID, const char* status, int progress, const char* errorMessage = nullptr);
+    
+    /**
+     * @brief Send all queued reports in one batch request
+     * 
+     * Falls back to one request per report if the server has no batch endpoint.
+     * 
+     * @return true if every report was accepted
+     */
+    bool sendStatusReports();
+    
+    /**
+     * @brief POST the contents of the shared JSON document, then clear it
+     * 
+     * @param url Request URL
+     * @return int HTTP status code, or a negative HTTPClient error
+     */
+    int postJson(const String& url);
+    
+    /**
+     * @brief Download firmware binary from URL
+     * 
+     * The image is hashed into _verifier as it arrives.
+     * 
+     * @param url Download URL
+     * @param buffer Buffer to store downloaded data
+     * @param expectedSize Expected size of download
+     * @return size_t Actual bytes downloaded (0 on error)
+     */
+    size_t downloadFirmware(const String& url, uint8_t** buffer, size_t expectedSize);
+    
+    // An extra connection of a parallel download
+    struct RangeConnection {
+        OTATLSClient client;
+        HTTPClient http;
+    };
+    
+    /**
+     * @brief Download an image as parallel ranges (see setParallelDownloads())
+     * 
+     * @param url Image URL
+     * @param buffer Buffer of the image size
+     * @param size Image size
+     * @param unsupported Set if the server ignored the Range header or the
+     *        connections couldn't be allocated; the image is then downloaded
+     *        over one connection
+     * @return true if every range was received; the image hash is then computed
+     */
+    bool downloadRanges(const String& url, uint8_t* buffer, size_t size, bool* unsupported);
+    
+    /**
+     * @brief Request part of a parallel download
+     * 
+     * @param connection Extra connection, or nullptr for the client's own one
+     * @return int HTTP status code, or a negative HTTPClient error
+     */
+    int requestRange(RangeConnection* connection, const String& url, size_t start, size_t end);
+    
+    /**
+     * @brief Download and install a firmware update without buffering the image
+     * 
+     * @param update Firmware update information
+     * @return true if update successful
+     * @return false if update failed
+     */
+    bool performStreamingUpdate(const FirmwareUpdate& update);
+    
+    /**
+     * @brief Download firmware and write it to flash chunk by chunk
+     * 
+     * Tries the delta patch first, then the compressed image, when they are
+     * offered, and falls back to the raw image. The flash session is left open on success so the caller can
+     * verify the image before finalizing it; on failure it is aborted.
+     * 
+     * @param update Firmware update information
+     * @return true if the full image was written
+     * @return false if download or flash write failed
+     */
+    bool streamFirmware(const FirmwareUpdate& update);
+    
+#if OTA_ENABLE_DELTA || OTA_ENABLE_COMPRESSION
+    /**
+     * @brief Download a delta patch or compressed image and decode it into flash
+     * 
+     * The decoded image is checked against the expected hash before this
+     * returns, so a patch applied to the wrong base is rejected.
+     * 
+     * @param update Firmware update information
+     * @param url Payload URL (deltaURL or compressedURL)
+     * @param payloadSize Payload size in bytes
+     * @param delta true if the payload is a delta patch
+     * @return true if the image was decoded and matches its hash
+     * @return false if the payload could not be downloaded or decoded
+     */
+    bool streamEncodedFirmware(const FirmwareUpdate& update, const String& url, size_t payloadSize, bool delta);
+#endif
+    
+#if OTA_ENABLE_SECTOR_MANIFESTS
+    /**
+     * @brief Build the image from unchanged sectors of the running partition and downloaded ones
+     * 
+     * Falls back (returning false) before anything is written if the
+     * manifest saves less than the compressed or full image.
+     * 
+     * @param update Firmware update information with a sector manifest
+     * @param unchanged One bit per sector from loadSectorManifest(); short runs are cleared
+     * @return true if the image was written and matches its hash
+     * @return false if the manifest was not used or the update failed
+     */
+    bool streamSectorFirmware(const FirmwareUpdate& update, uint8_t* unchanged);
+    
+    /**
+     * @brief Download the sector manifest and check its signature
+     * 
+     * Keeps the sector hashes in _chunkDigests if downloaded sectors are to
+     * be checked, and marks the sectors the running partition already holds.
+     * 
+     * @param update Firmware update information with a sector manifest
+     * @param unchanged Out: one bit per sector, set if the sector can be copied
+     *        (release with the allocator), or nullptr to skip comparing
+     * @return true if the manifest was read, matches the image and is signed
+     * @return false on a download, format or signature error
+     */
+    bool loadSectorManifest(const FirmwareUpdate& update, uint8_t** unchanged);
+    
+    /**
+     * @brief Copy part of the image from the running partition into the update
+     * 
+     * @param start First image byte to copy
+     * @param end Image byte to stop before
+     * @return true if the range was written
+     * @return false on a flash read or write error
+     */
+    bool copyRunningImage(size_t start, size_t end);
+#endif
+    
+    /**
+     * @brief Download the full image into flash
+     * 
+     * Continues an interrupted download of the same image from the offset
+     * saved in NVS, if any.
+     * 
+     * @param update Firmware update information
+     * @return true if the full image was written
+     * @return false if download or flash write failed
+     */
+    bool streamFullFirmware(const FirmwareUpdate& update);
+    
+    /**
+     * @brief Download a payload, reconnecting with Range requests after dropouts
+     * 
+     * With progress reporting enabled and a kept-alive connection, the
+     * payload is requested in ranges of the report step so that a progress
+     * report can be sent on the same connection between them.
+     * 
+     * @param update Update being downloaded
+     * @param url Download URL
+     * @param payloadSize Size of the payload in bytes
+     * @param offset In: first byte to request; out: bytes received so far
+     * @param end Byte to stop before (payloadSize for the rest of the payload)
+     * @param resumable true to checkpoint progress to NVS for resuming the update
+     * @return true if the payload was received up to end
+     * @return false on error (OTA_ERROR_NETWORK if only the connection failed)
+     */
+    bool downloadPayload(const FirmwareUpdate& update, const String& url, size_t payloadSize, size_t* offset,
+                         size_t end, bool resumable);
+    
+    /**
+     * @brief Issue one download request and consume what it delivers
+     * 
+     * @param update Update being downloaded
+     * @param url Download URL
+     * @param payloadSize Size of the payload in bytes
+     * @param offset In: first byte to request; out: bytes received so far
+     * @param end Byte to stop before (payloadSize for the rest of the payload)
+     * @param resumable true to checkpoint progress to NVS for resuming the update
+     * @return true if the request ended normally or can be retried
+     * @return false on an unrecoverable download or flash write error
+     */
+    bool receivePayload(const FirmwareUpdate& update, const String& url, size_t payloadSize, size_t* offset,
+                        size_t end, bool resumable);
+    
+    /**
+     * @brief Add received bytes to the staged sector and write it once it checks out
+     * 
+     * On a mismatch the staged sector is dropped and _chunkRejected is set,
+     * so the request is retried from _chunkStageStart.
+     * 
+     * @param size Bytes received at the end of _chunkStage
+     * @param imageSize Size of the image, for the last sector
+     * @return true if the data was consumed
+     * @return false on a sector that failed its check or a flash write error
+     */
+    bool commitChunk(size_t size, size_t imageSize);
+    
+    /**
+     * @brief Send a download progress report if the last one was long enough ago
+     * 
+     * @param update Update being downloaded
+     * @param received Payload bytes received so far
+     * @param total Payload size
+     * @param sessionBytes Bytes received since this download started, for throughput
+     */
+    void reportDownloadProgress(const FirmwareUpdate& update, size_t received, size_t total, size_t sessionBytes);
+    
+    /**
+     * @brief Reset the statistics at the start of an update
+     */
+    void beginStats();
+    
+    /**
+     * @brief Fill in the totals and connection timings of the statistics
+     */
+    void finishStats();
+    
+    /**
+     * @brief Record the current free heap if it is the lowest seen in this update
+     */
+    void sampleFreeHeap();
+    
+    /**
+     * @brief Call the progress callback if the download advanced far enough
+     * 
+     * @param current Bytes downloaded so far
+     * @param total Total bytes to download
+     */
+    void reportProgress(size_t current, size_t total);
+    
+    /**
+     * @brief Pass downloaded bytes to the decompressor or on to decodePayload()
+     * 
+     * @param data Payload data
+     * @param size Data size
+     * @return true if the data was consumed
+     * @return false on decompression, patch or flash write error
+     */
+    bool consumePayload(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Pass decompressed bytes to the delta decoder or straight to flash
+     * 
+     * @param data Payload data
+     * @param size Data size
+     * @return true if the data was consumed
+     * @return false on patch or flash write error
+     */
+    bool decodePayload(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Add image bytes to the running hash
+     * @param data Image data
+     * @param size Data size
+     */
+    void hashImage(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Hash image bytes and write them to flash
+     * 
+     * @param data Image data
+     * @param size Data size
+     * @return true if the data was written
+     * @return false on flash write error
+     */
+    bool writeImage(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Delta decoder output callback; context is the OTAClient
+     */
+    static bool writeDeltaOutput(void* context, const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Decompressor output callback; context is the OTAClient
+     */
+    static bool writeInflatedOutput(void* context, const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Pipeline consumer callback run on the writer task; context is the OTAClient
+     */
+    static bool consumePipelined(void* context, const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Delta decoder source callback reading the running partition
+     */
+    static bool readRunningImage(void* context, size_t offset, uint8_t* data, size_t size);
+    
+    /**
+     * @brief Check whether the delta patch of an update can be applied here
+     */
+    bool canApplyDelta(const FirmwareUpdate& update) const;
+    
+    /**
+     * @brief Check whether compressed payloads of an update can be decoded here
+     */
+    bool canDecompress(const FirmwareUpdate& update) const;
+    
+    /**
+     * @brief Check whether the sector manifest of an update can be used here
+     */
+    bool canReuseSectors(const FirmwareUpdate& update) const;
+    
+    /**
+     * @brief Check whether sector manifests can be used on this platform
+     */
+    bool supportsSectorReuse() const;
+    
+    /**
+     * @brief Check whether downloaded sectors of an update can be checked against its manifest
+     */
+    bool canCheckChunks(const FirmwareUpdate& update) const;
+    
+    /**
+     * @brief Check whether downloaded sectors can be checked in the current configuration
+     */
+    bool supportsChunkVerification() const;
+    
+    /**
+     * @brief Check whether compressed payloads can be decoded on this platform
+     */
+    bool supportsCompression() const;
+    
+    /**
+     * @brief Feed the already-written part of the image back into _verifier
+     * 
+     * @param length Number of bytes to re-hash from flash
+     * @return true if the data was read back
+     * @return false on flash read error
+     */
+    bool rehashWrittenImage(size_t length);
+    
+    /**
+     * @brief Load the saved download offset for an update
+     * 
+     * @param update Firmware update information
+     * @return size_t Offset to resume from, or 0 if none matches this image
+     */
+    size_t loadResumeOffset(const FirmwareUpdate& update);
+    
+    /**
+     * @brief Persist how much of an image is safely written to flash
+     * 
+     * @param update Firmware update information
+     * @param offset Bytes committed to flash
+     */
+    void saveResumeState(const FirmwareUpdate& update, size_t offset);
+    
+    /**
+     * @brief Discard any saved download progress
+     */
+    void clearResumeState();
+    
+    /**
+     * @brief Check whether the last failure left a resumable partial download
+     */
+    bool isResumePending() const;
+    
+    /**
+     * @brief Check whether a download has used up its low-power mode slice
+     * 
+     * Only downloads that can be resumed are paused, and only once they have
+     * written something since the last saved checkpoint.
+     * 
+     * @param resumable true if the download is of the raw image
+     */
+    bool isSliceOver(bool resumable) const;
+    
+    /**
+     * @brief Give the sketch a turn during a download
+     * 
+     * @param waiting true if the download has nothing to read yet, so it also sleeps for a millisecond
+     */
+    void yieldDownload(bool waiting);
+    
+    /**
+     * @brief Schedule loop()'s next check
+     * 
+     * @param wait Milliseconds from now
+     */
+    void schedulePoll(unsigned long wait);
+    
+    /**
+     * @brief Draw the next random delay between 0 and the poll jitter
+     */
+    unsigned long pollJitter();
+    
+    /**
+     * @brief Keep the poll schedule and update check ETag in RTC memory (low-power mode)
+     */
+    void saveSleepState();
+    
+    /**
+     * @brief Restore the poll schedule saved before deep sleep
+     */
+    void loadSleepState();
+    
+    /**
+     * @brief Restore the running release ID recorded when it was installed
+     */
+    void loadCurrentRelease();
+    
+#if OTA_ENABLE_BUNDLES
+    /**
+     * @brief Restore the release recorded for the data partitions' components
+     */
+    void loadComponentsRelease();
+    
+    /**
+     * @brief Record the release the data partitions' components belong to
+     * 
+     * @param releaseID Release ID, or an empty string while they are being rewritten
+     */
+    void saveComponentsRelease(const String& releaseID);
+#endif
+    
+    /**
+     * @brief Report an installed update as completed, or as on trial when it has to be validated
+     * 
+     * @param releaseID Release that was installed
+     */
+    void reportInstalled(const String& releaseID);
+    
+    /**
+     * @brief Find out how the last update on trial turned out
+     * 
+     * Starts the rollback timer on its first boot, or queues its outcome
+     * once the bootloader has kept or rolled it back.
+     */
+    void loadValidationState();
+    
+    /**
+     * @brief Forget the update on trial once its outcome is reported
+     */
+    void clearValidationState();
+    
+    /**
+     * @brief Record the release that will run after the next reboot
+     * 
+     * @param releaseID Release ID of the installed image
+     */
+    void saveInstalledRelease(const String& releaseID);
+    
+    /**
+     * @brief Verify a streamed image and mark it bootable
+     * 
+     * Aborts the pending update session if verification fails, so an invalid
+     * image is never committed with Update.end().
+     * 
+     * @param update Firmware update information
+     * @return true if the image was verified and committed
+     * @return false if verification or finalization failed
+     */
+    bool finalizeStreamedFirmware(const FirmwareUpdate& update);
+    
+    /**
+     * @brief Verify the downloaded image against its expected hash and signature
+     * 
+     * Finalizes the digest accumulated in _verifier during download; the same
+     * digest is used for the hash comparison and the signature check.
+     * 
+     * @param update Firmware update information
+     * @return true if the image is valid
+     * @return false if hash or signature verification failed
+     */
+    bool verifyImage(const FirmwareUpdate& update);
+    
+    /**
+     * @brief Add OTA_COMPONENTS_KEPT_NOTE to the last error if this update wrote components
+     */
+    void noteComponentsKept();
+    
+    /**
+     * @brief Check the digest in _verifier against an expected hash and signature
+     * 
+     * @param hash Expected SHA-256 as hex
+     * @param signature Base64-encoded signature (empty if the payload isn't signed)
+     * @return true if the digest matches and the signature, if checked, is valid
+     * @return false if hash or signature verification failed
+     */
+    bool verifyDigest(const String& hash, const String& signature);
+    
+#if OTA_ENABLE_BUNDLES
+    /**
+     * @brief Write every component of an update to its data partition
+     * 
+     * Runs once the application image is downloaded and verified, before it
+     * is selected for boot (on ESP32; elsewhere the core's single Update
+     * session makes it run right after). A component that can't be
+     * downloaded or verified leaves its partition as it was, and the update
+     * fails without installing the application.
+     * 
+     * @param update Firmware update information
+     * @return true if all components are installed
+     * @return false if one could not be downloaded, verified or written
+     */
+    bool installComponents(const FirmwareUpdate& update);
+    
+    /**
+     * @brief Download one component, verify it and write it to its partition
+     * 
+     * The image is staged in memory, and written from there once its hash
+     * and signature check out: up to OTA_MAX_STAGED_COMPONENT bytes in a
+     * streaming update, or whatever fits in a buffered one. Only a staged
+     * image may come from the local cache. Any other is checked in a first
+     * download from the OTA service that writes nothing, then downloaded
+     * again into the partition and checked again.
+     * 
+     * @param component Component to install
+     * @param written Out: set once the partition is being written
+     * @return true if the component was verified and written
+     * @return false on download, verification or flash error
+     */
+    bool installComponent(const FirmwareComponent& component, bool* written);
+    
+    /**
+     * @brief Download a component, hashing it into _verifier as it arrives
+     * 
+     * A dropped connection is resumed with a Range request, like other downloads.
+     * 
+     * @param url Where to download it from
+     * @param component Component to download
+     * @param image Buffer of component.size bytes to keep it in, or nullptr
+     * @param writer Open data partition session to write it to, or nullptr
+     * @return true if the whole component was received (and written)
+     * @return false on download or flash error
+     */
+    bool fetchComponent(const String& url, const FirmwareComponent& component, uint8_t* image,
+                        OTAFlashWriter* writer);
+    
+    /**
+     * @brief Check whether a component's partition already holds it
+     * 
+     * Hashes the partition's first component.size bytes. Only supported on ESP32.
+     * 
+     * @param component Component to check
+     * @return true if the partition holds the component
+     */
+    bool isComponentInstalled(const FirmwareComponent& component);
+#endif
+    
+    /**
+     * @brief Verify firmware signature
+     * 
+     * @param hash SHA-256 digest of the firmware (OTA_SHA256_SIZE bytes)
+     * @param signature Base64-encoded signature
+     * @return true if signature is valid
+     * @return false if signature is invalid
+     */
+    bool verifySignature(const uint8_t* hash, const String& signature);
+    
+    /**
+     * @brief Verify a decoded signature
+     * 
+     * @param hash SHA-256 digest of the signed data (OTA_SHA256_SIZE bytes)
+     * @param signature RSA-PSS or DER-encoded ECDSA signature
+     * @param length Signature length
+     * @return true if signature is valid
+     */
+    bool verifySignature(const uint8_t* hash, const uint8_t* signature, size_t length);
+    
+    /**
+     * @brief Parse a public key into _signingKey
+     * 
+     * @param key DER or NUL-terminated PEM key
+     * @param length Key length, including the terminator for PEM
+     * @return true if the key is an RSA or EC key
+     */
+    bool loadSigningKey(const uint8_t* key, size_t length);
+    
+    /**
+     * @brief Install firmware update
+     * 
+     * @param data Firmware data
+     * @param size Data size
+     * @return true if installation successful
+     * @return false if installation failed
+     */
+    bool installFirmware(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Set error state
+     * 
+     * @param errorCode Error code
+     * @param errorMessage Error message
+     */
+    void setError(int errorCode, const String& errorMessage);
     
     /**
      * @brief Convert hex string to bytes
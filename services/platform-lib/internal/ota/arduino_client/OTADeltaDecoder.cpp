@@ -0,0 +1,175 @@
+#include "OTADeltaDecoder.h"
+
+static const char OTA_DELTA_MAGIC[4] = { 'A', 'T', 'D', 'L' };
+
+OTADeltaDecoder::OTADeltaDecoder()
+    : _state(STATE_ERROR), _targetSize(0), _sourceSize(0), _output(0), _insertRemaining(0),
+      _pendingLen(0), _reader(nullptr), _writer(nullptr), _context(nullptr), _outputFailed(false),
+      _error("Not started") {
+}
+
+void OTADeltaDecoder::begin(size_t targetSize, DeltaSourceReader reader, DeltaOutputWriter writer, void* context) {
+    _state = STATE_HEADER;
+    _targetSize = targetSize;
+    _sourceSize = 0;
+    _output = 0;
+    _insertRemaining = 0;
+    _pendingLen = 0;
+    _reader = reader;
+    _writer = writer;
+    _context = context;
+    _outputFailed = false;
+    _error = "";
+}
+
+bool OTADeltaDecoder::write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        switch (_state) {
+            case STATE_HEADER:
+                if (collect(&data, &size, OTA_DELTA_HEADER_SIZE) && !parseHeader()) {
+                    return false;
+                }
+                break;
+            
+            case STATE_OPCODE:
+                if (data[0] == OTA_DELTA_OP_COPY) {
+                    _state = STATE_COPY_ARGS;
+                } else if (data[0] == OTA_DELTA_OP_INSERT) {
+                    _state = STATE_INSERT_LENGTH;
+                } else {
+                    return fail("Invalid patch operation");
+                }
+                data++;
+                size--;
+                break;
+            
+            case STATE_COPY_ARGS:
+                if (collect(&data, &size, 8)) {
+                    _pendingLen = 0;
+                    _state = STATE_OPCODE;
+                    if (!applyCopy(readUInt32(_pending), readUInt32(_pending + 4))) {
+                        return false;
+                    }
+                }
+                break;
+            
+            case STATE_INSERT_LENGTH:
+                if (collect(&data, &size, 4)) {
+                    _pendingLen = 0;
+                    _insertRemaining = readUInt32(_pending);
+                    _state = (_insertRemaining > 0) ? STATE_INSERT_DATA : STATE_OPCODE;
+                }
+                break;
+            
+            case STATE_INSERT_DATA: {
+                // Literal bytes go straight from the network buffer to the output
+                size_t len = min(size, _insertRemaining);
+                if (!emit(data, len)) {
+                    return false;
+                }
+                data += len;
+                size -= len;
+                _insertRemaining -= len;
+                if (_insertRemaining == 0) {
+                    _state = STATE_OPCODE;
+                }
+                break;
+            }
+            
+            case STATE_ERROR:
+            default:
+                return false;
+        }
+    }
+    
+    return true;
+}
+
+bool OTADeltaDecoder::isComplete() const {
+    return _state == STATE_OPCODE && _output == _targetSize;
+}
+
+bool OTADeltaDecoder::outputFailed() const {
+    return _outputFailed;
+}
+
+size_t OTADeltaDecoder::bytesOutput() const {
+    return _output;
+}
+
+const char* OTADeltaDecoder::errorString() const {
+    return _error;
+}
+
+bool OTADeltaDecoder::collect(const uint8_t** data, size_t* size, size_t length) {
+    size_t len = min(*size, length - _pendingLen);
+    memcpy(_pending + _pendingLen, *data, len);
+    _pendingLen += len;
+    *data += len;
+    *size -= len;
+    
+    return _pendingLen == length;
+}
+
+bool OTADeltaDecoder::parseHeader() {
+    if (memcmp(_pending, OTA_DELTA_MAGIC, sizeof(OTA_DELTA_MAGIC)) != 0) {
+        return fail("Invalid patch header");
+    }
+    
+    if (_pending[4] != OTA_DELTA_VERSION) {
+        return fail("Unsupported patch version");
+    }
+    
+    if (readUInt32(_pending + 12) != _targetSize) {
+        return fail("Patch target size mismatch");
+    }
+    
+    _sourceSize = readUInt32(_pending + 8);
+    _pendingLen = 0;
+    _state = STATE_OPCODE;
+    return true;
+}
+
+bool OTADeltaDecoder::applyCopy(size_t offset, size_t length) {
+    if (offset > _sourceSize || length > _sourceSize - offset) {
+        return fail("Patch copy outside source image");
+    }
+    
+    while (length > 0) {
+        size_t len = min(length, sizeof(_copyBuffer));
+        if (!_reader(_context, offset, _copyBuffer, len)) {
+            return fail("Source image read failed");
+        }
+        if (!emit(_copyBuffer, len)) {
+            return false;
+        }
+        offset += len;
+        length -= len;
+    }
+    
+    return true;
+}
+
+bool OTADeltaDecoder::emit(const uint8_t* data, size_t size) {
+    if (size > _targetSize - _output) {
+        return fail("Patch output exceeds target size");
+    }
+    
+    if (!_writer(_context, data, size)) {
+        _outputFailed = true;
+        return fail("Output write failed");
+    }
+    
+    _output += size;
+    return true;
+}
+
+bool OTADeltaDecoder::fail(const char* error) {
+    _state = STATE_ERROR;
+    _error = error;
+    return false;
+}
+
+uint32_t OTADeltaDecoder::readUInt32(const uint8_t* data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
@@ -0,0 +1,165 @@
+#ifndef OTA_DELTA_DECODER_H
+#define OTA_DELTA_DECODER_H
+
+#include <Arduino.h>
+
+// Delta patch header: "ATDL" | version | 3 reserved | source size | target size
+#define OTA_DELTA_HEADER_SIZE 16
+#define OTA_DELTA_VERSION 1
+
+// Patch operations
+#define OTA_DELTA_OP_COPY 0x01
+#define OTA_DELTA_OP_INSERT 0x02
+
+// Buffer used to move COPY ranges from the source image to the output
+#ifndef OTA_DELTA_COPY_BUFFER_SIZE
+#define OTA_DELTA_COPY_BUFFER_SIZE 512
+#endif
+
+/**
+ * @brief Callback function type for reading the source (currently running) image
+ * @param context Caller-supplied context pointer
+ * @param offset Offset within the source image
+ * @param data Output buffer
+ * @param size Number of bytes to read
+ * @return true if the data was read
+ */
+typedef bool (*DeltaSourceReader)(void* context, size_t offset, uint8_t* data, size_t size);
+
+/**
+ * @brief Callback function type for receiving reconstructed image data
+ * @param context Caller-supplied context pointer
+ * @param data Image data
+ * @param size Data size
+ * @return true if the data was accepted
+ */
+typedef bool (*DeltaOutputWriter)(void* context, const uint8_t* data, size_t size);
+
+/**
+ * @brief Streaming decoder for delta firmware patches
+ * 
+ * Applies a patch generated by the ATHENA OTA service as it is downloaded.
+ * The patch is a sequence of COPY operations, which take a range of the
+ * source image, and INSERT operations, which carry literal bytes. Patch data
+ * can be pushed in chunks of any size; the decoder keeps only the few header
+ * bytes of a partially received operation, so neither image is held in RAM.
+ */
+class OTADeltaDecoder {
+public:
+    /**
+     * @brief Construct a new OTADeltaDecoder object
+     */
+    OTADeltaDecoder();
+    
+    /**
+     * @brief Start decoding a new patch
+     * 
+     * @param targetSize Expected size of the reconstructed image
+     * @param reader Callback used to read COPY ranges from the source image
+     * @param writer Callback that receives the reconstructed image in order
+     * @param context Pointer passed to both callbacks
+     */
+    void begin(size_t targetSize, DeltaSourceReader reader, DeltaOutputWriter writer, void* context);
+    
+    /**
+     * @brief Feed patch data into the decoder
+     * 
+     * @param data Patch data
+     * @param size Data size
+     * @return true if the data was applied
+     * @return false if the patch is invalid or a callback failed
+     */
+    bool write(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Check whether the whole target image has been produced
+     */
+    bool isComplete() const;
+    
+    /**
+     * @brief Check whether the last failure came from the output callback
+     * 
+     * The callback is expected to report its own error in that case.
+     */
+    bool outputFailed() const;
+    
+    /**
+     * @brief Get the number of image bytes produced so far
+     */
+    size_t bytesOutput() const;
+    
+    /**
+     * @brief Get a description of the last error
+     * 
+     * @return const char* Error message string
+     */
+    const char* errorString() const;
+
+private:
+    enum State {
+        STATE_HEADER,
+        STATE_OPCODE,
+        STATE_COPY_ARGS,
+        STATE_INSERT_LENGTH,
+        STATE_INSERT_DATA,
+        STATE_ERROR
+    };
+    
+    State _state;
+    size_t _targetSize;
+    size_t _sourceSize;
+    size_t _output;
+    size_t _insertRemaining;
+    
+    // Partially received header or operation arguments
+    uint8_t _pending[OTA_DELTA_HEADER_SIZE];
+    size_t _pendingLen;
+    
+    uint8_t _copyBuffer[OTA_DELTA_COPY_BUFFER_SIZE];
+    
+    DeltaSourceReader _reader;
+    DeltaOutputWriter _writer;
+    void* _context;
+    bool _outputFailed;
+    const char* _error;
+    
+    /**
+     * @brief Collect bytes into _pending until it holds the given length
+     * 
+     * @param data In/out: remaining patch data
+     * @param size In/out: remaining patch data size
+     * @param length Number of bytes needed
+     * @return true once _pending holds length bytes
+     */
+    bool collect(const uint8_t** data, size_t* size, size_t length);
+    
+    /**
+     * @brief Validate the patch header held in _pending
+     */
+    bool parseHeader();
+    
+    /**
+     * @brief Copy a range of the source image to the output
+     */
+    bool applyCopy(size_t offset, size_t length);
+    
+    /**
+     * @brief Pass reconstructed bytes to the output callback
+     */
+    bool emit(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Enter the error state
+     * 
+     * @param error Static error message
+     * @return false, so callers can return fail() directly
+     */
+    bool fail(const char* error);
+    
+    /**
+     * @brief Read a little-endian uint32 from a byte buffer
+     */
+    static uint32_t readUInt32(const uint8_t* data);
+};
+
+#endif // OTA_DELTA_DECODER_H
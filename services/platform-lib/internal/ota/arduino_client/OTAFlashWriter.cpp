@@ -0,0 +1,409 @@
+#include "OTAFlashWriter.h"
+
+OTAFlashWriter::OTAFlashWriter()
+    : _imageSize(0), _written(0), _committed(0), _skipped(0), _running(false), _data(false), _allocator(otaDefaultAllocator())
+#if defined(ESP32)
+      , _partition(nullptr), _sector(nullptr), _sectorLen(0)
+#endif
+{
+}
+
+OTAFlashWriter::~OTAFlashWriter() {
+    abort();
+}
+
+#if defined(ESP32)
+
+bool OTAFlashWriter::begin(size_t imageSize, size_t resumeOffset) {
+    abort();
+    _error = "";
+    
+    if (imageSize == 0 || resumeOffset >= imageSize || (resumeOffset % OTA_FLASH_SECTOR_SIZE) != 0) {
+        _error = "Invalid image size or resume offset";
+        return false;
+    }
+    
+    _partition = esp_ota_get_next_update_partition(nullptr);
+    if (_partition == nullptr) {
+        _error = "No OTA partition available";
+        return false;
+    }
+    
+    if (imageSize > _partition->size) {
+        _error = "Image larger than OTA partition";
+        _partition = nullptr;
+        return false;
+    }
+    
+    _sector = (uint8_t*)_allocator.allocate(OTA_FLASH_SECTOR_SIZE, OTA_MEMORY_INTERNAL);
+    if (_sector == nullptr) {
+        _error = "Memory allocation failed";
+        _partition = nullptr;
+        return false;
+    }
+    
+    _imageSize = imageSize;
+    _written = resumeOffset;
+    _committed = resumeOffset;
+    _skipped = 0;
+    _sectorLen = 0;
+    _running = true;
+    _data = false;
+    
+    return true;
+}
+
+bool OTAFlashWriter::beginData(size_t imageSize, const char* label) {
+    abort();
+    _error = "";
+    
+    if (imageSize == 0) {
+        _error = "Invalid image size";
+        return false;
+    }
+    
+    _partition = findDataPartition(label);
+    if (_partition == nullptr) {
+        _error = "No such data partition";
+        return false;
+    }
+    
+    if (imageSize > _partition->size) {
+        _error = "Image larger than data partition";
+        _partition = nullptr;
+        return false;
+    }
+    
+    _sector = (uint8_t*)_allocator.allocate(OTA_FLASH_SECTOR_SIZE, OTA_MEMORY_INTERNAL);
+    if (_sector == nullptr) {
+        _error = "Memory allocation failed";
+        _partition = nullptr;
+        return false;
+    }
+    
+    _imageSize = imageSize;
+    _written = 0;
+    _committed = 0;
+    _skipped = 0;
+    _sectorLen = 0;
+    _running = true;
+    _data = true;
+    
+    return true;
+}
+
+const esp_partition_t* OTAFlashWriter::findDataPartition(const char* label) {
+    if (label == nullptr) {
+        // Arduino's SPIFFS and LittleFS both use the SPIFFS subtype
+        const esp_partition_t* partition =
+            esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+        return partition ? partition :
+            esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, nullptr);
+    }
+    
+    // Overwriting otadata would change which application boots
+    const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == nullptr || partition->subtype == ESP_PARTITION_SUBTYPE_DATA_OTA) {
+        return nullptr;
+    }
+    return partition;
+}
+
+size_t OTAFlashWriter::write(const uint8_t* data, size_t size) {
+    if (!_running) {
+        return 0;
+    }
+    
+    size_t accepted = 0;
+    
+    while (accepted < size) {
+        if (_written >= _imageSize) {
+            _error = "Image larger than expected";
+            break;
+        }
+        
+        size_t space = min(OTA_FLASH_SECTOR_SIZE - _sectorLen, _imageSize - _written);
+        size_t toCopy = min(space, size - accepted);
+        
+        memcpy(_sector + _sectorLen, data + accepted, toCopy);
+        _sectorLen += toCopy;
+        _written += toCopy;
+        accepted += toCopy;
+        
+        if (_sectorLen == OTA_FLASH_SECTOR_SIZE && !flushSector()) {
+            reset();
+            return 0;
+        }
+    }
+    
+    return accepted;
+}
+
+uint8_t* OTAFlashWriter::getBuffer(size_t* space) {
+    *space = 0;
+    if (!_running || _written >= _imageSize) {
+        return nullptr;
+    }
+    
+    *space = min(OTA_FLASH_SECTOR_SIZE - _sectorLen, _imageSize - _written);
+    return _sector + _sectorLen;
+}
+
+bool OTAFlashWriter::commitBuffer(size_t size) {
+    if (!_running || size > min(OTA_FLASH_SECTOR_SIZE - _sectorLen, _imageSize - _written)) {
+        _error = "Invalid buffer commit";
+        return false;
+    }
+    
+    _sectorLen += size;
+    _written += size;
+    
+    if (_sectorLen == OTA_FLASH_SECTOR_SIZE && !flushSector()) {
+        reset();
+        return false;
+    }
+    
+    return true;
+}
+
+bool OTAFlashWriter::end() {
+    if (!_running) {
+        _error = "No update in progress";
+        return false;
+    }
+    
+    if (_written != _imageSize) {
+        _error = "Image incomplete";
+        abort();
+        return false;
+    }
+    
+    if (_sectorLen > 0 && !flushSector()) {
+        abort();
+        return false;
+    }
+    
+    if (_data) {
+        reset();
+        return true;
+    }
+    
+    // Validates the image before switching the boot partition
+    esp_err_t err = esp_ota_set_boot_partition(_partition);
+    if (err != ESP_OK) {
+        _error = String("Set boot partition failed: ") + esp_err_to_name(err);
+        abort();
+        return false;
+    }
+    
+    reset();
+    return true;
+}
+
+void OTAFlashWriter::abort() {
+    reset();
+}
+
+bool OTAFlashWriter::supportsResume() const {
+    return true;
+}
+
+bool OTAFlashWriter::readBack(size_t offset, uint8_t* data, size_t size) {
+    if (!_running || offset + size > _committed) {
+        return false;
+    }
+    
+    return esp_partition_read(_partition, offset, data, size) == ESP_OK;
+}
+
+bool OTAFlashWriter::flushSector() {
+    if (!_data && _committed == 0 && _sector[0] != OTA_IMAGE_MAGIC) {
+        _error = "Invalid firmware image";
+        return false;
+    }
+    
+    // Encrypted partitions require 16-byte aligned writes; pad the final sector
+    size_t writeLen = (_sectorLen + 15) & ~((size_t)15);
+    memset(_sector + _sectorLen, 0xFF, writeLen - _sectorLen);
+    
+    // Reading a sector takes a fraction of the time erasing it does
+    if (sectorMatches(writeLen)) {
+        _skipped++;
+        _committed += _sectorLen;
+        _sectorLen = 0;
+        return true;
+    }
+    
+    esp_err_t err = esp_partition_erase_range(_partition, _committed, OTA_FLASH_SECTOR_SIZE);
+    if (err != ESP_OK) {
+        _error = String("Flash erase failed: ") + esp_err_to_name(err);
+        return false;
+    }
+    
+    err = esp_partition_write(_partition, _committed, _sector, writeLen);
+    if (err != ESP_OK) {
+        _error = String("Flash write failed: ") + esp_err_to_name(err);
+        return false;
+    }
+    
+    _committed += _sectorLen;
+    _sectorLen = 0;
+    
+    return true;
+}
+
+bool OTAFlashWriter::sectorMatches(size_t length) {
+    // Compared in pieces so no second sector buffer is needed
+    uint8_t existing[256];
+    for (size_t pos = 0; pos < length; pos += sizeof(existing)) {
+        size_t len = min(sizeof(existing), length - pos);
+        if (esp_partition_read(_partition, _committed + pos, existing, len) != ESP_OK ||
+            memcmp(existing, _sector + pos, len) != 0) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void OTAFlashWriter::reset() {
+    if (_sector) {
+        _allocator.release(_sector);
+        _sector = nullptr;
+    }
+    _partition = nullptr;
+    _sectorLen = 0;
+    _running = false;
+}
+
+#else
+
+bool OTAFlashWriter::begin(size_t imageSize, size_t resumeOffset) {
+    abort();
+    _error = "";
+    
+    if (resumeOffset != 0) {
+        _error = "Resume not supported on this platform";
+        return false;
+    }
+    
+    if (!Update.begin(imageSize)) {
+        _error = Update.errorString();
+        return false;
+    }
+    
+    _imageSize = imageSize;
+    _written = 0;
+    _committed = 0;
+    _skipped = 0;
+    _running = true;
+    _data = false;
+    
+    return true;
+}
+
+bool OTAFlashWriter::beginData(size_t imageSize, const char* label) {
+    abort();
+    _error = "";
+    
+    if (!Update.begin(imageSize, U_SPIFFS, -1, LOW, label)) {
+        _error = Update.errorString();
+        return false;
+    }
+    
+    _imageSize = imageSize;
+    _written = 0;
+    _committed = 0;
+    _skipped = 0;
+    _running = true;
+    _data = true;
+    
+    return true;
+}
+
+size_t OTAFlashWriter::write(const uint8_t* data, size_t size) {
+    if (!_running) {
+        return 0;
+    }
+    
+    size_t written = Update.write(const_cast<uint8_t*>(data), size);
+    if (written != size) {
+        _error = Update.errorString();
+    }
+    _written += written;
+    
+    return written;
+}
+
+uint8_t* OTAFlashWriter::getBuffer(size_t* space) {
+    // Update keeps its buffer private; callers fall back to write()
+    *space = 0;
+    return nullptr;
+}
+
+bool OTAFlashWriter::commitBuffer(size_t size) {
+    _error = "Direct writes not supported";
+    return false;
+}
+
+bool OTAFlashWriter::end() {
+    if (!_running) {
+        _error = "No update in progress";
+        return false;
+    }
+    
+    if (!Update.end() || !Update.isFinished()) {
+        _error = Update.errorString();
+        reset();
+        return false;
+    }
+    
+    _committed = _written;
+    reset();
+    return true;
+}
+
+void OTAFlashWriter::abort() {
+    if (_running) {
+        Update.abort();
+    }
+    reset();
+}
+
+bool OTAFlashWriter::supportsResume() const {
+    return false;
+}
+
+bool OTAFlashWriter::readBack(size_t offset, uint8_t* data, size_t size) {
+    return false;
+}
+
+void OTAFlashWriter::reset() {
+    _running = false;
+}
+
+#endif
+
+void OTAFlashWriter::setAllocator(const OTAAllocator& allocator) {
+    _allocator = allocator;
+}
+
+bool OTAFlashWriter::isRunning() const {
+    return _running;
+}
+
+size_t OTAFlashWriter::bytesWritten() const {
+    return _written;
+}
+
+size_t OTAFlashWriter::bytesCommitted() const {
+    return _committed;
+}
+
+size_t OTAFlashWriter::sectorsSkipped() const {
+    return _skipped;
+}
+
+const char* OTAFlashWriter::errorString() const {
+    return _error.c_str();
+}
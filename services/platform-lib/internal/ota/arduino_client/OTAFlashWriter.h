@@ -0,0 +1,231 @@
+#ifndef OTA_FLASH_WRITER_H
+#define OTA_FLASH_WRITER_H
+
+#include <Arduino.h>
+#include "OTAAllocator.h"
+#include <Update.h>
+
+#if defined(ESP32)
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#endif
+
+// Flash erase/write granularity
+#define OTA_FLASH_SECTOR_SIZE 4096
+
+// First byte of every ESP application image
+#define OTA_IMAGE_MAGIC 0xE9
+
+/**
+ * @brief Sequential firmware writer for the OTA partition
+ * 
+ * Buffers incoming image data into whole flash sectors and writes them to the
+ * next OTA partition. On ESP32 the writer talks to the partition directly, so
+ * an interrupted update can be continued at a sector-aligned offset after a
+ * reboot, and previously written bytes can be read back for re-hashing. A
+ * sector the partition already holds, as after reinstalling the release it
+ * held before, is left alone instead of being erased and programmed again,
+ * which saves both flash wear and erase time. The new partition is only
+ * selected for boot by end(). On other targets it delegates to the core's
+ * Update class and resuming is not supported.
+ * 
+ * beginData() opens a session for a data partition instead, such as the
+ * filesystem or a configuration blob. It has no second copy to fall back on:
+ * sectors are overwritten in place as they arrive, and end() changes nothing
+ * about which partition boots.
+ */
+class OTAFlashWriter {
+public:
+    /**
+     * @brief Construct a new OTAFlashWriter object
+     */
+    OTAFlashWriter();
+    
+    /**
+     * @brief Destroy the OTAFlashWriter object, aborting any open session
+     */
+    ~OTAFlashWriter();
+    
+    /**
+     * @brief Set where buffers come from; takes effect from the next begin()
+     * 
+     * @param allocator Allocation strategy, otaDefaultAllocator() by default
+     */
+    void setAllocator(const OTAAllocator& allocator);
+    
+    /**
+     * @brief Open a write session for a firmware image
+     * 
+     * @param imageSize Total size of the image in bytes
+     * @param resumeOffset Sector-aligned offset of data already in the
+     *        partition from an earlier session (0 to start over)
+     * @return true if the session was opened
+     * @return false if the partition is unavailable, too small, or resuming
+     *         is not supported at this offset
+     */
+    bool begin(size_t imageSize, size_t resumeOffset = 0);
+    
+    /**
+     * @brief Open a write session for a data partition
+     * 
+     * Whatever uses the partition, such as a mounted filesystem, must leave
+     * it alone until the session ends. Bytes past the image are not touched.
+     * 
+     * @param imageSize Total size of the image in bytes
+     * @param label Label of the partition, or nullptr for the filesystem
+     *        (SPIFFS/LittleFS, else FAT) partition
+     * @return true if the session was opened
+     * @return false if the partition is missing, too small or not a data partition
+     */
+    bool beginData(size_t imageSize, const char* label = nullptr);
+    
+    /**
+     * @brief Append image data
+     * 
+     * @param data Image data
+     * @param size Data size
+     * @return size_t Bytes accepted (less than size on error)
+     */
+    size_t write(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Get the free part of the sector buffer so data can be read into it directly
+     * 
+     * Saves a copy compared to write(). Fill at most *space bytes and then
+     * call commitBuffer() with the number of bytes stored.
+     * 
+     * @param space Out: number of bytes that fit
+     * @return uint8_t* Where the next image bytes go, or nullptr if direct
+     *         writes are not supported or the session is not open
+     */
+    uint8_t* getBuffer(size_t* space);
+    
+    /**
+     * @brief Append data placed in the buffer returned by getBuffer()
+     * 
+     * @param size Number of bytes stored (at most the space reported)
+     * @return true if the data was accepted
+     * @return false on flash error
+     */
+    bool commitBuffer(size_t size);
+    
+    /**
+     * @brief Flush remaining data and mark the new image bootable
+     * 
+     * A data partition session only flushes.
+     * 
+     * @return true if the image is complete and was selected for boot
+     * @return false if the image is incomplete or failed validation
+     */
+    bool end();
+    
+    /**
+     * @brief Abandon the session without changing the boot partition
+     */
+    void abort();
+    
+    /**
+     * @brief Check whether a write session is open
+     */
+    bool isRunning() const;
+    
+    /**
+     * @brief Get the number of image bytes accepted so far
+     * 
+     * @return size_t Bytes written, including data still buffered in RAM
+     */
+    size_t bytesWritten() const;
+    
+    /**
+     * @brief Get the number of image bytes durably stored in flash
+     * 
+     * This is always sector-aligned and is the offset a later session can
+     * resume from.
+     * 
+     * @return size_t Bytes committed to flash
+     */
+    size_t bytesCommitted() const;
+    
+    /**
+     * @brief Check whether sessions can resume at a non-zero offset
+     */
+    bool supportsResume() const;
+    
+    /**
+     * @brief Read back data previously committed to the partition
+     * 
+     * @param offset Offset within the image
+     * @param data Output buffer
+     * @param size Number of bytes to read (must lie below bytesCommitted())
+     * @return true if the data was read
+     * @return false if the range is not committed or the read failed
+     */
+    bool readBack(size_t offset, uint8_t* data, size_t size);
+    
+    /**
+     * @brief Get the number of sectors of this session that were already in flash
+     * 
+     * @return size_t Sectors not erased and rewritten because their content matched
+     */
+    size_t sectorsSkipped() const;
+    
+    /**
+     * @brief Get a description of the last error
+     * 
+     * @return const char* Error message string
+     */
+    const char* errorString() const;
+    
+#if defined(ESP32)
+    /**
+     * @brief Find the data partition beginData() would write
+     * 
+     * @param label Partition label, or nullptr for the filesystem partition
+     * @return const esp_partition_t* The partition, or nullptr if there is no such data partition
+     */
+    static const esp_partition_t* findDataPartition(const char* label);
+#endif
+
+private:
+    size_t _imageSize;
+    size_t _written;
+    size_t _committed;
+    size_t _skipped;
+    bool _running;
+    bool _data;
+    String _error;
+    OTAAllocator _allocator;
+    
+#if defined(ESP32)
+    const esp_partition_t* _partition;
+    uint8_t* _sector;
+    size_t _sectorLen;
+    
+    /**
+     * @brief Erase and program the buffered sector
+     * 
+     * @return true if the sector was written
+     * @return false on flash error
+     */
+    bool flushSector();
+    
+    /**
+     * @brief Check whether the partition already holds the buffered sector
+     * 
+     * @param length Bytes to compare, from the start of the sector
+     * @return true if flash matches the buffer
+     */
+    bool sectorMatches(size_t length);
+#endif
+    
+    /**
+     * @brief Release buffers and close the session
+     */
+    void reset();
+    
+    // Non-copyable: owns the sector buffer
+    OTAFlashWriter(const OTAFlashWriter&);
+    OTAFlashWriter& operator=(const OTAFlashWriter&);
+};
+
+#endif // OTA_FLASH_WRITER_H
@@ -0,0 +1,136 @@
+#include "OTAInflater.h"
+
+#if defined(ESP32)
+
+OTAInflater::OTAInflater()
+    : _decompressor(nullptr), _dict(nullptr), _dictOffset(0), _allocator(otaDefaultAllocator()), _writer(nullptr),
+      _context(nullptr),
+      _output(0), _done(false), _outputFailed(false), _error("Not started") {
+}
+
+OTAInflater::~OTAInflater() {
+    end();
+}
+
+bool OTAInflater::begin(InflateOutputWriter writer, void* context) {
+    end();
+    
+    // Neither is touched by the network or flash, so both can live in PSRAM
+    _decompressor = (tinfl_decompressor*)_allocator.allocate(sizeof(tinfl_decompressor), OTA_MEMORY_BULK);
+    _dict = (uint8_t*)_allocator.allocate(TINFL_LZ_DICT_SIZE, OTA_MEMORY_BULK);
+    if (!_decompressor || !_dict) {
+        end();
+        return fail("Memory allocation failed");
+    }
+    
+    tinfl_init(_decompressor);
+    _dictOffset = 0;
+    _writer = writer;
+    _context = context;
+    _output = 0;
+    _done = false;
+    _outputFailed = false;
+    _error = "";
+    return true;
+}
+
+bool OTAInflater::write(const uint8_t* data, size_t size) {
+    if (!_decompressor) {
+        return fail("Not started");
+    }
+    
+    if (_done) {
+        return size == 0 || fail("Data after end of compressed stream");
+    }
+    
+    while (true) {
+        // Output wraps around the dictionary, which doubles as the output buffer
+        size_t inBytes = size;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - _dictOffset;
+        tinfl_status status = tinfl_decompress(_decompressor, data, &inBytes, _dict, _dict + _dictOffset,
+                                               &outBytes, TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        data += inBytes;
+        size -= inBytes;
+        
+        if (outBytes > 0) {
+            if (!_writer(_context, _dict + _dictOffset, outBytes)) {
+                _outputFailed = true;
+                return fail("Output write failed");
+            }
+            _output += outBytes;
+            _dictOffset = (_dictOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+        
+        if (status < TINFL_STATUS_DONE) {
+            return fail("Corrupt compressed data");
+        }
+        
+        if (status == TINFL_STATUS_DONE) {
+            _done = true;
+            return size == 0 || fail("Data after end of compressed stream");
+        }
+        
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && size == 0) {
+            return true;
+        }
+        
+        if (inBytes == 0 && outBytes == 0) {
+            return fail("Decompression stalled");
+        }
+    }
+}
+
+void OTAInflater::end() {
+    _allocator.release(_decompressor);
+    _allocator.release(_dict);
+    _decompressor = nullptr;
+    _dict = nullptr;
+}
+
+#else
+
+OTAInflater::OTAInflater()
+    : _allocator(otaDefaultAllocator()), _writer(nullptr), _context(nullptr), _output(0), _done(false),
+      _outputFailed(false), _error("Not started") {
+}
+
+OTAInflater::~OTAInflater() {
+}
+
+bool OTAInflater::begin(InflateOutputWriter writer, void* context) {
+    return fail("Compression not supported on this platform");
+}
+
+bool OTAInflater::write(const uint8_t* data, size_t size) {
+    return fail("Compression not supported on this platform");
+}
+
+void OTAInflater::end() {
+}
+
+#endif
+
+void OTAInflater::setAllocator(const OTAAllocator& allocator) {
+    _allocator = allocator;
+}
+
+bool OTAInflater::isComplete() const {
+    return _done;
+}
+
+bool OTAInflater::outputFailed() const {
+    return _outputFailed;
+}
+
+size_t OTAInflater::bytesOutput() const {
+    return _output;
+}
+
+const char* OTAInflater::errorString() const {
+    return _error;
+}
+
+bool OTAInflater::fail(const char* error) {
+    _error = error;
+    return false;
+}
@@ -0,0 +1,128 @@
+#ifndef OTA_INFLATER_H
+#define OTA_INFLATER_H
+
+#include <Arduino.h>
+#include "OTAAllocator.h"
+
+#if defined(ESP32)
+#include <rom/miniz.h>
+#endif
+
+// Payload encoding understood by OTAInflater
+#define OTA_COMPRESSION_ZLIB "zlib"
+
+/**
+ * @brief Callback function type for receiving decompressed data
+ * @param context Caller-supplied context pointer
+ * @param data Decompressed data
+ * @param size Data size
+ * @return true if the data was accepted
+ */
+typedef bool (*InflateOutputWriter)(void* context, const uint8_t* data, size_t size);
+
+/**
+ * @brief Streaming zlib decompressor for firmware payloads
+ * 
+ * Compressed data can be pushed in chunks of any size and decompressed output
+ * is passed on as soon as it is produced. On ESP32 this uses the inflate
+ * implementation in ROM, so it adds no code size. Deflate back-references
+ * reach up to 32 KB, so a 32 KB dictionary plus about 11 KB of decoder state
+ * are allocated by begin() and released by end(). Not available on other
+ * targets.
+ */
+class OTAInflater {
+public:
+    /**
+     * @brief Construct a new OTAInflater object
+     */
+    OTAInflater();
+    
+    /**
+     * @brief Destroy the OTAInflater object, releasing its buffers
+     */
+    ~OTAInflater();
+    
+    /**
+     * @brief Set where buffers come from; takes effect from the next begin()
+     * 
+     * @param allocator Allocation strategy, otaDefaultAllocator() by default
+     */
+    void setAllocator(const OTAAllocator& allocator);
+    
+    /**
+     * @brief Allocate buffers and start decompressing a new stream
+     * 
+     * @param writer Callback that receives the decompressed data in order
+     * @param context Pointer passed to the callback
+     * @return true if the decompressor is ready
+     * @return false if allocation failed or decompression is unsupported
+     */
+    bool begin(InflateOutputWriter writer, void* context);
+    
+    /**
+     * @brief Feed compressed data into the decompressor
+     * 
+     * @param data Compressed data
+     * @param size Data size
+     * @return true if the data was decompressed
+     * @return false if the stream is corrupt or the callback failed
+     */
+    bool write(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Release the buffers allocated by begin()
+     */
+    void end();
+    
+    /**
+     * @brief Check whether the end of the compressed stream was reached
+     */
+    bool isComplete() const;
+    
+    /**
+     * @brief Check whether the last failure came from the output callback
+     * 
+     * The callback is expected to report its own error in that case.
+     */
+    bool outputFailed() const;
+    
+    /**
+     * @brief Get the number of decompressed bytes produced so far
+     */
+    size_t bytesOutput() const;
+    
+    /**
+     * @brief Get a description of the last error
+     * 
+     * @return const char* Error message string
+     */
+    const char* errorString() const;
+
+private:
+#if defined(ESP32)
+    tinfl_decompressor* _decompressor;
+    uint8_t* _dict;
+    size_t _dictOffset;
+#endif
+    OTAAllocator _allocator;
+    InflateOutputWriter _writer;
+    void* _context;
+    size_t _output;
+    bool _done;
+    bool _outputFailed;
+    const char* _error;
+    
+    /**
+     * @brief Record an error
+     * 
+     * @param error Static error message
+     * @return false, so callers can return fail() directly
+     */
+    bool fail(const char* error);
+    
+    // Non-copyable: owns the dictionary
+    OTAInflater(const OTAInflater&);
+    OTAInflater& operator=(const OTAInflater&);
+};
+
+#endif // OTA_INFLATER_H
@@ -0,0 +1,182 @@
+#include "OTAPipeline.h"
+
+#if defined(ESP32)
+
+OTAPipeline::OTAPipeline()
+    : _running(false), _failed(false), _held(nullptr), _consumer(nullptr), _context(nullptr),
+      _allocator(otaDefaultAllocator()), _free(nullptr), _filled(nullptr), _done(nullptr) {
+    for (size_t i = 0; i < OTA_PIPELINE_DEPTH; i++) {
+        _buffers[i] = nullptr;
+    }
+}
+
+OTAPipeline::~OTAPipeline() {
+    end();
+}
+
+bool OTAPipeline::begin(size_t chunkSize, PipelineConsumer consumer, void* context) {
+    end();
+    
+    _consumer = consumer;
+    _context = context;
+    _failed = false;
+    _held = nullptr;
+    
+    _free = xQueueCreate(OTA_PIPELINE_DEPTH, sizeof(uint8_t*));
+    _filled = xQueueCreate(OTA_PIPELINE_DEPTH + 1, sizeof(Chunk));
+    _done = xSemaphoreCreateBinary();
+    if (_free == nullptr || _filled == nullptr || _done == nullptr) {
+        release();
+        return false;
+    }
+    
+    for (size_t i = 0; i < OTA_PIPELINE_DEPTH; i++) {
+        _buffers[i] = (uint8_t*)_allocator.allocate(chunkSize, OTA_MEMORY_INTERNAL);
+        if (_buffers[i] == nullptr) {
+            release();
+            return false;
+        }
+        xQueueSend(_free, &_buffers[i], 0);
+    }
+    
+    // Run the writer on the core the caller isn't using
+    BaseType_t core = (portNUM_PROCESSORS > 1) ? (xPortGetCoreID() == 0 ? 1 : 0) : 0;
+    if (xTaskCreatePinnedToCore(writerTask, "ota_writer", OTA_PIPELINE_STACK_SIZE, this, OTA_PIPELINE_PRIORITY,
+                                nullptr, core) != pdPASS) {
+        release();
+        return false;
+    }
+    
+    _running = true;
+    return true;
+}
+
+uint8_t* OTAPipeline::acquire() {
+    if (!_running || _failed) {
+        return nullptr;
+    }
+    
+    if (_held == nullptr && xQueueReceive(_free, &_held, pdMS_TO_TICKS(OTA_PIPELINE_TIMEOUT_MS)) != pdTRUE) {
+        _held = nullptr;
+    }
+    
+    return _held;
+}
+
+bool OTAPipeline::submit(size_t size) {
+    if (!_running || _held == nullptr) {
+        return false;
+    }
+    
+    Chunk chunk = { _held, size };
+    _held = nullptr;
+    xQueueSend(_filled, &chunk, portMAX_DELAY);
+    
+    return !_failed;
+}
+
+bool OTAPipeline::end() {
+    if (!_running) {
+        return !_failed;
+    }
+    
+    // An empty chunk tells the writer to finish once the queue is drained
+    Chunk last = { nullptr, 0 };
+    xQueueSend(_filled, &last, portMAX_DELAY);
+    xSemaphoreTake(_done, portMAX_DELAY);
+    
+    _running = false;
+    release();
+    
+    return !_failed;
+}
+
+bool OTAPipeline::isRunning() const {
+    return _running;
+}
+
+bool OTAPipeline::failed() const {
+    return _failed;
+}
+
+void OTAPipeline::writerTask(void* context) {
+    OTAPipeline* pipeline = static_cast<OTAPipeline*>(context);
+    Chunk chunk;
+    
+    while (xQueueReceive(pipeline->_filled, &chunk, portMAX_DELAY) == pdTRUE && chunk.data != nullptr) {
+        // After a failure keep recycling buffers so the network side can't block forever
+        if (!pipeline->_failed && !pipeline->_consumer(pipeline->_context, chunk.data, chunk.size)) {
+            pipeline->_failed = true;
+        }
+        xQueueSend(pipeline->_free, &chunk.data, portMAX_DELAY);
+    }
+    
+    xSemaphoreGive(pipeline->_done);
+    vTaskDelete(nullptr);
+}
+
+void OTAPipeline::release() {
+    for (size_t i = 0; i < OTA_PIPELINE_DEPTH; i++) {
+        _allocator.release(_buffers[i]);
+        _buffers[i] = nullptr;
+    }
+    
+    if (_free) {
+        vQueueDelete(_free);
+        _free = nullptr;
+    }
+    if (_filled) {
+        vQueueDelete(_filled);
+        _filled = nullptr;
+    }
+    if (_done) {
+        vSemaphoreDelete(_done);
+        _done = nullptr;
+    }
+    
+    _held = nullptr;
+}
+
+#else
+
+OTAPipeline::OTAPipeline()
+    : _running(false), _failed(false), _held(nullptr), _consumer(nullptr), _context(nullptr),
+      _allocator(otaDefaultAllocator()) {
+}
+
+OTAPipeline::~OTAPipeline() {
+}
+
+bool OTAPipeline::begin(size_t chunkSize, PipelineConsumer consumer, void* context) {
+    // No second task to hand chunks to; callers write them inline
+    return false;
+}
+
+uint8_t* OTAPipeline::acquire() {
+    return nullptr;
+}
+
+bool OTAPipeline::submit(size_t size) {
+    return false;
+}
+
+bool OTAPipeline::end() {
+    return true;
+}
+
+bool OTAPipeline::isRunning() const {
+    return false;
+}
+
+bool OTAPipeline::failed() const {
+    return false;
+}
+
+void OTAPipeline::release() {
+}
+
+#endif
+
+void OTAPipeline::setAllocator(const OTAAllocator& allocator) {
+    _allocator = allocator;
+}
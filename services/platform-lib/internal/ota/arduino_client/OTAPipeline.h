@@ -0,0 +1,151 @@
+#ifndef OTA_PIPELINE_H
+#define OTA_PIPELINE_H
+
+#include <Arduino.h>
+#include "OTAAllocator.h"
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#endif
+
+// Number of chunk buffers in flight between the network and the writer
+#ifndef OTA_PIPELINE_DEPTH
+#define OTA_PIPELINE_DEPTH 4
+#endif
+
+// Writer task configuration
+#ifndef OTA_PIPELINE_STACK_SIZE
+#define OTA_PIPELINE_STACK_SIZE 4096
+#endif
+#ifndef OTA_PIPELINE_PRIORITY
+#define OTA_PIPELINE_PRIORITY 1
+#endif
+
+// How long the network side waits for the writer to free a buffer
+#define OTA_PIPELINE_TIMEOUT_MS 10000
+
+/**
+ * @brief Callback function type for processing a received chunk
+ * @param context Caller-supplied context pointer
+ * @param data Chunk data
+ * @param size Chunk size
+ * @return true if the data was processed
+ */
+typedef bool (*PipelineConsumer)(void* context, const uint8_t* data, size_t size);
+
+/**
+ * @brief Hands downloaded chunks to a writer task on the other core
+ * 
+ * The network side fills buffers from a small ring and submits them; a
+ * FreeRTOS task pinned to the other core passes each one to the consumer
+ * (hashing, decoding and flash writes) and returns it to the ring. Receiving
+ * the next chunks then overlaps with flash sector erases and writes. Chunks
+ * are consumed in the order they were submitted. Only available on ESP32.
+ */
+class OTAPipeline {
+public:
+    /**
+     * @brief Construct a new OTAPipeline object
+     */
+    OTAPipeline();
+    
+    /**
+     * @brief Destroy the OTAPipeline object; stops the writer task
+     */
+    ~OTAPipeline();
+    
+    /**
+     * @brief Set where buffers come from; takes effect from the next begin()
+     * 
+     * @param allocator Allocation strategy, otaDefaultAllocator() by default
+     */
+    void setAllocator(const OTAAllocator& allocator);
+    
+    /**
+     * @brief Allocate the ring and start the writer task
+     * 
+     * @param chunkSize Size of each buffer
+     * @param consumer Callback run on the writer task for each chunk
+     * @param context Pointer passed to the consumer
+     * @return true if the pipeline is running
+     * @return false if memory or the task could not be allocated
+     */
+    bool begin(size_t chunkSize, PipelineConsumer consumer, void* context);
+    
+    /**
+     * @brief Get a free buffer of chunkSize bytes to receive into
+     * 
+     * Blocks while every buffer is in flight. The same buffer is returned
+     * until it is submitted.
+     * 
+     * @return uint8_t* Buffer, or nullptr if the consumer failed or the writer stalled
+     */
+    uint8_t* acquire();
+    
+    /**
+     * @brief Pass the acquired buffer to the writer task
+     * 
+     * @param size Number of bytes stored in the buffer
+     * @return true if the data was queued
+     * @return false if the consumer has failed
+     */
+    bool submit(size_t size);
+    
+    /**
+     * @brief Wait for every submitted chunk to be consumed, then stop the writer task
+     * 
+     * @return true if all chunks were consumed successfully
+     */
+    bool end();
+    
+    /**
+     * @brief Check whether the pipeline is running
+     */
+    bool isRunning() const;
+    
+    /**
+     * @brief Check whether the consumer has rejected a chunk
+     * 
+     * The consumer is expected to report its own error in that case.
+     */
+    bool failed() const;
+
+private:
+    struct Chunk {
+        uint8_t* data;
+        size_t size;
+    };
+    
+    bool _running;
+    volatile bool _failed;
+    uint8_t* _held;
+    PipelineConsumer _consumer;
+    void* _context;
+    OTAAllocator _allocator;
+    
+#if defined(ESP32)
+    uint8_t* _buffers[OTA_PIPELINE_DEPTH];
+    QueueHandle_t _free;
+    QueueHandle_t _filled;
+    SemaphoreHandle_t _done;
+    
+    /**
+     * @brief Writer task entry point; context is the OTAPipeline
+     */
+    static void writerTask(void* context);
+#endif
+    
+    /**
+     * @brief Free the ring and queues
+     */
+    void release();
+    
+    // Non-copyable: the writer task holds a pointer to this object
+    OTAPipeline(const OTAPipeline&);
+    OTAPipeline& operator=(const OTAPipeline&);
+};
+
+#endif // OTA_PIPELINE_H
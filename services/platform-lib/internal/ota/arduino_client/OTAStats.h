@@ -0,0 +1,38 @@
+#ifndef OTA_STATS_H
+#define OTA_STATS_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Where the time of the last update went
+ *
+ * Collected by OTAClient::performUpdate() and kept until the next one. Times
+ * are in milliseconds and summed over every request and chunk of the update,
+ * including the fallback from a failed delta or compressed download to the
+ * raw image. With pipelined writes, hashing and flash writes run on the
+ * writer task and overlap with the download, so the phases can add up to
+ * more than totalMs.
+ */
+struct OTAStats {
+    uint32_t dnsMs;               // Host name lookups
+    uint32_t tlsMs;               // TCP connects and TLS handshakes
+    uint32_t firstByteMs;         // First download request until its response headers, including any connect
+    uint32_t downloadMs;          // Receiving the payload, including inline decoding and writes
+    uint32_t hashMs;              // SHA-256 over the image, including re-hashing a resumed download
+    uint32_t verifyMs;            // Signature verification
+    uint32_t flashWriteMs;        // Writing the image to flash
+    uint32_t finalizeMs;          // Update.end(): final checks and switching the boot partition
+    uint32_t totalMs;             // Whole update, from performUpdate() to its final status
+    uint32_t bytesDownloaded;     // Payload bytes received, including any the server resent
+    uint32_t bytesFromCache;      // Payload bytes received from the local cache, including any it served wrong
+    uint32_t bytesReused;         // Image bytes copied from the running partition by a sector manifest update
+    uint32_t sectorsSkipped;      // Flash sectors that already held their data, so weren't erased and rewritten
+    uint32_t throughput;          // Average download rate in bytes per second
+    uint32_t minFreeHeap;         // Lowest free heap seen during the update
+    uint16_t retries;             // Reconnects after a dropped or failed download request
+    uint16_t chunksRejected;      // Downloaded sectors that didn't match the sector manifest and were fetched again
+    uint8_t  componentsInstalled; // Bundle components downloaded and written to their partitions
+    uint8_t  componentsSkipped;   // Bundle components their partition already held
+};
+
+#endif // OTA_STATS_H
@@ -0,0 +1,124 @@
+#include "OTAStatusQueue.h"
+
+#if defined(ESP32)
+#include <Preferences.h>
+#endif
+
+// NVS key for the saved queue
+#define OTA_STATUS_QUEUE_KEY "status_queue"
+
+OTAStatusQueue::OTAStatusQueue() : _count(0), _saved(false) {
+}
+
+void OTAStatusQueue::add(const char* releaseID, const char* status, int progress, const char* errorMessage,
+                         uint32_t bytesDownloaded, uint32_t bytesTotal, uint32_t throughput,
+                         const OTAStats* stats) {
+    if (releaseID == nullptr || status == nullptr) {
+        return;
+    }
+    
+    // A newer report for a queued release replaces the older one and moves to the back
+    size_t index = 0;
+    while (index < _count && strncmp(_reports[index].releaseID, releaseID, OTA_STATUS_RELEASE_ID_SIZE) != 0) {
+        index++;
+    }
+    if (index == _count && _count == OTA_STATUS_QUEUE_SIZE) {
+        index = 0;
+    }
+    if (index < _count) {
+        memmove(&_reports[index], &_reports[index + 1], (_count - index - 1) * sizeof(OTAStatusReport));
+        _count--;
+    }
+    
+    OTAStatusReport& report = _reports[_count++];
+    strlcpy(report.releaseID, releaseID, sizeof(report.releaseID));
+    strlcpy(report.status, status, sizeof(report.status));
+    report.progress = (int16_t)progress;
+    strlcpy(report.errorMessage, errorMessage ? errorMessage : "", sizeof(report.errorMessage));
+    report.bytesDownloaded = bytesDownloaded;
+    report.bytesTotal = bytesTotal;
+    report.throughput = throughput;
+    report.hasStats = (stats != nullptr);
+    if (stats) {
+        report.stats = *stats;
+    }
+}
+
+size_t OTAStatusQueue::count() const {
+    return _count;
+}
+
+const OTAStatusReport& OTAStatusQueue::get(size_t index) const {
+    return _reports[index];
+}
+
+void OTAStatusQueue::clear() {
+    _count = 0;
+}
+
+#if defined(ESP32)
+
+bool OTAStatusQueue::load(const char* prefsNamespace) {
+    Preferences prefs;
+    if (!prefs.begin(prefsNamespace, true)) {
+        return false;
+    }
+    
+    // A saved queue of another size or layout is ignored
+    size_t length = prefs.isKey(OTA_STATUS_QUEUE_KEY) ? prefs.getBytesLength(OTA_STATUS_QUEUE_KEY) : 0;
+    bool restored = false;
+    if (length > 0 && length <= sizeof(_reports) && length % sizeof(OTAStatusReport) == 0 &&
+        prefs.getBytes(OTA_STATUS_QUEUE_KEY, _reports, length) == length) {
+        _count = length / sizeof(OTAStatusReport);
+        restored = true;
+    }
+    _saved = length > 0;
+    prefs.end();
+    
+    // Make sure every restored string is terminated
+    for (size_t i = 0; i < _count; i++) {
+        _reports[i].releaseID[OTA_STATUS_RELEASE_ID_SIZE - 1] = '\0';
+        _reports[i].status[OTA_STATUS_NAME_SIZE - 1] = '\0';
+        _reports[i].errorMessage[OTA_STATUS_ERROR_SIZE - 1] = '\0';
+    }
+    
+    return restored;
+}
+
+bool OTAStatusQueue::save(const char* prefsNamespace) {
+    // Nothing saved and nothing to save: skip the flash write
+    if (_count == 0 && !_saved) {
+        return true;
+    }
+    
+    Preferences prefs;
+    if (!prefs.begin(prefsNamespace, false)) {
+        return false;
+    }
+    
+    bool saved;
+    if (_count == 0) {
+        saved = prefs.remove(OTA_STATUS_QUEUE_KEY);
+        _saved = !saved;
+    } else {
+        size_t length = _count * sizeof(OTAStatusReport);
+        saved = prefs.putBytes(OTA_STATUS_QUEUE_KEY, _reports, length) == length;
+        _saved = true;
+    }
+    prefs.end();
+    
+    return saved;
+}
+
+#else
+
+bool OTAStatusQueue::load(const char* prefsNamespace) {
+    return false;
+}
+
+bool OTAStatusQueue::save(const char* prefsNamespace) {
+    // No NVS; reports only live until the next reboot
+    return _count == 0;
+}
+
+#endif
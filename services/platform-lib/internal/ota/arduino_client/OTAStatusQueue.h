@@ -0,0 +1,100 @@
+#ifndef OTA_STATUS_QUEUE_H
+#define OTA_STATUS_QUEUE_H
+
+#include <Arduino.h>
+#include "OTAStats.h"
+
+// Number of releases whose latest status can be held for sending
+#ifndef OTA_STATUS_QUEUE_SIZE
+#define OTA_STATUS_QUEUE_SIZE 4
+#endif
+
+// Field sizes of a queued report, including the terminator; longer values are truncated
+#define OTA_STATUS_RELEASE_ID_SIZE 48
+#define OTA_STATUS_NAME_SIZE 16
+#define OTA_STATUS_ERROR_SIZE 80
+
+/**
+ * @brief One queued status report
+ */
+struct OTAStatusReport {
+    char releaseID[OTA_STATUS_RELEASE_ID_SIZE];
+    char status[OTA_STATUS_NAME_SIZE];
+    int16_t progress;
+    char errorMessage[OTA_STATUS_ERROR_SIZE];
+    uint32_t bytesDownloaded;
+    uint32_t bytesTotal;
+    uint32_t throughput;
+    bool hasStats;
+    OTAStats stats;
+};
+
+/**
+ * @brief Small queue of status reports waiting to be sent to the server
+ * 
+ * Only the latest report per release is kept: adding a report for a release
+ * that is already queued replaces it. When the queue is full the oldest
+ * release is dropped. The queue can be saved to NVS, so a report survives the
+ * reboot that follows an install. Persistence is only available on ESP32.
+ */
+class OTAStatusQueue {
+public:
+    /**
+     * @brief Construct an empty OTAStatusQueue
+     */
+    OTAStatusQueue();
+    
+    /**
+     * @brief Queue a report, replacing any earlier one for the same release
+     * 
+     * @param releaseID Release ID
+     * @param status Status string (OTA_STATUS_*)
+     * @param progress Progress percentage
+     * @param errorMessage Error message (nullptr for none)
+     * @param bytesDownloaded Payload bytes received so far (0 if not downloading)
+     * @param bytesTotal Payload size (0 if not downloading)
+     * @param throughput Download rate in bytes per second
+     * @param stats Update statistics to send along (nullptr for none)
+     */
+    void add(const char* releaseID, const char* status, int progress, const char* errorMessage,
+             uint32_t bytesDownloaded = 0, uint32_t bytesTotal = 0, uint32_t throughput = 0,
+             const OTAStats* stats = nullptr);
+    
+    /**
+     * @brief Number of queued reports
+     */
+    size_t count() const;
+    
+    /**
+     * @brief Get a queued report, oldest first
+     */
+    const OTAStatusReport& get(size_t index) const;
+    
+    /**
+     * @brief Drop all queued reports
+     */
+    void clear();
+    
+    /**
+     * @brief Restore reports saved by an earlier boot
+     * 
+     * @param prefsNamespace NVS namespace to read from
+     * @return true if saved reports were restored
+     */
+    bool load(const char* prefsNamespace);
+    
+    /**
+     * @brief Save the queued reports, or remove the saved copy if the queue is empty
+     * 
+     * @param prefsNamespace NVS namespace to write to
+     * @return true if NVS now matches the queue
+     */
+    bool save(const char* prefsNamespace);
+
+private:
+    OTAStatusReport _reports[OTA_STATUS_QUEUE_SIZE];
+    size_t _count;
+    bool _saved;
+};
+
+#endif // OTA_STATUS_QUEUE_H
@@ -0,0 +1,375 @@
+#include "OTATLSClient.h"
+
+#if defined(ESP32)
+
+#include <WiFi.h>
+#include <esp_attr.h>
+#include <esp_rom_crc.h>
+#include <mbedtls/net_sockets.h>
+
+#define OTA_TLS_SESSION_MAGIC 0x4f544153 // "OTAS"
+
+// Saved session; RTC_NOINIT memory keeps it across deep sleep and software resets
+struct OTATLSSessionCache {
+    uint32_t magic;
+    uint32_t endpoint;
+    uint32_t length;
+    uint32_t checksum;
+    uint8_t data[OTA_TLS_SESSION_MAX_SIZE];
+};
+
+static RTC_NOINIT_ATTR OTATLSSessionCache otaSessionCache;
+
+OTATLSClient::OTATLSClient()
+    : _caCert(nullptr), _insecure(false), _sessionResumption(true), _started(false), _secured(false),
+      _peeked(-1), _lookupTime(0), _handshakeTime(0) {
+}
+
+OTATLSClient::~OTATLSClient() {
+    stop();
+}
+
+void OTATLSClient::setCACert(const char* rootCA) {
+    _caCert = rootCA;
+    _insecure = false;
+}
+
+void OTATLSClient::setInsecure() {
+    _caCert = nullptr;
+    _insecure = true;
+}
+
+void OTATLSClient::setSessionResumption(bool enable) {
+    _sessionResumption = enable;
+}
+
+void OTATLSClient::clearSession() {
+    otaSessionCache.magic = 0;
+}
+
+uint32_t OTATLSClient::lookupTime() const {
+    return _lookupTime;
+}
+
+uint32_t OTATLSClient::handshakeTime() const {
+    return _handshakeTime;
+}
+
+void OTATLSClient::resetTimings() {
+    _lookupTime = 0;
+    _handshakeTime = 0;
+}
+
+int OTATLSClient::connect(IPAddress ip, uint16_t port) {
+    return startSession(ip, port, nullptr, OTA_TLS_CONNECT_TIMEOUT_MS);
+}
+
+int OTATLSClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    return startSession(ip, port, nullptr, timeout);
+}
+
+int OTATLSClient::connect(const char* host, uint16_t port) {
+    return connect(host, port, OTA_TLS_CONNECT_TIMEOUT_MS);
+}
+
+int OTATLSClient::connect(const char* host, uint16_t port, int32_t timeout) {
+    IPAddress ip;
+    unsigned long start = millis();
+    bool resolved = WiFi.hostByName(host, ip);
+    _lookupTime += millis() - start;
+    if (!resolved) {
+        return 0;
+    }
+    
+    return startSession(ip, port, host, timeout);
+}
+
+size_t OTATLSClient::write(uint8_t data) {
+    return write(&data, 1);
+}
+
+size_t OTATLSClient::write(const uint8_t* buf, size_t size) {
+    if (!_secured) {
+        return 0;
+    }
+    
+    size_t written = 0;
+    unsigned long start = millis();
+    
+    while (written < size) {
+        int ret = mbedtls_ssl_write(&_ssl, buf + written, size - written);
+        if (ret > 0) {
+            written += ret;
+            continue;
+        }
+        
+        if ((ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ) ||
+            millis() - start > OTA_TLS_CONNECT_TIMEOUT_MS) {
+            stop();
+            break;
+        }
+        delay(1);
+    }
+    
+    return written;
+}
+
+int OTATLSClient::available() {
+    int peeked = (_peeked >= 0) ? 1 : 0;
+    if (!_secured) {
+        return peeked;
+    }
+    
+    // Process incoming records so decrypted data waiting in mbedtls is counted
+    int ret = mbedtls_ssl_read(&_ssl, nullptr, 0);
+    int pending = peeked + mbedtls_ssl_get_bytes_avail(&_ssl);
+    
+    if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE && pending == 0) {
+        // Closed by the peer or a bad record
+        stop();
+    }
+    
+    return pending;
+}
+
+int OTATLSClient::read() {
+    uint8_t data;
+    return (read(&data, 1) == 1) ? data : -1;
+}
+
+int OTATLSClient::read(uint8_t* buf, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    
+    int count = 0;
+    if (_peeked >= 0) {
+        buf[0] = (uint8_t)_peeked;
+        _peeked = -1;
+        count = 1;
+        if (size == 1) {
+            return count;
+        }
+    }
+    
+    if (!_secured) {
+        return (count > 0) ? count : -1;
+    }
+    
+    int ret = mbedtls_ssl_read(&_ssl, buf + count, size - count);
+    if (ret > 0) {
+        return count + ret;
+    }
+    
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        stop();
+    }
+    
+    return (count > 0) ? count : -1;
+}
+
+int OTATLSClient::peek() {
+    if (_peeked < 0) {
+        _peeked = read();
+    }
+    
+    return _peeked;
+}
+
+void OTATLSClient::flush() {
+    // Records are sent as they are written; WiFiClient::flush() would drop received TLS data
+}
+
+void OTATLSClient::stop() {
+    if (_secured) {
+        mbedtls_ssl_close_notify(&_ssl);
+        _secured = false;
+    }
+    
+    if (_started) {
+        mbedtls_ssl_free(&_ssl);
+        mbedtls_ssl_config_free(&_conf);
+        mbedtls_ctr_drbg_free(&_drbg);
+        mbedtls_entropy_free(&_entropy);
+        mbedtls_x509_crt_free(&_caChain);
+        _started = false;
+    }
+    
+    _peeked = -1;
+    WiFiClient::stop();
+}
+
+uint8_t OTATLSClient::connected() {
+    if (!_secured) {
+        return 0;
+    }
+    
+    // Data already received can still be read after the peer has closed
+    if (available() > 0) {
+        return 1;
+    }
+    
+    return (_secured && WiFiClient::connected()) ? 1 : 0;
+}
+
+int OTATLSClient::startSession(IPAddress ip, uint16_t port, const char* host, int32_t timeout) {
+    unsigned long start = millis();
+    int connected = handshake(ip, port, host, timeout);
+    _handshakeTime += millis() - start;
+    
+    return connected;
+}
+
+int OTATLSClient::handshake(IPAddress ip, uint16_t port, const char* host, int32_t timeout) {
+    stop();
+    
+    if (!_insecure && _caCert == nullptr) {
+        return 0;
+    }
+    
+    if (timeout <= 0) {
+        timeout = OTA_TLS_CONNECT_TIMEOUT_MS;
+    }
+    
+    if (!WiFiClient::connect(ip, port, timeout)) {
+        return 0;
+    }
+    
+    mbedtls_ssl_init(&_ssl);
+    mbedtls_ssl_config_init(&_conf);
+    mbedtls_ctr_drbg_init(&_drbg);
+    mbedtls_entropy_init(&_entropy);
+    mbedtls_x509_crt_init(&_caChain);
+    _started = true;
+    
+    int ret = mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy, nullptr, 0);
+    if (ret == 0) {
+        ret = mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret == 0 && !_insecure) {
+        ret = mbedtls_x509_crt_parse(&_caChain, (const unsigned char*)_caCert, strlen(_caCert) + 1);
+    }
+    if (ret == 0) {
+        if (_insecure) {
+            mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_NONE);
+        } else {
+            mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+            mbedtls_ssl_conf_ca_chain(&_conf, &_caChain, nullptr);
+        }
+        mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &_drbg);
+        ret = mbedtls_ssl_setup(&_ssl, &_conf);
+    }
+    if (ret == 0 && host != nullptr) {
+        ret = mbedtls_ssl_set_hostname(&_ssl, host);
+    }
+    if (ret != 0) {
+        stop();
+        return 0;
+    }
+    
+    mbedtls_ssl_set_bio(&_ssl, this, sendCallback, recvCallback, nullptr);
+    
+    // Sessions are matched by name, so connections by address always do a full handshake
+    bool resumable = _sessionResumption && host != nullptr;
+    uint32_t endpoint = resumable ? endpointKey(host, port) : 0;
+    bool resuming = resumable && restoreSession(endpoint);
+    
+    unsigned long start = millis();
+    while ((ret = mbedtls_ssl_handshake(&_ssl)) != 0) {
+        if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+            millis() - start > (unsigned long)timeout) {
+            // Don't offer a session that may have caused the failure again
+            if (resuming) {
+                clearSession();
+            }
+            stop();
+            return 0;
+        }
+        delay(1);
+    }
+    
+    _secured = true;
+    
+    // Saved after every handshake, since the server may have issued a new ticket
+    if (resumable) {
+        saveSession(endpoint);
+    }
+    
+    return 1;
+}
+
+bool OTATLSClient::restoreSession(uint32_t endpoint) {
+    if (otaSessionCache.magic != OTA_TLS_SESSION_MAGIC || otaSessionCache.endpoint != endpoint ||
+        otaSessionCache.length > sizeof(otaSessionCache.data) ||
+        esp_rom_crc32_le(0, otaSessionCache.data, otaSessionCache.length) != otaSessionCache.checksum) {
+        return false;
+    }
+    
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    
+    bool restored = mbedtls_ssl_session_load(&session, otaSessionCache.data, otaSessionCache.length) == 0 &&
+                    mbedtls_ssl_set_session(&_ssl, &session) == 0;
+    
+    mbedtls_ssl_session_free(&session);
+    return restored;
+}
+
+void OTATLSClient::saveSession(uint32_t endpoint) {
+    // Invalidate first so a partial write is never mistaken for a session
+    clearSession();
+    
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    
+    size_t length = 0;
+    if (mbedtls_ssl_get_session(&_ssl, &session) == 0 &&
+        mbedtls_ssl_session_save(&session, otaSessionCache.data, sizeof(otaSessionCache.data), &length) == 0) {
+        otaSessionCache.endpoint = endpoint;
+        otaSessionCache.length = length;
+        otaSessionCache.checksum = esp_rom_crc32_le(0, otaSessionCache.data, length);
+        otaSessionCache.magic = OTA_TLS_SESSION_MAGIC;
+    }
+    
+    mbedtls_ssl_session_free(&session);
+}
+
+uint32_t OTATLSClient::endpointKey(const char* host, uint16_t port) const {
+    uint32_t key = esp_rom_crc32_le(0, (const uint8_t*)host, strlen(host));
+    key = esp_rom_crc32_le(key, (const uint8_t*)&port, sizeof(port));
+    
+    // Resuming skips certificate checks, so a session only counts for the trust settings it was verified with
+    uint8_t insecure = _insecure ? 1 : 0;
+    key = esp_rom_crc32_le(key, &insecure, sizeof(insecure));
+    if (_caCert != nullptr) {
+        key = esp_rom_crc32_le(key, (const uint8_t*)_caCert, strlen(_caCert));
+    }
+    
+    return key;
+}
+
+int OTATLSClient::sendCallback(void* context, const unsigned char* buf, size_t len) {
+    OTATLSClient* client = static_cast<OTATLSClient*>(context);
+    
+    size_t sent = client->WiFiClient::write(buf, len);
+    if (sent > 0) {
+        return (int)sent;
+    }
+    
+    return client->WiFiClient::connected() ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_CONN_RESET;
+}
+
+int OTATLSClient::recvCallback(void* context, unsigned char* buf, size_t len) {
+    OTATLSClient* client = static_cast<OTATLSClient*>(context);
+    
+    if (client->WiFiClient::available() <= 0) {
+        // 0 tells mbedtls the connection was closed
+        return client->WiFiClient::connected() ? MBEDTLS_ERR_SSL_WANT_READ : 0;
+    }
+    
+    int received = client->WiFiClient::read(buf, len);
+    return (received > 0) ? received : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+#endif
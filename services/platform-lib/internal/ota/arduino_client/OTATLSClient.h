@@ -0,0 +1,177 @@
+#ifndef OTA_TLS_CLIENT_H
+#define OTA_TLS_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+
+#if defined(ESP32)
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#endif
+
+// Timeout for the TCP connect and the TLS handshake when none is given
+#define OTA_TLS_CONNECT_TIMEOUT_MS 30000
+
+// Largest serialized TLS session kept for resumption (ticket plus peer certificate)
+#ifndef OTA_TLS_SESSION_MAX_SIZE
+#define OTA_TLS_SESSION_MAX_SIZE 2048
+#endif
+
+#if defined(ESP32)
+
+/**
+ * @brief HTTPS transport that resumes TLS sessions across connections and reboots
+ * 
+ * Works like WiFiClientSecure, but after each handshake the negotiated session
+ * (including any session ticket the server sent) is saved in RTC memory. The
+ * next connection to the same host, port and CA certificate offers it back to
+ * the server, which then skips the certificate exchange and key agreement. The
+ * saved session survives deep sleep and software resets, such as the restart
+ * after an update, but not a power cycle. If the server declines the session
+ * a full handshake is done as usual.
+ */
+class OTATLSClient : public WiFiClient {
+public:
+    /**
+     * @brief Construct a new OTATLSClient object
+     */
+    OTATLSClient();
+    
+    /**
+     * @brief Destroy the OTATLSClient object
+     */
+    ~OTATLSClient();
+    
+    /**
+     * @brief Set the CA certificate used to verify the server
+     * 
+     * @param rootCA PEM-encoded CA certificate; must stay valid while the client is used
+     */
+    void setCACert(const char* rootCA);
+    
+    /**
+     * @brief Skip server certificate verification (not recommended)
+     */
+    void setInsecure();
+    
+    /**
+     * @brief Enable or disable TLS session resumption (enabled by default)
+     * 
+     * @param enable true to save and offer sessions, false for full handshakes only
+     */
+    void setSessionResumption(bool enable);
+    
+    /**
+     * @brief Forget the saved TLS session
+     */
+    void clearSession();
+    
+    /**
+     * @brief Time spent in host name lookups since the last resetTimings(), in milliseconds
+     */
+    uint32_t lookupTime() const;
+    
+    /**
+     * @brief Time spent in TCP connects and TLS handshakes since the last resetTimings(), in milliseconds
+     */
+    uint32_t handshakeTime() const;
+    
+    /**
+     * @brief Restart the lookup and handshake timers
+     */
+    void resetTimings();
+    
+    int connect(IPAddress ip, uint16_t port);
+    int connect(IPAddress ip, uint16_t port, int32_t timeout);
+    int connect(const char* host, uint16_t port);
+    int connect(const char* host, uint16_t port, int32_t timeout);
+    
+    size_t write(uint8_t data);
+    size_t write(const uint8_t* buf, size_t size);
+    int available();
+    int read();
+    int read(uint8_t* buf, size_t size);
+    int peek();
+    void flush();
+    void stop();
+    uint8_t connected();
+
+private:
+    const char* _caCert;
+    bool _insecure;
+    bool _sessionResumption;
+    bool _started;
+    bool _secured;
+    int _peeked;
+    uint32_t _lookupTime;
+    uint32_t _handshakeTime;
+    
+    mbedtls_ssl_context _ssl;
+    mbedtls_ssl_config _conf;
+    mbedtls_entropy_context _entropy;
+    mbedtls_ctr_drbg_context _drbg;
+    mbedtls_x509_crt _caChain;
+    
+    /**
+     * @brief Connect with handshake(), adding the time it took to handshakeTime()
+     */
+    int startSession(IPAddress ip, uint16_t port, const char* host, int32_t timeout);
+    
+    /**
+     * @brief Open the TCP connection and run the TLS handshake
+     * 
+     * @param ip Server address
+     * @param port Server port
+     * @param host Server name for SNI and certificate checks (nullptr if unknown)
+     * @param timeout Timeout in milliseconds
+     * @return int 1 on success, 0 on failure
+     */
+    int handshake(IPAddress ip, uint16_t port, const char* host, int32_t timeout);
+    
+    /**
+     * @brief Offer the saved session to the server if it was made for this endpoint
+     * 
+     * @return true if a session will be offered
+     */
+    bool restoreSession(uint32_t endpoint);
+    
+    /**
+     * @brief Save the session negotiated by the last handshake
+     */
+    void saveSession(uint32_t endpoint);
+    
+    /**
+     * @brief Identify a host, port and trust setting for matching saved sessions
+     */
+    uint32_t endpointKey(const char* host, uint16_t port) const;
+    
+    /**
+     * @brief mbedtls transport callbacks over the underlying TCP connection
+     */
+    static int sendCallback(void* context, const unsigned char* buf, size_t len);
+    static int recvCallback(void* context, unsigned char* buf, size_t len);
+    
+    // Non-copyable: the mbedtls contexts point at each other
+    OTATLSClient(const OTATLSClient&);
+    OTATLSClient& operator=(const OTATLSClient&);
+};
+
+#else
+
+/**
+ * @brief WiFiClientSecure without session resumption on other targets
+ */
+class OTATLSClient : public WiFiClientSecure {
+public:
+    void setSessionResumption(bool enable) {}
+    void clearSession() {}
+    uint32_t lookupTime() const { return 0; }
+    uint32_t handshakeTime() const { return 0; }
+    void resetTimings() {}
+};
+
+#endif
+
+#endif // OTA_TLS_CLIENT_H
@@ -0,0 +1,48 @@
+#include "OTAThrottle.h"
+
+// Tokens are counted in millionths of a byte: a micros() tick at the configured rate
+#define OTA_THROTTLE_SCALE 1000000ULL
+
+OTAThrottle::OTAThrottle() : _rate(0), _burst(0), _tokens(0), _lastRefill(0) {
+}
+
+void OTAThrottle::setRate(uint32_t bytesPerSecond, size_t burst) {
+    _rate = bytesPerSecond;
+    _burst = max(burst, (size_t)1);
+    reset();
+}
+
+void OTAThrottle::reset() {
+    _tokens = (uint64_t)_burst * OTA_THROTTLE_SCALE;
+    _lastRefill = micros();
+}
+
+size_t OTAThrottle::allowance(size_t wanted) {
+    if (_rate == 0) {
+        return wanted;
+    }
+    
+    refill();
+    uint64_t tokens = _tokens / OTA_THROTTLE_SCALE;
+    return (tokens < wanted) ? (size_t)tokens : wanted;
+}
+
+void OTAThrottle::consume(size_t bytes) {
+    if (_rate == 0) {
+        return;
+    }
+    
+    uint64_t taken = (uint64_t)bytes * OTA_THROTTLE_SCALE;
+    _tokens = (taken < _tokens) ? _tokens - taken : 0;
+}
+
+void OTAThrottle::refill() {
+    unsigned long now = micros();
+    // Unsigned subtraction keeps this right across the micros() wrap
+    uint64_t elapsed = (unsigned long)(now - _lastRefill);
+    _lastRefill = now;
+    
+    uint64_t full = (uint64_t)_burst * OTA_THROTTLE_SCALE;
+    uint64_t tokens = _tokens + elapsed * _rate;
+    _tokens = min(tokens, full);
+}
@@ -0,0 +1,59 @@
+#ifndef OTA_THROTTLE_H
+#define OTA_THROTTLE_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Token bucket that limits how fast downloads read from the network
+ * 
+ * The bucket fills at the configured rate up to the burst size, and every
+ * byte read takes a token. A download that runs out of tokens stops reading;
+ * the data then stays in the TCP receive buffer, the window closes and the
+ * server slows down, which leaves the rest of the link to the application.
+ * One bucket is shared by all connections of a download.
+ */
+class OTAThrottle {
+public:
+    /**
+     * @brief Construct a new OTAThrottle with no limit
+     */
+    OTAThrottle();
+    
+    /**
+     * @brief Set the rate limit
+     * 
+     * @param bytesPerSecond Sustained rate, or 0 for no limit
+     * @param burst Most bytes that can be read at once after an idle spell (at least 1)
+     */
+    void setRate(uint32_t bytesPerSecond, size_t burst);
+    
+    /**
+     * @brief Fill the bucket
+     */
+    void reset();
+    
+    /**
+     * @brief Get how many bytes may be read now
+     * 
+     * @param wanted Bytes the caller would like to read
+     * @return size_t Up to wanted bytes; 0 means wait before reading
+     */
+    size_t allowance(size_t wanted);
+    
+    /**
+     * @brief Take tokens for bytes that were read
+     * 
+     * @param bytes Bytes read, at most the last allowance()
+     */
+    void consume(size_t bytes);
+
+private:
+    uint32_t _rate;
+    size_t _burst;
+    uint64_t _tokens;               // Bytes times 1e6, so slow rates refill between calls
+    unsigned long _lastRefill;      // micros()
+    
+    void refill();
+};
+
+#endif // OTA_THROTTLE_H
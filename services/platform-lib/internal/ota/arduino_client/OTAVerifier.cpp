@@ -0,0 +1,68 @@
+#include "OTAVerifier.h"
+
+OTAVerifier::OTAVerifier()
+    : _bytesProcessed(0), _started(false), _finished(false) {
+    mbedtls_sha256_init(&_ctx);
+    memset(_digest, 0, sizeof(_digest));
+}
+
+OTAVerifier::~OTAVerifier() {
+    mbedtls_sha256_free(&_ctx);
+}
+
+void OTAVerifier::begin() {
+    mbedtls_sha256_free(&_ctx);
+    mbedtls_sha256_init(&_ctx);
+    mbedtls_sha256_starts(&_ctx, 0); // 0 = SHA-256 (not SHA-224)
+    
+    memset(_digest, 0, sizeof(_digest));
+    _bytesProcessed = 0;
+    _started = true;
+    _finished = false;
+}
+
+void OTAVerifier::update(const uint8_t* data, size_t size) {
+    if (!_started || _finished || size == 0) {
+        return;
+    }
+    
+    mbedtls_sha256_update(&_ctx, data, size);
+    _bytesProcessed += size;
+}
+
+const uint8_t* OTAVerifier::finish() {
+    if (!_started) {
+        begin();
+    }
+    
+    if (!_finished) {
+        mbedtls_sha256_finish(&_ctx, _digest);
+        mbedtls_sha256_free(&_ctx);
+        _finished = true;
+    }
+    
+    return _digest;
+}
+
+const uint8_t* OTAVerifier::digest() const {
+    return _finished ? _digest : nullptr;
+}
+
+bool OTAVerifier::matchesHash(const String& expectedHash) const {
+    if (!_finished) {
+        return false;
+    }
+    
+    // Convert hash to hex string
+    char hashStr[OTA_SHA256_SIZE * 2 + 1];
+    for (int i = 0; i < OTA_SHA256_SIZE; i++) {
+        sprintf(hashStr + (i * 2), "%02x", _digest[i]);
+    }
+    hashStr[OTA_SHA256_SIZE * 2] = '\0';
+    
+    return (expectedHash.equalsIgnoreCase(hashStr));
+}
+
+size_t OTAVerifier::bytesProcessed() const {
+    return _bytesProcessed;
+}
@@ -0,0 +1,90 @@
+#ifndef OTA_VERIFIER_H
+#define OTA_VERIFIER_H
+
+#include <Arduino.h>
+#include <mbedtls/sha256.h>
+
+// Size of a SHA-256 digest in bytes
+#define OTA_SHA256_SIZE 32
+
+/**
+ * @brief Incremental SHA-256 verifier for firmware images
+ * 
+ * Firmware bytes are fed to the verifier as they arrive from the network, so
+ * the image is hashed exactly once. The resulting digest is used both for the
+ * hex hash comparison and for signature verification.
+ * 
+ * On ESP32 the mbedtls SHA-256 implementation is backed by the hardware SHA
+ * accelerator when CONFIG_MBEDTLS_HARDWARE_SHA is enabled (the Arduino core
+ * default), falling back to software if the engine is busy.
+ */
+class OTAVerifier {
+public:
+    /**
+     * @brief Construct a new OTAVerifier object
+     */
+    OTAVerifier();
+    
+    /**
+     * @brief Destroy the OTAVerifier object
+     */
+    ~OTAVerifier();
+    
+    /**
+     * @brief Start a new digest, discarding any previous state
+     */
+    void begin();
+    
+    /**
+     * @brief Feed image bytes into the digest
+     * 
+     * @param data Image data
+     * @param size Data size
+     */
+    void update(const uint8_t* data, size_t size);
+    
+    /**
+     * @brief Finalize the digest
+     * 
+     * Further calls to update() are ignored until begin() is called again.
+     * 
+     * @return const uint8_t* Digest (OTA_SHA256_SIZE bytes)
+     */
+    const uint8_t* finish();
+    
+    /**
+     * @brief Get the finalized digest
+     * 
+     * @return const uint8_t* Digest, or nullptr if finish() has not been called
+     */
+    const uint8_t* digest() const;
+    
+    /**
+     * @brief Compare the finalized digest with an expected hex hash
+     * 
+     * @param expectedHash Expected SHA-256 hash (hex string, case-insensitive)
+     * @return true if hash matches
+     * @return false if hash doesn't match or digest is not finalized
+     */
+    bool matchesHash(const String& expectedHash) const;
+    
+    /**
+     * @brief Get the number of bytes fed into the current digest
+     * 
+     * @return size_t Bytes processed
+     */
+    size_t bytesProcessed() const;
+
+private:
+    mbedtls_sha256_context _ctx;
+    uint8_t _digest[OTA_SHA256_SIZE];
+    size_t _bytesProcessed;
+    bool _started;
+    bool _finished;
+    
+    // Non-copyable: the mbedtls context may own hardware state
+    OTAVerifier(const OTAVerifier&);
+    OTAVerifier& operator=(const OTAVerifier&);
+};
+
+#endif // OTA_VERIFIER_H
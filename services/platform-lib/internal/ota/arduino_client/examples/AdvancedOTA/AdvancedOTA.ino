@@ -2,19 +2,19 @@
  * Advanced OTA Update Example
  * 
  * This example demonstrates advanced OTA features including:
- * - Automatic retry on failure
- * - Health check after update
- * - Rollback detection
- * - Persistent update state
+ * - New firmware booted on trial, with a health check before it is kept
+ * - Automatic rollback if it fails the check, crashes or hangs
+ * - Rollback outcome reported to the server
+ * 
+ * Rollback needs a bootloader built with CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE.
  * 
  * Requirements:
- * - ESP32 or ESP8266 board
+ * - ESP32 board
  * - WiFi connection
  * - Device registered in ATHENA platform
  */
-
+ 
 #include <WiFi.h>
-#include <Preferences.h>
 #include "OTAClient.h"
 
 // WiFi credentials
@@ -42,50 +42,41 @@ MIIDdzCCAl+gAwIBAgIEAgAAuTANBgkqhkiG9w0BAQUFADBaMQswCQYDVQQGEwJJ...
 // Create OTA client
 OTAClient otaClient(otaServerURL, deviceID, publicKey);
 
-// Preferences for persistent storage
-Preferences preferences;
-
 // Update configuration
 const unsigned long UPDATE_CHECK_INTERVAL = 10 * 60 * 1000; // 10 minutes
-const int MAX_UPDATE_RETRIES = 3;
 const unsigned long HEALTH_CHECK_TIMEOUT = 60 * 1000; // 1 minute
 
 unsigned long lastUpdateCheck = 0;
-int updateRetryCount = 0;
+unsigned long updateCheckInterval = UPDATE_CHECK_INTERVAL;
 bool updateInProgress = false;
 
+// Keep new firmware pending after a reboot, so the health check decides whether it stays
+bool verifyRollbackLater() {
+    return true;
+}
+
 void setup() {
     Serial.begin(115200);
     Serial.println("\n\nATHENA OTA Client - Advanced Example");
     Serial.println("=====================================");
     
-    // Initialize preferences
-    preferences.begin("ota", false);
+    // Initialize OTA client
+    otaClient.setCACertificate(caCert);
+    otaClient.setProgressCallback(onProgress);
+    otaClient.setStatusCallback(onStatus);
     
-    // Check if we just updated
-    bool justUpdated = preferences.getBool("just_updated", false);
-    if (justUpdated) {
-        Serial.println("Device just updated - performing health check...");
-        if (performHealthCheck()) {
-            Serial.println("Health check passed - update successful!");
-            preferences.putBool("just_updated", false);
-            preferences.putInt("retry_count", 0);
-            
-            // Report success to server
-            reportUpdateSuccess();
-        } else {
-            Serial.println("Health check failed - update may have issues");
-            int retries = preferences.getInt("retry_count", 0);
-            if (retries >= MAX_UPDATE_RETRIES) {
-                Serial.println("Max retries reached - requesting rollback");
-                reportUpdateFailure("Health check failed after max retries");
-            } else {
-                preferences.putInt("retry_count", retries + 1);
-                reportUpdateFailure("Health check failed - retry " + String(retries + 1));
-            }
-        }
+    // Roll back unless new firmware passes its health check within a minute. Started
+    // before WiFi, so firmware that can't connect is rolled back too.
+    otaClient.setValidationTimeout(HEALTH_CHECK_TIMEOUT);
+    
+    if (!otaClient.begin()) {
+        Serial.println("Failed to initialize OTA client");
+        return;
     }
     
+    Serial.println("OTA client initialized");
+    Serial.println("Device ID: " + String(deviceID));
+    
     // Connect to WiFi
     Serial.print("Connecting to WiFi");
     WiFi.begin(ssid, password);
@@ -97,28 +88,30 @@ void setup() {
     Serial.print("IP address: ");
     Serial.println(WiFi.localIP());
     
-    // Initialize OTA client
-    otaClient.setCACertificate(caCert);
-    otaClient.setProgressCallback(onProgress);
-    otaClient.setStatusCallback(onStatus);
-    
-    if (!otaClient.begin()) {
-        Serial.println("Failed to initialize OTA client");
-        return;
+    // Check if we just updated
+    if (otaClient.isValidationPending()) {
+        Serial.println("Device just updated - performing health check...");
+        if (performHealthCheck()) {
+            Serial.println("Health check passed - update successful!");
+            otaClient.markValid();
+        } else {
+            Serial.println("Health check failed - rolling back");
+            otaClient.rollback("Health check failed");
+        }
     }
     
-    Serial.println("OTA client initialized");
-    Serial.println("Device ID: " + String(deviceID));
-    
     // Check for updates on startup
     checkForUpdates();
 }
 
 void loop() {
     // Check for updates periodically
-    if (!updateInProgress && millis() - lastUpdateCheck >= UPDATE_CHECK_INTERVAL) {
+    if (!updateInProgress && millis() - lastUpdateCheck >= updateCheckInterval) {
         lastUpdateCheck = millis();
         checkForUpdates();
+        
+        // Follow the server's schedule when it sends one
+        updateCheckInterval = otaClient.getPollDelay() > 0 ? otaClient.getPollDelay() : UPDATE_CHECK_INTERVAL;
     }
     
     // Your application code here
@@ -136,26 +129,9 @@ void checkForUpdates() {
         Serial.println("  Size: " + String(update.binarySize) + " bytes");
         Serial.println("  Release Notes: " + update.releaseNotes);
         
-        // Check if we should skip this update due to previous failures
-        String lastFailedRelease = preferences.getString("failed_release", "");
-        if (lastFailedRelease == update.releaseID) {
-            int retries = preferences.getInt("retry_count", 0);
-            if (retries >= MAX_UPDATE_RETRIES) {
-                Serial.println("Skipping update - max retries reached for this release");
-                return;
-            }
-        } else {
-            // New release - reset retry count
-            preferences.putInt("retry_count", 0);
-        }
-        
         Serial.println("\nStarting update...");
         updateInProgress = true;
         
-        // Store update info for post-update verification
-        preferences.putString("current_release", update.releaseID);
-        preferences.putBool("just_updated", true);
-        
         if (otaClient.performUpdate(update)) {
             Serial.println("\nUpdate downloaded and installed successfully!");
             Serial.println("Rebooting in 3 seconds...");
@@ -166,14 +142,8 @@ void checkForUpdates() {
             Serial.print("Error: ");
             Serial.println(otaClient.getLastErrorMessage());
             
+            // The OTA client already reported the failure to the server
             updateInProgress = false;
-            preferences.putBool("just_updated", false);
-            preferences.putString("failed_release", update.releaseID);
-            
-            int retries = preferences.getInt("retry_count", 0);
-            preferences.putInt("retry_count", retries + 1);
-            
-            reportUpdateFailure(otaClient.getLastErrorMessage());
         }
     } else {
         int error = otaClient.getLastError();
@@ -216,29 +186,6 @@ bool performHealthCheck() {
     return true;
 }
 
-void reportUpdateSuccess() {
-    String releaseID = preferences.getString("current_release", "");
-    if (releaseID.length() == 0) {
-        return;
-    }
-    
-    // The OTA client already reported completion during performUpdate
-    // This is just for additional logging
-    Serial.println("Update success reported to server");
-}
-
-void reportUpdateFailure(const String& errorMessage) {
-    String releaseID = preferences.getString("current_release", "");
-    if (releaseID.length() == 0) {
-        return;
-    }
-    
-    Serial.println("Reporting update failure to server: " + errorMessage);
-    
-    // The OTA client already reported failure during performUpdate
-    // This is just for additional logging
-}
-
 void onProgress(size_t current, size_t total) {
     static int lastPercentage = -1;
     int percentage = (current * 100) / total;
@@ -9,7 +9,7 @@
  * - WiFi connection
  * - Device registered in ATHENA platform
  */
-
+ 
 #include <WiFi.h>
 #include "OTAClient.h"
 
@@ -38,9 +38,11 @@ MIIDdzCCAl+gAwIBAgIEAgAAuTANBgkqhkiG9w0BAQUFADBaMQswCQYDVQQGEwJJ...
 // Create OTA client
 OTAClient otaClient(otaServerURL, deviceID, publicKey);
 
-// Check for updates every 5 minutes
+// Check for updates every 5 minutes, give or take a minute so a fleet
+// doesn't poll in lockstep, backing off to an hour while the server is down
 const unsigned long UPDATE_CHECK_INTERVAL = 5 * 60 * 1000;
-unsigned long lastUpdateCheck = 0;
+const unsigned long UPDATE_CHECK_JITTER = 60 * 1000;
+const unsigned long UPDATE_CHECK_MAX_BACKOFF = 60 * 60 * 1000;
 
 void setup() {
     Serial.begin(115200);
@@ -62,6 +64,7 @@ void setup() {
     otaClient.setCACertificate(caCert);
     otaClient.setProgressCallback(onProgress);
     otaClient.setStatusCallback(onStatus);
+    otaClient.setPollPolicy(UPDATE_CHECK_INTERVAL, UPDATE_CHECK_JITTER, UPDATE_CHECK_MAX_BACKOFF);
     
     if (!otaClient.begin()) {
         Serial.println("Failed to initialize OTA client");
@@ -70,57 +73,22 @@ void setup() {
     
     Serial.println("OTA client initialized");
     Serial.println("Device ID: " + String(deviceID));
-    Serial.println("\nChecking for updates...");
     
-    // Check for updates immediately on startup
-    checkForUpdates();
+    // The first check follows within UPDATE_CHECK_JITTER of startup
 }
 
 void loop() {
     // Check for updates periodically
-    if (millis() - lastUpdateCheck >= UPDATE_CHECK_INTERVAL) {
-        lastUpdateCheck = millis();
-        checkForUpdates();
+    if (otaClient.loop()) {
+        Serial.println("\nUpdate completed successfully! Rebooting...");
+        delay(3000);
+        ESP.restart();
     }
     
     // Your application code here
     delay(1000);
 }
 
-void checkForUpdates() {
-    Serial.println("\n--- Checking for firmware updates ---");
-    
-    FirmwareUpdate update;
-    if (otaClient.checkForUpdate(&update)) {
-        Serial.println("Update available!");
-        Serial.println("  Release ID: " + update.releaseID);
-        Serial.println("  Version: " + update.version);
-        Serial.println("  Size: " + String(update.binarySize) + " bytes");
-        Serial.println("  Release Notes: " + update.releaseNotes);
-        Serial.println("\nStarting update...");
-        
-        if (otaClient.performUpdate(update)) {
-            Serial.println("\nUpdate completed successfully!");
-            Serial.println("Rebooting in 3 seconds...");
-            delay(3000);
-            ESP.restart();
-        } else {
-            Serial.println("\nUpdate failed!");
-            Serial.print("Error: ");
-            Serial.println(otaClient.getLastErrorMessage());
-        }
-    } else {
-        int error = otaClient.getLastError();
-        if (error == OTA_ERROR_NO_UPDATE) {
-            Serial.println("No update available - firmware is up to date");
-        } else {
-            Serial.println("Failed to check for updates");
-            Serial.print("Error: ");
-            Serial.println(otaClient.getLastErrorMessage());
-        }
-    }
-}
-
 void onProgress(size_t current, size_t total) {
     int percentage = (current * 100) / total;
     Serial.printf("Progress: %d%% (%d/%d bytes)\n", percentage, current, total);
@@ -0,0 +1,110 @@
+/**
+ * Deep Sleep OTA Update Example
+ * 
+ * A battery sensor wakes every few minutes to take a reading and goes back
+ * to deep sleep. In low-power mode the OTA client keeps its poll schedule
+ * and update check ETag in RTC memory, so most wakes don't touch the network
+ * for OTA at all, and an update is downloaded a slice per wake instead of
+ * keeping the radio on for the whole image.
+ * 
+ * Requirements:
+ * - ESP32 board
+ * - WiFi connection
+ * - Device registered in ATHENA platform
+ */
+ 
+#include <WiFi.h>
+#include "OTAClient.h"
+
+// WiFi credentials
+const char* ssid = "YOUR_WIFI_SSID";
+const char* password = "YOUR_WIFI_PASSWORD";
+
+// ATHENA OTA service configuration
+const char* otaServerURL = "https://athena.example.com";
+const char* deviceID = "YOUR_DEVICE_ID";
+
+// Public key for signature verification (PEM format)
+const char* publicKey = R"(
+-----BEGIN PUBLIC KEY-----
+MIIBIjANBgkqhkiG9w0BAQEFAAOCAQ8AMIIBCgKCAQEA...
+-----END PUBLIC KEY-----
+)";
+
+// CA certificate for HTTPS (optional but recommended)
+const char* caCert = R"(
+-----BEGIN CERTIFICATE-----
+MIIDdzCCAl+gAwIBAgIEAgAAuTANBgkqhkiG9w0BAQUFADBaMQswCQYDVQQGEwJJ...
+-----END CERTIFICATE-----
+)";
+
+OTAClient otaClient(otaServerURL, deviceID, publicKey);
+
+// Take a reading every 5 minutes; check for updates every 6 hours, give or take 30 minutes
+const unsigned long READING_INTERVAL = 5UL * 60 * 1000;
+const unsigned long UPDATE_CHECK_INTERVAL = 6UL * 60 * 60 * 1000;
+const unsigned long UPDATE_CHECK_JITTER = 30UL * 60 * 1000;
+const unsigned long UPDATE_CHECK_MAX_BACKOFF = 24UL * 60 * 60 * 1000;
+
+// Download for at most 20 seconds per wake, and sleep a minute between slices
+const unsigned long DOWNLOAD_SLICE = 20UL * 1000;
+const unsigned long SLICE_INTERVAL = 60UL * 1000;
+
+void setup() {
+    Serial.begin(115200);
+    
+    takeReading();
+    
+    otaClient.setCACertificate(caCert);
+    otaClient.setPollPolicy(UPDATE_CHECK_INTERVAL, UPDATE_CHECK_JITTER, UPDATE_CHECK_MAX_BACKOFF);
+    otaClient.setLowPowerMode(DOWNLOAD_SLICE, SLICE_INTERVAL);
+    
+    // Restores the schedule from before the last sleep; no network needed yet
+    if (!otaClient.begin()) {
+        Serial.println("Failed to initialize OTA client");
+        sleepFor(READING_INTERVAL);
+    }
+    
+    // Only bring up WiFi when a check or the next slice of a download is due
+    if (otaClient.getNextPollDelay() == 0 && connectWiFi()) {
+        if (otaClient.loop()) {
+            Serial.println("Update completed successfully! Rebooting...");
+            ESP.restart();
+        }
+        if (otaClient.getLastError() == OTA_ERROR_PAUSED) {
+            Serial.println(otaClient.getLastErrorMessage());
+        }
+    }
+    
+    sleepFor(min(READING_INTERVAL, otaClient.getNextPollDelay()));
+}
+
+void loop() {
+    // Never reached: every wake runs setup() and goes back to sleep
+}
+
+void takeReading() {
+    // Your sensor code here
+}
+
+bool connectWiFi() {
+    WiFi.begin(ssid, password);
+    unsigned long started = millis();
+    while (WiFi.status() != WL_CONNECTED) {
+        if (millis() - started > 15000) {
+            return false;
+        }
+        delay(100);
+    }
+    return true;
+}
+
+void sleepFor(unsigned long ms) {
+    // A check scheduled for right now still gets a short sleep, so the loop can't spin
+    if (ms < 1000) {
+        ms = 1000;
+    }
+    WiFi.disconnect(true);
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+    esp_deep_sleep_start();
+}
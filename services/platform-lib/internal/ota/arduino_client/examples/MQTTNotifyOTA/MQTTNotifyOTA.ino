@@ -0,0 +1,120 @@
+/**
+ * MQTT-Notified OTA Update Example
+ * 
+ * Instead of polling the ATHENA OTA service every few minutes, this example
+ * subscribes to the device's update notice topic and only checks over HTTP
+ * when the service announces a deployment for it. A slow fallback poll
+ * covers notices missed while the broker was unreachable.
+ * 
+ * Requirements:
+ * - ESP32 board
+ * - WiFi connection
+ * - Device registered in ATHENA platform
+ * - PubSubClient library (by Nick O'Leary)
+ */
+ 
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include "OTAClient.h"
+
+// WiFi credentials
+const char* ssid = "YOUR_WIFI_SSID";
+const char* password = "YOUR_WIFI_PASSWORD";
+
+// ATHENA OTA service configuration
+const char* otaServerURL = "https://athena.example.com";
+const char* deviceID = "YOUR_DEVICE_ID";
+
+// MQTT broker the OTA service publishes notices to
+const char* mqttBroker = "mqtt.athena.example.com";
+const uint16_t mqttPort = 1883;
+
+// Public key for signature verification (PEM format)
+const char* publicKey = R"(
+-----BEGIN PUBLIC KEY-----
+MIIBIjANBgkqhkiG9w0BAQEFAAOCAQ8AMIIBCgKCAQEA...
+-----END PUBLIC KEY-----
+)";
+
+// CA certificate for HTTPS (optional but recommended)
+const char* caCert = R"(
+-----BEGIN CERTIFICATE-----
+MIIDdzCCAl+gAwIBAgIEAgAAuTANBgkqhkiG9w0BAQUFADBaMQswCQYDVQQGEwJJ...
+-----END CERTIFICATE-----
+)";
+
+OTAClient otaClient(otaServerURL, deviceID, publicKey);
+
+WiFiClient mqttNetwork;
+PubSubClient mqtt(mqttNetwork);
+
+// Fallback poll in case a notice is missed; notices and polls are both
+// spread over the jitter window so a deployment doesn't hit the server at once
+const unsigned long FALLBACK_CHECK_INTERVAL = 24UL * 60 * 60 * 1000; // 24 hours
+const unsigned long CHECK_JITTER = 10UL * 60 * 1000;                 // 10 minutes
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("\n\nATHENA OTA Client - MQTT Notification Example");
+    Serial.println("==============================================");
+    
+    // Connect to WiFi
+    Serial.print("Connecting to WiFi");
+    WiFi.begin(ssid, password);
+    while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+        Serial.print(".");
+    }
+    Serial.println("\nWiFi connected!");
+    
+    // Initialize OTA client
+    otaClient.setCACertificate(caCert);
+    otaClient.setStatusCallback(onStatus);
+    otaClient.setPollPolicy(FALLBACK_CHECK_INTERVAL, CHECK_JITTER, FALLBACK_CHECK_INTERVAL);
+    
+    if (!otaClient.begin()) {
+        Serial.println("Failed to initialize OTA client");
+        return;
+    }
+    
+    mqtt.setServer(mqttBroker, mqttPort);
+    mqtt.setCallback(onMqttMessage);
+    
+    // The retained notice catches up on anything deployed while the device was off
+}
+
+void loop() {
+    if (!mqtt.connected()) {
+        connectMqtt();
+    }
+    mqtt.loop();
+    
+    // Checks shortly after a notice, or when the fallback poll is due
+    if (otaClient.loop()) {
+        Serial.println("Update completed successfully! Rebooting...");
+        delay(1000);
+        ESP.restart();
+    }
+    
+    // Your application code here
+    delay(10);
+}
+
+void connectMqtt() {
+    String clientID = String("athena-ota-") + deviceID;
+    if (mqtt.connect(clientID.c_str())) {
+        // The retained notice, if any, is delivered right after subscribing
+        mqtt.subscribe(otaClient.getUpdateNoticeTopic().c_str(), 1);
+        Serial.println("Subscribed to " + otaClient.getUpdateNoticeTopic());
+    } else {
+        delay(5000);
+    }
+}
+
+void onMqttMessage(char* topic, byte* payload, unsigned int length) {
+    otaClient.handleUpdateNotice(topic, payload, length);
+}
+
+void onStatus(const char* status, int progress) {
+    Serial.printf("Status: %s (%d%%)\n", status, progress);
+}
@@ -0,0 +1,99 @@
+#include <Arduino.h>
+#include <base64.h>
+#include "HostSim.h"
+
+unsigned long millis() {
+    return (unsigned long)(HostSim::now() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)HostSim::now();
+}
+
+void delay(unsigned long ms) {
+    HostSim::advance((uint64_t)ms * 1000);
+}
+
+void yield() {
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    unsigned long lastData = millis();
+    
+    while (count < length) {
+        int n = read(buffer + count, length - count);
+        if (n > 0) {
+            count += n;
+            lastData = millis();
+            continue;
+        }
+        if (millis() - lastData >= _timeout) {
+            break;
+        }
+        delay(1);
+    }
+    
+    return count;
+}
+
+static const char base64Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int base64Value(char c) {
+    const char* found = (c != '\0') ? strchr(base64Alphabet, c) : nullptr;
+    return found ? (int)(found - base64Alphabet) : -1;
+}
+
+int base64_enc_len(int inputLen) {
+    return (inputLen + 2) / 3 * 4;
+}
+
+int base64_encode(char* output, char* input, int inputLen) {
+    const uint8_t* in = (const uint8_t*)input;
+    int written = 0;
+    
+    for (int i = 0; i < inputLen; i += 3) {
+        uint32_t triple = (uint32_t)in[i] << 16;
+        if (i + 1 < inputLen) triple |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < inputLen) triple |= in[i + 2];
+        
+        output[written++] = base64Alphabet[(triple >> 18) & 0x3F];
+        output[written++] = base64Alphabet[(triple >> 12) & 0x3F];
+        output[written++] = (i + 1 < inputLen) ? base64Alphabet[(triple >> 6) & 0x3F] : '=';
+        output[written++] = (i + 2 < inputLen) ? base64Alphabet[triple & 0x3F] : '=';
+    }
+    
+    output[written] = '\0';
+    return written;
+}
+
+int base64_dec_len(char* input, int inputLen) {
+    int padding = 0;
+    if (inputLen > 0 && input[inputLen - 1] == '=') padding++;
+    if (inputLen > 1 && input[inputLen - 2] == '=') padding++;
+    return inputLen / 4 * 3 - padding;
+}
+
+int base64_decode(char* output, char* input, int inputLen) {
+    uint32_t bits = 0;
+    int pending = 0;
+    int written = 0;
+    
+    for (int i = 0; i < inputLen; i++) {
+        int value = base64Value(input[i]);
+        if (value < 0) {
+            // Padding, or the end of the encoded text
+            break;
+        }
+        
+        bits = (bits << 6) | (uint32_t)value;
+        pending += 6;
+        if (pending >= 8) {
+            pending -= 8;
+            output[written++] = (char)((bits >> pending) & 0xFF);
+        }
+    }
+    
+    return written;
+}
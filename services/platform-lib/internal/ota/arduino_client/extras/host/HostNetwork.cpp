@@ -0,0 +1,429 @@
+#include <HTTPClient.h>
+#include <Update.h>
+#include <WiFiClientSecure.h>
+#include <strings.h>
+#include "HostSim.h"
+
+// Fixed part of a request and a response head (request line or status line,
+// Host, User-Agent, Connection, Content-Length), added to the named headers
+#define HOST_REQUEST_HEAD_BYTES 96
+#define HOST_RESPONSE_HEAD_BYTES 64
+
+UpdateClass Update;
+
+// WiFiClient
+
+WiFiClient::WiFiClient()
+    : _connected(false), _closing(false), _bodyBytes(0), _data(nullptr), _size(0), _position(0), _segment(0) {
+}
+
+WiFiClient::~WiFiClient() {
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip, port, 0);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    return connect("", port, timeout);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    return connect(host, port, 0);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeout) {
+    HostSim::Scope scope;
+    stop();
+    
+    // The TCP handshake plus whatever the transport adds on top
+    uint64_t roundTrip = 2ULL * HostSim::config().latencyMs * 1000;
+    HostSim::advance(roundTrip * (1 + handshakeRoundTrips()));
+    
+    HostSim::counters().connections++;
+    _connected = true;
+    _bodyBytes = 0;
+    return 1;
+}
+
+uint8_t WiFiClient::handshakeRoundTrips() const {
+    return 0;
+}
+
+size_t WiFiClient::write(uint8_t data) {
+    return write(&data, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+    // Requests are handed to the server by HTTPClient
+    return _connected ? size : 0;
+}
+
+size_t WiFiClient::arrived() {
+    uint64_t now = HostSim::now();
+    while (_segment < _segments.size() && _segments[_segment].arrival <= now) {
+        _segment++;
+    }
+    size_t end = (_segment > 0) ? _segments[_segment - 1].end : 0;
+    return end - _position;
+}
+
+int WiFiClient::available() {
+    HostSim::Scope scope;
+    return _data ? (int)arrived() : 0;
+}
+
+int WiFiClient::read() {
+    uint8_t c;
+    return (read(&c, 1) == 1) ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+    HostSim::Scope scope;
+    size_t count = _data ? std::min(arrived(), size) : 0;
+    if (count == 0) {
+        return -1;
+    }
+    
+    memcpy(buf, _data + _position, count);
+    _position += count;
+    return (int)count;
+}
+
+int WiFiClient::peek() {
+    HostSim::Scope scope;
+    return (_data && arrived() > 0) ? _data[_position] : -1;
+}
+
+void WiFiClient::flush() {
+    // Like the ESP32 core: drop whatever has been received
+    HostSim::Scope scope;
+    if (_data) {
+        _position += arrived();
+    }
+}
+
+void WiFiClient::stop() {
+    HostSim::Scope scope;
+    _connected = false;
+    _closing = false;
+    _data = nullptr;
+    _size = 0;
+    _position = 0;
+    _segment = 0;
+    _segments.clear();
+}
+
+uint8_t WiFiClient::connected() {
+    HostSim::Scope scope;
+    if (!_connected) {
+        return 0;
+    }
+    
+    // A dropped connection stays readable until its last bytes are read
+    if (_closing && _segment == _segments.size() && arrived() == 0) {
+        stop();
+        return 0;
+    }
+    return 1;
+}
+
+void WiFiClient::simReceive(const uint8_t* data, size_t size, uint64_t start) {
+    HostSim::Scope scope;
+    _data = data;
+    _size = size;
+    _position = 0;
+    _segment = 0;
+    
+    // Dropouts cut the body short after a number of bytes per connection
+    size_t delivered = size;
+    size_t limit = HostSim::config().disconnectEvery;
+    if (limit > 0 && _bodyBytes + size > limit) {
+        delivered = (limit > _bodyBytes) ? limit - _bodyBytes : 0;
+        _closing = true;
+        HostSim::counters().dropped++;
+    }
+    _bodyBytes += delivered;
+    HostSim::counters().bytesDown += delivered;
+    
+    std::vector<std::pair<size_t, uint64_t> > arrivals;
+    HostSim::scheduleTransfer(delivered, start, &arrivals);
+    _segments.resize(arrivals.size());
+    for (size_t i = 0; i < arrivals.size(); i++) {
+        _segments[i].end = arrivals[i].first;
+        _segments[i].arrival = arrivals[i].second;
+    }
+}
+
+size_t WiFiClient::simPending() const {
+    return _data ? _size - _position : 0;
+}
+
+uint8_t WiFiClientSecure::handshakeRoundTrips() const {
+    return HostSim::config().tlsRoundTrips;
+}
+
+// HTTPClient
+
+HTTPClient::HTTPClient() : _client(nullptr), _reuse(true), _port(0), _size(-1) {
+}
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+    HostSim::Scope scope;
+    std::string rest(url.c_str());
+    _port = 80;
+    
+    size_t scheme = rest.find("://");
+    if (scheme != std::string::npos) {
+        if (rest.compare(0, scheme, "https") == 0) {
+            _port = 443;
+        }
+        rest = rest.substr(scheme + 3);
+    }
+    
+    size_t slash = rest.find('/');
+    _host = rest.substr(0, slash);
+    _path = (slash != std::string::npos) ? rest.substr(slash) : "/";
+    
+    size_t colon = _host.find(':');
+    if (colon != std::string::npos) {
+        _port = (uint16_t)atoi(_host.c_str() + colon + 1);
+        _host = _host.substr(0, colon);
+    }
+    
+    _client = &client;
+    _requestHeaders.clear();
+    _responseHeaders.clear();
+    _size = -1;
+    return !_host.empty();
+}
+
+void HTTPClient::end() {
+    HostSim::Scope scope;
+    if (_client != nullptr && (!_reuse || _client->simPending() > 0)) {
+        // Unread body bytes would be taken for the next response
+        _client->stop();
+    }
+    _requestHeaders.clear();
+    _responseHeaders.clear();
+    _size = -1;
+}
+
+void HTTPClient::setReuse(bool reuse) {
+    _reuse = reuse;
+}
+
+void HTTPClient::addHeader(const String& name, const String& value, bool first, bool replace) {
+    HostSim::Scope scope;
+    for (size_t i = 0; replace && i < _requestHeaders.size(); i++) {
+        if (strcasecmp(_requestHeaders[i].first.c_str(), name.c_str()) == 0) {
+            _requestHeaders[i].second = value.c_str();
+            return;
+        }
+    }
+    _requestHeaders.push_back(std::make_pair(std::string(name.c_str()), std::string(value.c_str())));
+}
+
+void HTTPClient::collectHeaders(const char* headerKeys[], const size_t headerKeysCount) {
+    HostSim::Scope scope;
+    _collect.assign(headerKeys, headerKeys + headerKeysCount);
+}
+
+int HTTPClient::sendRequest(const char* method, uint8_t* payload, size_t size) {
+    HostSim::Scope scope;
+    if (_client == nullptr) {
+        return HTTPC_ERROR_NOT_CONNECTED;
+    }
+    if (!_client->connected() && !_client->connect(_host.c_str(), _port)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+    
+    HostSimRequest request;
+    request.method = method;
+    request.path = _path;
+    request.headers = _requestHeaders;
+    if (payload != nullptr) {
+        request.body.assign((const char*)payload, size);
+    }
+    
+    size_t requestBytes = HOST_REQUEST_HEAD_BYTES + _path.size() + _host.size() + size;
+    for (size_t i = 0; i < _requestHeaders.size(); i++) {
+        requestBytes += _requestHeaders[i].first.size() + _requestHeaders[i].second.size() + 4;
+    }
+    HostSim::counters().bytesUp += requestBytes;
+    
+    HostSimResponse response;
+    HostSim::handle(request, response);
+    
+    const HostSimConfig& config = HostSim::config();
+    uint64_t latency = config.latencyMs * 1000ULL;
+    uint64_t answered = HostSim::now() + HostSim::transferTime(requestBytes) + latency + config.serverMs * 1000ULL;
+    
+    size_t headBytes = HOST_RESPONSE_HEAD_BYTES;
+    for (size_t i = 0; i < response.headers.size(); i++) {
+        headBytes += response.headers[i].first.size() + response.headers[i].second.size() + 4;
+    }
+    uint64_t bodyStart = answered + HostSim::transferTime(headBytes);
+    
+    // sendRequest() returns once the response head has been parsed
+    HostSim::waitUntil(bodyStart + latency);
+    
+    _responseHeaders = response.headers;
+    const uint8_t* body = response.data;
+    if (body == nullptr) {
+        _body.swap(response.body);
+        body = (const uint8_t*)_body.data();
+        _size = (int)_body.size();
+    } else {
+        _size = (int)response.size;
+    }
+    _client->simReceive(body, _size, bodyStart);
+    
+    return response.status;
+}
+
+int HTTPClient::getSize() {
+    return _size;
+}
+
+WiFiClient& HTTPClient::getStream() {
+    return *_client;
+}
+
+WiFiClient* HTTPClient::getStreamPtr() {
+    return _client;
+}
+
+String HTTPClient::getString() {
+    String body;
+    if (_client == nullptr || _size <= 0) {
+        return body;
+    }
+    
+    body.reserve(_size);
+    char buffer[256];
+    int remaining = _size;
+    while (remaining > 0) {
+        size_t read = _client->readBytes(buffer, std::min((size_t)remaining, sizeof(buffer)));
+        if (read == 0) {
+            break;
+        }
+        body.concat(buffer, read);
+        remaining -= read;
+    }
+    return body;
+}
+
+String HTTPClient::header(const char* name) {
+    HostSim::Scope scope;
+    bool collected = false;
+    for (size_t i = 0; i < _collect.size(); i++) {
+        collected = collected || strcasecmp(_collect[i].c_str(), name) == 0;
+    }
+    
+    for (size_t i = 0; collected && i < _responseHeaders.size(); i++) {
+        if (strcasecmp(_responseHeaders[i].first.c_str(), name) == 0) {
+            return String(_responseHeaders[i].second.c_str());
+        }
+    }
+    return String();
+}
+
+bool HTTPClient::connected() {
+    return _client != nullptr && _client->connected();
+}
+
+// Update
+
+// Label of the partition Arduino's filesystems use by default
+static const char* partitionName(const char* label) {
+    return label ? label : "spiffs";
+}
+
+UpdateClass::UpdateClass() : _target(&_image), _size(0), _running(false), _finished(false), _error(nullptr) {
+}
+
+bool UpdateClass::begin(size_t size, int command, int ledPin, uint8_t ledOn, const char* label) {
+    HostSim::Scope scope;
+    if (_running) {
+        _error = "Already Running";
+        return false;
+    }
+    if (size == 0 || size == UPDATE_SIZE_UNKNOWN) {
+        _error = "Bad Size Given";
+        return false;
+    }
+    
+    // Flash, not heap: allocated in simulation scope
+    _target = (command == U_SPIFFS) ? &_partitions[partitionName(label)] : &_image;
+    _target->clear();
+    _target->reserve(size);
+    _size = size;
+    _running = true;
+    _finished = false;
+    _error = nullptr;
+    return true;
+}
+
+size_t UpdateClass::write(uint8_t* data, size_t len) {
+    HostSim::Scope scope;
+    if (!_running) {
+        return 0;
+    }
+    if (_target->size() + len > _size) {
+        _error = "Bad Size Given";
+        return 0;
+    }
+    
+    _target->insert(_target->end(), data, data + len);
+    HostSim::advance((uint64_t)len * 1000000ULL / HostSim::config().flashRate);
+    return len;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+    HostSim::Scope scope;
+    if (!_running) {
+        _error = "Not Running";
+        return false;
+    }
+    if (_target->size() < _size && !evenIfRemaining) {
+        _error = "Not Finished";
+        return false;
+    }
+    
+    // The bootloader checks the image by reading it back, roughly ten times faster than writing
+    if (_target == &_image) {
+        HostSim::advance((uint64_t)_image.size() * 100000ULL / HostSim::config().flashRate);
+    }
+    _running = false;
+    _finished = true;
+    return true;
+}
+
+void UpdateClass::abort() {
+    _running = false;
+    _finished = false;
+    _error = "Aborted";
+}
+
+bool UpdateClass::isFinished() {
+    return _finished;
+}
+
+bool UpdateClass::isRunning() {
+    return _running;
+}
+
+const char* UpdateClass::errorString() {
+    return _error ? _error : "No Error";
+}
+
+const std::vector<uint8_t>& UpdateClass::simImage() const {
+    return _image;
+}
+
+const std::vector<uint8_t>& UpdateClass::simPartition(const char* label) const {
+    static const std::vector<uint8_t> empty;
+    std::map<std::string, std::vector<uint8_t>>::const_iterator found = _partitions.find(partitionName(label));
+    return (found != _partitions.end()) ? found->second : empty;
+}
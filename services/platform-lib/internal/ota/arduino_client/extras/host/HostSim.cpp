@@ -0,0 +1,291 @@
+#include "HostSim.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <random>
+#include <set>
+
+namespace {
+
+HostSimConfig simConfig;
+HostSimCounters simCounters;
+HostSim::Handler simHandler;
+std::mt19937 lossRandom;
+std::set<uint64_t> linkSlots;
+
+std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+uint64_t clockOffset = 0;
+uint64_t clockLast = 0;
+
+int scopeDepth = 0;
+uint64_t scopeStarted = 0;
+uint64_t simCpu = 0;
+
+bool heapTracking = false;
+size_t heapInUse = 0;
+size_t heapPeakBytes = 0;
+
+uint64_t cpuClock(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+} // namespace
+
+std::string HostSimRequest::header(const std::string& name) const {
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (strcasecmp(headers[i].first.c_str(), name.c_str()) == 0) {
+            return headers[i].second;
+        }
+    }
+    return std::string();
+}
+
+void HostSim::configure(const HostSimConfig& config) {
+    simConfig = config;
+    simCounters = HostSimCounters();
+    lossRandom.seed(config.seed);
+    linkSlots.clear();
+    clockStart = std::chrono::steady_clock::now();
+    clockOffset = 0;
+    clockLast = 0;
+    simCpu = 0;
+}
+
+const HostSimConfig& HostSim::config() {
+    return simConfig;
+}
+
+uint64_t HostSim::now() {
+    // Time spent simulating doesn't pass on the device
+    uint64_t real = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - clockStart).count();
+    uint64_t time = ((real > simCpu) ? real - simCpu : 0) + clockOffset;
+    
+    // Simulation CPU time is measured on a different clock, so the difference can step back a tick
+    clockLast = std::max(clockLast, time);
+    return clockLast;
+}
+
+void HostSim::advance(uint64_t micros) {
+    clockOffset += micros;
+}
+
+void HostSim::waitUntil(uint64_t time) {
+    uint64_t current = now();
+    if (time > current) {
+        advance(time - current);
+    }
+}
+
+void HostSim::setHandler(Handler handler) {
+    simHandler = handler;
+}
+
+void HostSim::handle(const HostSimRequest& request, HostSimResponse& response) {
+    simCounters.requests++;
+    if (simHandler) {
+        simHandler(request, response);
+    }
+}
+
+uint64_t HostSim::transferTime(size_t size) {
+    return (simConfig.bandwidth > 0) ? (uint64_t)size * 1000000ULL / simConfig.bandwidth : 0;
+}
+
+void HostSim::scheduleTransfer(size_t size, uint64_t start, std::vector<std::pair<size_t, uint64_t> >* arrivals) {
+    arrivals->clear();
+    arrivals->reserve(size / HOST_SIM_SEGMENT_SIZE + 1);
+    
+    uint64_t latency = simConfig.latencyMs * 1000ULL;
+    uint64_t timeout = std::max((uint64_t)HOST_SIM_MIN_RTO_MS * 1000, 4 * latency);
+    size_t window = simConfig.windowSize ? std::max(simConfig.windowSize / HOST_SIM_SEGMENT_SIZE, (size_t)1) : 0;
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    
+    // The link is divided into slots of one segment; slots in the past can't be taken any more
+    uint64_t slot = std::max(transferTime(HOST_SIM_SEGMENT_SIZE), (uint64_t)1);
+    linkSlots.erase(linkSlots.begin(), linkSlots.lower_bound(now() / slot));
+    
+    uint64_t ready = start;
+    for (size_t offset = 0; offset < size; ) {
+        offset += std::min((size_t)HOST_SIM_SEGMENT_SIZE, size - offset);
+        
+        if (window > 0 && arrivals->size() >= window) {
+            ready = std::max(ready, (*arrivals)[arrivals->size() - window].second + latency);
+        }
+        // A lost segment stalls the sender for a retransmission timeout
+        if (simConfig.lossRate > 0 && chance(lossRandom) < simConfig.lossRate) {
+            ready += timeout;
+            simCounters.lostSegments++;
+        }
+        
+        uint64_t index = (ready + slot - 1) / slot;
+        while (!linkSlots.insert(index).second) {
+            index++;
+        }
+        arrivals->push_back(std::make_pair(offset, (index + 1) * slot + latency));
+    }
+}
+
+HostSimCounters& HostSim::counters() {
+    return simCounters;
+}
+
+void HostSim::startHeapTracking() {
+    heapTracking = true;
+    heapPeakBytes = heapInUse;
+}
+
+void HostSim::stopHeapTracking() {
+    heapTracking = false;
+}
+
+size_t HostSim::heapPeak() {
+    return heapPeakBytes;
+}
+
+uint64_t HostSim::cpuTime() {
+    return cpuClock(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+uint64_t HostSim::simCpuTime() {
+    return simCpu;
+}
+
+HostSim::Scope::Scope() {
+    if (scopeDepth++ == 0) {
+        scopeStarted = cpuClock(CLOCK_THREAD_CPUTIME_ID);
+    }
+}
+
+HostSim::Scope::~Scope() {
+    if (--scopeDepth == 0) {
+        simCpu += cpuClock(CLOCK_THREAD_CPUTIME_ID) - scopeStarted;
+    }
+}
+
+// Heap accounting: the benchmark links with -Wl,--wrap=malloc,--wrap=free,
+// --wrap=calloc,--wrap=realloc so the client's allocations come through here.
+// Each block carries a header saying whether it was counted, so
+// simulation-side blocks can be freed anywhere without skewing the totals.
+
+#define HOST_HEAP_COUNTED 0x4f544148454150ULL
+#define HOST_HEAP_UNCOUNTED 0x4f544153494d55ULL
+
+struct HostHeapHeader {
+    uint64_t magic;
+    uint64_t size;
+};
+
+extern "C" {
+
+void* __real_malloc(size_t size);
+void __real_free(void* ptr);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    HostHeapHeader* header = (HostHeapHeader*)__real_malloc(size + sizeof(HostHeapHeader));
+    if (header == nullptr) {
+        return nullptr;
+    }
+    
+    bool counted = heapTracking && scopeDepth == 0;
+    header->magic = counted ? HOST_HEAP_COUNTED : HOST_HEAP_UNCOUNTED;
+    header->size = size;
+    if (counted) {
+        heapInUse += size;
+        heapPeakBytes = std::max(heapPeakBytes, heapInUse);
+    }
+    
+    return header + 1;
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    
+    // Blocks from C library internals were not allocated through the wrapper
+    HostHeapHeader* header = (HostHeapHeader*)ptr - 1;
+    if (header->magic != HOST_HEAP_COUNTED && header->magic != HOST_HEAP_UNCOUNTED) {
+        __real_free(ptr);
+        return;
+    }
+    
+    if (header->magic == HOST_HEAP_COUNTED) {
+        heapInUse -= header->size;
+    }
+    header->magic = 0;
+    __real_free(header);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    if (size != 0 && count > (size_t)-1 / size) {
+        return nullptr;
+    }
+    
+    void* ptr = __wrap_malloc(count * size);
+    if (ptr != nullptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    if (ptr == nullptr) {
+        return __wrap_malloc(size);
+    }
+    
+    HostHeapHeader* header = (HostHeapHeader*)ptr - 1;
+    if (header->magic != HOST_HEAP_COUNTED && header->magic != HOST_HEAP_UNCOUNTED) {
+        return __real_realloc(ptr, size);
+    }
+    
+    if (size == 0) {
+        __wrap_free(ptr);
+        return nullptr;
+    }
+    
+    void* moved = __wrap_malloc(size);
+    if (moved != nullptr) {
+        memcpy(moved, ptr, std::min((size_t)header->size, size));
+        __wrap_free(ptr);
+    }
+    return moved;
+}
+
+} // extern "C"
+
+void* operator new(size_t size) {
+    void* ptr = __wrap_malloc(size ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    __wrap_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    __wrap_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    __wrap_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    __wrap_free(ptr);
+}
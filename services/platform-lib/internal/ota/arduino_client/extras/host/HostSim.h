@@ -0,0 +1,169 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+// Simulated device environment for running the OTA client on a host:
+// a clock, a network link, an HTTP server and heap accounting.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// TCP payload per segment on the simulated link
+#define HOST_SIM_SEGMENT_SIZE 1460
+// Retransmission timeout floor for a lost segment
+#define HOST_SIM_MIN_RTO_MS 200
+
+/**
+ * @brief Link, server and flash characteristics of a simulation run
+ */
+struct HostSimConfig {
+    uint32_t bandwidth = 1000000;      // Link rate in bytes per second, each direction
+    uint32_t latencyMs = 20;           // One-way delay
+    size_t windowSize = 0;             // TCP receive window: bytes in flight per connection (0 for no limit)
+    double lossRate = 0.0;             // Fraction of segments lost and retransmitted after a timeout
+    size_t disconnectEvery = 0;        // Response bytes a connection carries before it drops (0 for never)
+    uint32_t flashRate = 400000;       // Flash write rate in bytes per second
+    uint32_t serverMs = 2;             // Server time per request
+    uint8_t tlsRoundTrips = 2;         // Round trips of a full TLS handshake after the TCP one
+    uint32_t seed = 1;                 // Packet loss random seed
+};
+
+/**
+ * @brief One request as the simulated server sees it
+ */
+struct HostSimRequest {
+    std::string method;
+    std::string path;
+    std::vector<std::pair<std::string, std::string> > headers;
+    std::string body;
+    
+    /**
+     * @brief Get a request header (case-insensitive), or an empty string
+     */
+    std::string header(const std::string& name) const;
+};
+
+/**
+ * @brief The simulated server's answer to a request
+ */
+struct HostSimResponse {
+    int status = 404;
+    std::vector<std::pair<std::string, std::string> > headers;
+    std::string body;              // Body owned by the response...
+    const uint8_t* data = nullptr; // ...or borrowed from the server (e.g. the firmware image)
+    size_t size = 0;
+};
+
+/**
+ * @brief Request and transfer counters of a run
+ */
+struct HostSimCounters {
+    uint32_t connections = 0;
+    uint32_t requests = 0;
+    uint32_t lostSegments = 0;
+    uint32_t dropped = 0;      // Connections the link dropped mid-response
+    uint64_t bytesUp = 0;
+    uint64_t bytesDown = 0;
+};
+
+class HostSim {
+public:
+    typedef std::function<void(const HostSimRequest&, HostSimResponse&)> Handler;
+    
+    /**
+     * @brief Reset the clock, the counters and the link with a new configuration
+     */
+    static void configure(const HostSimConfig& config);
+    static const HostSimConfig& config();
+    
+    /**
+     * @brief Simulation time in microseconds
+     *
+     * Real time spent computing plus the time the simulated network and
+     * flash made the client wait, which passes instantly.
+     */
+    static uint64_t now();
+    
+    /**
+     * @brief Let simulated time pass without spending real time
+     */
+    static void advance(uint64_t micros);
+    
+    /**
+     * @brief Wait until a simulated moment (no-op if it has passed)
+     */
+    static void waitUntil(uint64_t time);
+    
+    /**
+     * @brief Set the function that answers HTTP requests
+     */
+    static void setHandler(Handler handler);
+    
+    /**
+     * @brief Answer a request with the configured handler
+     */
+    static void handle(const HostSimRequest& request, HostSimResponse& response);
+    
+    /**
+     * @brief Plan when each segment of a response arrives at the client
+     *
+     * Segments leave the server at the link rate from start on and arrive one
+     * latency later. All connections share the link, so a segment waits for
+     * the ones already scheduled on it. With a window, a segment can't leave
+     * before the one a window earlier is acknowledged. A lost segment arrives
+     * after a retransmission timeout, holding up the ones behind it.
+     *
+     * @param size Response size in bytes
+     * @param start Time the first byte leaves the server
+     * @param arrivals Out: for each segment, the offset past its end and its arrival time
+     */
+    static void scheduleTransfer(size_t size, uint64_t start, std::vector<std::pair<size_t, uint64_t> >* arrivals);
+    
+    /**
+     * @brief Time sending a number of bytes takes at the link rate
+     */
+    static uint64_t transferTime(size_t size);
+    
+    static HostSimCounters& counters();
+    
+    /**
+     * @brief Count heap allocations made outside simulation code from now on
+     *
+     * Resets the peak to the bytes currently allocated by the client.
+     */
+    static void startHeapTracking();
+    
+    /**
+     * @brief Stop counting heap allocations
+     */
+    static void stopHeapTracking();
+    
+    /**
+     * @brief Most client heap in use at once since startHeapTracking()
+     */
+    static size_t heapPeak();
+    
+    /**
+     * @brief Process CPU time in microseconds
+     */
+    static uint64_t cpuTime();
+    
+    /**
+     * @brief CPU time spent in simulation code, in microseconds
+     */
+    static uint64_t simCpuTime();
+    
+    /**
+     * @brief Marks simulation code, whose CPU time and heap are not the client's
+     */
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+    };
+};
+
+#endif // HOST_SIM_H
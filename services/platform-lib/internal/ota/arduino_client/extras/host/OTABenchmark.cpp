@@ -0,0 +1,585 @@
+// Runs one OTA update against the simulated server and link in HostSim.h and
+// prints what it cost as a single JSON line. See "Host Benchmarks" in the
+// library README for how to build it.
+
+#include <OTAClient.h>
+#include <base64.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/ecp.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/rsa.h>
+#include <mbedtls/version.h>
+#include "HostSim.h"
+
+#define BENCH_DEVICE_ID "bench-device"
+#define BENCH_SERVER_URL "https://ota.bench.local"
+#define BENCH_FIRMWARE_PATH "/firmware/bench.bin"
+#define BENCH_MANIFEST_PATH "/firmware/bench.sectors"
+#define BENCH_FILESYSTEM_PATH "/firmware/bench-fs.bin"
+#define BENCH_CONFIG_PATH "/firmware/bench-config.bin"
+#define BENCH_CONFIG_PARTITION "config"
+#define BENCH_CACHE_URL "http://cache.bench.local:8080"
+
+struct BenchOptions {
+    HostSimConfig sim;
+    const char* name = "default";
+    size_t imageSize = 1024 * 1024;
+    size_t chunkSize = OTA_DEFAULT_CHUNK_SIZE;
+    uint8_t reportPercent = OTA_DEFAULT_REPORT_PERCENT;
+    uint8_t parallel = 1;
+    bool reuse = true;
+    bool streaming = true;
+    bool signature = true;
+    bool ecdsa = false;
+    bool manifest = false;
+    long corruptSector = -1;
+    bool localCache = false;
+    bool badCache = false;
+    size_t filesystemSize = 0;
+    uint32_t rateLimit = 0;
+};
+
+// Turns the download gave the "application" through the yield callback
+static unsigned benchYields = 0;
+
+static void countYield() {
+    benchYields++;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --name NAME              scenario name to print\n"
+            "  --size BYTES             firmware image size (default 1048576)\n"
+            "  --bandwidth BYTES        link rate per second, each direction (default 1000000)\n"
+            "  --latency MS             one-way link delay (default 20)\n"
+            "  --loss RATE              fraction of segments lost, 0 to 1 (default 0)\n"
+            "  --window BYTES           TCP receive window per connection (default unlimited)\n"
+            "  --disconnect-every BYTES drop a connection after this many response bytes\n"
+            "  --flash-rate BYTES       flash write rate per second (default 400000)\n"
+            "  --server-ms MS           server time per request (default 2)\n"
+            "  --chunk BYTES            client chunk size (default %u)\n"
+            "  --report-percent N       progress report step (default %u)\n"
+            "  --parallel N             range connections for buffered downloads (default 1)\n"
+            "  --seed N                 packet loss seed (default 1)\n"
+            "  --no-reuse               open a connection per request\n"
+            "  --buffered               download the whole image before flashing\n"
+            "  --no-signature           skip signing and signature verification\n"
+            "  --key rsa|ecdsa          signing key: RSA-2048 (PSS) or ECDSA P-256 (default rsa)\n"
+            "  --manifest               offer a signed sector manifest, so sectors are checked as they arrive\n"
+            "  --corrupt-sector N       flip a byte of sector N the first time it is sent\n"
+            "  --local-cache            download through a LAN cache\n"
+            "  --bad-cache              download through a LAN cache that serves a wrong image\n"
+            "  --bundle BYTES           ship a filesystem image of this size and a config blob with the application\n"
+            "  --rate-limit BYTES       download rate limit per second (default none)\n",
+            program, (unsigned)OTA_DEFAULT_CHUNK_SIZE, (unsigned)OTA_DEFAULT_REPORT_PERCENT);
+}
+
+static bool parseOptions(int argc, char** argv, BenchOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        bool takesValue = true;
+        
+        if (strcmp(arg, "--no-reuse") == 0) {
+            options->reuse = false;
+            takesValue = false;
+        } else if (strcmp(arg, "--buffered") == 0) {
+            options->streaming = false;
+            takesValue = false;
+        } else if (strcmp(arg, "--no-signature") == 0) {
+            options->signature = false;
+            takesValue = false;
+        } else if (strcmp(arg, "--manifest") == 0) {
+            options->manifest = true;
+            takesValue = false;
+        } else if (strcmp(arg, "--local-cache") == 0) {
+            options->localCache = true;
+            takesValue = false;
+        } else if (strcmp(arg, "--bad-cache") == 0) {
+            options->localCache = true;
+            options->badCache = true;
+            takesValue = false;
+        } else if (value == nullptr) {
+            return false;
+        } else if (strcmp(arg, "--key") == 0) {
+            if (strcmp(value, "rsa") != 0 && strcmp(value, "ecdsa") != 0) {
+                return false;
+            }
+            options->ecdsa = strcmp(value, "ecdsa") == 0;
+        } else if (strcmp(arg, "--name") == 0) {
+            options->name = value;
+        } else if (strcmp(arg, "--size") == 0) {
+            options->imageSize = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--bandwidth") == 0) {
+            options->sim.bandwidth = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--latency") == 0) {
+            options->sim.latencyMs = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--loss") == 0) {
+            options->sim.lossRate = strtod(value, nullptr);
+        } else if (strcmp(arg, "--window") == 0) {
+            options->sim.windowSize = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--disconnect-every") == 0) {
+            options->sim.disconnectEvery = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--flash-rate") == 0) {
+            options->sim.flashRate = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--server-ms") == 0) {
+            options->sim.serverMs = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--chunk") == 0) {
+            options->chunkSize = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--report-percent") == 0) {
+            options->reportPercent = (uint8_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--parallel") == 0) {
+            options->parallel = (uint8_t)strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--seed") == 0) {
+            options->sim.seed = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--corrupt-sector") == 0) {
+            options->corruptSector = strtol(value, nullptr, 10);
+        } else if (strcmp(arg, "--bundle") == 0) {
+            options->filesystemSize = strtoul(value, nullptr, 10);
+        } else if (strcmp(arg, "--rate-limit") == 0) {
+            options->rateLimit = strtoul(value, nullptr, 10);
+        } else {
+            return false;
+        }
+        
+        if (takesValue) {
+            i++;
+        }
+    }
+    
+    return options->imageSize > 0 && options->sim.bandwidth > 0 && options->sim.flashRate > 0 &&
+           options->sim.lossRate >= 0 && options->sim.lossRate < 1 &&
+           options->corruptSector < (long)((options->imageSize + OTA_FLASH_SECTOR_SIZE - 1) / OTA_FLASH_SECTOR_SIZE);
+}
+
+// The same pseudo-random image for every run of a size
+static void makeImage(std::vector<uint8_t>* image, size_t size) {
+    image->resize(size);
+    uint32_t state = 0x9E3779B9;
+    for (size_t i = 0; i < size; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        (*image)[i] = (uint8_t)state;
+    }
+}
+
+// Error messages go into a JSON string
+static std::string jsonEscape(const char* text) {
+    std::string escaped;
+    for (; *text != '\0'; text++) {
+        if (*text == '"' || *text == '\\') {
+            escaped += '\\';
+        }
+        escaped += ((unsigned char)*text < 0x20) ? ' ' : *text;
+    }
+    return escaped;
+}
+
+// Room a response takes in a JSON document; the host's 64-bit pointers make it an overestimate for ESP32
+static size_t jsonDocBytes(const std::string& json) {
+    DynamicJsonDocument doc(json.size() * 4 + 1024);
+    deserializeJson(doc, json);
+    return doc.memoryUsage();
+}
+
+static std::string toHex(const uint8_t* data, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for (size_t i = 0; i < size; i++) {
+        hex += digits[data[i] >> 4];
+        hex += digits[data[i] & 0x0F];
+    }
+    return hex;
+}
+
+/**
+ * @brief Sign the image hash with a fresh key, as the OTA service's signer does
+ *
+ * @param hashes SHA-256 digests to sign: the image's, then the sector manifest's if there is one
+ * @param ecdsa Use a P-256 key instead of RSA-2048
+ * @param publicKey Out: the key in PEM, as the client expects it
+ * @param signatures Out: the RSA-PSS or DER-encoded ECDSA signature of each hash
+ */
+static bool signHashes(const std::vector<const uint8_t*>& hashes, bool ecdsa, std::string* publicKey,
+                       std::vector<std::string>* signatures) {
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_pk_context pk;
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_pk_init(&pk);
+    
+    unsigned char pem[1024];
+    bool generated =
+        mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, (const unsigned char*)"ota-bench", 9) == 0;
+    if (generated && ecdsa) {
+        generated = mbedtls_pk_setup(&pk, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)) == 0 &&
+                    mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(pk), mbedtls_ctr_drbg_random,
+                                        &drbg) == 0;
+    } else if (generated) {
+        generated = mbedtls_pk_setup(&pk, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA)) == 0 &&
+                    mbedtls_rsa_gen_key(mbedtls_pk_rsa(pk), mbedtls_ctr_drbg_random, &drbg, 2048, 65537) == 0;
+        // The service signs with RSA-PSS
+        mbedtls_rsa_set_padding(mbedtls_pk_rsa(pk), MBEDTLS_RSA_PKCS_V21, MBEDTLS_MD_SHA256);
+    }
+    
+    bool signedAll = generated && mbedtls_pk_write_pubkey_pem(&pk, pem, sizeof(pem)) == 0;
+    if (signedAll) {
+        publicKey->assign((const char*)pem);
+    }
+    
+    for (size_t i = 0; signedAll && i < hashes.size(); i++) {
+        unsigned char sig[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+        size_t sigLen = 0;
+#if MBEDTLS_VERSION_MAJOR >= 3
+        signedAll = mbedtls_pk_sign(&pk, MBEDTLS_MD_SHA256, hashes[i], 32, sig, sizeof(sig), &sigLen,
+                                    mbedtls_ctr_drbg_random, &drbg) == 0;
+#else
+        signedAll = mbedtls_pk_sign(&pk, MBEDTLS_MD_SHA256, hashes[i], 32, sig, &sigLen, mbedtls_ctr_drbg_random,
+                                    &drbg) == 0;
+#endif
+        signatures->push_back(std::string((const char*)sig, sigLen));
+    }
+    
+    mbedtls_pk_free(&pk);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+    return signedAll;
+}
+
+static std::string base64Text(const std::string& data) {
+    std::vector<char> encoded(base64_enc_len(data.size()) + 1);
+    base64_encode(encoded.data(), (char*)data.data(), data.size());
+    return std::string(encoded.data());
+}
+
+static void putUInt32LE(uint8_t* data, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        data[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+// The unsigned sector manifest of an image, in the OTA service's format
+static void makeSectorManifest(const std::vector<uint8_t>& image, std::vector<uint8_t>* manifest) {
+    manifest->assign(OTA_SECTOR_MANIFEST_HEADER_SIZE, 0);
+    memcpy(manifest->data(), OTA_SECTOR_MANIFEST_MAGIC, 4);
+    (*manifest)[4] = OTA_SECTOR_MANIFEST_VERSION;
+    putUInt32LE(manifest->data() + 8, OTA_FLASH_SECTOR_SIZE);
+    putUInt32LE(manifest->data() + 12, (uint32_t)image.size());
+    
+    for (size_t offset = 0; offset < image.size(); offset += OTA_FLASH_SECTOR_SIZE) {
+        uint8_t hash[32];
+        size_t length = std::min((size_t)OTA_FLASH_SECTOR_SIZE, image.size() - offset);
+        mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), image.data() + offset, length, hash);
+        manifest->insert(manifest->end(), hash, hash + sizeof(hash));
+    }
+}
+
+// What the server sends: the image, or a copy with a bad byte in one sector until that sector has gone out once
+struct BenchContent {
+    std::vector<uint8_t> image;
+    std::vector<uint8_t> corrupted;
+    std::vector<uint8_t> manifest;
+    size_t corruptOffset = 0;
+    bool corruptPending = false;
+    std::vector<uint8_t> cacheImage;  // What the LAN cache serves for the image, if not the image
+    unsigned cacheRequests = 0;
+    std::vector<uint8_t> filesystem;  // Bundle components, if any
+    std::vector<uint8_t> config;
+};
+
+// Decoded value of a query parameter of a request path, or an empty string
+static std::string queryParam(const std::string& path, const std::string& name) {
+    size_t start = path.find('?');
+    while (start != std::string::npos) {
+        start++;
+        size_t end = path.find('&', start);
+        std::string pair = path.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+        if (pair.compare(0, name.size() + 1, name + "=") == 0) {
+            std::string value;
+            for (size_t i = name.size() + 1; i < pair.size(); i++) {
+                if (pair[i] == '%' && i + 2 < pair.size()) {
+                    value += (char)strtoul(pair.substr(i + 1, 2).c_str(), nullptr, 16);
+                    i += 2;
+                } else {
+                    value += pair[i];
+                }
+            }
+            return value;
+        }
+        start = end;
+    }
+    return "";
+}
+
+/**
+ * @brief Answer the update check, firmware downloads (with ranges), status reports and LAN cache fetches
+ */
+static void serve(BenchContent& content, const std::string& updateJson, const HostSimRequest& request,
+                  HostSimResponse& response, bool cached = false) {
+    const std::vector<uint8_t>& firmware = (cached && !content.cacheImage.empty()) ? content.cacheImage : content.image;
+    
+    // The cache answers from its copy of what the server has, for the server's URLs only
+    const std::string cachePath = OTA_LOCAL_CACHE_PATH "?";
+    if (!cached && request.method == "GET" && request.path.compare(0, cachePath.size(), cachePath) == 0) {
+        content.cacheRequests++;
+        std::string source = queryParam(request.path, "src");
+        if (source.compare(0, strlen(BENCH_SERVER_URL "/"), BENCH_SERVER_URL "/") != 0) {
+            response.status = HTTP_CODE_FORBIDDEN;
+            return;
+        }
+        
+        HostSimRequest upstream = request;
+        upstream.path = source.substr(strlen(BENCH_SERVER_URL));
+        serve(content, updateJson, upstream, response, true);
+        return;
+    }
+    
+    if (request.method == "GET" && request.path.compare(0, 20, "/api/v1/ota/updates/") == 0) {
+        response.status = HTTP_CODE_OK;
+        response.headers.push_back(std::make_pair("Content-Type", "application/json"));
+        response.body = updateJson;
+        return;
+    }
+    
+    // The application image and the bundle components are served alike
+    const std::vector<uint8_t>* payload = nullptr;
+    if (request.path == BENCH_FIRMWARE_PATH) {
+        payload = &firmware;
+    } else if (request.path == BENCH_FILESYSTEM_PATH && !content.filesystem.empty()) {
+        payload = &content.filesystem;
+    } else if (request.path == BENCH_CONFIG_PATH && !content.config.empty()) {
+        payload = &content.config;
+    }
+    
+    if (request.method == "GET" && payload != nullptr) {
+        const std::vector<uint8_t>& image = *payload;
+        size_t start = 0;
+        size_t end = image.size();
+        std::string range = request.header("Range");
+        if (range.compare(0, 6, "bytes=") == 0) {
+            char* rest = nullptr;
+            start = strtoul(range.c_str() + 6, &rest, 10);
+            if (rest != nullptr && *rest == '-' && rest[1] != '\0') {
+                end = std::min(end, (size_t)strtoul(rest + 1, nullptr, 10) + 1);
+            }
+            if (start >= end) {
+                response.status = HTTP_CODE_RANGE_NOT_SATISFIABLE;
+                return;
+            }
+            response.status = HTTP_CODE_PARTIAL_CONTENT;
+            response.headers.push_back(std::make_pair("Content-Range", "bytes " + std::to_string(start) + "-" +
+                                                      std::to_string(end - 1) + "/" + std::to_string(image.size())));
+        } else {
+            response.status = HTTP_CODE_OK;
+        }
+        
+        const uint8_t* data = image.data();
+        if (!cached && payload == &content.image && content.corruptPending && start <= content.corruptOffset &&
+            content.corruptOffset < end) {
+            data = content.corrupted.data();
+            content.corruptPending = false;
+        }
+        response.data = data + start;
+        response.size = end - start;
+        return;
+    }
+    
+    if (request.method == "GET" && request.path == BENCH_MANIFEST_PATH && !content.manifest.empty()) {
+        response.status = HTTP_CODE_OK;
+        response.data = content.manifest.data();
+        response.size = content.manifest.size();
+        return;
+    }
+    
+    if (request.method == "POST" && request.path.compare(0, 27, "/api/v1/ota/updates/status") == 0) {
+        response.status = HTTP_CODE_OK;
+        response.body = "{\"accepted\":true}";
+        return;
+    }
+    
+    response.status = HTTP_CODE_NOT_FOUND;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--help") == 0) {
+        usage(argv[0]);
+        return 0;
+    }
+    
+    BenchOptions options;
+    if (!parseOptions(argc, argv, &options)) {
+        usage(argv[0]);
+        return 2;
+    }
+    
+    BenchContent content;
+    std::vector<uint8_t>& image = content.image;
+    makeImage(&image, options.imageSize);
+    
+    uint8_t hash[32];
+    mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), image.data(), image.size(), hash);
+    
+    std::vector<const uint8_t*> hashes(1, hash);
+    
+    // Components are signed after the image and before the manifest
+    uint8_t filesystemHash[32];
+    uint8_t configHash[32];
+    if (options.filesystemSize > 0) {
+        makeImage(&content.filesystem, options.filesystemSize);
+        std::reverse(content.filesystem.begin(), content.filesystem.end());
+        const char* config = "{\"sample_rate\":10,\"upload_interval\":60}";
+        content.config.assign(config, config + strlen(config));
+        mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), content.filesystem.data(), content.filesystem.size(),
+                   filesystemHash);
+        mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), content.config.data(), content.config.size(),
+                   configHash);
+        hashes.push_back(filesystemHash);
+        hashes.push_back(configHash);
+    }
+    
+    uint8_t manifestHash[32];
+    if (options.manifest) {
+        makeSectorManifest(image, &content.manifest);
+        mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), content.manifest.data(), content.manifest.size(),
+                   manifestHash);
+        hashes.push_back(manifestHash);
+    }
+    
+    std::string publicKey;
+    std::vector<std::string> signatures;
+    if (options.signature && !signHashes(hashes, options.ecdsa, &publicKey, &signatures)) {
+        fprintf(stderr, "signing the image failed\n");
+        return 2;
+    }
+    
+    if (options.corruptSector >= 0) {
+        content.corrupted = image;
+        content.corruptOffset = (size_t)options.corruptSector * OTA_FLASH_SECTOR_SIZE;
+        content.corrupted[content.corruptOffset] ^= 0xFF;
+        content.corruptPending = true;
+    }
+    
+    if (options.badCache) {
+        content.cacheImage = image;
+        content.cacheImage[image.size() / 2] ^= 0xFF;
+    }
+    
+    std::string updateJson = "{\"release_id\":\"bench-release\",\"version\":\"1.0.1\","
+                             "\"binary_url\":\"" BENCH_SERVER_URL BENCH_FIRMWARE_PATH "\","
+                             "\"binary_hash\":\"" + toHex(hash, sizeof(hash)) + "\","
+                             "\"binary_size\":" + std::to_string(image.size()) + ","
+                             "\"signature\":\"" + (signatures.empty() ? "" : base64Text(signatures[0])) + "\"";
+    // What the update response takes of the client's JSON document, as served and with every component slot filled
+    size_t responseDocBytes = 0;
+    size_t fullBundleDocBytes = 0;
+    if (options.filesystemSize > 0) {
+        std::string filesystemSignature = signatures.empty() ? "" : base64Text(signatures[1]);
+        std::string configSignature = signatures.empty() ? "" : base64Text(signatures[2]);
+        std::string filesystemComponent = "{\"name\":\"webui\",\"type\":\"" OTA_COMPONENT_FILESYSTEM "\","
+                                          "\"url\":\"" BENCH_SERVER_URL BENCH_FILESYSTEM_PATH "\","
+                                          "\"hash\":\"" + toHex(filesystemHash, sizeof(filesystemHash)) + "\","
+                                          "\"size\":" + std::to_string(content.filesystem.size()) + ","
+                                          "\"signature\":\"" + filesystemSignature + "\"}";
+        std::string configComponent = "{\"name\":\"config\",\"type\":\"" OTA_COMPONENT_DATA "\","
+                                      "\"partition\":\"" BENCH_CONFIG_PARTITION "\","
+                                      "\"url\":\"" BENCH_SERVER_URL BENCH_CONFIG_PATH "\","
+                                      "\"hash\":\"" + toHex(configHash, sizeof(configHash)) + "\","
+                                      "\"size\":" + std::to_string(content.config.size()) + ","
+                                      "\"signature\":\"" + configSignature + "\"}";
+        std::string fullBundle = updateJson + ",\"components\":[" + filesystemComponent;
+        for (int i = 1; i < OTA_MAX_COMPONENTS; i++) {
+            fullBundle += "," + configComponent;
+        }
+        fullBundleDocBytes = jsonDocBytes(fullBundle + "]}");
+        updateJson += ",\"components\":[" + filesystemComponent + "," + configComponent + "]";
+    }
+    if (options.manifest) {
+        // The manifest's signature follows its hashes
+        if (signatures.size() > 1) {
+            content.manifest.insert(content.manifest.end(), signatures.back().begin(), signatures.back().end());
+        }
+        updateJson += ",\"sector_manifest_url\":\"" BENCH_SERVER_URL BENCH_MANIFEST_PATH "\","
+                      "\"sector_manifest_size\":" + std::to_string(content.manifest.size());
+    }
+    updateJson += "}";
+    responseDocBytes = jsonDocBytes(updateJson);
+    
+    HostSim::setHandler([&](const HostSimRequest& request, HostSimResponse& response) {
+        serve(content, updateJson, request, response);
+    });
+    HostSim::configure(options.sim);
+    
+    // The client is constructed in tracked scope: its buffers are part of its footprint
+    HostSim::startHeapTracking();
+    uint64_t cpuStarted = HostSim::cpuTime();
+    uint64_t started = HostSim::now();
+    
+    bool success = false;
+    bool imageMatches = false;
+    OTAStats stats;
+    String error;
+    {
+        OTAClient client(BENCH_SERVER_URL, BENCH_DEVICE_ID, publicKey.c_str());
+        client.setVerifySignature(options.signature);
+        client.setStreamingUpdate(options.streaming);
+        client.setParallelDownloads(options.parallel);
+        client.setConnectionReuse(options.reuse);
+        client.setChunkSize(options.chunkSize);
+        client.setProgressReporting(options.reportPercent, OTA_DEFAULT_REPORT_INTERVAL_MS);
+        client.setDownloadRateLimit(options.rateLimit);
+        client.setYieldCallback(countYield);
+        if (options.localCache) {
+            client.setLocalCache(BENCH_CACHE_URL);
+        }
+        client.begin();
+        
+        FirmwareUpdate update;
+        success = client.checkForUpdate(&update) && client.performUpdate(update);
+        stats = client.getStats();
+        error = client.getLastErrorMessage();
+    }
+    
+    uint64_t elapsed = HostSim::now() - started;
+    uint64_t cpu = HostSim::cpuTime() - cpuStarted;
+    HostSim::stopHeapTracking();
+    
+    imageMatches = Update.simImage() == image;
+    if (options.filesystemSize > 0) {
+        imageMatches = imageMatches && Update.simPartition(nullptr) == content.filesystem &&
+                       Update.simPartition(BENCH_CONFIG_PARTITION) == content.config;
+    }
+    success = success && imageMatches;
+    
+    const HostSimCounters& counters = HostSim::counters();
+    uint64_t simCpu = HostSim::simCpuTime();
+    uint64_t clientCpu = (cpu > simCpu) ? cpu - simCpu : 0;
+    
+    printf("{\"scenario\":\"%s\",\"success\":%s,\"image_ok\":%s,\"error\":\"%s\","
+           "\"image_bytes\":%zu,\"chunk_size\":%zu,\"streaming\":%s,\"connection_reuse\":%s,\"parallel\":%u,"
+           "\"key\":\"%s\",\"link_bps\":%u,\"latency_ms\":%u,\"window_bytes\":%zu,\"loss_rate\":%.4f,"
+           "\"disconnect_every\":%zu,\"flash_bps\":%u,\"rate_limit_bps\":%u,"
+           "\"elapsed_ms\":%.1f,\"throughput_bps\":%u,\"link_efficiency\":%.3f,"
+           "\"phases_ms\":{\"dns\":%u,\"tls\":%u,\"first_byte\":%u,\"download\":%u,\"hash\":%u,"
+           "\"verify\":%u,\"flash_write\":%u,\"finalize\":%u,\"total\":%u},"
+           "\"bytes_downloaded\":%u,\"bytes_from_cache\":%u,\"cache_requests\":%u,\"components_installed\":%u,\"retries\":%u,\"chunks_rejected\":%u,\"requests\":%u,\"connections\":%u,"
+           "\"lost_segments\":%u,\"dropped_connections\":%u,\"bytes_up\":%llu,\"bytes_down\":%llu,\"yields\":%u,"
+           "\"peak_heap_bytes\":%zu,\"json_doc_size\":%zu,\"response_doc_bytes\":%zu,\"full_bundle_doc_bytes\":%zu,"
+           "\"cpu_ms\":%.2f,\"client_cpu_ms\":%.2f,\"sim_cpu_ms\":%.2f}\n",
+           options.name, success ? "true" : "false", imageMatches ? "true" : "false",
+           jsonEscape(success ? "" : error.c_str()).c_str(), image.size(), options.chunkSize, options.streaming ? "true" : "false",
+           options.reuse ? "true" : "false", (unsigned)options.parallel, options.ecdsa ? "ecdsa" : "rsa", options.sim.bandwidth, options.sim.latencyMs,
+           options.sim.windowSize, options.sim.lossRate,
+           options.sim.disconnectEvery, options.sim.flashRate, options.rateLimit, elapsed / 1000.0, stats.throughput,
+           (double)stats.throughput / options.sim.bandwidth, stats.dnsMs, stats.tlsMs, stats.firstByteMs,
+           stats.downloadMs, stats.hashMs, stats.verifyMs, stats.flashWriteMs, stats.finalizeMs, stats.totalMs,
+           stats.bytesDownloaded, stats.bytesFromCache, content.cacheRequests, (unsigned)stats.componentsInstalled, stats.retries, stats.chunksRejected, counters.requests, counters.connections, counters.lostSegments,
+           counters.dropped, (unsigned long long)counters.bytesUp, (unsigned long long)counters.bytesDown, benchYields,
+           HostSim::heapPeak(), (size_t)OTA_JSON_DOC_SIZE, responseDocBytes, fullBundleDocBytes, cpu / 1000.0, clientCpu / 1000.0, simCpu / 1000.0);
+    
+    return success ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host build of the Arduino core subset used by the OTA client. Time comes
+// from the simulation clock in HostSim.h, so delay() returns immediately.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+// ArduinoJson would otherwise look for Arduino's Print, Stream and PROGMEM support
+#ifndef ARDUINOJSON_ENABLE_ARDUINO_STRING
+#define ARDUINOJSON_ENABLE_ARDUINO_STRING 1
+#endif
+#ifndef ARDUINOJSON_ENABLE_ARDUINO_STREAM
+#define ARDUINOJSON_ENABLE_ARDUINO_STREAM 0
+#endif
+#ifndef ARDUINOJSON_ENABLE_ARDUINO_PRINT
+#define ARDUINOJSON_ENABLE_ARDUINO_PRINT 0
+#endif
+#ifndef ARDUINOJSON_ENABLE_PROGMEM
+#define ARDUINOJSON_ENABLE_PROGMEM 0
+#endif
+
+#define LOW 0x0
+#define HIGH 0x1
+
+using std::min;
+using std::max;
+
+template <typename T, typename L, typename H>
+inline T constrain(T value, L low, H high) {
+    return (value < low) ? low : ((value > high) ? high : value);
+}
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+// Part of the ESP32 and newer glibc C libraries, but not of every host's
+inline size_t host_strlcpy(char* dest, const char* src, size_t size) {
+    size_t length = strlen(src);
+    if (size > 0) {
+        size_t copied = (length < size - 1) ? length : size - 1;
+        memcpy(dest, src, copied);
+        dest[copied] = '\0';
+    }
+    return length;
+}
+#define strlcpy host_strlcpy
+
+/**
+ * @brief Arduino String on top of std::string
+ */
+class String {
+public:
+    String() {}
+    String(const char* str) : _str(str ? str : "") {}
+    String(const String& other) : _str(other._str) {}
+    explicit String(char c) : _str(1, c) {}
+    explicit String(int value) : _str(std::to_string(value)) {}
+    explicit String(unsigned int value) : _str(std::to_string(value)) {}
+    explicit String(long value) : _str(std::to_string(value)) {}
+    explicit String(unsigned long value) : _str(std::to_string(value)) {}
+    explicit String(long long value) : _str(std::to_string(value)) {}
+    explicit String(unsigned long long value) : _str(std::to_string(value)) {}
+    
+    String& operator=(const String& other) { _str = other._str; return *this; }
+    String& operator=(const char* str) { _str = str ? str : ""; return *this; }
+    
+    const char* c_str() const { return _str.c_str(); }
+    unsigned int length() const { return (unsigned int)_str.size(); }
+    bool reserve(unsigned int size) { _str.reserve(size); return true; }
+    bool isEmpty() const { return _str.empty(); }
+    
+    bool concat(const char* str) { _str += str ? str : ""; return true; }
+    bool concat(const char* str, unsigned int length) { _str.append(str, length); return true; }
+    bool concat(char c) { _str += c; return true; }
+    
+    String& operator+=(const String& other) { _str += other._str; return *this; }
+    String& operator+=(const char* str) { concat(str); return *this; }
+    String& operator+=(char c) { _str += c; return *this; }
+    
+    bool operator==(const String& other) const { return _str == other._str; }
+    bool operator==(const char* str) const { return _str == (str ? str : ""); }
+    bool operator!=(const String& other) const { return !(*this == other); }
+    bool operator!=(const char* str) const { return !(*this == str); }
+    char operator[](unsigned int index) const { return index < _str.size() ? _str[index] : '\0'; }
+    
+    bool equals(const String& other) const { return _str == other._str; }
+    bool equalsIgnoreCase(const String& other) const {
+        return _str.size() == other._str.size() &&
+               std::equal(_str.begin(), _str.end(), other._str.begin(),
+                          [](char a, char b) { return tolower((unsigned char)a) == tolower((unsigned char)b); });
+    }
+    bool startsWith(const String& prefix) const { return _str.compare(0, prefix._str.size(), prefix._str) == 0; }
+    
+    int indexOf(char c, unsigned int from = 0) const { return position(_str.find(c, from)); }
+    int indexOf(const String& str, unsigned int from = 0) const { return position(_str.find(str._str, from)); }
+    String substring(unsigned int from) const { return substring(from, length()); }
+    String substring(unsigned int from, unsigned int to) const {
+        return (from >= _str.size() || to <= from) ? String() : String(_str.substr(from, to - from).c_str());
+    }
+    long toInt() const { return atol(_str.c_str()); }
+
+private:
+    std::string _str;
+    
+    static int position(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+};
+
+// ArduinoJson's String adapter also names Arduino's concatenation helper
+class StringSumHelper : public String {
+public:
+    StringSumHelper(const String& str) : String(str) {}
+};
+
+inline StringSumHelper operator+(const String& a, const String& b) {
+    String sum(a);
+    sum += b;
+    return sum;
+}
+
+inline StringSumHelper operator+(const String& a, const char* b) {
+    String sum(a);
+    sum += b;
+    return sum;
+}
+
+inline StringSumHelper operator+(const char* a, const String& b) {
+    String sum(a);
+    sum += b;
+    return sum;
+}
+
+/**
+ * @brief Arduino Print/Stream subset
+ */
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t data) = 0;
+    virtual size_t write(const uint8_t* buf, size_t size) = 0;
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int read(uint8_t* buf, size_t size) = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    
+    /**
+     * @brief Read up to length bytes, waiting for each until the stream timeout
+     */
+    size_t readBytes(uint8_t* buffer, size_t length);
+    size_t readBytes(char* buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+protected:
+    unsigned long _timeout = 1000;
+};
+
+#endif // HOST_ARDUINO_H
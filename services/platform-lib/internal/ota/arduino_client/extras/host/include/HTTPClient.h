@@ -0,0 +1,61 @@
+#ifndef HOST_HTTP_CLIENT_H
+#define HOST_HTTP_CLIENT_H
+
+// Host build of the ESP32 HTTPClient subset used by the OTA client. Requests
+// are answered by HostSim's server over the simulated link.
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_PARTIAL_CONTENT 206
+#define HTTP_CODE_NOT_MODIFIED 304
+#define HTTP_CODE_FORBIDDEN 403
+#define HTTP_CODE_NOT_FOUND 404
+#define HTTP_CODE_RANGE_NOT_SATISFIABLE 416
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+class HTTPClient {
+public:
+    HTTPClient();
+    
+    bool begin(WiFiClient& client, const String& url);
+    void end();
+    void setReuse(bool reuse);
+    void addHeader(const String& name, const String& value, bool first = false, bool replace = true);
+    void collectHeaders(const char* headerKeys[], const size_t headerKeysCount);
+    
+    int sendRequest(const char* method, uint8_t* payload = nullptr, size_t size = 0);
+    
+    int getSize();
+    WiFiClient& getStream();
+    WiFiClient* getStreamPtr();
+    String getString();
+    String header(const char* name);
+    bool connected();
+
+private:
+    typedef std::vector<std::pair<std::string, std::string> > Headers;
+    
+    WiFiClient* _client;
+    bool _reuse;
+    std::string _host;
+    uint16_t _port;
+    std::string _path;
+    Headers _requestHeaders;
+    std::vector<std::string> _collect;
+    Headers _responseHeaders;
+    std::string _body;
+    int _size;
+};
+
+#endif // HOST_HTTP_CLIENT_H
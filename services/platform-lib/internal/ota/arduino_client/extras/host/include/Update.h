@@ -0,0 +1,55 @@
+#ifndef HOST_UPDATE_H
+#define HOST_UPDATE_H
+
+// Host build of the ESP32 Update library: the image goes into RAM standing in
+// for the update partition, and each write takes as long as the simulated
+// flash needs for it. U_SPIFFS updates write a RAM copy of the named data
+// partition in place.
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+class UpdateClass {
+public:
+    UpdateClass();
+    
+    bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int ledPin = -1, uint8_t ledOn = 0,
+               const char* label = nullptr);
+    size_t write(uint8_t* data, size_t len);
+    bool end(bool evenIfRemaining = false);
+    void abort();
+    bool isFinished();
+    bool isRunning();
+    const char* errorString();
+    
+    /**
+     * @brief The image written by the last finished update
+     */
+    const std::vector<uint8_t>& simImage() const;
+    
+    /**
+     * @brief What the last U_SPIFFS update of a data partition wrote to it
+     * 
+     * @param label Partition label, or nullptr for the filesystem partition
+     */
+    const std::vector<uint8_t>& simPartition(const char* label) const;
+
+private:
+    std::vector<uint8_t> _image;
+    std::map<std::string, std::vector<uint8_t>> _partitions;
+    std::vector<uint8_t>* _target;
+    size_t _size;
+    bool _running;
+    bool _finished;
+    const char* _error;
+};
+
+extern UpdateClass Update;
+
+#endif // HOST_UPDATE_H
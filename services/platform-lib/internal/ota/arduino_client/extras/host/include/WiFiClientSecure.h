@@ -0,0 +1,87 @@
+#ifndef HOST_WIFI_CLIENT_SECURE_H
+#define HOST_WIFI_CLIENT_SECURE_H
+
+// Host build of WiFiClient and WiFiClientSecure. A connection carries one
+// response body at a time, handed over by the simulated HTTPClient, and
+// releases its bytes as the simulated link delivers them.
+
+#include <Arduino.h>
+#include <vector>
+
+class IPAddress {
+public:
+    IPAddress() : _address(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : _address((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    operator uint32_t() const { return _address; }
+
+private:
+    uint32_t _address;
+};
+
+class WiFiClient : public Stream {
+public:
+    WiFiClient();
+    virtual ~WiFiClient();
+    
+    virtual int connect(IPAddress ip, uint16_t port);
+    virtual int connect(IPAddress ip, uint16_t port, int32_t timeout);
+    virtual int connect(const char* host, uint16_t port);
+    virtual int connect(const char* host, uint16_t port, int32_t timeout);
+    
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override;
+    void flush() override;
+    virtual void stop();
+    virtual uint8_t connected();
+    
+    /**
+     * @brief Queue a response body that arrives over the link from the given time on
+     *
+     * @param data Body bytes; must stay valid until the next call or stop()
+     * @param size Body size
+     * @param start Simulation time in microseconds the first byte leaves the server
+     */
+    void simReceive(const uint8_t* data, size_t size, uint64_t start);
+    
+    /**
+     * @brief Number of body bytes not read yet, arrived or not
+     */
+    size_t simPending() const;
+
+protected:
+    // Round trips a connect costs on top of the TCP handshake
+    virtual uint8_t handshakeRoundTrips() const;
+
+private:
+    struct Segment {
+        size_t end;       // Offset just past the segment in the body
+        uint64_t arrival; // Simulation time the segment is readable
+    };
+    
+    bool _connected;
+    bool _closing;         // The link drops the connection after the scheduled bytes
+    size_t _bodyBytes;     // Body bytes sent on this connection, for simulated dropouts
+    const uint8_t* _data;
+    size_t _size;
+    size_t _position;
+    size_t _segment;
+    std::vector<Segment> _segments;
+    
+    size_t arrived();
+};
+
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setCACert(const char* rootCA) {}
+    void setInsecure() {}
+
+protected:
+    uint8_t handshakeRoundTrips() const override;
+};
+
+#endif // HOST_WIFI_CLIENT_SECURE_H
@@ -0,0 +1,11 @@
+#ifndef HOST_BASE64_H
+#define HOST_BASE64_H
+
+// Host build of the Base64 library functions used by the OTA client
+
+int base64_encode(char* output, char* input, int inputLen);
+int base64_decode(char* output, char* input, int inputLen);
+int base64_enc_len(int inputLen);
+int base64_dec_len(char* input, int inputLen);
+
+#endif // HOST_BASE64_H
@@ -0,0 +1,165 @@
+package ota
+
+import (
+	"context"
+	"fmt"
+	"regexp"
+	"time"
+)
+
+const (
+	// ComponentTypeFilesystem is a filesystem image (SPIFFS, LittleFS) for the device's
+	// filesystem partition, or for the data partition named by Partition
+	ComponentTypeFilesystem = "filesystem"
+	// ComponentTypeData is a raw image, such as a configuration blob, for the data partition
+	// named by Partition
+	ComponentTypeData = "data"
+
+	// MaxReleaseComponents is the most components a release can ship with its application image
+	MaxReleaseComponents = 4
+
+	// maxPartitionLabelLength is the longest partition label an ESP32 partition table allows
+	maxPartitionLabelLength = 16
+)
+
+var componentNamePattern = regexp.MustCompile(`^[a-z0-9][a-z0-9_-]{0,31}$`)
+
+// componentArtifactName is the artifact a component image is stored as
+func componentArtifactName(name string) string {
+	return "component-" + name + ".bin"
+}
+
+// validateComponents checks that the components of a release request each have a name, a
+// known type and a partition of their own
+func validateComponents(components []ComponentData) error {
+	if len(components) > MaxReleaseComponents {
+		return fmt.Errorf("a release can have at most %d components", MaxReleaseComponents)
+	}
+
+	names := make(map[string]bool)
+	targets := make(map[string]bool)
+	for _, component := range components {
+		if !componentNamePattern.MatchString(component.Name) {
+			return fmt.Errorf("invalid component name: %q", component.Name)
+		}
+		if names[component.Name] {
+			return fmt.Errorf("duplicate component name: %s", component.Name)
+		}
+		names[component.Name] = true
+
+		switch component.Type {
+		case ComponentTypeFilesystem:
+		case ComponentTypeData:
+			if component.Partition == "" {
+				return fmt.Errorf("component %s needs a partition label", component.Name)
+			}
+		default:
+			return fmt.Errorf("component %s has invalid type: %q", component.Name, component.Type)
+		}
+
+		if len(component.Partition) > maxPartitionLabelLength {
+			return fmt.Errorf("component %s partition label is longer than %d characters", component.Name, maxPartitionLabelLength)
+		}
+
+		// Two images written to the same partition would leave only the last one
+		target := component.Partition
+		if target == "" {
+			target = "<" + ComponentTypeFilesystem + ">"
+		}
+		if targets[target] {
+			return fmt.Errorf("component %s targets a partition another component already uses", component.Name)
+		}
+		targets[target] = true
+
+		if len(component.Data) == 0 {
+			return fmt.Errorf("component %s has no data", component.Name)
+		}
+	}
+
+	return nil
+}
+
+// storeComponents hashes, signs and stores the component images of a new release
+func (s *Service) storeComponents(ctx context.Context, releaseID string, components []ComponentData) ([]ReleaseComponent, error) {
+	if len(components) == 0 {
+		return nil, nil
+	}
+
+	artifactBackend, ok := s.storageBackend.(ArtifactStorageBackend)
+	if !ok {
+		return nil, fmt.Errorf("storage backend does not support release components")
+	}
+
+	stored := make([]ReleaseComponent, 0, len(components))
+	for _, component := range components {
+		signature, err := s.signer.SignBinary(component.Data)
+		if err != nil {
+			return nil, fmt.Errorf("failed to sign component %s: %w", component.Name, err)
+		}
+
+		path, err := artifactBackend.StoreArtifact(ctx, releaseID, componentArtifactName(component.Name), component.Data)
+		if err != nil {
+			return nil, fmt.Errorf("failed to store component %s: %w", component.Name, err)
+		}
+
+		stored = append(stored, ReleaseComponent{
+			Name:      component.Name,
+			Type:      component.Type,
+			Partition: component.Partition,
+			Hash:      ComputeHash(component.Data),
+			Path:      path,
+			Size:      int64(len(component.Data)),
+			Signature: signature,
+		})
+	}
+
+	return stored, nil
+}
+
+// updateComponents returns the components of a release with download URLs. A device has to
+// install all of them with the application, so any URL that can't be generated fails the update.
+func (s *Service) updateComponents(ctx context.Context, release *FirmwareRelease) ([]UpdateComponent, error) {
+	if len(release.Components) == 0 {
+		return nil, nil
+	}
+
+	components := make([]UpdateComponent, 0, len(release.Components))
+	for _, component := range release.Components {
+		url, err := s.storageBackend.GetBinaryURL(ctx, component.Path, 1*time.Hour)
+		if err != nil {
+			return nil, fmt.Errorf("failed to generate URL for component %s: %w", component.Name, err)
+		}
+
+		components = append(components, UpdateComponent{
+			Name:      component.Name,
+			Type:      component.Type,
+			Partition: component.Partition,
+			URL:       url,
+			Hash:      component.Hash,
+			Size:      component.Size,
+			Signature: component.Signature,
+		})
+	}
+
+	return components, nil
+}
+
+// verifyComponents checks the stored component images of a release against their hashes and signatures
+func (s *Service) verifyComponents(ctx context.Context, release *FirmwareRelease) error {
+	for _, component := range release.Components {
+		data, err := s.storageBackend.GetBinary(ctx, component.Path)
+		if err != nil {
+			return fmt.Errorf("failed to get component %s: %w", component.Name, err)
+		}
+
+		if computedHash := ComputeHash(data); computedHash != component.Hash {
+			return fmt.Errorf("component %s hash mismatch: expected %s, got %s", component.Name, component.Hash, computedHash)
+		}
+
+		if err := s.signer.VerifySignature(data, component.Signature); err != nil {
+			return fmt.Errorf("component %s signature verification failed: %w", component.Name, err)
+		}
+	}
+
+	return nil
+}
@@ -0,0 +1,177 @@
+package ota
+
+import (
+	"context"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/mock"
+	"github.com/stretchr/testify/require"
+)
+
+// Test that component images are signed, stored next to the binary and offered with the update
+func TestService_CreateRelease_Components(t *testing.T) {
+	service, mockRepo, _, _ := setupTestService()
+
+	backend, err := NewLocalStorageBackendWithBaseURL(t.TempDir(), "http://localhost:8006")
+	require.NoError(t, err)
+	service.storageBackend = backend
+
+	filesystem := createTestImage(64*1024, 7)
+	config := []byte(`{"sample_rate":10}`)
+	req := &CreateReleaseRequest{
+		TemplateID: "template-001",
+		Version:    "1.1.0",
+		Channel:    ReleaseChannelStable,
+		BinaryData: createTestImage(128*1024, 8),
+		Components: []ComponentData{
+			{Name: "webui", Type: ComponentTypeFilesystem, Data: filesystem},
+			{Name: "config", Type: ComponentTypeData, Partition: "nvs_config", Data: config},
+		},
+	}
+
+	var created *FirmwareRelease
+	mockRepo.On("CreateRelease", mock.Anything, mock.AnythingOfType("*ota.FirmwareRelease")).Run(func(args mock.Arguments) {
+		created = args.Get(1).(*FirmwareRelease)
+	}).Return(nil)
+
+	release, err := service.CreateRelease(context.Background(), req)
+	require.NoError(t, err)
+	require.True(t, created == release)
+	require.Len(t, release.Components, 2)
+
+	webui := release.Components[0]
+	assert.Equal(t, "webui", webui.Name)
+	assert.Equal(t, ComponentTypeFilesystem, webui.Type)
+	assert.Equal(t, ComputeHash(filesystem), webui.Hash)
+	assert.Equal(t, int64(len(filesystem)), webui.Size)
+	assert.NoError(t, service.signer.VerifySignature(filesystem, webui.Signature))
+
+	_, stored, err := backend.GetArtifact(context.Background(), release.ReleaseID, "component-config.bin")
+	require.NoError(t, err)
+	assert.Equal(t, config, stored)
+	assert.Equal(t, "nvs_config", release.Components[1].Partition)
+
+	// The release verifies as a whole, components included
+	mockRepo.On("GetRelease", mock.Anything, release.ReleaseID).Return(release, nil)
+	assert.NoError(t, service.VerifyRelease(context.Background(), release.ReleaseID))
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    release.ReleaseID,
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusPending,
+	}
+	mockRepo.On("GetLatestUpdateForDevice", mock.Anything, "device-001").Return(deviceUpdate, nil)
+
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{})
+	require.NoError(t, err)
+	require.Len(t, update.Components, 2)
+	assert.Equal(t, "http://localhost:8006"+BinaryRoutePrefix+release.ReleaseID+"/component-webui.bin", update.Components[0].URL)
+	assert.Equal(t, webui.Hash, update.Components[0].Hash)
+	assert.Equal(t, webui.Signature, update.Components[0].Signature)
+	assert.Equal(t, "nvs_config", update.Components[1].Partition)
+
+	// A tampered component fails verification
+	_, err = backend.StoreArtifact(context.Background(), release.ReleaseID, "component-config.bin", []byte(`{"sample_rate":99}`))
+	require.NoError(t, err)
+	assert.Error(t, service.VerifyRelease(context.Background(), release.ReleaseID))
+
+	// Deleting the release removes its components with it
+	mockRepo.On("DeleteRelease", mock.Anything, release.ReleaseID).Return(nil)
+	require.NoError(t, service.DeleteRelease(context.Background(), release.ReleaseID))
+	_, _, err = backend.GetArtifact(context.Background(), release.ReleaseID, "component-webui.bin")
+	assert.Error(t, err)
+
+	mockRepo.AssertExpectations(t)
+}
+
+func TestValidateComponents(t *testing.T) {
+	data := []byte("image")
+	tests := []struct {
+		name       string
+		components []ComponentData
+		valid      bool
+	}{
+		{"none", nil, true},
+		{"filesystem and data", []ComponentData{
+			{Name: "fs", Type: ComponentTypeFilesystem, Data: data},
+			{Name: "config", Type: ComponentTypeData, Partition: "config", Data: data},
+		}, true},
+		{"second filesystem on a named partition", []ComponentData{
+			{Name: "fs", Type: ComponentTypeFilesystem, Data: data},
+			{Name: "assets", Type: ComponentTypeFilesystem, Partition: "assets", Data: data},
+		}, true},
+		{"invalid name", []ComponentData{{Name: "../fs", Type: ComponentTypeFilesystem, Data: data}}, false},
+		{"duplicate name", []ComponentData{
+			{Name: "fs", Type: ComponentTypeFilesystem, Data: data},
+			{Name: "fs", Type: ComponentTypeData, Partition: "other", Data: data},
+		}, false},
+		{"unknown type", []ComponentData{{Name: "boot", Type: "bootloader", Data: data}}, false},
+		{"data without partition", []ComponentData{{Name: "config", Type: ComponentTypeData, Data: data}}, false},
+		{"long partition label", []ComponentData{{Name: "config", Type: ComponentTypeData, Partition: "a_very_long_partition", Data: data}}, false},
+		{"shared partition", []ComponentData{
+			{Name: "config", Type: ComponentTypeData, Partition: "config", Data: data},
+			{Name: "defaults", Type: ComponentTypeData, Partition: "config", Data: data},
+		}, false},
+		{"empty image", []ComponentData{{Name: "fs", Type: ComponentTypeFilesystem}}, false},
+		{"too many", []ComponentData{
+			{Name: "a", Type: ComponentTypeData, Partition: "a", Data: data},
+			{Name: "b", Type: ComponentTypeData, Partition: "b", Data: data},
+			{Name: "c", Type: ComponentTypeData, Partition: "c", Data: data},
+			{Name: "d", Type: ComponentTypeData, Partition: "d", Data: data},
+			{Name: "e", Type: ComponentTypeData, Partition: "e", Data: data},
+		}, false},
+	}
+
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			err := validateComponents(tt.components)
+			if tt.valid {
+				assert.NoError(t, err)
+			} else {
+				assert.Error(t, err)
+			}
+		})
+	}
+}
+
+// Test that a backend without artifact support can't take components, and that nothing is left behind
+func TestService_CreateRelease_ComponentsNeedArtifactStorage(t *testing.T) {
+	service, mockRepo, _, mockStorage := setupTestService()
+
+	req := &CreateReleaseRequest{
+		TemplateID: "template-001",
+		Version:    "1.1.0",
+		Channel:    ReleaseChannelStable,
+		BinaryData: []byte("firmware"),
+		Components: []ComponentData{{Name: "fs", Type: ComponentTypeFilesystem, Data: []byte("filesystem")}},
+	}
+
+	mockStorage.On("StoreBinary", mock.Anything, mock.AnythingOfType("string"), req.BinaryData).Return("release/firmware.bin", nil)
+	mockStorage.On("DeleteBinary", mock.Anything, "release/firmware.bin").Return(nil)
+
+	_, err := service.CreateRelease(context.Background(), req)
+	assert.Error(t, err)
+
+	mockStorage.AssertExpectations(t)
+	mockRepo.AssertNotCalled(t, "CreateRelease", mock.Anything, mock.Anything)
+}
+
+func TestFirmwareReleaseEntity_Components(t *testing.T) {
+	release := createTestRelease("release-001")
+	release.Components = []ReleaseComponent{{Name: "fs", Type: ComponentTypeFilesystem, Hash: "abc", Path: "release-001/component-fs.bin", Size: 10, Signature: "sig"}}
+
+	entity, err := release.ToEntity()
+	require.NoError(t, err)
+	assert.NotEmpty(t, entity.ComponentsJSON)
+
+	restored, err := entity.FromEntity()
+	require.NoError(t, err)
+	assert.Equal(t, release.Components, restored.Components)
+
+	// Releases without components store nothing extra
+	entity, err = createTestRelease("release-002").ToEntity()
+	require.NoError(t, err)
+	assert.Empty(t, entity.ComponentsJSON)
+}
@@ -0,0 +1,151 @@
+package ota
+
+import (
+	"bytes"
+	"context"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/mock"
+	"github.com/stretchr/testify/require"
+)
+
+// createCompressibleImage returns data that compresses roughly like firmware does
+func createCompressibleImage(size int) []byte {
+	data := make([]byte, 0, size)
+	random := createTestImage(size, 10)
+	for len(data) < size {
+		data = append(data, random[:128]...)
+		data = append(data, bytes.Repeat([]byte{0xFF}, 128)...)
+		random = random[128:]
+	}
+	return data[:size]
+}
+
+func TestCompressZlib_RoundTrip(t *testing.T) {
+	data := createCompressibleImage(64 * 1024)
+
+	compressed, err := CompressZlib(data)
+	require.NoError(t, err)
+	assert.Less(t, len(compressed), len(data))
+
+	result, err := DecompressZlib(compressed)
+	require.NoError(t, err)
+	assert.Equal(t, data, result)
+
+	_, err = DecompressZlib([]byte("not zlib"))
+	assert.Error(t, err)
+}
+
+func setupCompressionTestService(t *testing.T) (*Service, *MockRepository, *LocalStorageBackend) {
+	service, mockRepo, _, _ := setupTestService()
+
+	backend, err := NewLocalStorageBackendWithBaseURL(t.TempDir(), "http://localhost:8006")
+	require.NoError(t, err)
+	service.storageBackend = backend
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusPending,
+	}
+	mockRepo.On("GetLatestUpdateForDevice", mock.Anything, "device-001").Return(deviceUpdate, nil)
+
+	return service, mockRepo, backend
+}
+
+// Test that a compressed image is offered to devices that can decode it
+func TestService_GetUpdateForDevice_Compressed(t *testing.T) {
+	service, mockRepo, backend := setupCompressionTestService(t)
+
+	binaryData := createCompressibleImage(128 * 1024)
+	release := createTestRelease("release-001")
+	release.BinarySize = int64(len(binaryData))
+	var err error
+	release.BinaryPath, err = backend.StoreBinary(context.Background(), "release-001", binaryData)
+	require.NoError(t, err)
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
+
+	// Devices that don't ask for compression get the raw image only
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{})
+	require.NoError(t, err)
+	assert.Empty(t, update.Compression)
+	assert.Empty(t, update.CompressedURL)
+
+	update, err = service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{Compression: CompressionZlib})
+	require.NoError(t, err)
+	assert.Equal(t, CompressionZlib, update.Compression)
+	assert.Equal(t, "http://localhost:8006"+BinaryRoutePrefix+"release-001/firmware.bin.zlib", update.CompressedURL)
+	assert.Less(t, update.CompressedSize, release.BinarySize*3/4)
+
+	_, compressed, err := backend.GetArtifact(context.Background(), "release-001", "firmware.bin.zlib")
+	require.NoError(t, err)
+	assert.Equal(t, int64(len(compressed)), update.CompressedSize)
+
+	result, err := DecompressZlib(compressed)
+	require.NoError(t, err)
+	assert.Equal(t, binaryData, result)
+}
+
+// Test that incompressible images are not offered compressed
+func TestService_GetUpdateForDevice_CompressedNotWorthwhile(t *testing.T) {
+	service, mockRepo, backend := setupCompressionTestService(t)
+
+	binaryData := createTestImage(64*1024, 11)
+	release := createTestRelease("release-001")
+	release.BinarySize = int64(len(binaryData))
+	var err error
+	release.BinaryPath, err = backend.StoreBinary(context.Background(), "release-001", binaryData)
+	require.NoError(t, err)
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
+
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{Compression: CompressionZlib})
+	require.NoError(t, err)
+	assert.Empty(t, update.CompressedURL)
+	assert.Equal(t, binaryData, mustGetBinary(t, backend, release.BinaryPath))
+}
+
+// Test that the delta patch is compressed when the device accepts compression
+func TestService_GetUpdateForDevice_CompressedDelta(t *testing.T) {
+	service, mockRepo, backend := setupCompressionTestService(t)
+
+	baseData := createCompressibleImage(128 * 1024)
+	targetData := append([]byte{}, baseData...)
+	copy(targetData[8192:], createTestImage(2048, 12))
+
+	baseRelease := createTestRelease("release-000")
+	var err error
+	baseRelease.BinaryPath, err = backend.StoreBinary(context.Background(), "release-000", baseData)
+	require.NoError(t, err)
+
+	release := createTestRelease("release-001")
+	release.BinarySize = int64(len(targetData))
+	release.BinaryPath, err = backend.StoreBinary(context.Background(), "release-001", targetData)
+	require.NoError(t, err)
+
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
+	mockRepo.On("GetRelease", mock.Anything, "release-000").Return(baseRelease, nil)
+
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{
+		CurrentReleaseID: "release-000",
+		Compression:      CompressionZlib,
+	})
+	require.NoError(t, err)
+	assert.Equal(t, CompressionZlib, update.Compression)
+	assert.Equal(t, "http://localhost:8006"+BinaryRoutePrefix+"release-001/delta-release-000.bin.zlib", update.DeltaURL)
+
+	_, compressedPatch, err := backend.GetArtifact(context.Background(), "release-001", "delta-release-000.bin.zlib")
+	require.NoError(t, err)
+	patch, err := DecompressZlib(compressedPatch)
+	require.NoError(t, err)
+	result, err := ApplyDelta(baseData, patch)
+	require.NoError(t, err)
+	assert.Equal(t, targetData, result)
+}
+
+func mustGetBinary(t *testing.T, backend *LocalStorageBackend, path string) []byte {
+	data, err := backend.GetBinary(context.Background(), path)
+	require.NoError(t, err)
+	return data
+}
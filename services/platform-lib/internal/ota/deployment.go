@@ -134,6 +134,7 @@ func (s *Service) initializeDeviceUpdates(ctx context.Context, deployment *OTADe
 	// Determine how many devices to update based on strategy
 	devicesToUpdate := s.selectDevicesForUpdate(deployment)
 
+	created := make([]*DeviceUpdate, 0, len(devicesToUpdate))
 	for _, deviceID := range devicesToUpdate {
 		update := &DeviceUpdate{
 			DeviceID:     deviceID,
@@ -149,8 +150,12 @@ func (s *Service) initializeDeviceUpdates(ctx context.Context, deployment *OTADe
 			s.logger.Warn("Failed to create device update", "device_id", deviceID, "error", err)
 			continue
 		}
+		created = append(created, update)
 	}
 
+	// Sent once every record exists, so a device that is told can already fetch its update
+	s.notifyDevices(ctx, created)
+
 	return nil
 }
 
@@ -300,19 +305,31 @@ func (s *Service) RollbackDeployment(ctx context.Context, deploymentID string) e
 	return nil
 }
 
-// GetUpdateForDevice retrieves the pending update for a device
-func (s *Service) GetUpdateForDevice(ctx context.Context, deviceID string) (*FirmwareUpdate, error) {
+// GetUpdateForDevice retrieves the pending update for a device. Depending on what the device
+// reports in opts, a delta patch or a sector manifest and a compressed image are offered
+// alongside the full image.
+func (s *Service) GetUpdateForDevice(ctx context.Context, deviceID string, opts UpdateCheckOptions) (*FirmwareUpdate, error) {
 	// Get the latest update for the device
 	update, err := s.repository.GetLatestUpdateForDevice(ctx, deviceID)
 	if err != nil {
 		return nil, fmt.Errorf("no pending update for device: %w", err)
 	}
 
-	// Only return if status is pending
-	if update.Status != UpdateStatusPending {
+	if !isUpdateOffered(update) {
 		return nil, fmt.Errorf("no pending update for device")
 	}
 
+	return s.buildFirmwareUpdate(ctx, deviceID, update, opts)
+}
+
+// isUpdateOffered reports whether a device update should be handed to the device: it is
+// pending, or the device was interrupted mid-download and is coming back to resume it
+func isUpdateOffered(update *DeviceUpdate) bool {
+	return update.Status == UpdateStatusPending || update.Status == UpdateStatusDownloading
+}
+
+// buildFirmwareUpdate describes an offered device update, with download URLs, for the device
+func (s *Service) buildFirmwareUpdate(ctx context.Context, deviceID string, update *DeviceUpdate, opts UpdateCheckOptions) (*FirmwareUpdate, error) {
 	// Get the release details
 	release, err := s.repository.GetRelease(ctx, update.ReleaseID)
 	if err != nil {
@@ -336,6 +353,52 @@ func (s *Service) GetUpdateForDevice(ctx context.Context, deviceID string) (*Fir
 		CreatedAt:    release.CreatedAt,
 	}
 
+	// The components are part of the release, so unlike the optional payloads below they
+	// can't be left out
+	firmwareUpdate.Components, err = s.updateComponents(ctx, release)
+	if err != nil {
+		return nil, err
+	}
+
+	// Compression applies to both the compressed image and the delta patch
+	compression := ""
+	if opts.Compression == CompressionZlib {
+		compressedURL, compressedSize, err := s.prepareCompressedUpdate(ctx, release)
+		if err != nil {
+			s.logger.Warn("Failed to prepare compressed update, offering raw image", "device_id", deviceID, "error", err)
+		} else {
+			compression = CompressionZlib
+			firmwareUpdate.Compression = compression
+			firmwareUpdate.CompressedURL = compressedURL
+			firmwareUpdate.CompressedSize = compressedSize
+		}
+	}
+
+	// Offer a delta patch when the device tells us what it is running
+	if opts.CurrentReleaseID != "" && opts.CurrentReleaseID != release.ReleaseID {
+		deltaURL, deltaSize, err := s.prepareDeltaUpdate(ctx, release, opts.CurrentReleaseID, compression)
+		if err != nil {
+			s.logger.Warn("Failed to prepare delta update, offering full image", "device_id", deviceID, "base_release_id", opts.CurrentReleaseID, "error", err)
+		} else if deltaURL != "" {
+			firmwareUpdate.DeltaURL = deltaURL
+			firmwareUpdate.DeltaSize = deltaSize
+			firmwareUpdate.DeltaBaseReleaseID = opts.CurrentReleaseID
+		}
+	}
+
+	// Without a delta, a device that says how its flash is laid out can still reuse the
+	// sectors it already has and check the rest as they arrive; a delta is smaller and
+	// checked as a whole, so both aren't sent
+	if firmwareUpdate.DeltaURL == "" && IsValidSectorSize(opts.SectorSize) {
+		manifestURL, manifestSize, err := s.prepareSectorManifest(ctx, release, opts.SectorSize)
+		if err != nil {
+			s.logger.Warn("Failed to prepare sector manifest, offering full image", "device_id", deviceID, "sector_size", opts.SectorSize, "error", err)
+		} else if manifestURL != "" {
+			firmwareUpdate.SectorManifestURL = manifestURL
+			firmwareUpdate.SectorManifestSize = manifestSize
+		}
+	}
+
 	return firmwareUpdate, nil
 }
 
@@ -347,10 +410,19 @@ func (s *Service) ReportUpdateStatus(ctx context.Context, report *UpdateStatusRe
 		return fmt.Errorf("failed to get device update: %w", err)
 	}
 
-	// Update status
+	// Update status; a progress-only report moves a download along without changing the
+	// deployment counts
+	progressOnly := update.Status == UpdateStatusDownloading && report.Status == UpdateStatusDownloading
 	update.Status = report.Status
 	update.Progress = report.Progress
 	update.ErrorMessage = report.ErrorMessage
+	if report.BytesTotal > 0 {
+		now := time.Now()
+		update.BytesDownloaded = report.BytesDownloaded
+		update.BytesTotal = report.BytesTotal
+		update.ThroughputBps = report.ThroughputBps
+		update.ProgressAt = &now
+	}
 
 	// Set completion time if completed or failed
 	if report.Status == UpdateStatusCompleted || report.Status == UpdateStatusFailed {
@@ -363,10 +435,19 @@ func (s *Service) ReportUpdateStatus(ctx context.Context, report *UpdateStatusRe
 		return fmt.Errorf("failed to update device update: %w", err)
 	}
 
-	// Update deployment statistics
-	err = s.updateDeploymentStats(ctx, update.DeploymentID)
-	if err != nil {
-		s.logger.Warn("Failed to update deployment stats", "deployment_id", update.DeploymentID, "error", err)
+	// A finished update is no longer offered, so devices needn't be told to check for it
+	if report.Status == UpdateStatusCompleted || report.Status == UpdateStatusFailed {
+		s.clearDeviceNotice(ctx, report.DeviceID)
+		s.recordUpdateStats(report)
+	}
+
+	// Update deployment statistics; progress reports within a download leave the counts
+	// unchanged, so they skip the stats query and the deployment write
+	if !progressOnly {
+		err = s.updateDeploymentStats(ctx, update.DeploymentID)
+		if err != nil {
+			s.logger.Warn("Failed to update deployment stats", "deployment_id", update.DeploymentID, "error", err)
+		}
 	}
 
 	// Check for automatic failure detection and rollback
@@ -382,6 +463,40 @@ func (s *Service) ReportUpdateStatus(ctx context.Context, report *UpdateStatusRe
 	return nil
 }
 
+// MaxBatchStatusReports is the largest number of reports accepted in one batch
+const MaxBatchStatusReports = 32
+
+// ReportUpdateStatusBatch applies a batch of status reports in order and returns which of
+// them could not be applied
+func (s *Service) ReportUpdateStatusBatch(ctx context.Context, reports []UpdateStatusReport) *BatchStatusResult {
+	result := &BatchStatusResult{}
+
+	for i := range reports {
+		report := &reports[i]
+
+		var err error
+		if report.DeviceID == "" || report.ReleaseID == "" || report.Status == "" {
+			err = fmt.Errorf("device_id, release_id and status are required")
+		} else {
+			err = s.ReportUpdateStatus(ctx, report)
+		}
+
+		if err != nil {
+			s.logger.Warn("Failed to apply batched status report", "device_id", report.DeviceID, "release_id", report.ReleaseID, "error", err)
+			result.Failed = append(result.Failed, BatchStatusFailure{
+				Index:     i,
+				ReleaseID: report.ReleaseID,
+				Error:     err.Error(),
+			})
+			continue
+		}
+
+		result.Accepted++
+	}
+
+	return result
+}
+
 // updateDeploymentStats updates the success and failure counts for a deployment
 func (s *Service) updateDeploymentStats(ctx context.Context, deploymentID string) error {
 	deployment, err := s.repository.GetDeployment(ctx, deploymentID)
@@ -467,12 +582,24 @@ func (s *Service) GetDeploymentStatus(ctx context.Context, deploymentID string)
 
 	// Calculate statistics
 	var pendingCount, downloadingCount, installingCount, completedCount, failedCount int
+	var throughputSum, throughputCount, slowestThroughput int64
+	var estimatedCompletion *time.Time
 	for _, update := range updates {
 		switch update.Status {
 		case UpdateStatusPending:
 			pendingCount++
 		case UpdateStatusDownloading:
 			downloadingCount++
+			if update.ThroughputBps > 0 {
+				throughputSum += update.ThroughputBps
+				throughputCount++
+				if slowestThroughput == 0 || update.ThroughputBps < slowestThroughput {
+					slowestThroughput = update.ThroughputBps
+				}
+			}
+			if eta, ok := update.EstimatedDownloadCompletion(); ok && (estimatedCompletion == nil || eta.After(*estimatedCompletion)) {
+				estimatedCompletion = &eta
+			}
 		case UpdateStatusInstalling:
 			installingCount++
 		case UpdateStatusCompleted:
@@ -502,6 +629,12 @@ func (s *Service) GetDeploymentStatus(ctx context.Context, deploymentID string)
 		ProgressPercentage: progressPercentage,
 		CreatedAt:          deployment.CreatedAt,
 		UpdatedAt:          deployment.UpdatedAt,
+
+		SlowestThroughputBps: slowestThroughput,
+		DownloadsCompleteAt:  estimatedCompletion,
+	}
+	if throughputCount > 0 {
+		report.AverageThroughputBps = throughputSum / throughputCount
 	}
 
 	return report, nil
@@ -522,4 +655,10 @@ type DeploymentStatusReport struct {
 	ProgressPercentage int                `json:"progress_percentage"`
 	CreatedAt          time.Time          `json:"created_at"`
 	UpdatedAt          time.Time          `json:"updated_at"`
+
+	// Download rates and the projected end of the slowest download, from the progress
+	// reports of devices that are still downloading
+	AverageThroughputBps int64      `json:"average_throughput_bps,omitempty"`
+	SlowestThroughputBps int64      `json:"slowest_throughput_bps,omitempty"`
+	DownloadsCompleteAt  *time.Time `json:"downloads_complete_at,omitempty"`
 }
@@ -0,0 +1,289 @@
+package ota
+
+import (
+	"context"
+	"encoding/binary"
+	"fmt"
+	"net"
+	"strings"
+
+	"github.com/athena/platform-lib/pkg/logger"
+)
+
+const (
+	// MDNSServiceType is the DNS-SD service type a LAN cache is advertised under
+	MDNSServiceType = "_athena-ota._tcp"
+
+	// mDNS transport (RFC 6762)
+	mdnsPort         = 5353
+	mdnsIPv4Group    = "224.0.0.251"
+	mdnsDomain       = "local."
+	mdnsTTL          = 120
+	mdnsMaxPacket    = 9000
+	mdnsCacheFlush   = 0x8000
+	mdnsUnicastReply = 0x8000
+
+	// DNS record types and class
+	dnsTypeA   = 1
+	dnsTypePTR = 12
+	dnsTypeTXT = 16
+	dnsTypeSRV = 33
+	dnsTypeANY = 255
+	dnsClassIN = 1
+)
+
+// MDNSAdvertiser answers mDNS queries for a LAN cache so devices on the same network can
+// find it without configuration. It publishes one DNS-SD instance of MDNSServiceType with
+// the cache's port and fetch path; only IPv4 is advertised, which is all the devices use.
+type MDNSAdvertiser struct {
+	instance string
+	host     string
+	port     uint16
+	ips      []net.IP
+	txt      []string
+	logger   *logger.Logger
+}
+
+// NewMDNSAdvertiser creates an advertiser for a LAN cache listening on port at ips. The
+// instance name also names the host record, so it must be a single DNS label.
+func NewMDNSAdvertiser(instance string, port int, ips []net.IP, logger *logger.Logger) (*MDNSAdvertiser, error) {
+	if instance == "" || len(instance) > 63 || strings.ContainsAny(instance, ". ") {
+		return nil, fmt.Errorf("invalid mDNS instance name: %q", instance)
+	}
+	if port <= 0 || port > 65535 {
+		return nil, fmt.Errorf("invalid port: %d", port)
+	}
+
+	var ipv4 []net.IP
+	for _, ip := range ips {
+		if v4 := ip.To4(); v4 != nil {
+			ipv4 = append(ipv4, v4)
+		}
+	}
+	if len(ipv4) == 0 {
+		return nil, fmt.Errorf("mDNS advertiser needs an IPv4 address")
+	}
+
+	return &MDNSAdvertiser{
+		instance: instance,
+		host:     instance + "." + mdnsDomain,
+		port:     uint16(port),
+		ips:      ipv4,
+		txt:      []string{"v=1", "path=" + LANCacheFetchPath},
+		logger:   logger,
+	}, nil
+}
+
+// Serve answers queries on the mDNS group until ctx is cancelled. iface may be nil to
+// let the system pick the interface.
+func (a *MDNSAdvertiser) Serve(ctx context.Context, iface *net.Interface) error {
+	group := &net.UDPAddr{IP: net.ParseIP(mdnsIPv4Group), Port: mdnsPort}
+	conn, err := net.ListenMulticastUDP("udp4", iface, group)
+	if err != nil {
+		return fmt.Errorf("failed to join mDNS group: %w", err)
+	}
+	defer conn.Close()
+
+	go func() {
+		<-ctx.Done()
+		conn.Close()
+	}()
+
+	// Announce once so caches that come up mid-rollout are seen without waiting for a query
+	if _, err := conn.WriteToUDP(a.response(0, nil, 0), group); err != nil {
+		a.logger.Warn("mDNS announcement failed", "error", err)
+	}
+
+	buffer := make([]byte, mdnsMaxPacket)
+	for {
+		n, source, err := conn.ReadFromUDP(buffer)
+		if err != nil {
+			if ctx.Err() != nil {
+				return nil
+			}
+			return fmt.Errorf("mDNS read failed: %w", err)
+		}
+
+		reply, unicast, ok := a.answer(buffer[:n], source.Port != mdnsPort)
+		if !ok {
+			continue
+		}
+
+		target := group
+		if unicast {
+			target = source
+		}
+		if _, err := conn.WriteToUDP(reply, target); err != nil {
+			a.logger.Warn("mDNS reply failed", "error", err)
+		}
+	}
+}
+
+// answer builds the reply to an mDNS query, if any of its questions are about the cache.
+// Legacy queries, sent from a port other than 5353, get a unicast reply that echoes the
+// query's ID and questions, as RFC 6762 section 6.7 asks.
+func (a *MDNSAdvertiser) answer(query []byte, legacy bool) (reply []byte, unicast bool, ok bool) {
+	if len(query) < 12 {
+		return nil, false, false
+	}
+
+	id := binary.BigEndian.Uint16(query[0:])
+	flags := binary.BigEndian.Uint16(query[2:])
+	questions := int(binary.BigEndian.Uint16(query[4:]))
+	if flags&0x8000 != 0 {
+		// A response from another responder
+		return nil, false, false
+	}
+
+	offset := 12
+	matched := false
+	unicast = legacy
+	var echoed []byte
+	echoedCount := 0
+	for i := 0; i < questions; i++ {
+		name, next, err := readDNSName(query, offset)
+		if err != nil || next+4 > len(query) {
+			return nil, false, false
+		}
+		qtype := binary.BigEndian.Uint16(query[next:])
+		qclass := binary.BigEndian.Uint16(query[next+2:])
+		offset = next + 4
+
+		if a.matches(name, qtype) {
+			matched = true
+			if qclass&mdnsUnicastReply != 0 {
+				unicast = true
+			}
+			if legacy {
+				echoed = appendDNSName(echoed, name)
+				echoed = binary.BigEndian.AppendUint16(echoed, qtype)
+				echoed = binary.BigEndian.AppendUint16(echoed, dnsClassIN)
+				echoedCount++
+			}
+		}
+	}
+	if !matched {
+		return nil, false, false
+	}
+
+	if !legacy {
+		id = 0
+	}
+	return a.response(id, echoed, echoedCount), unicast, true
+}
+
+// matches reports whether a question asks for one of the advertised records
+func (a *MDNSAdvertiser) matches(name string, qtype uint16) bool {
+	switch {
+	case strings.EqualFold(name, a.serviceName()):
+		return qtype == dnsTypePTR || qtype == dnsTypeANY
+	case strings.EqualFold(name, a.instanceName()):
+		return qtype == dnsTypeSRV || qtype == dnsTypeTXT || qtype == dnsTypeANY
+	case strings.EqualFold(name, a.host):
+		return qtype == dnsTypeA || qtype == dnsTypeANY
+	}
+	return false
+}
+
+// response encodes every advertised record: the PTR as the answer and the SRV, TXT and A
+// records that resolve it as additional records, so one round trip is enough. echoed holds
+// the encoded questions to repeat for a legacy query.
+func (a *MDNSAdvertiser) response(id uint16, echoed []byte, questions int) []byte {
+	packet := make([]byte, 12, 512)
+	binary.BigEndian.PutUint16(packet[0:], id)
+	binary.BigEndian.PutUint16(packet[2:], 0x8400) // response, authoritative
+	binary.BigEndian.PutUint16(packet[4:], uint16(questions))
+	binary.BigEndian.PutUint16(packet[6:], 1)
+	binary.BigEndian.PutUint16(packet[10:], uint16(2+len(a.ips)))
+	packet = append(packet, echoed...)
+
+	// PTR records are shared between responders; the rest belong to this one only
+	packet = appendDNSRecord(packet, a.serviceName(), dnsTypePTR, dnsClassIN, appendDNSName(nil, a.instanceName()))
+
+	srv := make([]byte, 6)
+	binary.BigEndian.PutUint16(srv[4:], a.port)
+	packet = appendDNSRecord(packet, a.instanceName(), dnsTypeSRV, dnsClassIN|mdnsCacheFlush, appendDNSName(srv, a.host))
+
+	var txt []byte
+	for _, entry := range a.txt {
+		txt = append(txt, byte(len(entry)))
+		txt = append(txt, entry...)
+	}
+	packet = appendDNSRecord(packet, a.instanceName(), dnsTypeTXT, dnsClassIN|mdnsCacheFlush, txt)
+
+	for _, ip := range a.ips {
+		packet = appendDNSRecord(packet, a.host, dnsTypeA, dnsClassIN|mdnsCacheFlush, ip)
+	}
+
+	return packet
+}
+
+func (a *MDNSAdvertiser) serviceName() string {
+	return MDNSServiceType + "." + mdnsDomain
+}
+
+func (a *MDNSAdvertiser) instanceName() string {
+	return a.instance + "." + a.serviceName()
+}
+
+// appendDNSRecord appends a resource record with the advertiser's TTL
+func appendDNSRecord(packet []byte, name string, rtype, class uint16, data []byte) []byte {
+	packet = appendDNSName(packet, name)
+	packet = binary.BigEndian.AppendUint16(packet, rtype)
+	packet = binary.BigEndian.AppendUint16(packet, class)
+	packet = binary.BigEndian.AppendUint32(packet, mdnsTTL)
+	packet = binary.BigEndian.AppendUint16(packet, uint16(len(data)))
+	return append(packet, data...)
+}
+
+// appendDNSName encodes a dotted name as labels, without compression
+func appendDNSName(packet []byte, name string) []byte {
+	for _, label := range strings.Split(strings.TrimSuffix(name, "."), ".") {
+		packet = append(packet, byte(len(label)))
+		packet = append(packet, label...)
+	}
+	return append(packet, 0)
+}
+
+// readDNSName decodes the name at offset, following compression pointers, and returns it
+// with a trailing dot along with the offset just past it
+func readDNSName(packet []byte, offset int) (string, int, error) {
+	var labels []string
+	next := -1
+	for jumps := 0; ; {
+		if offset >= len(packet) {
+			return "", 0, fmt.Errorf("name runs past the packet")
+		}
+		length := int(packet[offset])
+
+		switch {
+		case length == 0:
+			if next < 0 {
+				next = offset + 1
+			}
+			return strings.Join(labels, ".") + ".", next, nil
+
+		case length&0xC0 == 0xC0:
+			if offset+1 >= len(packet) {
+				return "", 0, fmt.Errorf("truncated name pointer")
+			}
+			if jumps++; jumps > 16 {
+				return "", 0, fmt.Errorf("name pointer loop")
+			}
+			if next < 0 {
+				next = offset + 2
+			}
+			offset = int(binary.BigEndian.Uint16(packet[offset:]) & 0x3FFF)
+
+		case length > 63:
+			return "", 0, fmt.Errorf("invalid label length %d", length)
+
+		default:
+			if offset+1+length > len(packet) {
+				return "", 0, fmt.Errorf("label runs past the packet")
+			}
+			labels = append(labels, string(packet[offset+1:offset+1+length]))
+			offset += 1 + length
+		}
+	}
+}
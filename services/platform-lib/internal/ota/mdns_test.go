@@ -0,0 +1,153 @@
+package ota
+
+import (
+	"encoding/binary"
+	"net"
+	"testing"
+
+	"github.com/athena/platform-lib/pkg/logger"
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/require"
+)
+
+// mdnsQuery encodes a query with one question per type for name
+func mdnsQuery(id uint16, name string, qclass uint16, qtypes ...uint16) []byte {
+	packet := make([]byte, 12)
+	binary.BigEndian.PutUint16(packet[0:], id)
+	binary.BigEndian.PutUint16(packet[4:], uint16(len(qtypes)))
+	for i, qtype := range qtypes {
+		if i == 0 {
+			packet = appendDNSName(packet, name)
+		} else {
+			// Later questions point back at the first name, as most resolvers do
+			packet = append(packet, 0xC0, 12)
+		}
+		packet = binary.BigEndian.AppendUint16(packet, qtype)
+		packet = binary.BigEndian.AppendUint16(packet, qclass)
+	}
+	return packet
+}
+
+type mdnsRecord struct {
+	name  string
+	rtype uint16
+	data  []byte
+	rdata int
+}
+
+// parseMDNSResponse decodes the records of a response, skipping its questions
+func parseMDNSResponse(t *testing.T, packet []byte) (uint16, int, []mdnsRecord) {
+	require.True(t, len(packet) >= 12)
+	questions := int(binary.BigEndian.Uint16(packet[4:]))
+	records := int(binary.BigEndian.Uint16(packet[6:])) + int(binary.BigEndian.Uint16(packet[8:])) + int(binary.BigEndian.Uint16(packet[10:]))
+
+	offset := 12
+	for i := 0; i < questions; i++ {
+		_, next, err := readDNSName(packet, offset)
+		require.NoError(t, err)
+		offset = next + 4
+	}
+
+	var parsed []mdnsRecord
+	for i := 0; i < records; i++ {
+		name, next, err := readDNSName(packet, offset)
+		require.NoError(t, err)
+		length := int(binary.BigEndian.Uint16(packet[next+8:]))
+		parsed = append(parsed, mdnsRecord{
+			name:  name,
+			rtype: binary.BigEndian.Uint16(packet[next:]),
+			data:  packet[next+10 : next+10+length],
+			rdata: next + 10,
+		})
+		offset = next + 10 + length
+	}
+	assert.Equal(t, len(packet), offset)
+
+	return binary.BigEndian.Uint16(packet[0:]), questions, parsed
+}
+
+func TestMDNSAdvertiser_AnswersServiceQuery(t *testing.T) {
+	advertiser, err := NewMDNSAdvertiser("site-gateway", 8080, []net.IP{net.ParseIP("192.168.1.20"), net.ParseIP("fe80::1")}, logger.New("debug", "test"))
+	require.NoError(t, err)
+
+	reply, unicast, ok := advertiser.answer(mdnsQuery(7, "_athena-ota._tcp.local.", dnsClassIN, dnsTypePTR), false)
+	require.True(t, ok)
+	assert.False(t, unicast)
+
+	id, questions, records := parseMDNSResponse(t, reply)
+	assert.Equal(t, uint16(0), id)
+	assert.Equal(t, 0, questions)
+	require.Len(t, records, 4)
+
+	assert.Equal(t, "_athena-ota._tcp.local.", records[0].name)
+	assert.Equal(t, uint16(dnsTypePTR), records[0].rtype)
+	target, _, err := readDNSName(reply, records[0].rdata)
+	require.NoError(t, err)
+	assert.Equal(t, "site-gateway._athena-ota._tcp.local.", target)
+
+	assert.Equal(t, uint16(dnsTypeSRV), records[1].rtype)
+	assert.Equal(t, uint16(8080), binary.BigEndian.Uint16(records[1].data[4:]))
+	host, _, err := readDNSName(reply, records[1].rdata+6)
+	require.NoError(t, err)
+	assert.Equal(t, "site-gateway.local.", host)
+
+	assert.Equal(t, uint16(dnsTypeTXT), records[2].rtype)
+	assert.Equal(t, "\x03v=1\x18path="+LANCacheFetchPath, string(records[2].data))
+
+	// Only the IPv4 address is advertised
+	assert.Equal(t, uint16(dnsTypeA), records[3].rtype)
+	assert.Equal(t, []byte{192, 168, 1, 20}, records[3].data)
+}
+
+func TestMDNSAdvertiser_QueryVariants(t *testing.T) {
+	advertiser, err := NewMDNSAdvertiser("site-gateway", 8080, []net.IP{net.ParseIP("10.0.0.2")}, logger.New("debug", "test"))
+	require.NoError(t, err)
+
+	// Unrelated services and record types are left to other responders
+	_, _, ok := advertiser.answer(mdnsQuery(0, "_http._tcp.local.", dnsClassIN, dnsTypePTR), false)
+	assert.False(t, ok)
+	_, _, ok = advertiser.answer(mdnsQuery(0, "_athena-ota._tcp.local.", dnsClassIN, dnsTypeA), false)
+	assert.False(t, ok)
+
+	// Names compare case-insensitively and compressed questions resolve
+	_, _, ok = advertiser.answer(mdnsQuery(0, "Site-Gateway._athena-ota._tcp.local.", dnsClassIN, dnsTypeA, dnsTypeSRV), false)
+	assert.True(t, ok)
+
+	// A question with the unicast-response bit gets a unicast reply
+	_, unicast, ok := advertiser.answer(mdnsQuery(0, "_athena-ota._tcp.local.", dnsClassIN|mdnsUnicastReply, dnsTypePTR), false)
+	require.True(t, ok)
+	assert.True(t, unicast)
+
+	// A legacy resolver gets its ID and question back
+	reply, unicast, ok := advertiser.answer(mdnsQuery(42, "site-gateway.local.", dnsClassIN, dnsTypeA), true)
+	require.True(t, ok)
+	assert.True(t, unicast)
+	id, questions, records := parseMDNSResponse(t, reply)
+	assert.Equal(t, uint16(42), id)
+	assert.Equal(t, 1, questions)
+	assert.Len(t, records, 4)
+
+	// Responses and malformed packets are ignored
+	response := mdnsQuery(0, "_athena-ota._tcp.local.", dnsClassIN, dnsTypePTR)
+	response[2] = 0x84
+	_, _, ok = advertiser.answer(response, false)
+	assert.False(t, ok)
+
+	looped := mdnsQuery(0, "x.local.", dnsClassIN, dnsTypePTR)
+	looped[12] = 0xC0
+	looped[13] = 12
+	_, _, ok = advertiser.answer(looped, false)
+	assert.False(t, ok)
+
+	_, _, ok = advertiser.answer([]byte{0, 1, 2}, false)
+	assert.False(t, ok)
+}
+
+func TestNewMDNSAdvertiser_InvalidConfig(t *testing.T) {
+	_, err := NewMDNSAdvertiser("two.labels", 8080, []net.IP{net.ParseIP("10.0.0.2")}, logger.New("debug", "test"))
+	assert.Error(t, err)
+	_, err = NewMDNSAdvertiser("gateway", 0, []net.IP{net.ParseIP("10.0.0.2")}, logger.New("debug", "test"))
+	assert.Error(t, err)
+	_, err = NewMDNSAdvertiser("gateway", 8080, []net.IP{net.ParseIP("::1")}, logger.New("debug", "test"))
+	assert.Error(t, err)
+}
@@ -58,6 +58,22 @@ type FirmwareRelease struct {
 	ReleaseNotes string         `json:"release_notes"`
 	CreatedAt    time.Time      `json:"created_at"`
 	CreatedBy    string         `json:"created_by"`
+
+	// Optional images for the device's data partitions, installed with the application
+	Components []ReleaseComponent `json:"components,omitempty"`
+}
+
+// ReleaseComponent is an image shipped in a release besides the application, such as a
+// filesystem or a configuration blob, that the device writes to one of its data partitions
+// in the same update session
+type ReleaseComponent struct {
+	Name      string `json:"name"`
+	Type      string `json:"type"`
+	Partition string `json:"partition,omitempty"`
+	Hash      string `json:"hash"`
+	Path      string `json:"path"`
+	Size      int64  `json:"size"`
+	Signature string `json:"signature"`
 }
 
 // FirmwareReleaseEntity represents the Datastore entity for firmware releases
@@ -73,6 +89,8 @@ type FirmwareReleaseEntity struct {
 	ReleaseNotes string    `datastore:"release_notes,noindex"`
 	CreatedAt    time.Time `datastore:"created_at"`
 	CreatedBy    string    `datastore:"created_by"`
+
+	ComponentsJSON string `datastore:"components_json,noindex"`
 }
 
 // OTADeployment represents an OTA deployment configuration
@@ -115,6 +133,12 @@ type DeviceUpdate struct {
 	ErrorMessage string       `json:"error_message,omitempty"`
 	StartedAt    time.Time    `json:"started_at"`
 	CompletedAt  *time.Time   `json:"completed_at,omitempty"`
+
+	// Download progress from the device's last report, if it sent any
+	BytesDownloaded int64      `json:"bytes_downloaded,omitempty"`
+	BytesTotal      int64      `json:"bytes_total,omitempty"`
+	ThroughputBps   int64      `json:"throughput_bps,omitempty"`
+	ProgressAt      *time.Time `json:"progress_at,omitempty"`
 }
 
 // DeviceUpdateEntity represents the Datastore entity for device updates
@@ -127,6 +151,11 @@ type DeviceUpdateEntity struct {
 	ErrorMessage string    `datastore:"error_message,noindex"`
 	StartedAt    time.Time `datastore:"started_at"`
 	CompletedAt  time.Time `datastore:"completed_at"`
+
+	BytesDownloaded int64     `datastore:"bytes_downloaded,noindex"`
+	BytesTotal      int64     `datastore:"bytes_total,noindex"`
+	ThroughputBps   int64     `datastore:"throughput_bps,noindex"`
+	ProgressAt      time.Time `datastore:"progress_at,noindex"`
 }
 
 // CreateReleaseRequest represents a request to create a new firmware release
@@ -137,6 +166,17 @@ type CreateReleaseRequest struct {
 	BinaryData   []byte         `json:"binary_data" binding:"required"`
 	ReleaseNotes string         `json:"release_notes"`
 	CreatedBy    string         `json:"created_by"`
+
+	// Optional component images to ship with the application
+	Components []ComponentData `json:"components,omitempty"`
+}
+
+// ComponentData is a component image uploaded with a release
+type ComponentData struct {
+	Name      string `json:"name"`
+	Type      string `json:"type"`
+	Partition string `json:"partition,omitempty"`
+	Data      []byte `json:"data"`
 }
 
 // DeploymentConfig represents the configuration for a deployment
@@ -154,6 +194,50 @@ type UpdateStatusReport struct {
 	Status       UpdateStatus `json:"status" binding:"required"`
 	Progress     int          `json:"progress"`
 	ErrorMessage string       `json:"error_message,omitempty"`
+
+	// Optional download progress, sent with downloading reports
+	BytesDownloaded int64 `json:"bytes_downloaded,omitempty"`
+	BytesTotal      int64 `json:"bytes_total,omitempty"`
+	ThroughputBps   int64 `json:"throughput_bps,omitempty"`
+
+	// Optional timings of the whole update, sent with the final report
+	Stats *UpdateStats `json:"stats,omitempty"`
+}
+
+// UpdateStats breaks down where a device's update time went. Times are in milliseconds.
+type UpdateStats struct {
+	DNSMs           int64 `json:"dns_ms"`
+	TLSMs           int64 `json:"tls_ms"`
+	FirstByteMs     int64 `json:"first_byte_ms"`
+	DownloadMs      int64 `json:"download_ms"`
+	HashMs          int64 `json:"hash_ms"`
+	VerifyMs        int64 `json:"verify_ms"`
+	FlashWriteMs    int64 `json:"flash_write_ms"`
+	FinalizeMs      int64 `json:"finalize_ms"`
+	TotalMs         int64 `json:"total_ms"`
+	BytesDownloaded int64 `json:"bytes_downloaded"`
+	ThroughputBps   int64 `json:"throughput_bps"`
+	MinFreeHeap     int64 `json:"min_free_heap"`
+	Retries         int   `json:"retries"`
+}
+
+// BatchStatusReport carries several status reports in one request, so a device can send
+// everything it queued (for example across a reboot) with a single round trip
+type BatchStatusReport struct {
+	Reports []UpdateStatusReport `json:"reports" binding:"required"`
+}
+
+// BatchStatusResult lists the reports of a batch that could not be applied
+type BatchStatusResult struct {
+	Accepted int                  `json:"accepted"`
+	Failed   []BatchStatusFailure `json:"failed,omitempty"`
+}
+
+// BatchStatusFailure describes one rejected report in a batch
+type BatchStatusFailure struct {
+	Index     int    `json:"index"`
+	ReleaseID string `json:"release_id"`
+	Error     string `json:"error"`
 }
 
 // FirmwareUpdate represents the update information for a device
@@ -166,10 +250,49 @@ type FirmwareUpdate struct {
 	Signature    string    `json:"signature"`
 	ReleaseNotes string    `json:"release_notes"`
 	CreatedAt    time.Time `json:"created_at"`
+
+	// Optional delta patch from the device's current release to this one
+	DeltaURL           string `json:"delta_url,omitempty"`
+	DeltaSize          int64  `json:"delta_size,omitempty"`
+	DeltaBaseReleaseID string `json:"delta_base_release_id,omitempty"`
+
+	// Optional compressed copy of the image; Compression also applies to DeltaURL
+	Compression    string `json:"compression,omitempty"`
+	CompressedURL  string `json:"compressed_url,omitempty"`
+	CompressedSize int64  `json:"compressed_size,omitempty"`
+
+	// Optional signed per-sector hashes of the raw image, for devices that fetch only changed
+	// sectors and check each downloaded one before writing it
+	SectorManifestURL  string `json:"sector_manifest_url,omitempty"`
+	SectorManifestSize int64  `json:"sector_manifest_size,omitempty"`
+
+	// Optional images for the device's data partitions, installed in the same session before
+	// the application image is made bootable
+	Components []UpdateComponent `json:"components,omitempty"`
+}
+
+// UpdateComponent is a component image offered to a device with an update
+type UpdateComponent struct {
+	Name      string `json:"name"`
+	Type      string `json:"type"`
+	Partition string `json:"partition,omitempty"`
+	URL       string `json:"url"`
+	Hash      string `json:"hash"`
+	Size      int64  `json:"size"`
+	Signature string `json:"signature"`
 }
 
 // ToEntity converts a FirmwareRelease to a FirmwareReleaseEntity
 func (r *FirmwareRelease) ToEntity() (*FirmwareReleaseEntity, error) {
+	componentsJSON := ""
+	if len(r.Components) > 0 {
+		encoded, err := json.Marshal(r.Components)
+		if err != nil {
+			return nil, err
+		}
+		componentsJSON = string(encoded)
+	}
+
 	return &FirmwareReleaseEntity{
 		ReleaseID:    r.ReleaseID,
 		TemplateID:   r.TemplateID,
@@ -182,11 +305,20 @@ func (r *FirmwareRelease) ToEntity() (*FirmwareReleaseEntity, error) {
 		ReleaseNotes: r.ReleaseNotes,
 		CreatedAt:    r.CreatedAt,
 		CreatedBy:    r.CreatedBy,
+
+		ComponentsJSON: componentsJSON,
 	}, nil
 }
 
 // FromEntity converts a FirmwareReleaseEntity to a FirmwareRelease
 func (e *FirmwareReleaseEntity) FromEntity() (*FirmwareRelease, error) {
+	var components []ReleaseComponent
+	if e.ComponentsJSON != "" {
+		if err := json.Unmarshal([]byte(e.ComponentsJSON), &components); err != nil {
+			return nil, err
+		}
+	}
+
 	return &FirmwareRelease{
 		ReleaseID:    e.ReleaseID,
 		TemplateID:   e.TemplateID,
@@ -199,6 +331,7 @@ func (e *FirmwareReleaseEntity) FromEntity() (*FirmwareRelease, error) {
 		ReleaseNotes: e.ReleaseNotes,
 		CreatedAt:    e.CreatedAt,
 		CreatedBy:    e.CreatedBy,
+		Components:   components,
 	}, nil
 }
 
@@ -258,11 +391,18 @@ func (u *DeviceUpdate) ToEntity() (*DeviceUpdateEntity, error) {
 		Progress:     u.Progress,
 		ErrorMessage: u.ErrorMessage,
 		StartedAt:    u.StartedAt,
+
+		BytesDownloaded: u.BytesDownloaded,
+		BytesTotal:      u.BytesTotal,
+		ThroughputBps:   u.ThroughputBps,
 	}
 
 	if u.CompletedAt != nil {
 		entity.CompletedAt = *u.CompletedAt
 	}
+	if u.ProgressAt != nil {
+		entity.ProgressAt = *u.ProgressAt
+	}
 
 	return entity, nil
 }
@@ -277,11 +417,32 @@ func (e *DeviceUpdateEntity) FromEntity() (*DeviceUpdate, error) {
 		Progress:     e.Progress,
 		ErrorMessage: e.ErrorMessage,
 		StartedAt:    e.StartedAt,
+
+		BytesDownloaded: e.BytesDownloaded,
+		BytesTotal:      e.BytesTotal,
+		ThroughputBps:   e.ThroughputBps,
 	}
 
 	if !e.CompletedAt.IsZero() {
 		update.CompletedAt = &e.CompletedAt
 	}
+	if !e.ProgressAt.IsZero() {
+		update.ProgressAt = &e.ProgressAt
+	}
 
 	return update, nil
 }
+
+// EstimatedDownloadCompletion projects when the device will finish downloading from the
+// rate in its last progress report. It returns false while no usable progress is known.
+func (u *DeviceUpdate) EstimatedDownloadCompletion() (time.Time, bool) {
+	if u.Status != UpdateStatusDownloading || u.ProgressAt == nil || u.ThroughputBps <= 0 || u.BytesTotal <= 0 {
+		return time.Time{}, false
+	}
+
+	remaining := u.BytesTotal - u.BytesDownloaded
+	if remaining < 0 {
+		remaining = 0
+	}
+	return u.ProgressAt.Add(time.Duration(remaining) * time.Second / time.Duration(u.ThroughputBps)), true
+}
@@ -0,0 +1,63 @@
+package ota
+
+import (
+	"context"
+	"encoding/json"
+	"fmt"
+	"time"
+
+	mqtt "github.com/eclipse/paho.mqtt.golang"
+)
+
+// mqttPublishTimeout bounds how long a notice waits for the broker's acknowledgement
+const mqttPublishTimeout = 5 * time.Second
+
+// MQTTNotifier publishes update notices to each device's UpdateNoticeTopic. Notices are
+// retained, so a device that was offline when the deployment started receives its notice
+// as soon as it subscribes.
+type MQTTNotifier struct {
+	client mqtt.Client
+	qos    byte
+}
+
+// NewMQTTNotifier creates a notifier that publishes through a connected MQTT client
+func NewMQTTNotifier(client mqtt.Client) *MQTTNotifier {
+	return &MQTTNotifier{
+		client: client,
+		qos:    1,
+	}
+}
+
+// NotifyUpdate publishes a retained update notice for a device
+func (n *MQTTNotifier) NotifyUpdate(ctx context.Context, deviceID string, notice *UpdateNotice) error {
+	payload, err := json.Marshal(notice)
+	if err != nil {
+		return fmt.Errorf("failed to encode update notice: %w", err)
+	}
+
+	return n.publish(ctx, UpdateNoticeTopic(deviceID), payload)
+}
+
+// ClearNotice removes the retained notice for a device
+func (n *MQTTNotifier) ClearNotice(ctx context.Context, deviceID string) error {
+	// An empty retained message deletes the one held by the broker
+	return n.publish(ctx, UpdateNoticeTopic(deviceID), []byte{})
+}
+
+func (n *MQTTNotifier) publish(ctx context.Context, topic string, payload []byte) error {
+	token := n.client.Publish(topic, n.qos, true, payload)
+
+	select {
+	case <-token.Done():
+	case <-ctx.Done():
+		return ctx.Err()
+	case <-time.After(mqttPublishTimeout):
+		return fmt.Errorf("timed out publishing to %s", topic)
+	}
+
+	if err := token.Error(); err != nil {
+		return fmt.Errorf("failed to publish to %s: %w", topic, err)
+	}
+
+	return nil
+}
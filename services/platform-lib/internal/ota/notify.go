@@ -0,0 +1,129 @@
+package ota
+
+import (
+	"context"
+	"sync"
+)
+
+const (
+	// noticeWorkers bounds how many update notices are in flight at once
+	noticeWorkers = 16
+
+	// noticeFailureLimit is how many notices in a row may fail before the rest of a deployment's
+	// are skipped: a broker that is down would fail them all, each after its publish timeout
+	noticeFailureLimit = 32
+)
+
+// UpdateNotice is pushed to a device when a deployment creates an update for it, so the
+// device only has to check over HTTP when there is something to install
+type UpdateNotice struct {
+	ReleaseID    string `json:"release_id"`
+	DeploymentID string `json:"deployment_id"`
+}
+
+// UpdateNotifier delivers update notices to devices
+type UpdateNotifier interface {
+	// NotifyUpdate tells a device that an update is pending for it
+	NotifyUpdate(ctx context.Context, deviceID string, notice *UpdateNotice) error
+	// ClearNotice withdraws a device's notice once its update has finished
+	ClearNotice(ctx context.Context, deviceID string) error
+}
+
+// UpdateNoticeTopic returns the MQTT topic a device subscribes to for update notices
+func UpdateNoticeTopic(deviceID string) string {
+	return "ota/" + deviceID + "/update"
+}
+
+// SetNotifier enables push notifications for new device updates. Devices that don't
+// listen for them keep discovering updates by polling.
+func (s *Service) SetNotifier(notifier UpdateNotifier) {
+	s.notifier = notifier
+}
+
+// notifyDevices pushes update notices for a deployment's new device updates. They are sent in
+// the background by a few workers, so a large rollout doesn't hold up the request that started
+// it, and given up after a run of failures, since devices still find their update by polling.
+func (s *Service) notifyDevices(ctx context.Context, updates []*DeviceUpdate) {
+	if s.notifier == nil || len(updates) == 0 {
+		return
+	}
+
+	// The request that created the updates is usually over before the notices are
+	ctx = context.WithoutCancel(ctx)
+	s.notices.Add(1)
+	go func() {
+		defer s.notices.Done()
+		s.sendNotices(ctx, updates)
+	}()
+}
+
+// sendNotices sends one notice per update and returns once they are all sent or given up
+func (s *Service) sendNotices(ctx context.Context, updates []*DeviceUpdate) {
+	queue := make(chan *DeviceUpdate)
+	stop := make(chan struct{})
+	var mu sync.Mutex
+	failures := 0
+	var wg sync.WaitGroup
+
+	for i := 0; i < noticeWorkers && i < len(updates); i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for update := range queue {
+				err := s.notifyDevice(ctx, update)
+
+				mu.Lock()
+				if err == nil {
+					failures = 0
+				} else if failures++; failures == noticeFailureLimit {
+					close(stop)
+				}
+				mu.Unlock()
+			}
+		}()
+	}
+
+	sent := 0
+	for _, update := range updates {
+		select {
+		case <-stop:
+		default:
+			queue <- update
+			sent++
+			continue
+		}
+		break
+	}
+	close(queue)
+	wg.Wait()
+
+	if sent < len(updates) {
+		s.logger.Warn("Stopped sending update notices after repeated failures", "release_id", updates[0].ReleaseID,
+			"deployment_id", updates[0].DeploymentID, "sent", sent, "skipped", len(updates)-sent)
+	}
+}
+
+// notifyDevice pushes an update notice. Failures are only logged, since the device still
+// finds the update on its next poll.
+func (s *Service) notifyDevice(ctx context.Context, update *DeviceUpdate) error {
+	notice := &UpdateNotice{
+		ReleaseID:    update.ReleaseID,
+		DeploymentID: update.DeploymentID,
+	}
+	err := s.notifier.NotifyUpdate(ctx, update.DeviceID, notice)
+	if err != nil {
+		s.logger.Warn("Failed to send update notice", "device_id", update.DeviceID, "release_id", update.ReleaseID, "error", err)
+	}
+	return err
+}
+
+// clearDeviceNotice withdraws a device's update notice, if a notifier is configured
+func (s *Service) clearDeviceNotice(ctx context.Context, deviceID string) {
+	if s.notifier == nil {
+		return
+	}
+
+	if err := s.notifier.ClearNotice(ctx, deviceID); err != nil {
+		s.logger.Warn("Failed to clear update notice", "device_id", deviceID, "error", err)
+	}
+}
@@ -0,0 +1,98 @@
+package ota
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"hash/fnv"
+	"strconv"
+	"strings"
+	"time"
+)
+
+const (
+	// DefaultPollInterval is how long a device is told to wait before checking again
+	// when there is nothing for it to install
+	DefaultPollInterval = 1 * time.Hour
+
+	// DefaultPollJitter is the window over which devices' next checks are spread, so a
+	// fleet that powered up together doesn't keep polling in lockstep
+	DefaultPollJitter = 15 * time.Minute
+)
+
+// SetPollInterval sets the delay sent to devices in Retry-After when no update is pending.
+// Each device gets a fixed offset within jitter on top of interval.
+func (s *Service) SetPollInterval(interval, jitter time.Duration) {
+	s.pollInterval = interval
+	s.pollJitter = jitter
+}
+
+// pollDelay returns how long a device should wait before its next update check
+func (s *Service) pollDelay(deviceID string) time.Duration {
+	interval, jitter := s.pollInterval, s.pollJitter
+	if interval <= 0 {
+		interval, jitter = DefaultPollInterval, DefaultPollJitter
+	}
+
+	// Retry-After is in whole seconds, so a window shorter than one adds nothing
+	if jitter < time.Second {
+		return interval
+	}
+	window := uint64(jitter / time.Second)
+
+	// Hashing the device ID keeps each device's offset stable from poll to poll
+	h := fnv.New32a()
+	h.Write([]byte(deviceID))
+	return interval + time.Duration(uint64(h.Sum32())%window)*time.Second
+}
+
+// retryAfterValue formats a delay as a Retry-After header value in whole seconds
+func retryAfterValue(delay time.Duration) string {
+	seconds := int64(delay / time.Second)
+	if seconds < 1 {
+		seconds = 1
+	}
+	return strconv.FormatInt(seconds, 10)
+}
+
+// updateETag identifies the update state a device's check is answered from. It changes when
+// a new deployment targets the device, when the device's update changes status, or when the
+// device asks for a different delta base, compression or sector size. Signed download URLs
+// differ on every response, so the tag is weak. A nil update stands for "nothing pending".
+func updateETag(update *DeviceUpdate, opts UpdateCheckOptions) string {
+	h := sha256.New()
+	if update != nil {
+		h.Write([]byte(update.ReleaseID))
+		h.Write([]byte{0})
+		h.Write([]byte(update.DeploymentID))
+		h.Write([]byte{0})
+		h.Write([]byte(update.Status))
+		h.Write([]byte{0})
+		h.Write([]byte(update.StartedAt.UTC().Format(time.RFC3339Nano)))
+	}
+	h.Write([]byte{0})
+	h.Write([]byte(opts.CurrentReleaseID))
+	h.Write([]byte{0})
+	h.Write([]byte(opts.Compression))
+	h.Write([]byte{0})
+	h.Write([]byte(strconv.Itoa(opts.SectorSize)))
+
+	return `W/"` + hex.EncodeToString(h.Sum(nil)[:12]) + `"`
+}
+
+// etagMatches reports whether an If-None-Match header matches etag, using the weak
+// comparison RFC 9110 requires for If-None-Match
+func etagMatches(ifNoneMatch, etag string) bool {
+	if ifNoneMatch == "" {
+		return false
+	}
+
+	want := strings.TrimPrefix(etag, "W/")
+	for _, candidate := range strings.Split(ifNoneMatch, ",") {
+		candidate = strings.TrimSpace(candidate)
+		if candidate == "*" || strings.TrimPrefix(candidate, "W/") == want {
+			return true
+		}
+	}
+
+	return false
+}
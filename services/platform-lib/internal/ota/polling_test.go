@@ -0,0 +1,139 @@
+package ota
+
+import (
+	"errors"
+	"net/http"
+	"net/http/httptest"
+	"strconv"
+	"testing"
+	"time"
+
+	"github.com/gin-gonic/gin"
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/mock"
+	"github.com/stretchr/testify/require"
+)
+
+func TestService_GetUpdateForDeviceHandler_NotModified(t *testing.T) {
+	service, mockRepo, _, _ := setupTestService()
+	service.SetPollInterval(30*time.Minute, 0)
+
+	router := gin.New()
+	RegisterRoutes(router, service)
+
+	mockRepo.On("GetLatestUpdateForDevice", mock.Anything, "device-001").Return(nil, errors.New("not found"))
+
+	req, _ := http.NewRequest("GET", "/api/v1/ota/updates/device-001", nil)
+	w := httptest.NewRecorder()
+	router.ServeHTTP(w, req)
+
+	assert.Equal(t, http.StatusNotFound, w.Code)
+	assert.Equal(t, "1800", w.Header().Get("Retry-After"))
+	etag := w.Header().Get("ETag")
+	require.NotEmpty(t, etag)
+
+	// The same state answers with an empty 304
+	req, _ = http.NewRequest("GET", "/api/v1/ota/updates/device-001", nil)
+	req.Header.Set("If-None-Match", etag)
+	w = httptest.NewRecorder()
+	router.ServeHTTP(w, req)
+
+	assert.Equal(t, http.StatusNotModified, w.Code)
+	assert.Empty(t, w.Body.Bytes())
+	assert.Equal(t, etag, w.Header().Get("ETag"))
+	assert.Equal(t, "1800", w.Header().Get("Retry-After"))
+}
+
+func TestService_GetUpdateForDeviceHandler_ETagChangesWithDeployment(t *testing.T) {
+	service, mockRepo, _, mockStorage := setupTestService()
+
+	router := gin.New()
+	RegisterRoutes(router, service)
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusPending,
+		StartedAt:    time.Now(),
+	}
+	release := createTestRelease("release-001")
+
+	mockRepo.On("GetLatestUpdateForDevice", mock.Anything, "device-001").Return(deviceUpdate, nil)
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
+	mockStorage.On("GetBinaryURL", mock.Anything, release.BinaryPath, mock.AnythingOfType("time.Duration")).Return("https://storage.example.com/firmware.bin", nil)
+
+	// A tag from when nothing was pending no longer matches
+	staleETag := updateETag(nil, UpdateCheckOptions{})
+
+	req, _ := http.NewRequest("GET", "/api/v1/ota/updates/device-001", nil)
+	req.Header.Set("If-None-Match", staleETag)
+	w := httptest.NewRecorder()
+	router.ServeHTTP(w, req)
+
+	assert.Equal(t, http.StatusOK, w.Code)
+	assert.NotEqual(t, staleETag, w.Header().Get("ETag"))
+	assert.Empty(t, w.Header().Get("Retry-After"))
+}
+
+func TestUpdateETag(t *testing.T) {
+	update := &DeviceUpdate{
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusPending,
+		StartedAt:    time.Unix(1700000000, 0),
+	}
+
+	etag := updateETag(update, UpdateCheckOptions{})
+	assert.Equal(t, etag, updateETag(update, UpdateCheckOptions{}))
+	assert.NotEqual(t, etag, updateETag(nil, UpdateCheckOptions{}))
+	assert.NotEqual(t, etag, updateETag(update, UpdateCheckOptions{CurrentReleaseID: "release-000"}))
+	assert.NotEqual(t, etag, updateETag(update, UpdateCheckOptions{Compression: CompressionZlib}))
+
+	downloading := *update
+	downloading.Status = UpdateStatusDownloading
+	assert.NotEqual(t, etag, updateETag(&downloading, UpdateCheckOptions{}))
+}
+
+func TestETagMatches(t *testing.T) {
+	etag := `W/"abc"`
+
+	assert.True(t, etagMatches(`W/"abc"`, etag))
+	assert.True(t, etagMatches(`"abc"`, etag))
+	assert.True(t, etagMatches(`"xyz", W/"abc"`, etag))
+	assert.True(t, etagMatches("*", etag))
+	assert.False(t, etagMatches("", etag))
+	assert.False(t, etagMatches(`W/"xyz"`, etag))
+}
+
+func TestService_PollDelay(t *testing.T) {
+	service, _, _, _ := setupTestService()
+
+	// Unconfigured services fall back to the defaults
+	delay := service.pollDelay("device-001")
+	assert.GreaterOrEqual(t, delay, DefaultPollInterval)
+	assert.Less(t, delay, DefaultPollInterval+DefaultPollJitter)
+	assert.Equal(t, delay, service.pollDelay("device-001"))
+
+	// Devices are spread across the jitter window
+	service.SetPollInterval(time.Hour, time.Hour)
+	offsets := make(map[time.Duration]bool)
+	for i := 0; i < 20; i++ {
+		delay := service.pollDelay("device-" + strconv.Itoa(i))
+		assert.GreaterOrEqual(t, delay, time.Hour)
+		assert.Less(t, delay, 2*time.Hour)
+		offsets[delay] = true
+	}
+	assert.Greater(t, len(offsets), 10)
+
+	// A window under a second has no whole-second offsets to spread over
+	service.SetPollInterval(time.Hour, 500*time.Millisecond)
+	assert.Equal(t, time.Hour, service.pollDelay("device-001"))
+	service.SetPollInterval(time.Hour, 1500*time.Millisecond)
+	assert.Equal(t, time.Hour, service.pollDelay("device-001"))
+	service.SetPollInterval(time.Hour, -time.Minute)
+	assert.Equal(t, time.Hour, service.pollDelay("device-001"))
+
+	assert.Equal(t, "1", retryAfterValue(0))
+	assert.Equal(t, "90", retryAfterValue(90*time.Second))
+}
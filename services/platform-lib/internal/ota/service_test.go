@@ -377,6 +377,74 @@ func TestService_ReportUpdateStatusHandler(t *testing.T) {
 	mockRepo.AssertExpectations(t)
 }
 
+func TestService_ReportUpdateStatusBatchHandler(t *testing.T) {
+	service, mockRepo, _, _ := setupTestService()
+
+	router := gin.New()
+	RegisterRoutes(router, service)
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-002",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusPending,
+		StartedAt:    time.Now(),
+	}
+
+	deployment := &OTADeployment{
+		DeploymentID:     "deployment-001",
+		ReleaseID:        "release-002",
+		Status:           DeploymentStatusActive,
+		FailureThreshold: 10,
+	}
+
+	mockRepo.On("GetDeviceUpdate", mock.Anything, "device-001", "release-001").Return(nil, assert.AnError)
+	mockRepo.On("GetDeviceUpdate", mock.Anything, "device-001", "release-002").Return(deviceUpdate, nil)
+	mockRepo.On("UpdateDeviceUpdate", mock.Anything, mock.AnythingOfType("*ota.DeviceUpdate")).Return(nil)
+	mockRepo.On("GetDeployment", mock.Anything, "deployment-001").Return(deployment, nil)
+	mockRepo.On("GetDeploymentStats", mock.Anything, "deployment-001").Return(1, 0, 0, nil)
+	mockRepo.On("UpdateDeployment", mock.Anything, mock.AnythingOfType("*ota.OTADeployment")).Return(nil)
+
+	batch := BatchStatusReport{
+		Reports: []UpdateStatusReport{
+			{DeviceID: "device-001", ReleaseID: "release-001", Status: UpdateStatusFailed, ErrorMessage: "Hash verification failed"},
+			{DeviceID: "device-001", ReleaseID: "release-002", Status: UpdateStatusCompleted, Progress: 100},
+			{DeviceID: "device-001", Status: UpdateStatusCompleted},
+		},
+	}
+
+	reqBody, _ := json.Marshal(batch)
+	req, _ := http.NewRequest("POST", "/api/v1/ota/updates/status/batch", bytes.NewBuffer(reqBody))
+	req.Header.Set("Content-Type", "application/json")
+
+	w := httptest.NewRecorder()
+	router.ServeHTTP(w, req)
+
+	assert.Equal(t, http.StatusOK, w.Code)
+
+	var result BatchStatusResult
+	require.NoError(t, json.Unmarshal(w.Body.Bytes(), &result))
+	assert.Equal(t, 1, result.Accepted)
+	require.Len(t, result.Failed, 2)
+	assert.Equal(t, 0, result.Failed[0].Index)
+	assert.Equal(t, "release-001", result.Failed[0].ReleaseID)
+	assert.Equal(t, 2, result.Failed[1].Index)
+	assert.Equal(t, UpdateStatusCompleted, deviceUpdate.Status)
+
+	// Empty and oversized batches are rejected outright
+	for _, count := range []int{0, MaxBatchStatusReports + 1} {
+		batch := BatchStatusReport{Reports: make([]UpdateStatusReport, count)}
+		reqBody, _ := json.Marshal(batch)
+		req, _ := http.NewRequest("POST", "/api/v1/ota/updates/status/batch", bytes.NewBuffer(reqBody))
+		req.Header.Set("Content-Type", "application/json")
+
+		w := httptest.NewRecorder()
+		router.ServeHTTP(w, req)
+
+		assert.Equal(t, http.StatusBadRequest, w.Code)
+	}
+}
+
 // Helper functions
 
 func createTestRelease(releaseID string) *FirmwareRelease {
@@ -680,7 +748,7 @@ func TestService_GetUpdateForDevice_Authentication(t *testing.T) {
 	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
 	mockStorage.On("GetBinaryURL", mock.Anything, release.BinaryPath, mock.AnythingOfType("time.Duration")).Return("https://storage.example.com/firmware.bin", nil)
 
-	update, err := service.GetUpdateForDevice(context.Background(), "device-001")
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{})
 
 	require.NoError(t, err)
 	require.NotNil(t, update)
@@ -708,7 +776,7 @@ func TestService_GetUpdateForDevice_NoPendingUpdate(t *testing.T) {
 
 	mockRepo.On("GetLatestUpdateForDevice", mock.Anything, "device-001").Return(deviceUpdate, nil)
 
-	update, err := service.GetUpdateForDevice(context.Background(), "device-001")
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{})
 
 	assert.Error(t, err)
 	assert.Nil(t, update)
@@ -717,6 +785,35 @@ func TestService_GetUpdateForDevice_NoPendingUpdate(t *testing.T) {
 	mockRepo.AssertExpectations(t)
 }
 
+// Test that an interrupted download is offered again so the device can resume it
+func TestService_GetUpdateForDevice_ResumeDownloading(t *testing.T) {
+	service, mockRepo, _, mockStorage := setupTestService()
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusDownloading,
+		Progress:     40,
+		StartedAt:    time.Now(),
+	}
+
+	release := createTestRelease("release-001")
+
+	mockRepo.On("GetLatestUpdateForDevice", mock.Anything, "device-001").Return(deviceUpdate, nil)
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
+	mockStorage.On("GetBinaryURL", mock.Anything, release.BinaryPath, mock.AnythingOfType("time.Duration")).Return("https://storage.example.com/firmware.bin", nil)
+
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{})
+
+	require.NoError(t, err)
+	require.NotNil(t, update)
+	assert.Equal(t, release.ReleaseID, update.ReleaseID)
+
+	mockRepo.AssertExpectations(t)
+	mockStorage.AssertExpectations(t)
+}
+
 // Test update status reporting with progress tracking
 func TestService_ReportUpdateStatus_ProgressTracking(t *testing.T) {
 	service, mockRepo, _, _ := setupTestService()
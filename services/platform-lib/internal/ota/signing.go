@@ -2,6 +2,8 @@ package ota
 
 import (
 	"crypto"
+	"crypto/ecdsa"
+	"crypto/elliptic"
 	"crypto/rand"
 	"crypto/rsa"
 	"crypto/sha256"
@@ -11,13 +13,27 @@ import (
 	"fmt"
 )
 
+// SigningAlgorithm identifies how firmware binaries are signed
+type SigningAlgorithm string
+
+const (
+	// SigningAlgorithmRSAPSS signs the SHA-256 hash with RSA-PSS
+	SigningAlgorithmRSAPSS SigningAlgorithm = "rsa-pss-sha256"
+	// SigningAlgorithmECDSAP256 signs the SHA-256 hash with ECDSA on P-256, ASN.1 DER encoded.
+	// Keys and signatures are much smaller than RSA ones.
+	SigningAlgorithmECDSAP256 SigningAlgorithm = "ecdsa-p256-sha256"
+)
+
 // Signer handles firmware binary signing and verification
 type Signer struct {
-	privateKey *rsa.PrivateKey
-	publicKey  *rsa.PublicKey
+	privateKey crypto.Signer
+	publicKey  crypto.PublicKey
+	algorithm  SigningAlgorithm
 }
 
-// NewSigner creates a new Signer with the provided RSA keys
+// NewSigner creates a new Signer with the provided keys. The algorithm follows from the
+// key type: RSA keys sign with RSA-PSS, P-256 keys with ECDSA. Devices pick the same
+// algorithm from the public key they were given.
 func NewSigner(privateKeyPEM, publicKeyPEM []byte) (*Signer, error) {
 	// Parse private key
 	privateKey, err := parsePrivateKey(privateKeyPEM)
@@ -31,12 +47,26 @@ func NewSigner(privateKeyPEM, publicKeyPEM []byte) (*Signer, error) {
 		return nil, fmt.Errorf("failed to parse public key: %w", err)
 	}
 
+	algorithm, err := keyAlgorithm(publicKey)
+	if err != nil {
+		return nil, err
+	}
+	if privateAlgorithm, err := keyAlgorithm(privateKey.Public()); err != nil || privateAlgorithm != algorithm {
+		return nil, fmt.Errorf("private and public keys use different algorithms")
+	}
+
 	return &Signer{
 		privateKey: privateKey,
 		publicKey:  publicKey,
+		algorithm:  algorithm,
 	}, nil
 }
 
+// Algorithm returns the algorithm the signer signs with
+func (s *Signer) Algorithm() SigningAlgorithm {
+	return s.algorithm
+}
+
 // SignBinary signs the firmware binary and returns the signature
 func (s *Signer) SignBinary(binaryData []byte) (string, error) {
 	if s.privateKey == nil {
@@ -46,8 +76,12 @@ func (s *Signer) SignBinary(binaryData []byte) (string, error) {
 	// Compute SHA-256 hash of the binary
 	hash := sha256.Sum256(binaryData)
 
-	// Sign the hash using RSA-PSS
-	signature, err := rsa.SignPSS(rand.Reader, s.privateKey, crypto.SHA256, hash[:], nil)
+	// RSA keys sign with RSA-PSS; ECDSA keys produce an ASN.1 DER signature
+	var opts crypto.SignerOpts = crypto.SHA256
+	if _, ok := s.privateKey.(*rsa.PrivateKey); ok {
+		opts = &rsa.PSSOptions{SaltLength: rsa.PSSSaltLengthAuto, Hash: crypto.SHA256}
+	}
+	signature, err := s.privateKey.Sign(rand.Reader, hash[:], opts)
 	if err != nil {
 		return "", fmt.Errorf("failed to sign binary: %w", err)
 	}
@@ -71,10 +105,17 @@ func (s *Signer) VerifySignature(binaryData []byte, signatureBase64 string) erro
 	// Compute SHA-256 hash of the binary
 	hash := sha256.Sum256(binaryData)
 
-	// Verify the signature using RSA-PSS
-	err = rsa.VerifyPSS(s.publicKey, crypto.SHA256, hash[:], signature, nil)
-	if err != nil {
-		return fmt.Errorf("signature verification failed: %w", err)
+	switch key := s.publicKey.(type) {
+	case *rsa.PublicKey:
+		if err := rsa.VerifyPSS(key, crypto.SHA256, hash[:], signature, nil); err != nil {
+			return fmt.Errorf("signature verification failed: %w", err)
+		}
+	case *ecdsa.PublicKey:
+		if !ecdsa.VerifyASN1(key, hash[:], signature) {
+			return fmt.Errorf("signature verification failed: invalid ECDSA signature")
+		}
+	default:
+		return fmt.Errorf("unsupported public key type %T", s.publicKey)
 	}
 
 	return nil
@@ -115,34 +156,81 @@ func GenerateKeyPair(bits int) (privateKeyPEM, publicKeyPEM []byte, err error) {
 	return privateKeyPEM, publicKeyPEM, nil
 }
 
-// parsePrivateKey parses a PEM-encoded RSA private key
-func parsePrivateKey(privateKeyPEM []byte) (*rsa.PrivateKey, error) {
-	block, _ := pem.Decode(privateKeyPEM)
-	if block == nil {
-		return nil, fmt.Errorf("failed to decode PEM block")
+// GenerateECDSAKeyPair generates a new P-256 key pair for signing with SigningAlgorithmECDSAP256
+func GenerateECDSAKeyPair() (privateKeyPEM, publicKeyPEM []byte, err error) {
+	privateKey, err := ecdsa.GenerateKey(elliptic.P256(), rand.Reader)
+	if err != nil {
+		return nil, nil, fmt.Errorf("failed to generate private key: %w", err)
 	}
 
-	privateKey, err := x509.ParsePKCS1PrivateKey(block.Bytes)
+	privateKeyBytes, err := x509.MarshalECPrivateKey(privateKey)
 	if err != nil {
-		// Try PKCS8 format
-		key, err := x509.ParsePKCS8PrivateKey(block.Bytes)
-		if err != nil {
-			return nil, fmt.Errorf("failed to parse private key: %w", err)
-		}
+		return nil, nil, fmt.Errorf("failed to marshal private key: %w", err)
+	}
+	privateKeyPEM = pem.EncodeToMemory(&pem.Block{
+		Type:  "EC PRIVATE KEY",
+		Bytes: privateKeyBytes,
+	})
 
-		rsaKey, ok := key.(*rsa.PrivateKey)
-		if !ok {
-			return nil, fmt.Errorf("key is not an RSA private key")
+	publicKeyBytes, err := x509.MarshalPKIXPublicKey(&privateKey.PublicKey)
+	if err != nil {
+		return nil, nil, fmt.Errorf("failed to marshal public key: %w", err)
+	}
+	publicKeyPEM = pem.EncodeToMemory(&pem.Block{
+		Type:  "PUBLIC KEY",
+		Bytes: publicKeyBytes,
+	})
+
+	return privateKeyPEM, publicKeyPEM, nil
+}
+
+// keyAlgorithm returns the signing algorithm for a public key
+func keyAlgorithm(publicKey crypto.PublicKey) (SigningAlgorithm, error) {
+	switch key := publicKey.(type) {
+	case *rsa.PublicKey:
+		return SigningAlgorithmRSAPSS, nil
+	case *ecdsa.PublicKey:
+		if key.Curve != elliptic.P256() {
+			return "", fmt.Errorf("ECDSA keys must use the P-256 curve")
 		}
+		return SigningAlgorithmECDSAP256, nil
+	default:
+		return "", fmt.Errorf("key is not an RSA or ECDSA key")
+	}
+}
 
-		return rsaKey, nil
+// parsePrivateKey parses a PEM-encoded RSA or ECDSA private key
+func parsePrivateKey(privateKeyPEM []byte) (crypto.Signer, error) {
+	block, _ := pem.Decode(privateKeyPEM)
+	if block == nil {
+		return nil, fmt.Errorf("failed to decode PEM block")
+	}
+
+	if privateKey, err := x509.ParsePKCS1PrivateKey(block.Bytes); err == nil {
+		return privateKey, nil
+	}
+	if privateKey, err := x509.ParseECPrivateKey(block.Bytes); err == nil {
+		return privateKey, nil
 	}
 
-	return privateKey, nil
+	// Try PKCS8 format
+	key, err := x509.ParsePKCS8PrivateKey(block.Bytes)
+	if err != nil {
+		return nil, fmt.Errorf("failed to parse private key: %w", err)
+	}
+
+	switch privateKey := key.(type) {
+	case *rsa.PrivateKey:
+		return privateKey, nil
+	case *ecdsa.PrivateKey:
+		return privateKey, nil
+	default:
+		return nil, fmt.Errorf("key is not an RSA or ECDSA private key")
+	}
 }
 
-// parsePublicKey parses a PEM-encoded RSA public key
-func parsePublicKey(publicKeyPEM []byte) (*rsa.PublicKey, error) {
+// parsePublicKey parses a PEM-encoded RSA or ECDSA public key
+func parsePublicKey(publicKeyPEM []byte) (crypto.PublicKey, error) {
 	block, _ := pem.Decode(publicKeyPEM)
 	if block == nil {
 		return nil, fmt.Errorf("failed to decode PEM block")
@@ -153,10 +241,10 @@ func parsePublicKey(publicKeyPEM []byte) (*rsa.PublicKey, error) {
 		return nil, fmt.Errorf("failed to parse public key: %w", err)
 	}
 
-	rsaKey, ok := publicKey.(*rsa.PublicKey)
-	if !ok {
-		return nil, fmt.Errorf("key is not an RSA public key")
+	switch publicKey.(type) {
+	case *rsa.PublicKey, *ecdsa.PublicKey:
+		return publicKey, nil
+	default:
+		return nil, fmt.Errorf("key is not an RSA or ECDSA public key")
 	}
-
-	return rsaKey, nil
 }
@@ -0,0 +1,132 @@
+package ota
+
+import (
+	"context"
+	"net/http"
+	"net/http/httptest"
+	"testing"
+
+	"github.com/gin-gonic/gin"
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/mock"
+	"github.com/stretchr/testify/require"
+)
+
+func TestLocalStorageBackend_GetBinaryURL_WithBaseURL(t *testing.T) {
+	backend, err := NewLocalStorageBackendWithBaseURL(t.TempDir(), "https://ota.example.com/")
+	require.NoError(t, err)
+
+	path, err := backend.StoreBinary(context.Background(), "release-001", []byte("firmware"))
+	require.NoError(t, err)
+
+	url, err := backend.GetBinaryURL(context.Background(), path, 0)
+	require.NoError(t, err)
+	assert.Equal(t, "https://ota.example.com/api/v1/ota/binaries/release-001/firmware.bin", url)
+}
+
+func TestLocalStorageBackend_OpenBinary_StaysInBasePath(t *testing.T) {
+	backend, err := NewLocalStorageBackend(t.TempDir())
+	require.NoError(t, err)
+
+	_, _, err = backend.OpenBinary(context.Background(), "../../../etc/passwd")
+	assert.Error(t, err)
+}
+
+// Test resuming a download with a Range request
+func TestService_DownloadBinaryHandler_Range(t *testing.T) {
+	service, _, _, _ := setupTestService()
+
+	backend, err := NewLocalStorageBackendWithBaseURL(t.TempDir(), "http://localhost:8006")
+	require.NoError(t, err)
+	service.storageBackend = backend
+
+	binaryData := []byte("0123456789abcdefghijklmnopqrstuvwxyz")
+	path, err := backend.StoreBinary(context.Background(), "release-001", binaryData)
+	require.NoError(t, err)
+
+	router := gin.New()
+	RegisterRoutes(router, service)
+
+	// Full download
+	req, _ := http.NewRequest("GET", BinaryRoutePrefix+path, nil)
+	w := httptest.NewRecorder()
+	router.ServeHTTP(w, req)
+
+	assert.Equal(t, http.StatusOK, w.Code)
+	assert.Equal(t, binaryData, w.Body.Bytes())
+	assert.Equal(t, "bytes", w.Header().Get("Accept-Ranges"))
+
+	// Resume from byte 10
+	req, _ = http.NewRequest("GET", BinaryRoutePrefix+path, nil)
+	req.Header.Set("Range", "bytes=10-")
+	w = httptest.NewRecorder()
+	router.ServeHTTP(w, req)
+
+	assert.Equal(t, http.StatusPartialContent, w.Code)
+	assert.Equal(t, binaryData[10:], w.Body.Bytes())
+	assert.Equal(t, "bytes 10-35/36", w.Header().Get("Content-Range"))
+
+	// Offset past the end of the image
+	req, _ = http.NewRequest("GET", BinaryRoutePrefix+path, nil)
+	req.Header.Set("Range", "bytes=100-")
+	w = httptest.NewRecorder()
+	router.ServeHTTP(w, req)
+
+	assert.Equal(t, http.StatusRequestedRangeNotSatisfiable, w.Code)
+}
+
+// Test range requests against a backend that can only return whole binaries
+func TestService_DownloadBinaryHandler_RangeFallback(t *testing.T) {
+	service, _, _, mockStorage := setupTestService()
+
+	binaryData := []byte("0123456789abcdefghijklmnopqrstuvwxyz")
+	mockStorage.On("GetBinary", mock.Anything, "release-001/firmware.bin").Return(binaryData, nil)
+
+	router := gin.New()
+	RegisterRoutes(router, service)
+
+	req, _ := http.NewRequest("GET", BinaryRoutePrefix+"release-001/firmware.bin", nil)
+	req.Header.Set("Range", "bytes=30-")
+	w := httptest.NewRecorder()
+	router.ServeHTTP(w, req)
+
+	assert.Equal(t, http.StatusPartialContent, w.Code)
+	assert.Equal(t, binaryData[30:], w.Body.Bytes())
+
+	mockStorage.AssertExpectations(t)
+}
+
+func TestService_DownloadBinaryHandler_NotFound(t *testing.T) {
+	service, _, _, _ := setupTestService()
+
+	backend, err := NewLocalStorageBackend(t.TempDir())
+	require.NoError(t, err)
+	service.storageBackend = backend
+
+	router := gin.New()
+	RegisterRoutes(router, service)
+
+	req, _ := http.NewRequest("GET", BinaryRoutePrefix+"missing/firmware.bin", nil)
+	w := httptest.NewRecorder()
+	router.ServeHTTP(w, req)
+
+	assert.Equal(t, http.StatusNotFound, w.Code)
+}
+
+// Test that paths climbing out of the storage root are rejected before any backend sees them
+func TestService_DownloadBinaryHandler_RejectsTraversal(t *testing.T) {
+	service, _, _, mockStorage := setupTestService()
+
+	router := gin.New()
+	RegisterRoutes(router, service)
+
+	for _, binaryPath := range []string{"../secrets.env", "release-001/../../secrets.env", "release-001/%2e%2e/%2e%2e/secrets.env"} {
+		req, _ := http.NewRequest("GET", BinaryRoutePrefix+binaryPath, nil)
+		w := httptest.NewRecorder()
+		router.ServeHTTP(w, req)
+
+		assert.Equal(t, http.StatusBadRequest, w.Code, binaryPath)
+	}
+
+	mockStorage.AssertNotCalled(t, "GetBinary", mock.Anything, mock.Anything)
+}
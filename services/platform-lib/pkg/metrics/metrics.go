@@ -36,6 +36,13 @@ type Metrics struct {
 	templatesDeployed prometheus.Gauge
 	otaUpdatesTotal   *prometheus.CounterVec
 
+	// OTA update statistics reported by devices
+	otaUpdatePhaseDuration *prometheus.HistogramVec
+	otaUpdateThroughput    *prometheus.HistogramVec
+	otaUpdateBytes         *prometheus.HistogramVec
+	otaUpdateRetries       *prometheus.HistogramVec
+	otaUpdateMinFreeHeap   *prometheus.HistogramVec
+
 	logger logger.Logger
 }
 
@@ -223,6 +230,67 @@ func NewMetrics(serviceName string, logger logger.Logger) *Metrics {
 		[]string{"status", "device_type"},
 	)
 
+	// Initialize OTA update statistics
+	m.otaUpdatePhaseDuration = prometheus.NewHistogramVec(
+		prometheus.HistogramOpts{
+			Name: "ota_update_phase_duration_seconds",
+			Help: "Time devices spent in each phase of an OTA update",
+			ConstLabels: prometheus.Labels{
+				"service": serviceName,
+			},
+			Buckets: prometheus.ExponentialBuckets(0.01, 2, 16),
+		},
+		[]string{"phase", "status"},
+	)
+
+	m.otaUpdateThroughput = prometheus.NewHistogramVec(
+		prometheus.HistogramOpts{
+			Name: "ota_update_throughput_bytes_per_second",
+			Help: "Average download rate of OTA updates on the device",
+			ConstLabels: prometheus.Labels{
+				"service": serviceName,
+			},
+			Buckets: prometheus.ExponentialBuckets(1024, 2, 12),
+		},
+		[]string{"status"},
+	)
+
+	m.otaUpdateBytes = prometheus.NewHistogramVec(
+		prometheus.HistogramOpts{
+			Name: "ota_update_download_bytes",
+			Help: "Bytes downloaded by devices per OTA update",
+			ConstLabels: prometheus.Labels{
+				"service": serviceName,
+			},
+			Buckets: prometheus.ExponentialBuckets(16*1024, 2, 10),
+		},
+		[]string{"status"},
+	)
+
+	m.otaUpdateRetries = prometheus.NewHistogramVec(
+		prometheus.HistogramOpts{
+			Name: "ota_update_download_retries",
+			Help: "Download reconnects per OTA update",
+			ConstLabels: prometheus.Labels{
+				"service": serviceName,
+			},
+			Buckets: []float64{0, 1, 2, 3, 5, 10},
+		},
+		[]string{"status"},
+	)
+
+	m.otaUpdateMinFreeHeap = prometheus.NewHistogramVec(
+		prometheus.HistogramOpts{
+			Name: "ota_update_min_free_heap_bytes",
+			Help: "Lowest free heap devices saw during an OTA update",
+			ConstLabels: prometheus.Labels{
+				"service": serviceName,
+			},
+			Buckets: prometheus.ExponentialBuckets(8*1024, 2, 8),
+		},
+		[]string{"status"},
+	)
+
 	// Register all metrics
 	m.registry.MustRegister(
 		m.httpRequestsTotal,
@@ -241,6 +309,11 @@ func NewMetrics(serviceName string, logger logger.Logger) *Metrics {
 		m.devicesOnline,
 		m.templatesDeployed,
 		m.otaUpdatesTotal,
+		m.otaUpdatePhaseDuration,
+		m.otaUpdateThroughput,
+		m.otaUpdateBytes,
+		m.otaUpdateRetries,
+		m.otaUpdateMinFreeHeap,
 	)
 
 	logger.Info("Metrics initialized", "service", serviceName)
@@ -351,6 +424,24 @@ func (m *Metrics) RecordOTAUpdate(status, deviceType string) {
 	m.otaUpdatesTotal.WithLabelValues(status, deviceType).Inc()
 }
 
+// RecordOTAUpdatePhase records how long one phase of a device's OTA update took
+func (m *Metrics) RecordOTAUpdatePhase(phase, status string, duration time.Duration) {
+	m.otaUpdatePhaseDuration.WithLabelValues(phase, status).Observe(duration.Seconds())
+}
+
+// RecordOTAUpdateTransfer records the download figures a device reported for an OTA update
+func (m *Metrics) RecordOTAUpdateTransfer(status string, bytes, throughputBps int64, retries int, minFreeHeap int64) {
+	m.otaUpdateBytes.WithLabelValues(status).Observe(float64(bytes))
+	m.otaUpdateRetries.WithLabelValues(status).Observe(float64(retries))
+	if throughputBps > 0 {
+		m.otaUpdateThroughput.WithLabelValues(status).Observe(float64(throughputBps))
+	}
+	// Devices that can't measure their heap report zero
+	if minFreeHeap > 0 {
+		m.otaUpdateMinFreeHeap.WithLabelValues(status).Observe(float64(minFreeHeap))
+	}
+}
+
 // SetDBConnections sets the number of active database connections
 func (m *Metrics) SetDBConnections(count float64) {
 	m.dbConnections.Set(count)
@@ -0,0 +1,189 @@
+package ota
+
+import (
+	"context"
+	"fmt"
+	"time"
+)
+
+const (
+	// deltaMaxSizePercent is the largest delta, relative to the full image, worth offering
+	deltaMaxSizePercent = 80
+
+	// compressedMaxSizePercent is the largest compressed image, relative to the raw image,
+	// worth the device's decompression cost
+	compressedMaxSizePercent = 90
+
+	compressedArtifactName = "firmware.bin.zlib"
+)
+
+// UpdateCheckOptions describes what a device reports when it polls for an update
+type UpdateCheckOptions struct {
+	// CurrentReleaseID is the release the device is running; enables delta patches
+	CurrentReleaseID string
+	// Compression is the payload encoding the device can decode (CompressionZlib or empty)
+	Compression string
+	// SectorSize is the flash sector size of a device that can skip unchanged sectors (0 if it can't)
+	SectorSize int
+}
+
+// prepareCompressedUpdate returns the URL and size of the compressed release image, creating
+// and caching it on first use. An empty URL means compression isn't worthwhile or supported.
+func (s *Service) prepareCompressedUpdate(ctx context.Context, release *FirmwareRelease) (string, int64, error) {
+	artifactBackend, ok := s.storageBackend.(ArtifactStorageBackend)
+	if !ok {
+		return "", 0, nil
+	}
+
+	path, data, err := s.getOrCreateArtifact(ctx, artifactBackend, release.ReleaseID, compressedArtifactName, func() ([]byte, error) {
+		raw, err := s.storageBackend.GetBinary(ctx, release.BinaryPath)
+		if err != nil {
+			return nil, fmt.Errorf("failed to get binary: %w", err)
+		}
+		return CompressZlib(raw)
+	})
+	if err != nil {
+		return "", 0, err
+	}
+
+	if int64(len(data))*100 > release.BinarySize*compressedMaxSizePercent {
+		return "", 0, nil
+	}
+
+	url, err := s.storageBackend.GetBinaryURL(ctx, path, 1*time.Hour)
+	if err != nil {
+		return "", 0, fmt.Errorf("failed to generate compressed URL: %w", err)
+	}
+
+	return url, int64(len(data)), nil
+}
+
+// prepareSectorManifest returns the URL and size of the release's signed sector manifest at the
+// given sector size, creating and caching it on first use. An empty URL means it isn't supported.
+func (s *Service) prepareSectorManifest(ctx context.Context, release *FirmwareRelease, sectorSize int) (string, int64, error) {
+	artifactBackend, ok := s.storageBackend.(ArtifactStorageBackend)
+	if !ok {
+		return "", 0, nil
+	}
+
+	// The format version is part of the name, so manifests cached in an older format aren't served
+	manifestName := fmt.Sprintf("sectors-%d.v%d.bin", sectorSize, sectorManifestVersion)
+	path, manifest, err := s.getOrCreateArtifact(ctx, artifactBackend, release.ReleaseID, manifestName, func() ([]byte, error) {
+		raw, err := s.storageBackend.GetBinary(ctx, release.BinaryPath)
+		if err != nil {
+			return nil, fmt.Errorf("failed to get binary: %w", err)
+		}
+		manifest, err := GenerateSectorManifest(raw, sectorSize)
+		if err != nil {
+			return nil, err
+		}
+		return SignSectorManifest(manifest, s.signer)
+	})
+	if err != nil {
+		return "", 0, err
+	}
+
+	manifestURL, err := s.storageBackend.GetBinaryURL(ctx, path, 1*time.Hour)
+	if err != nil {
+		return "", 0, fmt.Errorf("failed to generate sector manifest URL: %w", err)
+	}
+
+	return manifestURL, int64(len(manifest)), nil
+}
+
+// prepareDeltaUpdate returns the URL and size of a delta patch from the base release to the
+// target release, generating and caching it on first use. An empty URL means no delta applies.
+func (s *Service) prepareDeltaUpdate(ctx context.Context, release *FirmwareRelease, baseReleaseID, compression string) (string, int64, error) {
+	artifactBackend, ok := s.storageBackend.(ArtifactStorageBackend)
+	if !ok {
+		return "", 0, nil
+	}
+
+	deltaName := fmt.Sprintf("delta-%s.bin", baseReleaseID)
+	if compression == CompressionZlib {
+		deltaName += ".zlib"
+	}
+
+	path, patch, err := s.getOrCreateArtifact(ctx, artifactBackend, release.ReleaseID, deltaName, func() ([]byte, error) {
+		patch, err := s.generateDelta(ctx, release, baseReleaseID)
+		if err != nil || compression != CompressionZlib {
+			return patch, err
+		}
+		return CompressZlib(patch)
+	})
+	if err != nil {
+		return "", 0, err
+	}
+
+	if int64(len(patch))*100 > release.BinarySize*deltaMaxSizePercent {
+		return "", 0, nil
+	}
+
+	deltaURL, err := s.storageBackend.GetBinaryURL(ctx, path, 1*time.Hour)
+	if err != nil {
+		return "", 0, fmt.Errorf("failed to generate delta URL: %w", err)
+	}
+
+	return deltaURL, int64(len(patch)), nil
+}
+
+// generateDelta builds the patch from the base release binary to the target release binary
+func (s *Service) generateDelta(ctx context.Context, release *FirmwareRelease, baseReleaseID string) ([]byte, error) {
+	baseRelease, err := s.repository.GetRelease(ctx, baseReleaseID)
+	if err != nil {
+		return nil, fmt.Errorf("failed to get base release: %w", err)
+	}
+
+	if baseRelease.TemplateID != release.TemplateID {
+		return nil, fmt.Errorf("base release %s belongs to a different template", baseReleaseID)
+	}
+
+	baseData, err := s.storageBackend.GetBinary(ctx, baseRelease.BinaryPath)
+	if err != nil {
+		return nil, fmt.Errorf("failed to get base binary: %w", err)
+	}
+
+	targetData, err := s.storageBackend.GetBinary(ctx, release.BinaryPath)
+	if err != nil {
+		return nil, fmt.Errorf("failed to get target binary: %w", err)
+	}
+
+	patch, err := GenerateDelta(baseData, targetData)
+	if err != nil {
+		return nil, fmt.Errorf("failed to generate delta: %w", err)
+	}
+
+	s.logger.Info("Generated delta patch", "release_id", release.ReleaseID, "base_release_id", baseReleaseID, "delta_size", len(patch), "binary_size", len(targetData))
+
+	return patch, nil
+}
+
+// getOrCreateArtifact returns a cached release artifact, building and storing it with build
+// if it doesn't exist yet
+func (s *Service) getOrCreateArtifact(ctx context.Context, artifactBackend ArtifactStorageBackend, releaseID, name string, build func() ([]byte, error)) (string, []byte, error) {
+	path, data, err := artifactBackend.GetArtifact(ctx, releaseID, name)
+	if err == nil {
+		return path, data, nil
+	}
+
+	s.artifactMu.Lock()
+	defer s.artifactMu.Unlock()
+
+	// Another request may have created it while we waited
+	path, data, err = artifactBackend.GetArtifact(ctx, releaseID, name)
+	if err == nil {
+		return path, data, nil
+	}
+
+	data, err = build()
+	if err != nil {
+		return "", nil, err
+	}
+
+	path, err = artifactBackend.StoreArtifact(ctx, releaseID, name, data)
+	if err != nil {
+		return "", nil, fmt.Errorf("failed to store artifact %s: %w", name, err)
+	}
+
+	return path, data, nil
+}
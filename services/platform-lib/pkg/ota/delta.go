@@ -0,0 +1,218 @@
+package ota
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+)
+
+// Delta patch format (all integers little-endian):
+//
+//	header: "ATDL" | version (1 byte) | reserved (3 bytes) | source size (uint32) | target size (uint32)
+//	ops:    0x01 COPY   | source offset (uint32) | length (uint32)
+//	        0x02 INSERT | length (uint32) | literal bytes
+//
+// Applying the ops in order reproduces the target image. The format is designed to be
+// applied while streaming: the device reads COPY ranges from its running partition and
+// writes the output straight to the OTA partition, so it never holds either image in RAM.
+const (
+	deltaMagic      = "ATDL"
+	deltaVersion    = 1
+	deltaHeaderSize = 16
+
+	deltaOpCopy   byte = 0x01
+	deltaOpInsert byte = 0x02
+
+	// Source blocks are indexed at this granularity; it is also the shortest match
+	// worth encoding as a COPY
+	deltaBlockSize = 32
+
+	// Limits work per target position when many source blocks share a hash
+	deltaMaxCandidates = 8
+
+	deltaHashBase uint32 = 257
+)
+
+// GenerateDelta produces a patch that transforms source into target
+func GenerateDelta(source, target []byte) ([]byte, error) {
+	if uint64(len(source)) > uint64(^uint32(0)) || uint64(len(target)) > uint64(^uint32(0)) {
+		return nil, fmt.Errorf("image too large for delta encoding")
+	}
+
+	var patch bytes.Buffer
+	patch.Grow(deltaHeaderSize + len(target)/4)
+
+	header := make([]byte, deltaHeaderSize)
+	copy(header, deltaMagic)
+	header[4] = deltaVersion
+	binary.LittleEndian.PutUint32(header[8:], uint32(len(source)))
+	binary.LittleEndian.PutUint32(header[12:], uint32(len(target)))
+	patch.Write(header)
+
+	// Index block-aligned windows of the source by rolling hash
+	index := make(map[uint32][]int, len(source)/deltaBlockSize+1)
+	for offset := 0; offset+deltaBlockSize <= len(source); offset += deltaBlockSize {
+		h := deltaHash(source[offset : offset+deltaBlockSize])
+		if len(index[h]) < deltaMaxCandidates {
+			index[h] = append(index[h], offset)
+		}
+	}
+
+	// base^(blockSize-1), used to roll the oldest byte out of the window
+	var pow uint32 = 1
+	for i := 1; i < deltaBlockSize; i++ {
+		pow *= deltaHashBase
+	}
+
+	literalStart := 0
+	pos := 0
+	var h uint32
+	if len(target) >= deltaBlockSize {
+		h = deltaHash(target[:deltaBlockSize])
+	}
+
+	for pos+deltaBlockSize <= len(target) {
+		matchOffset, matchLen := deltaLongestMatch(source, target, pos, index[h])
+
+		if matchLen >= deltaBlockSize {
+			// Grow the match backwards into bytes that would otherwise be inserted
+			for pos > literalStart && matchOffset > 0 && target[pos-1] == source[matchOffset-1] {
+				pos--
+				matchOffset--
+				matchLen++
+			}
+
+			writeDeltaInsert(&patch, target[literalStart:pos])
+			writeDeltaCopy(&patch, matchOffset, matchLen)
+
+			pos += matchLen
+			literalStart = pos
+			if pos+deltaBlockSize <= len(target) {
+				h = deltaHash(target[pos : pos+deltaBlockSize])
+			}
+			continue
+		}
+
+		// Slide the window one byte
+		if pos+deltaBlockSize < len(target) {
+			h = (h-uint32(target[pos])*pow)*deltaHashBase + uint32(target[pos+deltaBlockSize])
+		}
+		pos++
+	}
+
+	writeDeltaInsert(&patch, target[literalStart:])
+
+	return patch.Bytes(), nil
+}
+
+// ApplyDelta reconstructs the target image from source and a patch produced by GenerateDelta
+func ApplyDelta(source, patch []byte) ([]byte, error) {
+	if len(patch) < deltaHeaderSize || string(patch[:4]) != deltaMagic {
+		return nil, fmt.Errorf("invalid delta patch header")
+	}
+
+	if patch[4] != deltaVersion {
+		return nil, fmt.Errorf("unsupported delta patch version: %d", patch[4])
+	}
+
+	sourceSize := binary.LittleEndian.Uint32(patch[8:])
+	targetSize := binary.LittleEndian.Uint32(patch[12:])
+
+	if uint64(sourceSize) != uint64(len(source)) {
+		return nil, fmt.Errorf("delta patch expects a %d byte source, got %d", sourceSize, len(source))
+	}
+
+	target := make([]byte, 0, targetSize)
+	ops := patch[deltaHeaderSize:]
+
+	for len(ops) > 0 {
+		switch ops[0] {
+		case deltaOpCopy:
+			if len(ops) < 9 {
+				return nil, fmt.Errorf("truncated delta copy op")
+			}
+			offset := uint64(binary.LittleEndian.Uint32(ops[1:]))
+			length := uint64(binary.LittleEndian.Uint32(ops[5:]))
+			if offset+length > uint64(len(source)) {
+				return nil, fmt.Errorf("delta copy outside source image")
+			}
+			target = append(target, source[offset:offset+length]...)
+			ops = ops[9:]
+
+		case deltaOpInsert:
+			if len(ops) < 5 {
+				return nil, fmt.Errorf("truncated delta insert op")
+			}
+			length := uint64(binary.LittleEndian.Uint32(ops[1:]))
+			if uint64(len(ops)-5) < length {
+				return nil, fmt.Errorf("truncated delta insert data")
+			}
+			target = append(target, ops[5:5+length]...)
+			ops = ops[5+length:]
+
+		default:
+			return nil, fmt.Errorf("invalid delta op: 0x%02x", ops[0])
+		}
+
+		if uint64(len(target)) > uint64(targetSize) {
+			return nil, fmt.Errorf("delta patch output exceeds target size")
+		}
+	}
+
+	if uint64(len(target)) != uint64(targetSize) {
+		return nil, fmt.Errorf("delta patch produced %d bytes, expected %d", len(target), targetSize)
+	}
+
+	return target, nil
+}
+
+// deltaHash computes the polynomial hash of a block; it matches the rolling update in GenerateDelta
+func deltaHash(block []byte) uint32 {
+	var h uint32
+	for _, b := range block {
+		h = h*deltaHashBase + uint32(b)
+	}
+	return h
+}
+
+// deltaLongestMatch returns the longest forward match of target[pos:] among the candidate source offsets
+func deltaLongestMatch(source, target []byte, pos int, candidates []int) (int, int) {
+	bestOffset, bestLen := 0, 0
+
+	for _, offset := range candidates {
+		if !bytes.Equal(source[offset:offset+deltaBlockSize], target[pos:pos+deltaBlockSize]) {
+			continue
+		}
+
+		length := deltaBlockSize
+		for offset+length < len(source) && pos+length < len(target) && source[offset+length] == target[pos+length] {
+			length++
+		}
+
+		if length > bestLen {
+			bestOffset, bestLen = offset, length
+		}
+	}
+
+	return bestOffset, bestLen
+}
+
+func writeDeltaCopy(patch *bytes.Buffer, offset, length int) {
+	var op [9]byte
+	op[0] = deltaOpCopy
+	binary.LittleEndian.PutUint32(op[1:], uint32(offset))
+	binary.LittleEndian.PutUint32(op[5:], uint32(length))
+	patch.Write(op[:])
+}
+
+func writeDeltaInsert(patch *bytes.Buffer, literal []byte) {
+	if len(literal) == 0 {
+		return
+	}
+
+	var op [5]byte
+	op[0] = deltaOpInsert
+	binary.LittleEndian.PutUint32(op[1:], uint32(len(literal)))
+	patch.Write(op[:])
+	patch.Write(literal)
+}
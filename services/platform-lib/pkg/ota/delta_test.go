@@ -0,0 +1,167 @@
+package ota
+
+import (
+	"bytes"
+	"context"
+	"math/rand"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/mock"
+	"github.com/stretchr/testify/require"
+)
+
+func createTestImage(size int, seed int64) []byte {
+	data := make([]byte, size)
+	rand.New(rand.NewSource(seed)).Read(data)
+	return data
+}
+
+func TestDelta_RoundTrip(t *testing.T) {
+	source := createTestImage(256*1024, 1)
+
+	// Patch a few bytes, insert a block and drop a block, like a typical rebuild
+	target := append([]byte{}, source[:1000]...)
+	target = append(target, []byte("new code inserted here")...)
+	target = append(target, source[1000:50000]...)
+	target = append(target, source[60000:]...)
+	target[70000] ^= 0xFF
+	target[150000] ^= 0x55
+
+	patch, err := GenerateDelta(source, target)
+	require.NoError(t, err)
+	assert.Less(t, len(patch), len(target)/10)
+
+	result, err := ApplyDelta(source, patch)
+	require.NoError(t, err)
+	assert.True(t, bytes.Equal(target, result))
+}
+
+func TestDelta_IdenticalImages(t *testing.T) {
+	source := createTestImage(64*1024, 2)
+
+	patch, err := GenerateDelta(source, source)
+	require.NoError(t, err)
+	assert.Less(t, len(patch), 64)
+
+	result, err := ApplyDelta(source, patch)
+	require.NoError(t, err)
+	assert.Equal(t, source, result)
+}
+
+func TestDelta_UnrelatedAndEmptyImages(t *testing.T) {
+	cases := map[string][2][]byte{
+		"unrelated":    {createTestImage(4096, 3), createTestImage(4096, 4)},
+		"empty source": {nil, createTestImage(100, 5)},
+		"empty target": {createTestImage(100, 6), nil},
+		"tiny target":  {createTestImage(100, 7), []byte{1, 2, 3}},
+	}
+
+	for name, images := range cases {
+		t.Run(name, func(t *testing.T) {
+			patch, err := GenerateDelta(images[0], images[1])
+			require.NoError(t, err)
+
+			result, err := ApplyDelta(images[0], patch)
+			require.NoError(t, err)
+			assert.True(t, bytes.Equal(images[1], result))
+		})
+	}
+}
+
+func TestDelta_ApplyRejectsInvalidPatch(t *testing.T) {
+	source := createTestImage(1024, 8)
+	target := append(append([]byte{}, source...), 9, 9, 9)
+
+	patch, err := GenerateDelta(source, target)
+	require.NoError(t, err)
+
+	// Wrong magic
+	bad := append([]byte{}, patch...)
+	bad[0] = 'X'
+	_, err = ApplyDelta(source, bad)
+	assert.Error(t, err)
+
+	// Wrong source image
+	_, err = ApplyDelta(source[:512], patch)
+	assert.Error(t, err)
+
+	// Truncated patch
+	_, err = ApplyDelta(source, patch[:len(patch)-1])
+	assert.Error(t, err)
+}
+
+// Test that a delta is generated, cached and offered to a device that reports its release
+func TestService_GetUpdateForDevice_Delta(t *testing.T) {
+	service, mockRepo, _, _ := setupTestService()
+
+	backend, err := NewLocalStorageBackendWithBaseURL(t.TempDir(), "http://localhost:8006")
+	require.NoError(t, err)
+	service.storageBackend = backend
+
+	baseData := createTestImage(128*1024, 9)
+	targetData := append([]byte{}, baseData...)
+	copy(targetData[4096:], []byte("updated firmware build"))
+
+	baseRelease := createTestRelease("release-000")
+	baseRelease.BinaryPath, err = backend.StoreBinary(context.Background(), "release-000", baseData)
+	require.NoError(t, err)
+
+	release := createTestRelease("release-001")
+	release.BinarySize = int64(len(targetData))
+	release.BinaryPath, err = backend.StoreBinary(context.Background(), "release-001", targetData)
+	require.NoError(t, err)
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusPending,
+	}
+
+	mockRepo.On("GetLatestUpdateForDevice", mock.Anything, "device-001").Return(deviceUpdate, nil)
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
+	mockRepo.On("GetRelease", mock.Anything, "release-000").Return(baseRelease, nil).Once()
+
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{CurrentReleaseID: "release-000"})
+	require.NoError(t, err)
+	assert.Equal(t, "release-000", update.DeltaBaseReleaseID)
+	assert.Equal(t, "http://localhost:8006"+BinaryRoutePrefix+"release-001/delta-release-000.bin", update.DeltaURL)
+	assert.Less(t, update.DeltaSize, release.BinarySize/10)
+
+	_, patch, err := backend.GetArtifact(context.Background(), "release-001", "delta-release-000.bin")
+	require.NoError(t, err)
+	result, err := ApplyDelta(baseData, patch)
+	require.NoError(t, err)
+	assert.Equal(t, targetData, result)
+
+	// Second poll is served from the cached patch without loading the base release again
+	update, err = service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{CurrentReleaseID: "release-000"})
+	require.NoError(t, err)
+	assert.Equal(t, int64(len(patch)), update.DeltaSize)
+
+	mockRepo.AssertExpectations(t)
+}
+
+// Test that no delta is offered when the storage backend can't keep artifacts
+func TestService_GetUpdateForDevice_DeltaUnsupportedBackend(t *testing.T) {
+	service, mockRepo, _, mockStorage := setupTestService()
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusPending,
+	}
+
+	release := createTestRelease("release-001")
+
+	mockRepo.On("GetLatestUpdateForDevice", mock.Anything, "device-001").Return(deviceUpdate, nil)
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
+	mockStorage.On("GetBinaryURL", mock.Anything, release.BinaryPath, mock.AnythingOfType("time.Duration")).Return("https://storage.example.com/firmware.bin", nil)
+
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{CurrentReleaseID: "release-000"})
+	require.NoError(t, err)
+	assert.Empty(t, update.DeltaURL)
+	assert.Equal(t, "https://storage.example.com/firmware.bin", update.BinaryURL)
+}
@@ -205,3 +205,74 @@ func TestService_GetDeploymentStatus(t *testing.T) {
 
 	mockRepo.AssertExpectations(t)
 }
+
+// Test that download progress reports are stored without recomputing deployment stats
+func TestService_ReportUpdateStatus_DownloadProgress(t *testing.T) {
+	service, mockRepo, _, _ := setupDeploymentTestService()
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusDownloading,
+		Progress:     10,
+		StartedAt:    time.Now(),
+	}
+
+	mockRepo.On("GetDeviceUpdate", mock.Anything, "device-001", "release-001").Return(deviceUpdate, nil)
+	mockRepo.On("UpdateDeviceUpdate", mock.Anything, mock.MatchedBy(func(update *DeviceUpdate) bool {
+		return update.Progress == 25 && update.BytesDownloaded == 500000 && update.BytesTotal == 1000000 &&
+			update.ThroughputBps == 20000 && update.ProgressAt != nil
+	})).Return(nil)
+
+	report := &UpdateStatusReport{
+		DeviceID:        "device-001",
+		ReleaseID:       "release-001",
+		Status:          UpdateStatusDownloading,
+		Progress:        25,
+		BytesDownloaded: 500000,
+		BytesTotal:      1000000,
+		ThroughputBps:   20000,
+	}
+
+	err := service.ReportUpdateStatus(context.Background(), report)
+
+	require.NoError(t, err)
+
+	// GetDeployment and GetDeploymentStats are not expected
+	mockRepo.AssertExpectations(t)
+	mockRepo.AssertNotCalled(t, "GetDeploymentStats", mock.Anything, mock.Anything)
+}
+
+// Test download rates and the estimated completion in the deployment status
+func TestService_GetDeploymentStatus_Throughput(t *testing.T) {
+	service, mockRepo, _, _ := setupDeploymentTestService()
+
+	deployment := &OTADeployment{
+		DeploymentID:  "deployment-001",
+		ReleaseID:     "release-001",
+		Status:        DeploymentStatusActive,
+		TargetDevices: []string{"device-001", "device-002", "device-003"},
+	}
+
+	reportedAt := time.Now().Truncate(time.Second)
+	deviceUpdates := []*DeviceUpdate{
+		{DeviceID: "device-001", Status: UpdateStatusDownloading, BytesDownloaded: 600000, BytesTotal: 1000000, ThroughputBps: 40000, ProgressAt: &reportedAt},
+		{DeviceID: "device-002", Status: UpdateStatusDownloading, BytesDownloaded: 200000, BytesTotal: 1000000, ThroughputBps: 20000, ProgressAt: &reportedAt},
+		{DeviceID: "device-003", Status: UpdateStatusDownloading},
+	}
+
+	mockRepo.On("GetDeployment", mock.Anything, "deployment-001").Return(deployment, nil)
+	mockRepo.On("ListDeviceUpdates", mock.Anything, "deployment-001").Return(deviceUpdates, nil)
+
+	statusReport, err := service.GetDeploymentStatus(context.Background(), "deployment-001")
+
+	require.NoError(t, err)
+	assert.Equal(t, 3, statusReport.DownloadingCount)
+	assert.Equal(t, int64(30000), statusReport.AverageThroughputBps)
+	assert.Equal(t, int64(20000), statusReport.SlowestThroughputBps)
+	require.NotNil(t, statusReport.DownloadsCompleteAt)
+	assert.Equal(t, reportedAt.Add(40*time.Second), *statusReport.DownloadsCompleteAt) // 800000 bytes at 20000/s
+
+	mockRepo.AssertExpectations(t)
+}
@@ -0,0 +1,320 @@
+package ota
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"fmt"
+	"io"
+	"net/http"
+	"net/url"
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+
+	"github.com/athena/platform-lib/pkg/logger"
+)
+
+const (
+	// LANCacheFetchPath is where a LAN cache serves payloads: GET LANCacheFetchPath?src=<origin URL>,
+	// with sha256=<hex> when the payload's hash is known
+	LANCacheFetchPath = "/ota-cache/v1/fetch"
+
+	// Defaults for LANCacheConfig
+	defaultLANCacheMaxBytes      = 1 << 30
+	defaultLANCacheMaxEntryBytes = 64 << 20
+	defaultLANCacheFetchTimeout  = 10 * time.Minute
+)
+
+// LANCacheConfig configures a LAN cache
+type LANCacheConfig struct {
+	// Dir holds the cached payloads
+	Dir string
+	// AllowedOrigins are the URL prefixes payloads may be fetched from, normally the OTA
+	// service's storage base URL; the cache is not an open proxy, so at least one is required
+	AllowedOrigins []string
+	// MaxBytes bounds the cache on disk; the least recently used payloads are removed first
+	MaxBytes int64
+	// MaxEntryBytes bounds a single payload
+	MaxEntryBytes int64
+	// Client fetches payloads from their origin; defaults to a client with a 10 minute timeout
+	Client *http.Client
+}
+
+// LANCache serves firmware downloads to the devices of one site from local disk, fetching
+// each payload from its origin once. Devices find it with mDNS (see MDNSAdvertiser) and
+// ask for payloads by origin URL, so a rollout costs the site's uplink one download per
+// payload instead of one per device. Downloads with a known hash are stored under it and
+// checked before they are served; other payloads are stored under their origin URL without
+// its query, which holds the expiring signature. Devices check everything they receive
+// against the signed release either way.
+type LANCache struct {
+	config LANCacheConfig
+	logger *logger.Logger
+
+	mu       sync.Mutex
+	inflight map[string]*lanCacheFetch
+}
+
+// lanCacheFetch is a download from the origin that other requests for the same key wait for
+type lanCacheFetch struct {
+	done chan struct{}
+	err  error
+}
+
+// NewLANCache creates a cache that keeps payloads in config.Dir
+func NewLANCache(config LANCacheConfig, logger *logger.Logger) (*LANCache, error) {
+	if len(config.AllowedOrigins) == 0 {
+		return nil, fmt.Errorf("LAN cache needs at least one allowed origin")
+	}
+	if config.MaxBytes <= 0 {
+		config.MaxBytes = defaultLANCacheMaxBytes
+	}
+	if config.MaxEntryBytes <= 0 {
+		config.MaxEntryBytes = defaultLANCacheMaxEntryBytes
+	}
+	if config.Client == nil {
+		config.Client = &http.Client{Timeout: defaultLANCacheFetchTimeout}
+	}
+
+	if err := os.MkdirAll(config.Dir, 0755); err != nil {
+		return nil, fmt.Errorf("failed to create cache directory: %w", err)
+	}
+
+	return &LANCache{
+		config:   config,
+		logger:   logger,
+		inflight: make(map[string]*lanCacheFetch),
+	}, nil
+}
+
+// ServeHTTP answers GET and HEAD requests on LANCacheFetchPath, with Range support
+func (c *LANCache) ServeHTTP(w http.ResponseWriter, r *http.Request) {
+	if r.URL.Path != LANCacheFetchPath {
+		http.NotFound(w, r)
+		return
+	}
+	if r.Method != http.MethodGet && r.Method != http.MethodHead {
+		http.Error(w, "method not allowed", http.StatusMethodNotAllowed)
+		return
+	}
+
+	source := r.URL.Query().Get("src")
+	if !c.isAllowed(source) {
+		http.Error(w, "source not allowed", http.StatusForbidden)
+		return
+	}
+
+	expectedHash := strings.ToLower(r.URL.Query().Get("sha256"))
+	if expectedHash != "" {
+		if decoded, err := hex.DecodeString(expectedHash); err != nil || len(decoded) != sha256.Size {
+			http.Error(w, "invalid sha256", http.StatusBadRequest)
+			return
+		}
+	}
+
+	key, err := lanCacheKey(source, expectedHash)
+	if err != nil {
+		http.Error(w, err.Error(), http.StatusBadRequest)
+		return
+	}
+
+	if err := c.ensure(key, source, expectedHash); err != nil {
+		c.logger.Warn("LAN cache fetch failed", "source", redactQuery(source), "error", err)
+		http.Error(w, "fetch from origin failed", http.StatusBadGateway)
+		return
+	}
+
+	file, err := os.Open(c.entryPath(key))
+	if err != nil {
+		http.Error(w, "cached payload unavailable", http.StatusInternalServerError)
+		return
+	}
+	defer file.Close()
+
+	info, err := file.Stat()
+	if err != nil {
+		http.Error(w, "cached payload unavailable", http.StatusInternalServerError)
+		return
+	}
+
+	// The access time drives eviction; most filesystems don't keep a reliable one
+	now := time.Now()
+	_ = os.Chtimes(file.Name(), now, now)
+
+	// ServeContent handles Range, If-Range and 206/416 responses
+	w.Header().Set("Content-Type", "application/octet-stream")
+	http.ServeContent(w, r, "", info.ModTime(), file)
+}
+
+// isAllowed reports whether source is under one of the allowed origins
+func (c *LANCache) isAllowed(source string) bool {
+	parsed, err := url.Parse(source)
+	if err != nil || (parsed.Scheme != "http" && parsed.Scheme != "https") || parsed.Host == "" {
+		return false
+	}
+
+	for _, origin := range c.config.AllowedOrigins {
+		if strings.HasPrefix(source, origin) {
+			return true
+		}
+	}
+	return false
+}
+
+// ensure makes sure the payload for key is on disk, fetching it from source unless another
+// request already is
+func (c *LANCache) ensure(key, source, expectedHash string) error {
+	if _, err := os.Stat(c.entryPath(key)); err == nil {
+		return nil
+	}
+
+	c.mu.Lock()
+	fetch, waiting := c.inflight[key]
+	if !waiting {
+		fetch = &lanCacheFetch{done: make(chan struct{})}
+		c.inflight[key] = fetch
+	}
+	c.mu.Unlock()
+
+	if waiting {
+		<-fetch.done
+		return fetch.err
+	}
+
+	fetch.err = c.fetch(key, source, expectedHash)
+
+	c.mu.Lock()
+	delete(c.inflight, key)
+	c.mu.Unlock()
+	close(fetch.done)
+
+	return fetch.err
+}
+
+// fetch downloads source into the cache under key
+func (c *LANCache) fetch(key, source, expectedHash string) error {
+	resp, err := c.config.Client.Get(source)
+	if err != nil {
+		return fmt.Errorf("failed to fetch: %w", redactURLError(err))
+	}
+	defer resp.Body.Close()
+
+	if resp.StatusCode != http.StatusOK {
+		return fmt.Errorf("origin answered %s", resp.Status)
+	}
+	if resp.ContentLength > c.config.MaxEntryBytes {
+		return fmt.Errorf("payload of %d bytes exceeds the %d byte limit", resp.ContentLength, c.config.MaxEntryBytes)
+	}
+
+	temp, err := os.CreateTemp(c.config.Dir, "fetch-*")
+	if err != nil {
+		return fmt.Errorf("failed to create cache file: %w", err)
+	}
+	defer os.Remove(temp.Name())
+	defer temp.Close()
+
+	hash := sha256.New()
+	written, err := io.Copy(io.MultiWriter(temp, hash), io.LimitReader(resp.Body, c.config.MaxEntryBytes+1))
+	if err != nil {
+		return fmt.Errorf("failed to download: %w", err)
+	}
+	if written > c.config.MaxEntryBytes {
+		return fmt.Errorf("payload exceeds the %d byte limit", c.config.MaxEntryBytes)
+	}
+	if resp.ContentLength >= 0 && written != resp.ContentLength {
+		return fmt.Errorf("payload truncated at %d of %d bytes", written, resp.ContentLength)
+	}
+
+	// A wrong payload is never served, so one bad response can't reach the whole site
+	if expectedHash != "" && hex.EncodeToString(hash.Sum(nil)) != expectedHash {
+		return fmt.Errorf("payload hash mismatch")
+	}
+
+	if err := temp.Close(); err != nil {
+		return fmt.Errorf("failed to write cache file: %w", err)
+	}
+	if err := os.Rename(temp.Name(), c.entryPath(key)); err != nil {
+		return fmt.Errorf("failed to store cache file: %w", err)
+	}
+
+	c.logger.Info("LAN cache stored payload", "source", redactQuery(source), "size", written)
+	c.evict(key)
+	return nil
+}
+
+// evict removes the least recently used payloads until the cache fits in MaxBytes, keeping keep
+func (c *LANCache) evict(keep string) {
+	entries, err := os.ReadDir(c.config.Dir)
+	if err != nil {
+		return
+	}
+
+	type cacheEntry struct {
+		name    string
+		size    int64
+		touched time.Time
+	}
+	var cached []cacheEntry
+	var total int64
+	for _, entry := range entries {
+		info, err := entry.Info()
+		if err != nil || !entry.Type().IsRegular() || strings.HasPrefix(entry.Name(), "fetch-") {
+			continue
+		}
+		cached = append(cached, cacheEntry{name: entry.Name(), size: info.Size(), touched: info.ModTime()})
+		total += info.Size()
+	}
+
+	sort.Slice(cached, func(i, j int) bool { return cached[i].touched.Before(cached[j].touched) })
+	for _, entry := range cached {
+		if total <= c.config.MaxBytes {
+			break
+		}
+		if entry.name == keep {
+			continue
+		}
+		if err := os.Remove(filepath.Join(c.config.Dir, entry.name)); err == nil {
+			total -= entry.size
+		}
+	}
+}
+
+func (c *LANCache) entryPath(key string) string {
+	return filepath.Join(c.config.Dir, key)
+}
+
+// lanCacheKey names a payload on disk: its hash if known, otherwise a hash of its origin
+// URL without the query
+func lanCacheKey(source, expectedHash string) (string, error) {
+	if expectedHash != "" {
+		return "sha256-" + expectedHash, nil
+	}
+
+	parsed, err := url.Parse(source)
+	if err != nil {
+		return "", fmt.Errorf("invalid source URL: %w", err)
+	}
+	parsed.RawQuery = ""
+	parsed.Fragment = ""
+	sum := sha256.Sum256([]byte(parsed.String()))
+	return "url-" + hex.EncodeToString(sum[:]), nil
+}
+
+// redactQuery drops the query of a URL, which may hold a signature, for logging
+func redactQuery(source string) string {
+	if i := strings.IndexByte(source, '?'); i >= 0 {
+		return source[:i]
+	}
+	return source
+}
+
+// redactURLError keeps a signed URL out of an HTTP client error
+func redactURLError(err error) error {
+	if urlErr, ok := err.(*url.Error); ok {
+		return fmt.Errorf("%s %s: %w", urlErr.Op, redactQuery(urlErr.URL), urlErr.Err)
+	}
+	return err
+}
@@ -0,0 +1,166 @@
+package ota
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"net/http"
+	"net/http/httptest"
+	"net/url"
+	"os"
+	"sync"
+	"sync/atomic"
+	"testing"
+	"time"
+
+	"github.com/athena/platform-lib/pkg/logger"
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/require"
+)
+
+// newTestOrigin serves payloads by path and counts the requests that reach it
+func newTestOrigin(t *testing.T, payloads map[string][]byte) (*httptest.Server, *int32) {
+	var hits int32
+	origin := httptest.NewServer(http.HandlerFunc(func(w http.ResponseWriter, r *http.Request) {
+		atomic.AddInt32(&hits, 1)
+		payload, ok := payloads[r.URL.Path]
+		if !ok {
+			http.NotFound(w, r)
+			return
+		}
+		// Long enough for concurrent requests to find the fetch in flight
+		time.Sleep(20 * time.Millisecond)
+		w.Write(payload)
+	}))
+	t.Cleanup(origin.Close)
+	return origin, &hits
+}
+
+func lanCacheRequest(source, hash string) *http.Request {
+	query := url.Values{"src": {source}}
+	if hash != "" {
+		query.Set("sha256", hash)
+	}
+	return httptest.NewRequest(http.MethodGet, LANCacheFetchPath+"?"+query.Encode(), nil)
+}
+
+func TestLANCache_FetchesOnce(t *testing.T) {
+	image := createTestImage(64*1024, 1)
+	origin, hits := newTestOrigin(t, map[string][]byte{"/binaries/release-001/firmware.bin": image})
+
+	cache, err := NewLANCache(LANCacheConfig{Dir: t.TempDir(), AllowedOrigins: []string{origin.URL + "/binaries/"}}, logger.New("debug", "test"))
+	require.NoError(t, err)
+
+	// Devices arrive together at the start of a rollout
+	var wg sync.WaitGroup
+	for i := 0; i < 8; i++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			recorder := httptest.NewRecorder()
+			cache.ServeHTTP(recorder, lanCacheRequest(origin.URL+"/binaries/release-001/firmware.bin?expires=1&sig=a", ""))
+			assert.Equal(t, http.StatusOK, recorder.Code)
+			assert.Equal(t, image, recorder.Body.Bytes())
+		}()
+	}
+	wg.Wait()
+	assert.Equal(t, int32(1), atomic.LoadInt32(hits))
+
+	// A freshly signed URL for the same payload is still a hit, and ranges are served from disk
+	request := lanCacheRequest(origin.URL+"/binaries/release-001/firmware.bin?expires=2&sig=b", "")
+	request.Header.Set("Range", "bytes=4096-8191")
+	recorder := httptest.NewRecorder()
+	cache.ServeHTTP(recorder, request)
+	assert.Equal(t, http.StatusPartialContent, recorder.Code)
+	assert.Equal(t, image[4096:8192], recorder.Body.Bytes())
+	assert.Equal(t, int32(1), atomic.LoadInt32(hits))
+}
+
+func TestLANCache_VerifiesHash(t *testing.T) {
+	image := createTestImage(32*1024, 2)
+	sum := sha256.Sum256(image)
+	hash := hex.EncodeToString(sum[:])
+	origin, hits := newTestOrigin(t, map[string][]byte{"/firmware.bin": image})
+
+	dir := t.TempDir()
+	cache, err := NewLANCache(LANCacheConfig{Dir: dir, AllowedOrigins: []string{origin.URL + "/"}}, logger.New("debug", "test"))
+	require.NoError(t, err)
+
+	// A payload that doesn't match the hash the device asked for is neither served nor kept
+	recorder := httptest.NewRecorder()
+	bad := sha256.Sum256([]byte("other firmware"))
+	cache.ServeHTTP(recorder, lanCacheRequest(origin.URL+"/firmware.bin", hex.EncodeToString(bad[:])))
+	assert.Equal(t, http.StatusBadGateway, recorder.Code)
+	entries, err := os.ReadDir(dir)
+	require.NoError(t, err)
+	assert.Empty(t, entries)
+
+	recorder = httptest.NewRecorder()
+	cache.ServeHTTP(recorder, lanCacheRequest(origin.URL+"/firmware.bin", hash))
+	assert.Equal(t, http.StatusOK, recorder.Code)
+	assert.Equal(t, image, recorder.Body.Bytes())
+
+	recorder = httptest.NewRecorder()
+	cache.ServeHTTP(recorder, lanCacheRequest(origin.URL+"/firmware.bin", "not-hex"))
+	assert.Equal(t, http.StatusBadRequest, recorder.Code)
+
+	assert.Equal(t, int32(2), atomic.LoadInt32(hits))
+}
+
+func TestLANCache_RejectsOtherOrigins(t *testing.T) {
+	_, err := NewLANCache(LANCacheConfig{Dir: t.TempDir()}, logger.New("debug", "test"))
+	assert.Error(t, err)
+
+	cache, err := NewLANCache(LANCacheConfig{Dir: t.TempDir(), AllowedOrigins: []string{"https://ota.example.com/binaries/"}}, logger.New("debug", "test"))
+	require.NoError(t, err)
+
+	for _, source := range []string{
+		"",
+		"http://169.254.169.254/latest/meta-data",
+		"https://ota.example.com.attacker.net/binaries/firmware.bin",
+		"file:///etc/passwd",
+	} {
+		recorder := httptest.NewRecorder()
+		cache.ServeHTTP(recorder, lanCacheRequest(source, ""))
+		assert.Equal(t, http.StatusForbidden, recorder.Code, source)
+	}
+
+	recorder := httptest.NewRecorder()
+	cache.ServeHTTP(recorder, httptest.NewRequest(http.MethodPost, LANCacheFetchPath, nil))
+	assert.Equal(t, http.StatusMethodNotAllowed, recorder.Code)
+}
+
+func TestLANCache_EvictsLeastRecentlyUsed(t *testing.T) {
+	payloads := map[string][]byte{
+		"/a.bin": createTestImage(40*1024, 3),
+		"/b.bin": createTestImage(40*1024, 4),
+		"/c.bin": createTestImage(40*1024, 5),
+	}
+	origin, hits := newTestOrigin(t, payloads)
+
+	cache, err := NewLANCache(LANCacheConfig{Dir: t.TempDir(), AllowedOrigins: []string{origin.URL + "/"}, MaxBytes: 100 * 1024, MaxEntryBytes: 50 * 1024}, logger.New("debug", "test"))
+	require.NoError(t, err)
+
+	fetch := func(path string) int {
+		recorder := httptest.NewRecorder()
+		cache.ServeHTTP(recorder, lanCacheRequest(origin.URL+path, ""))
+		return recorder.Code
+	}
+
+	require.Equal(t, http.StatusOK, fetch("/a.bin"))
+	require.Equal(t, http.StatusOK, fetch("/b.bin"))
+	// Touch a so b is the oldest when c arrives; mtimes need to differ
+	time.Sleep(20 * time.Millisecond)
+	require.Equal(t, http.StatusOK, fetch("/a.bin"))
+	time.Sleep(20 * time.Millisecond)
+	require.Equal(t, http.StatusOK, fetch("/c.bin"))
+	assert.Equal(t, int32(3), atomic.LoadInt32(hits))
+
+	require.Equal(t, http.StatusOK, fetch("/a.bin"))
+	assert.Equal(t, int32(3), atomic.LoadInt32(hits))
+	require.Equal(t, http.StatusOK, fetch("/b.bin"))
+	assert.Equal(t, int32(4), atomic.LoadInt32(hits))
+
+	// Payloads over the entry limit aren't cached at all
+	payloads["/big.bin"] = createTestImage(60*1024, 6)
+	assert.Equal(t, http.StatusBadGateway, fetch("/big.bin"))
+}
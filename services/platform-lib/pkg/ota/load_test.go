@@ -0,0 +1,714 @@
+package ota
+
+import (
+	"bytes"
+	"context"
+	"encoding/json"
+	"fmt"
+	"io"
+	"math/rand"
+	"net/http"
+	"net/http/httptest"
+	"os"
+	"sort"
+	"strconv"
+	"sync"
+	"testing"
+	"time"
+
+	"github.com/athena/platform-lib/pkg/config"
+	"github.com/athena/platform-lib/pkg/logger"
+	"github.com/gin-gonic/gin"
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/require"
+)
+
+// The load test runs a fleet of simulated devices against the OTA service over HTTP. Each one
+// speaks the Arduino OTAClient's protocol: an update check with the query parameters and ETag
+// the client sends, batched status reports, and the download of the payload the client would
+// pick. It only runs when OTA_LOAD_DEVICES sets the fleet size, so a plain go test stays a unit
+// test run; size a rollout with e.g.
+//
+//	OTA_LOAD_DEVICES=20000 OTA_LOAD_CONCURRENCY=512 go test -run TestServiceLoad -v ./pkg/ota
+//
+// Other settings: OTA_LOAD_CONCURRENCY (workers, 32 by default), OTA_LOAD_IMAGE_SIZE (bytes),
+// OTA_LOAD_PROGRESS_REPORTS (downloading reports per update), OTA_LOAD_FAILURE_RATE (share of
+// devices that report a failed update) and OTA_LOAD_OUTPUT (file to write the results to as JSON).
+
+// loadConfig describes one load test run
+type loadConfig struct {
+	Devices         int     `json:"devices"`
+	Concurrency     int     `json:"concurrency"`
+	ImageSize       int     `json:"image_size"`
+	ProgressReports int     `json:"progress_reports"`
+	FailureRate     float64 `json:"failure_rate"`
+}
+
+// loadLatency summarizes the latencies of one kind of request, in milliseconds
+type loadLatency struct {
+	Count int     `json:"count"`
+	P50Ms float64 `json:"p50_ms"`
+	P99Ms float64 `json:"p99_ms"`
+	MaxMs float64 `json:"max_ms"`
+}
+
+// loadResult is what a load test run reports
+type loadResult struct {
+	Config            loadConfig             `json:"config"`
+	ElapsedMs         float64                `json:"elapsed_ms"`
+	Requests          int                    `json:"requests"`
+	RequestsPerSecond float64                `json:"requests_per_second"`
+	UpdatesPerSecond  float64                `json:"updates_per_second"`
+	BytesDownloaded   int64                  `json:"bytes_downloaded"`
+	Errors            int                    `json:"errors"`
+	Latency           map[string]loadLatency `json:"latency"`
+	DatastoreOps      map[string]float64     `json:"datastore_ops_per_update"`
+	EntitiesRead      float64                `json:"entities_read_per_update"`
+}
+
+// Request kinds the load test times
+const (
+	loadPollUpdate      = "poll_update"       // Check that is offered the update
+	loadPollNoUpdate    = "poll_no_update"    // Check after the update, answered with 404
+	loadPollNotModified = "poll_not_modified" // The next one, with the ETag, answered with 304
+	loadStatusProgress  = "status_progress"   // Batch with a downloading report
+	loadStatusFinal     = "status_final"      // Batch with the completed or failed report
+	loadDownload        = "download"          // The payload
+)
+
+func loadConfigFromEnv(t *testing.T) loadConfig {
+	cfg := loadConfig{
+		Concurrency:     32,
+		ImageSize:       64 * 1024,
+		ProgressReports: 1,
+	}
+
+	ints := map[string]*int{
+		"OTA_LOAD_DEVICES":          &cfg.Devices,
+		"OTA_LOAD_CONCURRENCY":      &cfg.Concurrency,
+		"OTA_LOAD_IMAGE_SIZE":       &cfg.ImageSize,
+		"OTA_LOAD_PROGRESS_REPORTS": &cfg.ProgressReports,
+	}
+	for name, value := range ints {
+		if env := os.Getenv(name); env != "" {
+			parsed, err := strconv.Atoi(env)
+			require.NoError(t, err, "%s should be an integer", name)
+			*value = parsed
+		}
+	}
+	if env := os.Getenv("OTA_LOAD_FAILURE_RATE"); env != "" {
+		parsed, err := strconv.ParseFloat(env, 64)
+		require.NoError(t, err, "OTA_LOAD_FAILURE_RATE should be a number")
+		cfg.FailureRate = parsed
+	}
+
+	require.Greater(t, cfg.Devices, 0)
+	require.Greater(t, cfg.Concurrency, 0)
+	require.Greater(t, cfg.ImageSize, 0)
+	return cfg
+}
+
+// TestServiceLoad measures update checks, status reports and downloads of a deployment to a fleet
+func TestServiceLoad(t *testing.T) {
+	if os.Getenv("OTA_LOAD_DEVICES") == "" {
+		t.Skip("Skipping OTA service load test; set OTA_LOAD_DEVICES to run it")
+	}
+
+	cfg := loadConfigFromEnv(t)
+	ctx := context.Background()
+	gin.SetMode(gin.ReleaseMode)
+
+	// Per-request logging would dominate the run; the service logs Info for every report
+	repo := newMemoryRepository()
+	privateKeyPEM, publicKeyPEM, err := GenerateKeyPair(2048)
+	require.NoError(t, err)
+	signer, err := NewSigner(privateKeyPEM, publicKeyPEM)
+	require.NoError(t, err)
+	service, err := NewService(&config.Config{ServiceName: "ota-load-test"}, logger.New("error", "ota-load-test"),
+		repo, nil, signer, nil)
+	require.NoError(t, err)
+
+	router := gin.New()
+	RegisterRoutes(router, service)
+	server := httptest.NewServer(router)
+	defer server.Close()
+
+	storage, err := NewLocalStorageBackendWithBaseURL(t.TempDir(), server.URL)
+	require.NoError(t, err)
+	service.storageBackend = storage
+
+	// The new release changes a few of the running one's sectors, so devices are offered a delta
+	random := rand.New(rand.NewSource(1))
+	baseImage := make([]byte, cfg.ImageSize)
+	random.Read(baseImage)
+	newImage := append([]byte(nil), baseImage...)
+	for offset := 0; offset < len(newImage); offset += 16 * 4096 {
+		newImage[offset] ^= 0xff
+	}
+
+	baseRelease, err := service.CreateRelease(ctx, &CreateReleaseRequest{TemplateID: "load-test", Version: "1.0.0",
+		Channel: ReleaseChannelStable, BinaryData: baseImage})
+	require.NoError(t, err)
+	release, err := service.CreateRelease(ctx, &CreateReleaseRequest{TemplateID: "load-test", Version: "1.1.0",
+		Channel: ReleaseChannelStable, BinaryData: newImage})
+	require.NoError(t, err)
+
+	devices := make([]*loadDevice, cfg.Devices)
+	deviceIDs := make([]string, cfg.Devices)
+	for i := range devices {
+		deviceIDs[i] = fmt.Sprintf("load-device-%05d", i)
+		devices[i] = &loadDevice{
+			id:             deviceIDs[i],
+			currentRelease: baseRelease.ReleaseID,
+			fail:           random.Float64() < cfg.FailureRate,
+		}
+	}
+
+	// A threshold above 100% keeps an automatic rollback from ending the run early
+	deployment, err := service.DeployRelease(ctx, release.ReleaseID, &DeploymentConfig{
+		Strategy:         DeploymentStrategyImmediate,
+		TargetDevices:    deviceIDs,
+		FailureThreshold: 101,
+	})
+	require.NoError(t, err)
+
+	// Only the devices' traffic is counted
+	repo.resetCounts()
+
+	client := &http.Client{
+		Timeout:   60 * time.Second,
+		Transport: &http.Transport{MaxIdleConns: cfg.Concurrency, MaxIdleConnsPerHost: cfg.Concurrency},
+	}
+
+	queue := make(chan *loadDevice)
+	timings := make([]map[string][]time.Duration, cfg.Concurrency)
+	errorCounts := make([]int, cfg.Concurrency)
+	downloaded := make([]int64, cfg.Concurrency)
+	var firstError sync.Once
+	var wg sync.WaitGroup
+
+	started := time.Now()
+	for worker := 0; worker < cfg.Concurrency; worker++ {
+		worker := worker
+		timings[worker] = map[string][]time.Duration{}
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for device := range queue {
+				read, err := device.run(client, server.URL, cfg, timings[worker])
+				downloaded[worker] += read
+				if err != nil {
+					errorCounts[worker]++
+					firstError.Do(func() { t.Errorf("Device %s: %v", device.id, err) })
+				}
+			}
+		}()
+	}
+	for _, device := range devices {
+		queue <- device
+	}
+	close(queue)
+	wg.Wait()
+	elapsed := time.Since(started)
+
+	result := loadResult{
+		Config:       cfg,
+		ElapsedMs:    float64(elapsed.Microseconds()) / 1000,
+		Latency:      map[string]loadLatency{},
+		DatastoreOps: map[string]float64{},
+	}
+
+	merged := map[string][]time.Duration{}
+	for worker := range timings {
+		for kind, durations := range timings[worker] {
+			merged[kind] = append(merged[kind], durations...)
+		}
+		result.Errors += errorCounts[worker]
+		result.BytesDownloaded += downloaded[worker]
+	}
+	for kind, durations := range merged {
+		result.Latency[kind] = summarizeLatency(durations)
+		result.Requests += len(durations)
+	}
+	result.RequestsPerSecond = float64(result.Requests) / elapsed.Seconds()
+	result.UpdatesPerSecond = float64(cfg.Devices) / elapsed.Seconds()
+
+	ops, entitiesRead := repo.counts()
+	for op, count := range ops {
+		result.DatastoreOps[op] = float64(count) / float64(cfg.Devices)
+	}
+	result.EntitiesRead = float64(entitiesRead) / float64(cfg.Devices)
+
+	t.Logf("%d devices, %d concurrent: %.0f ms, %.0f requests/s, %.1f updates/s, %d errors",
+		cfg.Devices, cfg.Concurrency, result.ElapsedMs, result.RequestsPerSecond, result.UpdatesPerSecond, result.Errors)
+	kinds := make([]string, 0, len(result.Latency))
+	for kind := range result.Latency {
+		kinds = append(kinds, kind)
+	}
+	sort.Strings(kinds)
+	for _, kind := range kinds {
+		latency := result.Latency[kind]
+		t.Logf("  %-18s %6d requests, p50 %7.2f ms, p99 %7.2f ms, max %7.2f ms",
+			kind, latency.Count, latency.P50Ms, latency.P99Ms, latency.MaxMs)
+	}
+	t.Logf("  datastore ops per update: %v, entities read per update: %.0f", result.DatastoreOps, result.EntitiesRead)
+
+	if path := os.Getenv("OTA_LOAD_OUTPUT"); path != "" {
+		data, err := json.MarshalIndent(result, "", "  ")
+		require.NoError(t, err)
+		require.NoError(t, os.WriteFile(path, data, 0644))
+	}
+
+	// Every device's outcome landed, and the deployment counts agree
+	assert.Equal(t, 0, result.Errors)
+	expectedFailures := 0
+	for _, device := range devices {
+		if device.fail {
+			expectedFailures++
+		}
+	}
+	final, err := repo.GetDeployment(ctx, deployment.DeploymentID)
+	require.NoError(t, err)
+	assert.Equal(t, cfg.Devices-expectedFailures, final.SuccessCount)
+	assert.Equal(t, expectedFailures, final.FailureCount)
+	assert.Equal(t, DeploymentStatusCompleted, final.Status)
+}
+
+func summarizeLatency(durations []time.Duration) loadLatency {
+	sort.Slice(durations, func(i, j int) bool { return durations[i] < durations[j] })
+	percentile := func(p float64) float64 {
+		index := int(p * float64(len(durations)-1))
+		return float64(durations[index].Microseconds()) / 1000
+	}
+	return loadLatency{
+		Count: len(durations),
+		P50Ms: percentile(0.50),
+		P99Ms: percentile(0.99),
+		MaxMs: percentile(1),
+	}
+}
+
+// loadDevice is one simulated device running OTAClient::loop()
+type loadDevice struct {
+	id             string
+	currentRelease string
+	etag           string
+	fail           bool
+}
+
+// run takes the device through one update and the two checks after it, timing every request.
+// It returns the payload bytes downloaded.
+func (d *loadDevice) run(client *http.Client, baseURL string, cfg loadConfig, timings map[string][]time.Duration) (int64, error) {
+	update, err := d.check(client, baseURL, http.StatusOK, loadPollUpdate, timings)
+	if err != nil {
+		return 0, err
+	}
+
+	// Like the client's: a delta from the running release, else the compressed image, else the raw one
+	url, size := update.BinaryURL, update.BinarySize
+	if update.DeltaURL != "" && update.DeltaBaseReleaseID == d.currentRelease {
+		url, size = update.DeltaURL, update.DeltaSize
+	} else if update.CompressedURL != "" {
+		url, size = update.CompressedURL, update.CompressedSize
+	}
+
+	// The first downloading state is queued and goes out with the first progress report
+	for i := 1; i <= cfg.ProgressReports; i++ {
+		received := size * int64(i) / int64(cfg.ProgressReports+1)
+		report := UpdateStatusReport{DeviceID: d.id, ReleaseID: update.ReleaseID, Status: UpdateStatusDownloading,
+			Progress: int(received * 50 / size), BytesDownloaded: received, BytesTotal: size, ThroughputBps: 100000}
+		if err := d.report(client, baseURL, report, loadStatusProgress, timings); err != nil {
+			return 0, err
+		}
+	}
+
+	requestStarted := time.Now()
+	resp, err := client.Get(url)
+	if err != nil {
+		return 0, fmt.Errorf("download: %w", err)
+	}
+	body, err := io.ReadAll(resp.Body)
+	resp.Body.Close()
+	timings[loadDownload] = append(timings[loadDownload], time.Since(requestStarted))
+	if err != nil {
+		return 0, fmt.Errorf("download: %w", err)
+	}
+	if resp.StatusCode != http.StatusOK || int64(len(body)) != size {
+		return int64(len(body)), fmt.Errorf("download: HTTP %d, %d of %d bytes", resp.StatusCode, len(body), size)
+	}
+
+	// Installing and completed replace each other in the client's queue, so only the final state is sent
+	report := UpdateStatusReport{DeviceID: d.id, ReleaseID: update.ReleaseID, Status: UpdateStatusCompleted, Progress: 100}
+	if d.fail {
+		report.Status = UpdateStatusFailed
+		report.Progress = 50
+		report.ErrorMessage = "Hash verification failed"
+	} else {
+		d.currentRelease = update.ReleaseID
+	}
+	if err := d.report(client, baseURL, report, loadStatusFinal, timings); err != nil {
+		return int64(len(body)), err
+	}
+
+	// Nothing more to install: a 404 with an ETag, then a 304 for the same answer
+	if _, err := d.check(client, baseURL, http.StatusNotFound, loadPollNoUpdate, timings); err != nil {
+		return int64(len(body)), err
+	}
+	if _, err := d.check(client, baseURL, http.StatusNotModified, loadPollNotModified, timings); err != nil {
+		return int64(len(body)), err
+	}
+
+	return int64(len(body)), nil
+}
+
+// check sends an update check the way OTAClient::checkForUpdate() does
+func (d *loadDevice) check(client *http.Client, baseURL string, expected int, kind string, timings map[string][]time.Duration) (*FirmwareUpdate, error) {
+	url := baseURL + "/api/v1/ota/updates/" + d.id + "?current_release=" + d.currentRelease +
+		"&compression=" + CompressionZlib + "&sector_size=4096"
+	req, err := http.NewRequest(http.MethodGet, url, nil)
+	if err != nil {
+		return nil, err
+	}
+	if d.etag != "" {
+		req.Header.Set("If-None-Match", d.etag)
+	}
+
+	requestStarted := time.Now()
+	resp, err := client.Do(req)
+	if err != nil {
+		return nil, fmt.Errorf("%s: %w", kind, err)
+	}
+	body, err := io.ReadAll(resp.Body)
+	resp.Body.Close()
+	timings[kind] = append(timings[kind], time.Since(requestStarted))
+	if err != nil {
+		return nil, fmt.Errorf("%s: %w", kind, err)
+	}
+	if resp.StatusCode != expected {
+		return nil, fmt.Errorf("%s: HTTP %d, expected %d: %s", kind, resp.StatusCode, expected, body)
+	}
+
+	// The client keeps the tag of a "no update" answer and drops it otherwise
+	if resp.StatusCode == http.StatusNotFound {
+		d.etag = resp.Header.Get("ETag")
+	} else if resp.StatusCode != http.StatusNotModified {
+		d.etag = ""
+	}
+
+	if resp.StatusCode != http.StatusOK {
+		return nil, nil
+	}
+	var update FirmwareUpdate
+	if err := json.Unmarshal(body, &update); err != nil {
+		return nil, fmt.Errorf("%s: %w", kind, err)
+	}
+	return &update, nil
+}
+
+// report sends a status report in a batch, as OTAClient::flushStatusReports() does
+func (d *loadDevice) report(client *http.Client, baseURL string, report UpdateStatusReport, kind string, timings map[string][]time.Duration) error {
+	payload, err := json.Marshal(BatchStatusReport{Reports: []UpdateStatusReport{report}})
+	if err != nil {
+		return err
+	}
+
+	requestStarted := time.Now()
+	resp, err := client.Post(baseURL+"/api/v1/ota/updates/status/batch", "application/json", bytes.NewReader(payload))
+	if err != nil {
+		return fmt.Errorf("%s: %w", kind, err)
+	}
+	body, err := io.ReadAll(resp.Body)
+	resp.Body.Close()
+	timings[kind] = append(timings[kind], time.Since(requestStarted))
+	if err != nil {
+		return fmt.Errorf("%s: %w", kind, err)
+	}
+
+	var result BatchStatusResult
+	if resp.StatusCode != http.StatusOK || json.Unmarshal(body, &result) != nil || result.Accepted != 1 {
+		return fmt.Errorf("%s: HTTP %d: %s", kind, resp.StatusCode, body)
+	}
+	return nil
+}
+
+// memoryRepository is a Repository in memory that counts its operations. Queries read
+// the entities the Datastore repository's queries would, so those counts carry over.
+type memoryRepository struct {
+	mu           sync.Mutex
+	releases     map[string]*FirmwareRelease
+	deployments  map[string]*OTADeployment
+	updates      map[string]*DeviceUpdate // By device_id#release_id, as in Datastore
+	byDevice     map[string][]string
+	byDeployment map[string][]string
+	ops          map[string]int64
+	entitiesRead int64
+}
+
+func newMemoryRepository() *memoryRepository {
+	return &memoryRepository{
+		releases:     map[string]*FirmwareRelease{},
+		deployments:  map[string]*OTADeployment{},
+		updates:      map[string]*DeviceUpdate{},
+		byDevice:     map[string][]string{},
+		byDeployment: map[string][]string{},
+		ops:          map[string]int64{},
+	}
+}
+
+func (r *memoryRepository) resetCounts() {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.ops = map[string]int64{}
+	r.entitiesRead = 0
+}
+
+func (r *memoryRepository) counts() (map[string]int64, int64) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	ops := make(map[string]int64, len(r.ops))
+	for op, count := range r.ops {
+		ops[op] = count
+	}
+	return ops, r.entitiesRead
+}
+
+// count records an operation that read the given number of entities; call with mu held
+func (r *memoryRepository) count(op string, read int) {
+	r.ops[op]++
+	r.entitiesRead += int64(read)
+}
+
+func (r *memoryRepository) CreateRelease(ctx context.Context, release *FirmwareRelease) error {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count("CreateRelease", 0)
+	copied := *release
+	r.releases[release.ReleaseID] = &copied
+	return nil
+}
+
+func (r *memoryRepository) GetRelease(ctx context.Context, releaseID string) (*FirmwareRelease, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count("GetRelease", 1)
+	release, ok := r.releases[releaseID]
+	if !ok {
+		return nil, fmt.Errorf("release not found: %s", releaseID)
+	}
+	copied := *release
+	return &copied, nil
+}
+
+func (r *memoryRepository) GetReleaseByVersion(ctx context.Context, templateID, version string, channel ReleaseChannel) (*FirmwareRelease, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count("GetReleaseByVersion", len(r.releases))
+	for _, release := range r.releases {
+		if release.TemplateID == templateID && release.Version == version && release.Channel == channel {
+			copied := *release
+			return &copied, nil
+		}
+	}
+	return nil, fmt.Errorf("release not found: %s %s", templateID, version)
+}
+
+func (r *memoryRepository) ListReleases(ctx context.Context, templateID string, channel ReleaseChannel) ([]*FirmwareRelease, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	var releases []*FirmwareRelease
+	for _, release := range r.releases {
+		if release.TemplateID == templateID && (channel == "" || release.Channel == channel) {
+			copied := *release
+			releases = append(releases, &copied)
+		}
+	}
+	r.count("ListReleases", len(releases))
+	return releases, nil
+}
+
+func (r *memoryRepository) DeleteRelease(ctx context.Context, releaseID string) error {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count("DeleteRelease", 0)
+	delete(r.releases, releaseID)
+	return nil
+}
+
+func (r *memoryRepository) ReleaseExists(ctx context.Context, releaseID string) (bool, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count("ReleaseExists", 1)
+	_, ok := r.releases[releaseID]
+	return ok, nil
+}
+
+func (r *memoryRepository) CreateDeployment(ctx context.Context, deployment *OTADeployment) error {
+	return r.putDeployment("CreateDeployment", deployment)
+}
+
+func (r *memoryRepository) UpdateDeployment(ctx context.Context, deployment *OTADeployment) error {
+	return r.putDeployment("UpdateDeployment", deployment)
+}
+
+func (r *memoryRepository) putDeployment(op string, deployment *OTADeployment) error {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count(op, 0)
+	copied := *deployment
+	r.deployments[deployment.DeploymentID] = &copied
+	return nil
+}
+
+func (r *memoryRepository) GetDeployment(ctx context.Context, deploymentID string) (*OTADeployment, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count("GetDeployment", 1)
+	deployment, ok := r.deployments[deploymentID]
+	if !ok {
+		return nil, fmt.Errorf("deployment not found: %s", deploymentID)
+	}
+	copied := *deployment
+	return &copied, nil
+}
+
+func (r *memoryRepository) ListDeployments(ctx context.Context, releaseID string) ([]*OTADeployment, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	var deployments []*OTADeployment
+	for _, deployment := range r.deployments {
+		if deployment.ReleaseID == releaseID {
+			copied := *deployment
+			deployments = append(deployments, &copied)
+		}
+	}
+	r.count("ListDeployments", len(deployments))
+	return deployments, nil
+}
+
+func (r *memoryRepository) GetActiveDeployments(ctx context.Context) ([]*OTADeployment, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	var deployments []*OTADeployment
+	for _, deployment := range r.deployments {
+		if deployment.Status == DeploymentStatusActive {
+			copied := *deployment
+			deployments = append(deployments, &copied)
+		}
+	}
+	r.count("GetActiveDeployments", len(deployments))
+	return deployments, nil
+}
+
+func (r *memoryRepository) CreateDeviceUpdate(ctx context.Context, update *DeviceUpdate) error {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count("CreateDeviceUpdate", 0)
+	key := update.DeviceID + "#" + update.ReleaseID
+	if _, exists := r.updates[key]; !exists {
+		r.byDevice[update.DeviceID] = append(r.byDevice[update.DeviceID], key)
+		r.byDeployment[update.DeploymentID] = append(r.byDeployment[update.DeploymentID], key)
+	}
+	copied := *update
+	r.updates[key] = &copied
+	return nil
+}
+
+func (r *memoryRepository) UpdateDeviceUpdate(ctx context.Context, update *DeviceUpdate) error {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count("UpdateDeviceUpdate", 0)
+	copied := *update
+	r.updates[update.DeviceID+"#"+update.ReleaseID] = &copied
+	return nil
+}
+
+func (r *memoryRepository) GetDeviceUpdate(ctx context.Context, deviceID, releaseID string) (*DeviceUpdate, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.count("GetDeviceUpdate", 1)
+	update, ok := r.updates[deviceID+"#"+releaseID]
+	if !ok {
+		return nil, fmt.Errorf("device update not found for device %s and release %s", deviceID, releaseID)
+	}
+	copied := *update
+	return &copied, nil
+}
+
+func (r *memoryRepository) GetLatestUpdateForDevice(ctx context.Context, deviceID string) (*DeviceUpdate, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	var latest *DeviceUpdate
+	for _, key := range r.byDevice[deviceID] {
+		if update := r.updates[key]; latest == nil || update.StartedAt.After(latest.StartedAt) {
+			latest = update
+		}
+	}
+	if latest == nil {
+		r.count("GetLatestUpdateForDevice", 0)
+		return nil, fmt.Errorf("no updates found for device %s", deviceID)
+	}
+	// The query is limited to one entity
+	r.count("GetLatestUpdateForDevice", 1)
+	copied := *latest
+	return &copied, nil
+}
+
+// deploymentUpdates returns copies of a deployment's device updates that match the filter;
+// call with mu held
+func (r *memoryRepository) deploymentUpdates(deploymentID string, match func(*DeviceUpdate) bool) []*DeviceUpdate {
+	var updates []*DeviceUpdate
+	for _, key := range r.byDeployment[deploymentID] {
+		if update := r.updates[key]; match(update) {
+			copied := *update
+			updates = append(updates, &copied)
+		}
+	}
+	return updates
+}
+
+func (r *memoryRepository) ListDeviceUpdates(ctx context.Context, deploymentID string) ([]*DeviceUpdate, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	updates := r.deploymentUpdates(deploymentID, func(*DeviceUpdate) bool { return true })
+	r.count("ListDeviceUpdates", len(updates))
+	return updates, nil
+}
+
+func (r *memoryRepository) GetDeviceUpdatesByStatus(ctx context.Context, deploymentID string, status UpdateStatus) ([]*DeviceUpdate, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	updates := r.deploymentUpdates(deploymentID, func(update *DeviceUpdate) bool { return update.Status == status })
+	r.count("GetDeviceUpdatesByStatus", len(updates))
+	return updates, nil
+}
+
+func (r *memoryRepository) GetDeploymentStats(ctx context.Context, deploymentID string) (successCount, failureCount, pendingCount int, err error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+
+	// The Datastore repository lists every device update of the deployment to count them
+	keys := r.byDeployment[deploymentID]
+	for _, key := range keys {
+		switch r.updates[key].Status {
+		case UpdateStatusCompleted:
+			successCount++
+		case UpdateStatusFailed:
+			failureCount++
+		case UpdateStatusPending, UpdateStatusDownloading, UpdateStatusInstalling:
+			pendingCount++
+		}
+	}
+	r.count("GetDeploymentStats", len(keys))
+	return successCount, failureCount, pendingCount, nil
+}
+
+func (r *memoryRepository) GetDevicesPendingUpdate(ctx context.Context, deploymentID string, limit int) ([]*DeviceUpdate, error) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	updates := r.deploymentUpdates(deploymentID, func(update *DeviceUpdate) bool { return update.Status == UpdateStatusPending })
+	if limit > 0 && len(updates) > limit {
+		updates = updates[:limit]
+	}
+	r.count("GetDevicesPendingUpdate", len(updates))
+	return updates, nil
+}
@@ -0,0 +1,186 @@
+package ota
+
+import (
+	"context"
+	"errors"
+	"fmt"
+	"sync/atomic"
+	"testing"
+	"time"
+
+	"github.com/athena/platform-lib/internal/device"
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/mock"
+	"github.com/stretchr/testify/require"
+)
+
+// MockNotifier is a mock implementation of UpdateNotifier
+type MockNotifier struct {
+	mock.Mock
+}
+
+func (m *MockNotifier) NotifyUpdate(ctx context.Context, deviceID string, notice *UpdateNotice) error {
+	args := m.Called(ctx, deviceID, notice)
+	return args.Error(0)
+}
+
+func (m *MockNotifier) ClearNotice(ctx context.Context, deviceID string) error {
+	args := m.Called(ctx, deviceID)
+	return args.Error(0)
+}
+
+func TestService_DeployRelease_NotifiesSelectedDevices(t *testing.T) {
+	service, mockRepo, mockDeviceRepo, _ := setupDeploymentTestService()
+	notifier := new(MockNotifier)
+	service.SetNotifier(notifier)
+
+	release := createTestRelease("release-001")
+
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
+	mockDeviceRepo.On("ListDevices", mock.Anything, mock.AnythingOfType("*device.DeviceFilters")).Return([]*device.Device{
+		{DeviceID: "device-001"},
+		{DeviceID: "device-002"},
+		{DeviceID: "device-003"},
+		{DeviceID: "device-004"},
+	}, nil)
+	mockRepo.On("CreateDeployment", mock.Anything, mock.AnythingOfType("*ota.OTADeployment")).Return(nil)
+	mockRepo.On("CreateDeviceUpdate", mock.Anything, mock.AnythingOfType("*ota.DeviceUpdate")).Return(nil).Times(2)
+
+	// Only the staged half of the fleet is told; one notice failing doesn't stop the rollout
+	notifier.On("NotifyUpdate", mock.Anything, "device-001", mock.MatchedBy(func(notice *UpdateNotice) bool {
+		return notice.ReleaseID == "release-001" && notice.DeploymentID != ""
+	})).Return(errors.New("broker unavailable")).Once()
+	notifier.On("NotifyUpdate", mock.Anything, "device-002", mock.AnythingOfType("*ota.UpdateNotice")).Return(nil).Once()
+
+	deployment, err := service.DeployRelease(context.Background(), "release-001", &DeploymentConfig{
+		Strategy:          DeploymentStrategyStaged,
+		RolloutPercentage: 50,
+	})
+
+	require.NoError(t, err)
+	require.NotNil(t, deployment)
+
+	service.notices.Wait()
+	mockRepo.AssertExpectations(t)
+	notifier.AssertExpectations(t)
+	notifier.AssertNotCalled(t, "NotifyUpdate", mock.Anything, "device-003", mock.Anything)
+}
+
+// blockingNotifier holds every notice until it is released, failing it if fail is set
+type blockingNotifier struct {
+	release chan struct{}
+	fail    bool
+	calls   atomic.Int32
+}
+
+func (n *blockingNotifier) NotifyUpdate(ctx context.Context, deviceID string, notice *UpdateNotice) error {
+	n.calls.Add(1)
+	<-n.release
+	if n.fail {
+		return errors.New("timed out publishing")
+	}
+	return nil
+}
+
+func (n *blockingNotifier) ClearNotice(ctx context.Context, deviceID string) error {
+	return nil
+}
+
+func deployToFleet(t *testing.T, service *Service, mockRepo *MockRepository, devices int) {
+	targets := make([]string, devices)
+	for i := range targets {
+		targets[i] = fmt.Sprintf("device-%05d", i)
+	}
+
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(createTestRelease("release-001"), nil)
+	mockRepo.On("CreateDeployment", mock.Anything, mock.AnythingOfType("*ota.OTADeployment")).Return(nil)
+	mockRepo.On("CreateDeviceUpdate", mock.Anything, mock.AnythingOfType("*ota.DeviceUpdate")).Return(nil)
+	mockRepo.On("UpdateDeployment", mock.Anything, mock.AnythingOfType("*ota.OTADeployment")).Return(nil)
+
+	_, err := service.DeployRelease(context.Background(), "release-001", &DeploymentConfig{
+		Strategy:      DeploymentStrategyImmediate,
+		TargetDevices: targets,
+	})
+	require.NoError(t, err)
+}
+
+func TestService_DeployRelease_DoesNotWaitForNotices(t *testing.T) {
+	service, mockRepo, _, _ := setupDeploymentTestService()
+	notifier := &blockingNotifier{release: make(chan struct{})}
+	service.SetNotifier(notifier)
+
+	// Returns while every worker is still waiting on the broker
+	deployToFleet(t, service, mockRepo, 200)
+	mockRepo.AssertNumberOfCalls(t, "CreateDeviceUpdate", 200)
+
+	close(notifier.release)
+	service.notices.Wait()
+	assert.Equal(t, int32(200), notifier.calls.Load())
+}
+
+func TestService_DeployRelease_StopsNoticesAfterRepeatedFailures(t *testing.T) {
+	service, mockRepo, _, _ := setupDeploymentTestService()
+	notifier := &blockingNotifier{release: make(chan struct{}), fail: true}
+	close(notifier.release)
+	service.SetNotifier(notifier)
+
+	deployToFleet(t, service, mockRepo, 1000)
+	service.notices.Wait()
+
+	// Workers that already took a notice finish it; the rest of the fleet is left to polling
+	calls := notifier.calls.Load()
+	assert.GreaterOrEqual(t, calls, int32(noticeFailureLimit))
+	assert.LessOrEqual(t, calls, int32(noticeFailureLimit+noticeWorkers))
+}
+
+func TestService_ReportUpdateStatus_ClearsNoticeWhenFinished(t *testing.T) {
+	service, mockRepo, _, _ := setupDeploymentTestService()
+	notifier := new(MockNotifier)
+	service.SetNotifier(notifier)
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusPending,
+		StartedAt:    time.Now(),
+	}
+	deployment := &OTADeployment{
+		DeploymentID:     "deployment-001",
+		ReleaseID:        "release-001",
+		Status:           DeploymentStatusActive,
+		FailureThreshold: 10,
+	}
+
+	mockRepo.On("GetDeviceUpdate", mock.Anything, "device-001", "release-001").Return(deviceUpdate, nil)
+	mockRepo.On("UpdateDeviceUpdate", mock.Anything, mock.AnythingOfType("*ota.DeviceUpdate")).Return(nil)
+	mockRepo.On("GetDeployment", mock.Anything, "deployment-001").Return(deployment, nil)
+	mockRepo.On("GetDeploymentStats", mock.Anything, "deployment-001").Return(1, 0, 0, nil)
+	mockRepo.On("UpdateDeployment", mock.Anything, mock.AnythingOfType("*ota.OTADeployment")).Return(nil)
+
+	// Progress reports keep the notice
+	err := service.ReportUpdateStatus(context.Background(), &UpdateStatusReport{
+		DeviceID:  "device-001",
+		ReleaseID: "release-001",
+		Status:    UpdateStatusDownloading,
+		Progress:  50,
+	})
+	require.NoError(t, err)
+	notifier.AssertNotCalled(t, "ClearNotice", mock.Anything, mock.Anything)
+
+	notifier.On("ClearNotice", mock.Anything, "device-001").Return(nil).Once()
+
+	err = service.ReportUpdateStatus(context.Background(), &UpdateStatusReport{
+		DeviceID:  "device-001",
+		ReleaseID: "release-001",
+		Status:    UpdateStatusCompleted,
+		Progress:  100,
+	})
+	require.NoError(t, err)
+
+	notifier.AssertExpectations(t)
+}
+
+func TestUpdateNoticeTopic(t *testing.T) {
+	assert.Equal(t, "ota/device-001/update", UpdateNoticeTopic("device-001"))
+}
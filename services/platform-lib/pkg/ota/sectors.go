@@ -0,0 +1,168 @@
+package ota
+
+import (
+	"crypto/sha256"
+	"encoding/base64"
+	"encoding/binary"
+	"fmt"
+)
+
+// Sector manifest format (all integers little-endian):
+//
+//	header: "ATSM" | version (1 byte) | reserved (3 bytes) | sector size (uint32) | image size (uint32)
+//	hashes: SHA-256 of each sector of the image in order; the last one covers what is left
+//	signature: the rest of the manifest, the release signer's signature of everything before it
+//
+// A device compares the hashes with the same sectors of its running partition, copies the
+// ones that match from flash and downloads only the rest with Range requests. It also checks
+// each downloaded sector against its hash before writing it, so a corrupt range is fetched
+// again instead of failing the whole image. The signature lets it trust the hashes before
+// the signed image hash can be checked at the end.
+const (
+	sectorManifestMagic      = "ATSM"
+	sectorManifestVersion    = 2
+	sectorManifestHeaderSize = 16
+
+	// Longest signature a device accepts after the hashes; RSA-4096 needs 512 bytes
+	maxManifestSignatureSize = 512
+
+	// Sector sizes a device may ask for: flash erase sizes, from small NOR parts to 64 KB blocks
+	minManifestSectorSize = 512
+	maxManifestSectorSize = 64 * 1024
+)
+
+// SectorManifest lists the hash of every sector of a firmware image
+type SectorManifest struct {
+	SectorSize int
+	ImageSize  int
+	Hashes     [][sha256.Size]byte
+	// Signature covers the manifest up to the end of the hashes; empty if it isn't signed
+	Signature []byte
+}
+
+// IsValidSectorSize reports whether a manifest can be built at the given sector size
+func IsValidSectorSize(sectorSize int) bool {
+	return sectorSize >= minManifestSectorSize && sectorSize <= maxManifestSectorSize &&
+		sectorSize&(sectorSize-1) == 0
+}
+
+// GenerateSectorManifest hashes image in sectorSize pieces. The result is unsigned; see
+// SignSectorManifest.
+func GenerateSectorManifest(image []byte, sectorSize int) ([]byte, error) {
+	if !IsValidSectorSize(sectorSize) {
+		return nil, fmt.Errorf("invalid sector size: %d", sectorSize)
+	}
+	if uint64(len(image)) > uint64(^uint32(0)) {
+		return nil, fmt.Errorf("image too large for a sector manifest")
+	}
+
+	sectors := (len(image) + sectorSize - 1) / sectorSize
+	manifest := make([]byte, sectorManifestHeaderSize, sectorManifestHeaderSize+sectors*sha256.Size)
+	copy(manifest, sectorManifestMagic)
+	manifest[4] = sectorManifestVersion
+	binary.LittleEndian.PutUint32(manifest[8:], uint32(sectorSize))
+	binary.LittleEndian.PutUint32(manifest[12:], uint32(len(image)))
+
+	for offset := 0; offset < len(image); offset += sectorSize {
+		end := offset + sectorSize
+		if end > len(image) {
+			end = len(image)
+		}
+		hash := sha256.Sum256(image[offset:end])
+		manifest = append(manifest, hash[:]...)
+	}
+
+	return manifest, nil
+}
+
+// SignSectorManifest appends signer's signature of an unsigned manifest to it
+func SignSectorManifest(manifest []byte, signer *Signer) ([]byte, error) {
+	if signer == nil {
+		return nil, fmt.Errorf("signer not configured")
+	}
+
+	signatureBase64, err := signer.SignBinary(manifest)
+	if err != nil {
+		return nil, fmt.Errorf("failed to sign sector manifest: %w", err)
+	}
+
+	signature, err := base64.StdEncoding.DecodeString(signatureBase64)
+	if err != nil {
+		return nil, fmt.Errorf("failed to decode sector manifest signature: %w", err)
+	}
+
+	signed := make([]byte, 0, len(manifest)+len(signature))
+	signed = append(signed, manifest...)
+	return append(signed, signature...), nil
+}
+
+// ParseSectorManifest decodes a manifest produced by GenerateSectorManifest
+func ParseSectorManifest(manifest []byte) (*SectorManifest, error) {
+	if len(manifest) < sectorManifestHeaderSize || string(manifest[:4]) != sectorManifestMagic {
+		return nil, fmt.Errorf("invalid sector manifest header")
+	}
+
+	if manifest[4] != sectorManifestVersion {
+		return nil, fmt.Errorf("unsupported sector manifest version: %d", manifest[4])
+	}
+
+	sectorSize := int(binary.LittleEndian.Uint32(manifest[8:]))
+	imageSize := int(binary.LittleEndian.Uint32(manifest[12:]))
+	if !IsValidSectorSize(sectorSize) {
+		return nil, fmt.Errorf("invalid sector size: %d", sectorSize)
+	}
+
+	sectors := (imageSize + sectorSize - 1) / sectorSize
+	hashes := manifest[sectorManifestHeaderSize:]
+	if len(hashes) < sectors*sha256.Size {
+		return nil, fmt.Errorf("sector manifest has %d bytes of hashes, expected %d", len(hashes), sectors*sha256.Size)
+	}
+
+	signature := hashes[sectors*sha256.Size:]
+	if len(signature) > maxManifestSignatureSize {
+		return nil, fmt.Errorf("sector manifest signature too long: %d bytes", len(signature))
+	}
+
+	parsed := &SectorManifest{
+		SectorSize: sectorSize,
+		ImageSize:  imageSize,
+		Hashes:     make([][sha256.Size]byte, sectors),
+	}
+	if len(signature) > 0 {
+		parsed.Signature = append([]byte{}, signature...)
+	}
+	for i := range parsed.Hashes {
+		copy(parsed.Hashes[i][:], hashes[i*sha256.Size:])
+	}
+
+	return parsed, nil
+}
+
+// VerifySignature checks the manifest's signature with signer; manifest must be the
+// encoded form m was parsed from
+func (m *SectorManifest) VerifySignature(manifest []byte, signer *Signer) error {
+	if len(m.Signature) == 0 {
+		return fmt.Errorf("sector manifest is not signed")
+	}
+
+	signed := manifest[:len(manifest)-len(m.Signature)]
+	return signer.VerifySignature(signed, base64.StdEncoding.EncodeToString(m.Signature))
+}
+
+// ChangedSectors returns the indexes of the sectors whose content differs from the same
+// sectors of base, the way a device running base decides what to download
+func (m *SectorManifest) ChangedSectors(base []byte) []int {
+	var changed []int
+	for i, hash := range m.Hashes {
+		offset := i * m.SectorSize
+		end := offset + m.SectorSize
+		if end > m.ImageSize {
+			end = m.ImageSize
+		}
+		if end > len(base) || sha256.Sum256(base[offset:end]) != hash {
+			changed = append(changed, i)
+		}
+	}
+
+	return changed
+}
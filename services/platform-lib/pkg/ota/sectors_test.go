@@ -0,0 +1,182 @@
+package ota
+
+import (
+	"context"
+	"encoding/base64"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/mock"
+	"github.com/stretchr/testify/require"
+)
+
+func TestSectorManifest_RoundTrip(t *testing.T) {
+	// A partial last sector is hashed as far as the image goes
+	image := createTestImage(10*4096+100, 1)
+
+	manifest, err := GenerateSectorManifest(image, 4096)
+	require.NoError(t, err)
+	assert.Len(t, manifest, sectorManifestHeaderSize+11*32)
+
+	parsed, err := ParseSectorManifest(manifest)
+	require.NoError(t, err)
+	assert.Equal(t, 4096, parsed.SectorSize)
+	assert.Equal(t, len(image), parsed.ImageSize)
+	assert.Len(t, parsed.Hashes, 11)
+	assert.Empty(t, parsed.ChangedSectors(image))
+}
+
+func TestSectorManifest_ChangedSectors(t *testing.T) {
+	base := createTestImage(16*4096, 2)
+	target := append([]byte{}, base...)
+	target[5*4096+17] ^= 0xFF
+	copy(target[9*4096-4:], []byte("spans two sectors"))
+
+	manifest, err := GenerateSectorManifest(target, 4096)
+	require.NoError(t, err)
+	parsed, err := ParseSectorManifest(manifest)
+	require.NoError(t, err)
+
+	assert.Equal(t, []int{5, 8, 9}, parsed.ChangedSectors(base))
+
+	// Sectors past the end of a shorter running image can't be reused
+	assert.Equal(t, []int{5, 8, 9, 12, 13, 14, 15}, parsed.ChangedSectors(base[:12*4096+10]))
+}
+
+func TestSectorManifest_InvalidInput(t *testing.T) {
+	image := createTestImage(8192, 3)
+
+	for _, sectorSize := range []int{0, 256, 3000, 128 * 1024} {
+		_, err := GenerateSectorManifest(image, sectorSize)
+		assert.Error(t, err, "sector size %d", sectorSize)
+	}
+
+	manifest, err := GenerateSectorManifest(image, 4096)
+	require.NoError(t, err)
+
+	// Wrong magic
+	bad := append([]byte{}, manifest...)
+	bad[0] = 'X'
+	_, err = ParseSectorManifest(bad)
+	assert.Error(t, err)
+
+	// Unsupported version
+	bad = append([]byte{}, manifest...)
+	bad[4] = 99
+	_, err = ParseSectorManifest(bad)
+	assert.Error(t, err)
+
+	// Missing hashes
+	_, err = ParseSectorManifest(manifest[:len(manifest)-1])
+	assert.Error(t, err)
+
+	// More trailing bytes than any signature
+	_, err = ParseSectorManifest(append(append([]byte{}, manifest...), make([]byte, 513)...))
+	assert.Error(t, err)
+}
+
+func TestSectorManifest_Signature(t *testing.T) {
+	image := createTestImage(5*4096, 5)
+	manifest, err := GenerateSectorManifest(image, 4096)
+	require.NoError(t, err)
+
+	// Unsigned manifests parse, but have nothing to verify
+	parsed, err := ParseSectorManifest(manifest)
+	require.NoError(t, err)
+	assert.Empty(t, parsed.Signature)
+
+	for _, generate := range []func() ([]byte, []byte, error){
+		func() ([]byte, []byte, error) { return GenerateKeyPair(2048) },
+		GenerateECDSAKeyPair,
+	} {
+		privateKeyPEM, publicKeyPEM, err := generate()
+		require.NoError(t, err)
+		signer, err := NewSigner(privateKeyPEM, publicKeyPEM)
+		require.NoError(t, err)
+
+		assert.Error(t, parsed.VerifySignature(manifest, signer))
+
+		signed, err := SignSectorManifest(manifest, signer)
+		require.NoError(t, err)
+		assert.Equal(t, manifest, signed[:len(manifest)])
+
+		// The device hashes everything before the signature, the way SignBinary does
+		signedParsed, err := ParseSectorManifest(signed)
+		require.NoError(t, err)
+		assert.Equal(t, parsed.Hashes, signedParsed.Hashes)
+		assert.Len(t, signedParsed.Signature, len(signed)-len(manifest))
+		assert.NoError(t, signer.VerifySignature(manifest, base64.StdEncoding.EncodeToString(signedParsed.Signature)))
+		assert.NoError(t, signedParsed.VerifySignature(signed, signer))
+
+		// A changed hash no longer matches the signature
+		tampered := append([]byte{}, signed...)
+		tampered[sectorManifestHeaderSize+40] ^= 0x01
+		tamperedParsed, err := ParseSectorManifest(tampered)
+		require.NoError(t, err)
+		assert.Error(t, tamperedParsed.VerifySignature(tampered, signer))
+	}
+
+	_, err = SignSectorManifest(manifest, nil)
+	assert.Error(t, err)
+}
+
+// Test that a signed sector manifest is generated, cached and offered to a device that reports
+// its sector size, and left out when a delta applies
+func TestService_GetUpdateForDevice_SectorManifest(t *testing.T) {
+	service, mockRepo, _, _ := setupTestService()
+
+	backend, err := NewLocalStorageBackendWithBaseURL(t.TempDir(), "http://localhost:8006")
+	require.NoError(t, err)
+	service.storageBackend = backend
+
+	baseData := createTestImage(128*1024, 4)
+	targetData := append([]byte{}, baseData...)
+	copy(targetData[4096:], []byte("updated firmware build"))
+
+	baseRelease := createTestRelease("release-000")
+	baseRelease.BinaryPath, err = backend.StoreBinary(context.Background(), "release-000", baseData)
+	require.NoError(t, err)
+
+	release := createTestRelease("release-001")
+	release.BinarySize = int64(len(targetData))
+	release.BinaryPath, err = backend.StoreBinary(context.Background(), "release-001", targetData)
+	require.NoError(t, err)
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusPending,
+	}
+
+	mockRepo.On("GetLatestUpdateForDevice", mock.Anything, "device-001").Return(deviceUpdate, nil)
+	mockRepo.On("GetRelease", mock.Anything, "release-001").Return(release, nil)
+	mockRepo.On("GetRelease", mock.Anything, "release-000").Return(baseRelease, nil).Once()
+
+	update, err := service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{SectorSize: 4096})
+	require.NoError(t, err)
+	assert.Equal(t, "http://localhost:8006"+BinaryRoutePrefix+"release-001/sectors-4096.v2.bin", update.SectorManifestURL)
+
+	// The test signer's RSA-2048 signature follows the hashes
+	assert.Equal(t, int64(sectorManifestHeaderSize+32*32+256), update.SectorManifestSize)
+
+	_, manifest, err := backend.GetArtifact(context.Background(), "release-001", "sectors-4096.v2.bin")
+	require.NoError(t, err)
+	parsed, err := ParseSectorManifest(manifest)
+	require.NoError(t, err)
+	assert.Equal(t, []int{1}, parsed.ChangedSectors(baseData))
+	assert.NoError(t, parsed.VerifySignature(manifest, service.signer))
+
+	// A device that can apply a delta gets that instead
+	update, err = service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{CurrentReleaseID: "release-000", SectorSize: 4096})
+	require.NoError(t, err)
+	assert.NotEmpty(t, update.DeltaURL)
+	assert.Empty(t, update.SectorManifestURL)
+
+	// Sizes the manifest can't be built at are ignored
+	update, err = service.GetUpdateForDevice(context.Background(), "device-001", UpdateCheckOptions{SectorSize: 1000})
+	require.NoError(t, err)
+	assert.Empty(t, update.SectorManifestURL)
+
+	mockRepo.AssertExpectations(t)
+}
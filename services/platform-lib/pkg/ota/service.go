@@ -1,10 +1,16 @@
 package ota
 
 import (
+	"bytes"
 	"context"
+	"encoding/json"
 	"fmt"
 	"io"
 	"net/http"
+	"path"
+	"strconv"
+	"strings"
+	"sync"
 	"time"
 
 	"github.com/athena/platform-lib/internal/device"
@@ -22,6 +28,20 @@ type Service struct {
 	deviceRepository device.Repository
 	signer           *Signer
 	storageBackend   StorageBackend
+
+	// Serializes artifact generation so concurrent polls don't build the same file twice
+	artifactMu sync.Mutex
+
+	// Retry-After hint for devices with nothing to install; zero uses the defaults
+	pollInterval time.Duration
+	pollJitter   time.Duration
+
+	// Optional push channel for new device updates, and the notices still being sent
+	notifier UpdateNotifier
+	notices  sync.WaitGroup
+
+	// Optional sink for the update statistics devices report
+	statsRecorder UpdateStatsRecorder
 }
 
 // StorageBackend defines the interface for binary storage
@@ -32,6 +52,23 @@ type StorageBackend interface {
 	DeleteBinary(ctx context.Context, path string) error
 }
 
+// RangeStorageBackend is implemented by storage backends that can open a stored binary
+// for seeking, so downloads can be served in byte ranges without loading the whole image
+type RangeStorageBackend interface {
+	OpenBinary(ctx context.Context, path string) (io.ReadSeekCloser, time.Time, error)
+}
+
+// ArtifactStorageBackend is implemented by storage backends that can keep additional
+// named files, such as delta patches, next to a release binary
+type ArtifactStorageBackend interface {
+	StoreArtifact(ctx context.Context, releaseID, name string, data []byte) (string, error)
+	GetArtifact(ctx context.Context, releaseID, name string) (string, []byte, error)
+	DeleteArtifacts(ctx context.Context, releaseID string) error
+}
+
+// BinaryRoutePrefix is the URL path under which the OTA service serves stored binaries
+const BinaryRoutePrefix = "/api/v1/ota/binaries/"
+
 // NewService creates a new OTA service instance
 func NewService(cfg *config.Config, logger *logger.Logger, repo Repository, deviceRepo device.Repository, signer *Signer, storage StorageBackend) (*Service, error) {
 	return &Service{
@@ -56,6 +93,10 @@ func (s *Service) CreateRelease(ctx context.Context, req *CreateReleaseRequest)
 		return nil, fmt.Errorf("invalid release channel: %s", req.Channel)
 	}
 
+	if err := validateComponents(req.Components); err != nil {
+		return nil, err
+	}
+
 	// Generate release ID
 	releaseID := uuid.New().String()
 
@@ -74,6 +115,12 @@ func (s *Service) CreateRelease(ctx context.Context, req *CreateReleaseRequest)
 		return nil, fmt.Errorf("failed to store binary: %w", err)
 	}
 
+	components, err := s.storeComponents(ctx, releaseID, req.Components)
+	if err != nil {
+		s.deleteReleaseFiles(ctx, releaseID, binaryPath)
+		return nil, err
+	}
+
 	// Create release object
 	release := &FirmwareRelease{
 		ReleaseID:    releaseID,
@@ -87,21 +134,30 @@ func (s *Service) CreateRelease(ctx context.Context, req *CreateReleaseRequest)
 		ReleaseNotes: req.ReleaseNotes,
 		CreatedAt:    time.Now(),
 		CreatedBy:    req.CreatedBy,
+		Components:   components,
 	}
 
 	// Store release metadata in repository
 	err = s.repository.CreateRelease(ctx, release)
 	if err != nil {
 		// Clean up binary if metadata storage fails
-		_ = s.storageBackend.DeleteBinary(ctx, binaryPath)
+		s.deleteReleaseFiles(ctx, releaseID, binaryPath)
 		return nil, fmt.Errorf("failed to create release: %w", err)
 	}
 
-	s.logger.Info("Created firmware release", "release_id", releaseID, "template_id", req.TemplateID, "version", req.Version)
+	s.logger.Info("Created firmware release", "release_id", releaseID, "template_id", req.TemplateID, "version", req.Version, "components", len(components))
 
 	return release, nil
 }
 
+// deleteReleaseFiles removes what was stored for a release that could not be created
+func (s *Service) deleteReleaseFiles(ctx context.Context, releaseID, binaryPath string) {
+	_ = s.storageBackend.DeleteBinary(ctx, binaryPath)
+	if artifactBackend, ok := s.storageBackend.(ArtifactStorageBackend); ok {
+		_ = artifactBackend.DeleteArtifacts(ctx, releaseID)
+	}
+}
+
 // GetRelease retrieves a firmware release by ID
 func (s *Service) GetRelease(ctx context.Context, releaseID string) (*FirmwareRelease, error) {
 	return s.repository.GetRelease(ctx, releaseID)
@@ -126,6 +182,14 @@ func (s *Service) DeleteRelease(ctx context.Context, releaseID string) error {
 		s.logger.Warn("Failed to delete binary from storage", "error", err)
 	}
 
+	// Delete the components, delta patches and other files stored for this release
+	if artifactBackend, ok := s.storageBackend.(ArtifactStorageBackend); ok {
+		err = artifactBackend.DeleteArtifacts(ctx, releaseID)
+		if err != nil {
+			s.logger.Warn("Failed to delete release artifacts from storage", "error", err)
+		}
+	}
+
 	// Delete release metadata
 	err = s.repository.DeleteRelease(ctx, releaseID)
 	if err != nil {
@@ -163,7 +227,7 @@ func (s *Service) VerifyRelease(ctx context.Context, releaseID string) error {
 		return fmt.Errorf("signature verification failed: %w", err)
 	}
 
-	return nil
+	return s.verifyComponents(ctx, release)
 }
 
 // RegisterRoutes registers HTTP routes for the OTA service
@@ -179,6 +243,9 @@ func RegisterRoutes(router *gin.Engine, service *Service) {
 		v1.DELETE("/releases/:releaseId", service.deleteReleaseHandler)
 		v1.POST("/releases/:releaseId/verify", service.verifyReleaseHandler)
 
+		// Binary download (supports Range requests for resumable downloads)
+		v1.GET("/binaries/*path", service.downloadBinaryHandler)
+
 		// Deployment management
 		v1.POST("/deployments", service.createDeploymentHandler)
 		v1.GET("/deployments/:deploymentId", service.getDeploymentHandler)
@@ -189,6 +256,7 @@ func RegisterRoutes(router *gin.Engine, service *Service) {
 		// Device update endpoints
 		v1.GET("/updates/:deviceId", service.getUpdateForDeviceHandler)
 		v1.POST("/updates/status", service.reportUpdateStatusHandler)
+		v1.POST("/updates/status/batch", service.reportUpdateStatusBatchHandler)
 	}
 }
 
@@ -233,6 +301,22 @@ func (s *Service) createReleaseHandler(c *gin.Context) {
 
 	req.BinaryData = binaryData
 
+	// Components are described by a JSON list, with each image in a component_<name> file
+	if list := c.PostForm("components"); list != "" {
+		if err := json.Unmarshal([]byte(list), &req.Components); err != nil {
+			c.JSON(http.StatusBadRequest, gin.H{"error": "invalid components list"})
+			return
+		}
+		for i := range req.Components {
+			data, err := readFormFile(c, "component_"+req.Components[i].Name)
+			if err != nil {
+				c.JSON(http.StatusBadRequest, gin.H{"error": fmt.Sprintf("component %s: %v", req.Components[i].Name, err)})
+				return
+			}
+			req.Components[i].Data = data
+		}
+	}
+
 	// Create release
 	release, err := s.CreateRelease(c.Request.Context(), &req)
 	if err != nil {
@@ -244,6 +328,17 @@ func (s *Service) createReleaseHandler(c *gin.Context) {
 	c.JSON(http.StatusCreated, release)
 }
 
+// readFormFile reads a file uploaded in a multipart form
+func readFormFile(c *gin.Context, field string) ([]byte, error) {
+	file, _, err := c.Request.FormFile(field)
+	if err != nil {
+		return nil, fmt.Errorf("file %s is required", field)
+	}
+	defer file.Close()
+
+	return io.ReadAll(file)
+}
+
 func (s *Service) getReleaseHandler(c *gin.Context) {
 	releaseID := c.Param("releaseId")
 
@@ -293,6 +388,49 @@ func (s *Service) verifyReleaseHandler(c *gin.Context) {
 	c.JSON(http.StatusOK, gin.H{"verified": true, "message": "release signature verified successfully"})
 }
 
+func (s *Service) downloadBinaryHandler(c *gin.Context) {
+	// Backends join the path onto their storage root, so it is checked once here for every backend
+	requested := c.Param("path")
+	for _, segment := range strings.Split(requested, "/") {
+		if segment == ".." {
+			c.JSON(http.StatusBadRequest, gin.H{"error": "invalid binary path"})
+			return
+		}
+	}
+	binaryPath := strings.TrimPrefix(path.Clean("/"+requested), "/")
+	if binaryPath == "" {
+		c.JSON(http.StatusBadRequest, gin.H{"error": "binary path is required"})
+		return
+	}
+
+	var content io.ReadSeeker
+	var modTime time.Time
+
+	if rangeBackend, ok := s.storageBackend.(RangeStorageBackend); ok {
+		file, fileModTime, err := rangeBackend.OpenBinary(c.Request.Context(), binaryPath)
+		if err != nil {
+			c.JSON(http.StatusNotFound, gin.H{"error": err.Error()})
+			return
+		}
+		defer file.Close()
+
+		content = file
+		modTime = fileModTime
+	} else {
+		data, err := s.storageBackend.GetBinary(c.Request.Context(), binaryPath)
+		if err != nil {
+			c.JSON(http.StatusNotFound, gin.H{"error": err.Error()})
+			return
+		}
+
+		content = bytes.NewReader(data)
+	}
+
+	// ServeContent handles Range, If-Range and 206/416 responses
+	c.Header("Content-Type", "application/octet-stream")
+	http.ServeContent(c.Writer, c.Request, path.Base(binaryPath), modTime, content)
+}
+
 // Deployment handlers
 func (s *Service) createDeploymentHandler(c *gin.Context) {
 	var req struct {
@@ -378,8 +516,41 @@ func (s *Service) rollbackDeploymentHandler(c *gin.Context) {
 
 func (s *Service) getUpdateForDeviceHandler(c *gin.Context) {
 	deviceID := c.Param("deviceId")
+	opts := UpdateCheckOptions{
+		CurrentReleaseID: c.Query("current_release"),
+		Compression:      c.Query("compression"),
+	}
+	if sectorSize, err := strconv.Atoi(c.Query("sector_size")); err == nil {
+		opts.SectorSize = sectorSize
+	}
 
-	update, err := s.GetUpdateForDevice(c.Request.Context(), deviceID)
+	deviceUpdate, err := s.repository.GetLatestUpdateForDevice(c.Request.Context(), deviceID)
+	if err != nil {
+		err = fmt.Errorf("no pending update for device: %w", err)
+		deviceUpdate = nil
+	} else if !isUpdateOffered(deviceUpdate) {
+		err = fmt.Errorf("no pending update for device")
+		deviceUpdate = nil
+	}
+
+	// Devices send the tag back so an unchanged "no update" answer costs a 304 and no lookups
+	etag := updateETag(deviceUpdate, opts)
+	c.Header("ETag", etag)
+	if deviceUpdate == nil {
+		c.Header("Retry-After", retryAfterValue(s.pollDelay(deviceID)))
+	}
+
+	if etagMatches(c.GetHeader("If-None-Match"), etag) {
+		c.Status(http.StatusNotModified)
+		return
+	}
+
+	if deviceUpdate == nil {
+		c.JSON(http.StatusNotFound, gin.H{"error": err.Error()})
+		return
+	}
+
+	update, err := s.buildFirmwareUpdate(c.Request.Context(), deviceID, deviceUpdate, opts)
 	if err != nil {
 		c.JSON(http.StatusNotFound, gin.H{"error": err.Error()})
 		return
@@ -405,3 +576,20 @@ func (s *Service) reportUpdateStatusHandler(c *gin.Context) {
 
 	c.JSON(http.StatusOK, gin.H{"message": "update status reported successfully"})
 }
+
+func (s *Service) reportUpdateStatusBatchHandler(c *gin.Context) {
+	var batch BatchStatusReport
+
+	if err := c.ShouldBindJSON(&batch); err != nil {
+		c.JSON(http.StatusBadRequest, gin.H{"error": err.Error()})
+		return
+	}
+
+	if len(batch.Reports) == 0 || len(batch.Reports) > MaxBatchStatusReports {
+		c.JSON(http.StatusBadRequest, gin.H{"error": fmt.Sprintf("batch must contain 1 to %d reports", MaxBatchStatusReports)})
+		return
+	}
+
+	// Each report stands alone; one the device can't fix by resending doesn't fail the rest
+	c.JSON(http.StatusOK, s.ReportUpdateStatusBatch(c.Request.Context(), batch.Reports))
+}
@@ -1,6 +1,11 @@
 package ota
 
 import (
+	"crypto/ecdsa"
+	"crypto/elliptic"
+	"crypto/rand"
+	"crypto/x509"
+	"encoding/pem"
 	"testing"
 
 	"github.com/stretchr/testify/assert"
@@ -237,3 +242,71 @@ func TestSigner_SignBinary_EmptyData(t *testing.T) {
 	err = signer.VerifySignature(emptyData, signature)
 	assert.NoError(t, err)
 }
+
+// Test ECDSA P-256 signing and verification
+func TestSigner_ECDSA_SignAndVerify(t *testing.T) {
+	privateKeyPEM, publicKeyPEM, err := GenerateECDSAKeyPair()
+	require.NoError(t, err)
+	assert.Contains(t, string(privateKeyPEM), "EC PRIVATE KEY")
+	assert.Contains(t, string(publicKeyPEM), "PUBLIC KEY")
+
+	signer, err := NewSigner(privateKeyPEM, publicKeyPEM)
+	require.NoError(t, err)
+	assert.Equal(t, SigningAlgorithmECDSAP256, signer.Algorithm())
+
+	binaryData := []byte("test firmware binary data for ECDSA signing")
+	signature, err := signer.SignBinary(binaryData)
+	require.NoError(t, err)
+	assert.NotEmpty(t, signature)
+
+	assert.NoError(t, signer.VerifySignature(binaryData, signature))
+
+	err = signer.VerifySignature([]byte("tampered firmware binary data"), signature)
+	assert.Error(t, err)
+	assert.Contains(t, err.Error(), "signature verification failed")
+}
+
+// Test that the algorithm follows the key type
+func TestSigner_Algorithm(t *testing.T) {
+	privateKeyPEM, publicKeyPEM, err := GenerateKeyPair(2048)
+	require.NoError(t, err)
+
+	signer, err := NewSigner(privateKeyPEM, publicKeyPEM)
+	require.NoError(t, err)
+	assert.Equal(t, SigningAlgorithmRSAPSS, signer.Algorithm())
+}
+
+// Test signer creation with keys of different algorithms
+func TestNewSigner_MismatchedKeyTypes(t *testing.T) {
+	rsaPrivatePEM, rsaPublicPEM, err := GenerateKeyPair(2048)
+	require.NoError(t, err)
+	ecPrivatePEM, ecPublicPEM, err := GenerateECDSAKeyPair()
+	require.NoError(t, err)
+
+	signer, err := NewSigner(rsaPrivatePEM, ecPublicPEM)
+	assert.Error(t, err)
+	assert.Nil(t, signer)
+
+	signer, err = NewSigner(ecPrivatePEM, rsaPublicPEM)
+	assert.Error(t, err)
+	assert.Nil(t, signer)
+}
+
+// Test that ECDSA keys on other curves are rejected
+func TestNewSigner_UnsupportedCurve(t *testing.T) {
+	privateKey, err := ecdsa.GenerateKey(elliptic.P384(), rand.Reader)
+	require.NoError(t, err)
+
+	privateKeyBytes, err := x509.MarshalECPrivateKey(privateKey)
+	require.NoError(t, err)
+	publicKeyBytes, err := x509.MarshalPKIXPublicKey(&privateKey.PublicKey)
+	require.NoError(t, err)
+
+	signer, err := NewSigner(
+		pem.EncodeToMemory(&pem.Block{Type: "EC PRIVATE KEY", Bytes: privateKeyBytes}),
+		pem.EncodeToMemory(&pem.Block{Type: "PUBLIC KEY", Bytes: publicKeyBytes}),
+	)
+	assert.Error(t, err)
+	assert.Nil(t, signer)
+	assert.Contains(t, err.Error(), "P-256")
+}
@@ -0,0 +1,65 @@
+package ota
+
+import (
+	"time"
+)
+
+// UpdateStatsRecorder receives the statistics devices send with their final status
+// report, for example to build fleet-wide latency histograms
+type UpdateStatsRecorder interface {
+	// RecordOTAUpdatePhase records the time one phase of an update took
+	RecordOTAUpdatePhase(phase, status string, duration time.Duration)
+	// RecordOTAUpdateTransfer records the download figures of an update
+	RecordOTAUpdateTransfer(status string, bytes, throughputBps int64, retries int, minFreeHeap int64)
+}
+
+// Update phases reported to the stats recorder
+const (
+	UpdatePhaseDNS       = "dns"
+	UpdatePhaseTLS       = "tls"
+	UpdatePhaseFirstByte = "first_byte"
+	UpdatePhaseDownload  = "download"
+	UpdatePhaseHash      = "hash"
+	UpdatePhaseVerify    = "verify"
+	UpdatePhaseFlash     = "flash_write"
+	UpdatePhaseFinalize  = "finalize"
+	UpdatePhaseTotal     = "total"
+)
+
+// SetStatsRecorder enables recording of the update statistics devices report
+func (s *Service) SetStatsRecorder(recorder UpdateStatsRecorder) {
+	s.statsRecorder = recorder
+}
+
+// recordUpdateStats passes the statistics of a finished update to the recorder, if one is
+// configured and the device sent any
+func (s *Service) recordUpdateStats(report *UpdateStatusReport) {
+	if s.statsRecorder == nil || report.Stats == nil {
+		return
+	}
+
+	stats := report.Stats
+	status := string(report.Status)
+	phases := []struct {
+		name string
+		ms   int64
+	}{
+		{UpdatePhaseDNS, stats.DNSMs},
+		{UpdatePhaseTLS, stats.TLSMs},
+		{UpdatePhaseFirstByte, stats.FirstByteMs},
+		{UpdatePhaseDownload, stats.DownloadMs},
+		{UpdatePhaseHash, stats.HashMs},
+		{UpdatePhaseVerify, stats.VerifyMs},
+		{UpdatePhaseFlash, stats.FlashWriteMs},
+		{UpdatePhaseFinalize, stats.FinalizeMs},
+		{UpdatePhaseTotal, stats.TotalMs},
+	}
+	for _, phase := range phases {
+		// Negative values can only come from a broken client
+		if phase.ms >= 0 {
+			s.statsRecorder.RecordOTAUpdatePhase(phase.name, status, time.Duration(phase.ms)*time.Millisecond)
+		}
+	}
+
+	s.statsRecorder.RecordOTAUpdateTransfer(status, stats.BytesDownloaded, stats.ThroughputBps, stats.Retries, stats.MinFreeHeap)
+}
@@ -0,0 +1,91 @@
+package ota
+
+import (
+	"context"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/mock"
+	"github.com/stretchr/testify/require"
+)
+
+// MockStatsRecorder is a mock implementation of UpdateStatsRecorder
+type MockStatsRecorder struct {
+	mock.Mock
+}
+
+func (m *MockStatsRecorder) RecordOTAUpdatePhase(phase, status string, duration time.Duration) {
+	m.Called(phase, status, duration)
+}
+
+func (m *MockStatsRecorder) RecordOTAUpdateTransfer(status string, bytes, throughputBps int64, retries int, minFreeHeap int64) {
+	m.Called(status, bytes, throughputBps, retries, minFreeHeap)
+}
+
+func TestService_ReportUpdateStatus_RecordsStats(t *testing.T) {
+	service, mockRepo, _, _ := setupDeploymentTestService()
+	recorder := new(MockStatsRecorder)
+	service.SetStatsRecorder(recorder)
+
+	deviceUpdate := &DeviceUpdate{
+		DeviceID:     "device-001",
+		ReleaseID:    "release-001",
+		DeploymentID: "deployment-001",
+		Status:       UpdateStatusInstalling,
+		StartedAt:    time.Now(),
+	}
+	deployment := &OTADeployment{
+		DeploymentID:     "deployment-001",
+		ReleaseID:        "release-001",
+		Status:           DeploymentStatusActive,
+		FailureThreshold: 10,
+	}
+
+	mockRepo.On("GetDeviceUpdate", mock.Anything, "device-001", "release-001").Return(deviceUpdate, nil)
+	mockRepo.On("UpdateDeviceUpdate", mock.Anything, mock.AnythingOfType("*ota.DeviceUpdate")).Return(nil)
+	mockRepo.On("GetDeployment", mock.Anything, "deployment-001").Return(deployment, nil)
+	mockRepo.On("GetDeploymentStats", mock.Anything, "deployment-001").Return(1, 0, 0, nil)
+	mockRepo.On("UpdateDeployment", mock.Anything, mock.AnythingOfType("*ota.OTADeployment")).Return(nil)
+
+	// Reports without stats record nothing
+	err := service.ReportUpdateStatus(context.Background(), &UpdateStatusReport{
+		DeviceID:  "device-001",
+		ReleaseID: "release-001",
+		Status:    UpdateStatusInstalling,
+		Progress:  50,
+		Stats:     &UpdateStats{TotalMs: 1000},
+	})
+	require.NoError(t, err)
+	recorder.AssertNotCalled(t, "RecordOTAUpdatePhase", mock.Anything, mock.Anything, mock.Anything)
+
+	recorder.On("RecordOTAUpdatePhase", mock.AnythingOfType("string"), "completed", mock.AnythingOfType("time.Duration")).Return()
+	recorder.On("RecordOTAUpdateTransfer", "completed", int64(1048576), int64(52428), 2, int64(81920)).Return().Once()
+
+	err = service.ReportUpdateStatus(context.Background(), &UpdateStatusReport{
+		DeviceID:  "device-001",
+		ReleaseID: "release-001",
+		Status:    UpdateStatusCompleted,
+		Progress:  100,
+		Stats: &UpdateStats{
+			DNSMs:           40,
+			TLSMs:           900,
+			FirstByteMs:     120,
+			DownloadMs:      20000,
+			HashMs:          300,
+			VerifyMs:        150,
+			FlashWriteMs:    6000,
+			FinalizeMs:      800,
+			TotalMs:         22500,
+			BytesDownloaded: 1048576,
+			ThroughputBps:   52428,
+			MinFreeHeap:     81920,
+			Retries:         2,
+		},
+	})
+	require.NoError(t, err)
+
+	recorder.AssertExpectations(t)
+	recorder.AssertNumberOfCalls(t, "RecordOTAUpdatePhase", 9)
+	recorder.AssertCalled(t, "RecordOTAUpdatePhase", UpdatePhaseDownload, "completed", 20*time.Second)
+	recorder.AssertCalled(t, "RecordOTAUpdatePhase", UpdatePhaseTLS, "completed", 900*time.Millisecond)
+}
@@ -3,14 +3,17 @@ package ota
 import (
 	"context"
 	"fmt"
+	"io"
 	"os"
 	"path/filepath"
+	"strings"
 	"time"
 )
 
 // LocalStorageBackend implements StorageBackend using local filesystem
 type LocalStorageBackend struct {
 	basePath string
+	baseURL  string
 }
 
 // NewLocalStorageBackend creates a new local storage backend
@@ -26,6 +29,20 @@ func NewLocalStorageBackend(basePath string) (*LocalStorageBackend, error) {
 	}, nil
 }
 
+// NewLocalStorageBackendWithBaseURL creates a local storage backend whose binary URLs
+// point at the OTA service's binary download endpoint, so devices can fetch (and resume)
+// downloads over HTTP instead of receiving file:// paths
+func NewLocalStorageBackendWithBaseURL(basePath, baseURL string) (*LocalStorageBackend, error) {
+	backend, err := NewLocalStorageBackend(basePath)
+	if err != nil {
+		return nil, err
+	}
+
+	backend.baseURL = strings.TrimRight(baseURL, "/")
+
+	return backend, nil
+}
+
 // StoreBinary stores a binary file in the local filesystem
 func (s *LocalStorageBackend) StoreBinary(ctx context.Context, releaseID string, data []byte) (string, error) {
 	// Create release directory
@@ -68,10 +85,98 @@ func (s *LocalStorageBackend) GetBinaryURL(ctx context.Context, path string, exp
 		return "", fmt.Errorf("binary file not found: %w", err)
 	}
 
+	// Serve through the OTA service when it is reachable over HTTP
+	if s.baseURL != "" {
+		return s.baseURL + BinaryRoutePrefix + filepath.ToSlash(path), nil
+	}
+
 	// For local storage, return file:// URL
 	return "file://" + fullPath, nil
 }
 
+// OpenBinary opens a binary file for ranged reads
+func (s *LocalStorageBackend) OpenBinary(ctx context.Context, path string) (io.ReadSeekCloser, time.Time, error) {
+	// Clean against the root so the path cannot escape the storage directory
+	fullPath := filepath.Join(s.basePath, filepath.Clean("/"+path))
+
+	file, err := os.Open(fullPath)
+	if err != nil {
+		return nil, time.Time{}, fmt.Errorf("failed to open binary file: %w", err)
+	}
+
+	info, err := file.Stat()
+	if err != nil {
+		file.Close()
+		return nil, time.Time{}, fmt.Errorf("failed to stat binary file: %w", err)
+	}
+
+	if info.IsDir() {
+		file.Close()
+		return nil, time.Time{}, fmt.Errorf("binary file not found: %s", path)
+	}
+
+	return file, info.ModTime(), nil
+}
+
+// StoreArtifact stores an additional named file (such as a delta patch) next to a release binary
+func (s *LocalStorageBackend) StoreArtifact(ctx context.Context, releaseID, name string, data []byte) (string, error) {
+	if filepath.Base(name) != name {
+		return "", fmt.Errorf("invalid artifact name: %s", name)
+	}
+
+	releaseDir := filepath.Join(s.basePath, releaseID)
+	err := os.MkdirAll(releaseDir, 0755)
+	if err != nil {
+		return "", fmt.Errorf("failed to create release directory: %w", err)
+	}
+
+	// Write to a temporary file first so concurrent readers never see a partial artifact
+	artifactPath := filepath.Join(releaseDir, name)
+	tmpPath := artifactPath + ".tmp"
+	err = os.WriteFile(tmpPath, data, 0644)
+	if err != nil {
+		return "", fmt.Errorf("failed to write artifact file: %w", err)
+	}
+
+	err = os.Rename(tmpPath, artifactPath)
+	if err != nil {
+		_ = os.Remove(tmpPath)
+		return "", fmt.Errorf("failed to store artifact file: %w", err)
+	}
+
+	return filepath.Join(releaseID, name), nil
+}
+
+// GetArtifact retrieves a named artifact stored for a release and returns its path and contents
+func (s *LocalStorageBackend) GetArtifact(ctx context.Context, releaseID, name string) (string, []byte, error) {
+	if filepath.Base(name) != name {
+		return "", nil, fmt.Errorf("invalid artifact name: %s", name)
+	}
+
+	path := filepath.Join(releaseID, name)
+
+	data, err := os.ReadFile(filepath.Join(s.basePath, path))
+	if err != nil {
+		return "", nil, fmt.Errorf("failed to read artifact file: %w", err)
+	}
+
+	return path, data, nil
+}
+
+// DeleteArtifacts deletes every file stored for a release
+func (s *LocalStorageBackend) DeleteArtifacts(ctx context.Context, releaseID string) error {
+	if releaseID == "" || filepath.Base(releaseID) != releaseID {
+		return fmt.Errorf("invalid release ID: %s", releaseID)
+	}
+
+	err := os.RemoveAll(filepath.Join(s.basePath, releaseID))
+	if err != nil {
+		return fmt.Errorf("failed to delete release artifacts: %w", err)
+	}
+
+	return nil
+}
+
 // DeleteBinary deletes a binary file from the local filesystem
 func (s *LocalStorageBackend) DeleteBinary(ctx context.Context, path string) error {
 	fullPath := filepath.Join(s.basePath, path)
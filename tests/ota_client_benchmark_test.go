@@ -0,0 +1,241 @@
+package tests
+
+import (
+	"encoding/json"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"strings"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+	"github.com/stretchr/testify/require"
+)
+
+// otaClientDir is the Arduino OTA client library, built for the host with its extras/host shims
+const otaClientDir = "../services/platform-lib/internal/ota/arduino_client"
+
+// otaBenchScenario is one simulated link and client configuration
+type otaBenchScenario struct {
+	Name string
+	Args []string
+	// MinEfficiency is the lowest acceptable share of the link rate the download reaches
+	MinEfficiency float64
+	// MaxPeakHeap bounds the client's heap, in bytes (0 for no bound)
+	MaxPeakHeap int64
+	// ExpectRetries requires the client to have resumed after dropouts
+	ExpectRetries bool
+	// ExpectRejectedChunks requires a corrupt sector to have been fetched again on its own
+	ExpectRejectedChunks bool
+	// FromCache is the share of downloaded bytes expected from the LAN cache (0 for no check)
+	FromCache float64
+	// Components is the number of bundle components the update must install
+	Components int
+	// MaxThroughput bounds the download rate, in bytes per second (0 for no bound)
+	MaxThroughput int64
+}
+
+// otaBenchResult is the JSON line printed by the benchmark
+type otaBenchResult struct {
+	Scenario       string           `json:"scenario"`
+	Success        bool             `json:"success"`
+	Error          string           `json:"error"`
+	ImageBytes     int64            `json:"image_bytes"`
+	LinkBps        int64            `json:"link_bps"`
+	ElapsedMs      float64          `json:"elapsed_ms"`
+	ThroughputBps  int64            `json:"throughput_bps"`
+	LinkEfficiency float64          `json:"link_efficiency"`
+	PhasesMs       map[string]int64 `json:"phases_ms"`
+	BytesDown      int64            `json:"bytes_downloaded"`
+	BytesFromCache int64            `json:"bytes_from_cache"`
+	Components     int              `json:"components_installed"`
+	Retries        int              `json:"retries"`
+	ChunksRejected int              `json:"chunks_rejected"`
+	Requests       int              `json:"requests"`
+	Connections    int              `json:"connections"`
+	LostSegments   int              `json:"lost_segments"`
+	DroppedConns   int              `json:"dropped_connections"`
+	PeakHeapBytes  int64            `json:"peak_heap_bytes"`
+	JSONDocSize    int64            `json:"json_doc_size"`
+	ResponseDoc    int64            `json:"response_doc_bytes"`
+	FullBundleDoc  int64            `json:"full_bundle_doc_bytes"`
+	CPUMs          float64          `json:"cpu_ms"`
+	ClientCPUMs    float64          `json:"client_cpu_ms"`
+	SimCPUMs       float64          `json:"sim_cpu_ms"`
+}
+
+// Streaming keeps one flash sector and a few small buffers in heap, whatever the image size
+const otaStreamingHeapBound = 32 * 1024
+
+var otaBenchScenarios = []otaBenchScenario{
+	// 1 MB/s link, 20 ms latency: the 400 KB/s flash is the bottleneck
+	{Name: "baseline", Args: []string{}, MinEfficiency: 0.3, MaxPeakHeap: otaStreamingHeapBound},
+	{Name: "fast_link", Args: []string{"--bandwidth", "10000000", "--latency", "5", "--flash-rate", "100000000"},
+		MinEfficiency: 0.6, MaxPeakHeap: otaStreamingHeapBound},
+	{Name: "slow_link", Args: []string{"--size", "262144", "--bandwidth", "50000", "--latency", "150"},
+		MinEfficiency: 0.6, MaxPeakHeap: otaStreamingHeapBound},
+	{Name: "lossy", Args: []string{"--loss", "0.02"}, MinEfficiency: 0.15, MaxPeakHeap: otaStreamingHeapBound},
+	{Name: "dropouts", Args: []string{"--disconnect-every", "200000"}, MaxPeakHeap: otaStreamingHeapBound,
+		ExpectRetries: true},
+	{Name: "small_chunks", Args: []string{"--chunk", "512"}, MinEfficiency: 0.3, MaxPeakHeap: otaStreamingHeapBound},
+	{Name: "no_reuse", Args: []string{"--no-reuse"}, MinEfficiency: 0.3, MaxPeakHeap: otaStreamingHeapBound},
+	{Name: "ecdsa", Args: []string{"--key", "ecdsa"}, MinEfficiency: 0.3, MaxPeakHeap: otaStreamingHeapBound},
+	// A signed sector manifest lets the client drop a corrupt sector as it arrives
+	{Name: "corrupt_sector", Args: []string{"--manifest", "--corrupt-sector", "100"}, MaxPeakHeap: otaStreamingHeapBound,
+		ExpectRejectedChunks: true},
+	// Downloads go through a LAN cache; one that serves a wrong image is abandoned for the server
+	{Name: "local_cache", Args: []string{"--local-cache"}, MinEfficiency: 0.3, MaxPeakHeap: otaStreamingHeapBound,
+		FromCache: 1},
+	{Name: "bad_cache", Args: []string{"--bad-cache"}, MaxPeakHeap: otaStreamingHeapBound, FromCache: 0.5},
+	// A filesystem image and a config blob go to their partitions in the same session as the application
+	{Name: "bundle", Args: []string{"--bundle", "262144"}, MinEfficiency: 0.3, MaxPeakHeap: otaStreamingHeapBound,
+		Components: 2},
+	// A 100 KB/s rate limit leaves most of the link to application traffic, on one connection or several
+	{Name: "rate_limited", Args: []string{"--rate-limit", "100000"}, MinEfficiency: 0.09,
+		MaxPeakHeap: otaStreamingHeapBound, MaxThroughput: 105000},
+	{Name: "rate_limited_parallel", Args: []string{"--buffered", "--parallel", "4", "--rate-limit", "100000"},
+		MinEfficiency: 0.09, MaxThroughput: 105000},
+	// Buffered updates hold the whole image in heap, so only success is checked
+	{Name: "buffered", Args: []string{"--buffered", "--size", "262144"}},
+	// 100 ms round trips and a 4-segment receive window hold one connection to about a tenth of the link
+	{Name: "window_limited", Args: []string{"--buffered", "--size", "524288", "--bandwidth", "500000", "--latency", "50",
+		"--window", "5744"}, MinEfficiency: 0.05},
+	{Name: "window_limited_parallel", Args: []string{"--buffered", "--size", "524288", "--bandwidth", "500000",
+		"--latency", "50", "--window", "5744", "--parallel", "4"}, MinEfficiency: 0.2},
+	{Name: "parallel_dropouts", Args: []string{"--buffered", "--parallel", "4", "--disconnect-every", "100000"},
+		ExpectRetries: true},
+}
+
+// TestOTAClientHostBenchmark builds the OTA client for the host and runs it over simulated links
+func TestOTAClientHostBenchmark(t *testing.T) {
+	if testing.Short() {
+		t.Skip("Skipping OTA client benchmark in short mode")
+	}
+
+	binary := buildOTABenchmark(t)
+
+	var results []otaBenchResult
+	for _, scenario := range otaBenchScenarios {
+		scenario := scenario
+		t.Run(scenario.Name, func(t *testing.T) {
+			args := append([]string{"--name", scenario.Name}, scenario.Args...)
+			output, err := exec.Command(binary, args...).Output()
+
+			var result otaBenchResult
+			require.NoError(t, json.Unmarshal(output, &result), "Benchmark output should be JSON: %s", output)
+			results = append(results, result)
+			t.Logf("%s: %.0f ms, %d B/s (%.0f%% of link), %d requests, %d connections, peak heap %d B, client CPU %.1f ms",
+				result.Scenario, result.ElapsedMs, result.ThroughputBps, result.LinkEfficiency*100,
+				result.Requests, result.Connections, result.PeakHeapBytes, result.ClientCPUMs)
+
+			require.NoError(t, err, "Update should succeed: %s", result.Error)
+			assert.True(t, result.Success, "Update should succeed: %s", result.Error)
+			assert.GreaterOrEqual(t, result.LinkEfficiency, scenario.MinEfficiency,
+				"Download should use enough of the link")
+			if scenario.MaxPeakHeap > 0 {
+				assert.LessOrEqual(t, result.PeakHeapBytes, scenario.MaxPeakHeap,
+					"Streaming update heap should not grow with the image")
+			}
+			if scenario.MaxThroughput > 0 {
+				assert.LessOrEqual(t, result.ThroughputBps, scenario.MaxThroughput,
+					"Download should keep to the rate limit")
+			}
+			if scenario.ExpectRetries {
+				assert.Greater(t, result.Retries, 0, "Dropped downloads should be resumed")
+			}
+			if scenario.ExpectRejectedChunks {
+				assert.Greater(t, result.ChunksRejected, 0, "Corrupt sectors should be caught as they arrive")
+				assert.Less(t, result.BytesDown, result.ImageBytes+result.ImageBytes/50,
+					"Only the corrupt sector should be downloaded again")
+			}
+			if scenario.FromCache > 0 {
+				require.Greater(t, result.BytesDown, int64(0))
+				assert.InDelta(t, scenario.FromCache, float64(result.BytesFromCache)/float64(result.BytesDown), 0.01,
+					"Downloads should come from the LAN cache while it serves the right image")
+			}
+			assert.Equal(t, scenario.Components, result.Components, "Every bundle component should be installed")
+			// The client only parses the response it was served, so a fully loaded bundle is sized alongside it
+			assert.LessOrEqual(t, result.ResponseDoc, result.JSONDocSize,
+				"Update response should fit in OTA_JSON_DOC_SIZE")
+			assert.LessOrEqual(t, result.FullBundleDoc, result.JSONDocSize,
+				"A response with OTA_MAX_COMPONENTS components should fit in OTA_JSON_DOC_SIZE")
+		})
+	}
+
+	// Keep the numbers for comparing runs
+	if path := os.Getenv("OTA_BENCH_OUTPUT"); path != "" {
+		data, err := json.MarshalIndent(results, "", "  ")
+		require.NoError(t, err)
+		require.NoError(t, os.WriteFile(path, data, 0644))
+	}
+}
+
+// buildOTABenchmark compiles the client and its host shims, skipping the test when
+// the compiler, ArduinoJson or mbedtls can't be found
+func buildOTABenchmark(t *testing.T) string {
+	cxx := envOr("CXX", "g++")
+	if _, err := exec.LookPath(cxx); err != nil {
+		t.Skipf("%s not available, skipping OTA client benchmark", cxx)
+	}
+
+	home, _ := os.UserHomeDir()
+	arduinoJSON := envOr("ARDUINOJSON_INCLUDE", filepath.Join(home, "Arduino", "libraries", "ArduinoJson", "src"))
+	if _, err := os.Stat(filepath.Join(arduinoJSON, "ArduinoJson.h")); err != nil {
+		t.Skip("ArduinoJson not found (set ARDUINOJSON_INCLUDE), skipping OTA client benchmark")
+	}
+
+	var includes []string
+	if dir := os.Getenv("MBEDTLS_INCLUDE"); dir != "" {
+		includes = append(includes, "-I", dir)
+	}
+	ldflags := strings.Fields(envOr("MBEDTLS_LDFLAGS", "-lmbedtls -lmbedx509 -lmbedcrypto"))
+	if dir := os.Getenv("MBEDTLS_LIB"); dir != "" {
+		ldflags = append([]string{"-L", dir}, ldflags...)
+	}
+
+	workDir := t.TempDir()
+	if !canLinkMbedTLS(cxx, workDir, includes, ldflags) {
+		t.Skip("mbedtls not available (set MBEDTLS_INCLUDE, MBEDTLS_LIB or MBEDTLS_LDFLAGS), skipping OTA client benchmark")
+	}
+
+	library, err := filepath.Abs(otaClientDir)
+	require.NoError(t, err)
+	sources, err := filepath.Glob(filepath.Join(library, "*.cpp"))
+	require.NoError(t, err)
+	hostSources, err := filepath.Glob(filepath.Join(library, "extras", "host", "*.cpp"))
+	require.NoError(t, err)
+
+	binary := filepath.Join(workDir, "ota_benchmark")
+	args := []string{"-std=gnu++17", "-O2", "-o", binary,
+		"-I", filepath.Join(library, "extras", "host", "include"), "-I", library, "-I", arduinoJSON}
+	args = append(args, includes...)
+	args = append(args, sources...)
+	args = append(args, hostSources...)
+	args = append(args, ldflags...)
+	// Heap accounting intercepts the C allocator
+	args = append(args, "-Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc")
+
+	output, err := exec.Command(cxx, args...).CombinedOutput()
+	require.NoError(t, err, "Host build of the OTA client failed:\n%s", output)
+	return binary
+}
+
+// canLinkMbedTLS compiles and links a program against mbedtls
+func canLinkMbedTLS(cxx, workDir string, includes, ldflags []string) bool {
+	source := filepath.Join(workDir, "mbedtls_probe.cpp")
+	program := "#include <mbedtls/pk.h>\nint main() { mbedtls_pk_context pk; mbedtls_pk_init(&pk); mbedtls_pk_free(&pk); return 0; }\n"
+	if err := os.WriteFile(source, []byte(program), 0644); err != nil {
+		return false
+	}
+
+	args := append([]string{"-o", filepath.Join(workDir, "mbedtls_probe"), source}, includes...)
+	args = append(args, ldflags...)
+	return exec.Command(cxx, args...).Run() == nil
+}
+
+func envOr(name, fallback string) string {
+	if value := os.Getenv(name); value != "" {
+		return value
+	}
+	return fallback
+}